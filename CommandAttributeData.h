@@ -461,6 +461,12 @@ const TPMA_CC    s_ccAttr [] = {
 #if (PAD_LIST || CC_NTC2_GetConfig)
     TPMA_CC_INITIALIZER(0x0213, 0, 1, 0, 0, 0, 0, 1, 0),     // TPM_CC_NTC2_GetConfig
 #endif
+#if (PAD_LIST || CC_NTC2_EncryptDecryptStart)
+    TPMA_CC_INITIALIZER(0x0214, 0, 0, 0, 0, 1, 1, 1, 0),     // TPM_CC_NTC2_EncryptDecryptStart
+#endif
+#if (PAD_LIST || CC_NTC2_EncryptDecryptUpdate)
+    TPMA_CC_INITIALIZER(0x0215, 0, 0, 0, 0, 1, 0, 1, 0),     // TPM_CC_NTC2_EncryptDecryptUpdate
+#endif
 
 #endif	/* TPM_NUVOTON */
 
@@ -979,6 +985,14 @@ const COMMAND_ATTRIBUTES    s_commandAttributes [] = {
     (COMMAND_ATTRIBUTES)(CC_NTC2_GetConfig             *  // 0x20000213
 			 (IS_IMPLEMENTED+NO_SESSIONS)),
 #endif
+#if (PAD_LIST  || CC_NTC2_EncryptDecryptStart)
+    (COMMAND_ATTRIBUTES)(CC_NTC2_EncryptDecryptStart   *  // 0x20000214
+			 (IS_IMPLEMENTED+DECRYPT_2+HANDLE_1_USER+R_HANDLE)),
+#endif
+#if (PAD_LIST  || CC_NTC2_EncryptDecryptUpdate)
+    (COMMAND_ATTRIBUTES)(CC_NTC2_EncryptDecryptUpdate  *  // 0x20000215
+			 (IS_IMPLEMENTED+DECRYPT_2+HANDLE_1_USER+ENCRYPT_2)),
+#endif
 #endif
     0
 };
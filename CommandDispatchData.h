@@ -263,9 +263,11 @@ const _UNMARSHAL_T_ unmarshalArray[] = {
 #ifdef TPM_NUVOTON
 ,
 #define NTC2_CFG_STRUCT_P_UNMARSHAL	(TPMT_SYM_DEF_OBJECT_P_UNMARSHAL + 1)
-					UNMARSHAL_DISPATCH(NTC2_CFG_STRUCT)
+					UNMARSHAL_DISPATCH(NTC2_CFG_STRUCT),
+#define NTC2_STREAM_BUFFER_P_UNMARSHAL	(NTC2_CFG_STRUCT_P_UNMARSHAL + 1)
+					UNMARSHAL_DISPATCH(NTC2_STREAM_BUFFER)
 					
-#define PARAMETER_LAST_TYPE             (NTC2_CFG_STRUCT_P_UNMARSHAL)
+#define PARAMETER_LAST_TYPE             (NTC2_STREAM_BUFFER_P_UNMARSHAL)
 
 #else
 
@@ -361,9 +363,11 @@ const _MARSHAL_T_ marshalArray[] = {
 #ifdef TPM_NUVOTON
 ,
 #define NTC2_CFG_STRUCT_P_MARSHAL		(UINT16_P_MARSHAL + 1)
-				    MARSHAL_DISPATCH(NTC2_CFG_STRUCT)
+				    MARSHAL_DISPATCH(NTC2_CFG_STRUCT),
+#define NTC2_STREAM_BUFFER_P_MARSHAL		(NTC2_CFG_STRUCT_P_MARSHAL + 1)
+				    MARSHAL_DISPATCH(NTC2_STREAM_BUFFER)
 
-#define RESPONSE_PARAMETER_LAST_TYPE    (NTC2_CFG_STRUCT_P_MARSHAL)
+#define RESPONSE_PARAMETER_LAST_TYPE    (NTC2_STREAM_BUFFER_P_MARSHAL)
 
 #else     
 				    // RESPONSE_PARAMETER_LAST_TYPE is the end of the response parameter list.
@@ -4325,10 +4329,76 @@ NTC2_GetConfig_COMMAND_DESCRIPTOR_t _NTC2_GetConfigData = {
 
 #define _NTC2_GetConfigDataAddress (&_NTC2_GetConfigData)
 
+typedef TPM_RC (NTC2_EncryptDecryptStart_Entry) (
+						 NTC2_EncryptDecryptStart_In *in,
+						 NTC2_EncryptDecryptStart_Out *out
+						 );
+typedef const struct {
+    NTC2_EncryptDecryptStart_Entry	*entry;
+    UINT16				inSize;
+    UINT16				outSize;
+    UINT16				offsetOfTypes;
+    UINT16				paramOffsets[4];
+    BYTE				types[8];
+} NTC2_EncryptDecryptStart_COMMAND_DESCRIPTOR_t;
+
+NTC2_EncryptDecryptStart_COMMAND_DESCRIPTOR_t _NTC2_EncryptDecryptStartData = {
+    /* entry */		&NTC2_EncryptDecryptStart,
+    /* inSize */        (UINT16)(sizeof(NTC2_EncryptDecryptStart_In)),
+    /* outSize */       (UINT16)(sizeof(NTC2_EncryptDecryptStart_Out)),
+    /* offsetOfTypes */ offsetof(NTC2_EncryptDecryptStart_COMMAND_DESCRIPTOR_t, types),
+    /* offsets */       {(UINT16)(offsetof(NTC2_EncryptDecryptStart_In, auth)),
+			 (UINT16)(offsetof(NTC2_EncryptDecryptStart_In, decrypt)),
+			 (UINT16)(offsetof(NTC2_EncryptDecryptStart_In, mode)),
+			 (UINT16)(offsetof(NTC2_EncryptDecryptStart_In, ivIn))},
+    /* types */         {TPMI_DH_OBJECT_H_UNMARSHAL,
+			 TPM2B_AUTH_P_UNMARSHAL,
+			 TPMI_YES_NO_P_UNMARSHAL,
+			 TPMI_ALG_CIPHER_MODE_P_UNMARSHAL + ADD_FLAG,
+			 TPM2B_IV_P_UNMARSHAL,
+			 END_OF_LIST,
+			 TPMI_DH_OBJECT_H_MARSHAL,
+			 END_OF_LIST}
+};
+
+#define _NTC2_EncryptDecryptStartDataAddress (&_NTC2_EncryptDecryptStartData)
+
+typedef TPM_RC (NTC2_EncryptDecryptUpdate_Entry) (
+						  NTC2_EncryptDecryptUpdate_In *in,
+						  NTC2_EncryptDecryptUpdate_Out *out
+						  );
+typedef const struct {
+    NTC2_EncryptDecryptUpdate_Entry	*entry;
+    UINT16				inSize;
+    UINT16				outSize;
+    UINT16				offsetOfTypes;
+    UINT16				paramOffsets[2];
+    BYTE				types[6];
+} NTC2_EncryptDecryptUpdate_COMMAND_DESCRIPTOR_t;
+
+NTC2_EncryptDecryptUpdate_COMMAND_DESCRIPTOR_t _NTC2_EncryptDecryptUpdateData = {
+    /* entry */		&NTC2_EncryptDecryptUpdate,
+    /* inSize */        (UINT16)(sizeof(NTC2_EncryptDecryptUpdate_In)),
+    /* outSize */       (UINT16)(sizeof(NTC2_EncryptDecryptUpdate_Out)),
+    /* offsetOfTypes */ offsetof(NTC2_EncryptDecryptUpdate_COMMAND_DESCRIPTOR_t, types),
+    /* offsets */       {(UINT16)(offsetof(NTC2_EncryptDecryptUpdate_In, inData)),
+			 (UINT16)(offsetof(NTC2_EncryptDecryptUpdate_Out, ivOut))},
+    /* types */         {TPMI_DH_OBJECT_H_UNMARSHAL,
+			 NTC2_STREAM_BUFFER_P_UNMARSHAL,
+			 END_OF_LIST,
+			 NTC2_STREAM_BUFFER_P_MARSHAL,
+			 TPM2B_IV_P_MARSHAL,
+			 END_OF_LIST}
+};
+
+#define _NTC2_EncryptDecryptUpdateDataAddress (&_NTC2_EncryptDecryptUpdateData)
+
 #else
 #define _NTC2_PreConfigDataAddress 0
 #define _NTC2_LockPreConfigDataAddress 0
 #define _NTC2_GetConfigDataAddress 0
+#define _NTC2_EncryptDecryptStartDataAddress 0
+#define _NTC2_EncryptDecryptUpdateDataAddress 0
 #endif		/* TPM_NUVOTON */
 
 COMMAND_DESCRIPTOR_t *s_CommandDataArray[] = {
@@ -4728,6 +4798,8 @@ COMMAND_DESCRIPTOR_t *s_CommandDataArray[] = {
     (COMMAND_DESCRIPTOR_t *)_NTC2_PreConfigDataAddress,
     (COMMAND_DESCRIPTOR_t *)_NTC2_LockPreConfigDataAddress,
     (COMMAND_DESCRIPTOR_t *)_NTC2_GetConfigDataAddress,
+    (COMMAND_DESCRIPTOR_t *)_NTC2_EncryptDecryptStartDataAddress,
+    (COMMAND_DESCRIPTOR_t *)_NTC2_EncryptDecryptUpdateDataAddress,
 #endif
 #endif    
     0
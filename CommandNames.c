@@ -0,0 +1,215 @@
+/********************************************************************************/
+/*										*/
+/*			Command Code Names for the Tools			*/
+/*            $Id: CommandNames.c $						*/
+/*										*/
+/*  Licenses and Notices							*/
+/*										*/
+/*  1. Copyright Licenses:							*/
+/*										*/
+/*  - Trusted Computing Group (TCG) grants to the user of the source code in	*/
+/*    this specification (the "Source Code") a worldwide, irrevocable, 		*/
+/*    nonexclusive, royalty free, copyright license to reproduce, create 	*/
+/*    derivative works, distribute, display and perform the Source Code and	*/
+/*    derivative works thereof, and to grant others the rights granted herein.	*/
+/*										*/
+/*  - The TCG grants to the user of the other parts of the specification 	*/
+/*    (other than the Source Code) the rights to reproduce, distribute, 	*/
+/*    display, and perform the specification solely for the purpose of 		*/
+/*    developing products based on such documents.				*/
+/*										*/
+/*  2. Source Code Distribution Conditions:					*/
+/*										*/
+/*  - Redistributions of Source Code must retain the above copyright licenses, 	*/
+/*    this list of conditions and the following disclaimers.			*/
+/*										*/
+/*  - Redistributions in binary form must reproduce the above copyright 	*/
+/*    licenses, this list of conditions	and the following disclaimers in the 	*/
+/*    documentation and/or other materials provided with the distribution.	*/
+/*										*/
+/*  3. Disclaimers:								*/
+/*										*/
+/*  - THE COPYRIGHT LICENSES SET FORTH ABOVE DO NOT REPRESENT ANY FORM OF	*/
+/*  LICENSE OR WAIVER, EXPRESS OR IMPLIED, BY ESTOPPEL OR OTHERWISE, WITH	*/
+/*  RESPECT TO PATENT RIGHTS HELD BY TCG MEMBERS (OR OTHER THIRD PARTIES)	*/
+/*  THAT MAY BE NECESSARY TO IMPLEMENT THIS SPECIFICATION OR OTHERWISE.		*/
+/*  Contact TCG Administration (admin@trustedcomputinggroup.org) for 		*/
+/*  information on specification licensing rights available through TCG 	*/
+/*  membership agreements.							*/
+/*										*/
+/*  - THIS SPECIFICATION IS PROVIDED "AS IS" WITH NO EXPRESS OR IMPLIED 	*/
+/*    WARRANTIES WHATSOEVER, INCLUDING ANY WARRANTY OF MERCHANTABILITY OR 	*/
+/*    FITNESS FOR A PARTICULAR PURPOSE, ACCURACY, COMPLETENESS, OR 		*/
+/*    NONINFRINGEMENT OF INTELLECTUAL PROPERTY RIGHTS, OR ANY WARRANTY 		*/
+/*    OTHERWISE ARISING OUT OF ANY PROPOSAL, SPECIFICATION OR SAMPLE.		*/
+/*										*/
+/*  - Without limitation, TCG and its members and licensors disclaim all 	*/
+/*    liability, including liability for infringement of any proprietary 	*/
+/*    rights, relating to use of information in this specification and to the	*/
+/*    implementation of this specification, and TCG disclaims all liability for	*/
+/*    cost of procurement of substitute goods or services, lost profits, loss 	*/
+/*    of use, loss of data or any incidental, consequential, direct, indirect, 	*/
+/*    or special damages, whether under contract, tort, warranty or otherwise, 	*/
+/*    arising in any way out of use or reliance upon this specification or any 	*/
+/*    information herein.							*/
+/*										*/
+/*  (c) Copyright IBM Corp. and others, 2016 - 2026				*/
+/*										*/
+/********************************************************************************/
+
+/* D.8 CommandNames.c */
+/* D.8.1. Description */
+/* This file maps command codes to names for the offline tools. */
+/* D.8.2. Includes and Data Definitions */
+#include <stddef.h>
+#include <stdint.h>
+#include "CommandNames_fp.h"
+
+typedef struct
+{
+    uint32_t         commandCode;
+    const char      *name;
+} COMMAND_NAME;
+
+static const COMMAND_NAME s_commandNames[] = {
+    {0x0000011F, "TPM2_NV_UndefineSpaceSpecial"},
+    {0x00000120, "TPM2_EvictControl"},
+    {0x00000121, "TPM2_HierarchyControl"},
+    {0x00000122, "TPM2_NV_UndefineSpace"},
+    {0x00000124, "TPM2_ChangeEPS"},
+    {0x00000125, "TPM2_ChangePPS"},
+    {0x00000126, "TPM2_Clear"},
+    {0x00000127, "TPM2_ClearControl"},
+    {0x00000128, "TPM2_ClockSet"},
+    {0x00000129, "TPM2_HierarchyChangeAuth"},
+    {0x0000012A, "TPM2_NV_DefineSpace"},
+    {0x0000012B, "TPM2_PCR_Allocate"},
+    {0x0000012C, "TPM2_PCR_SetAuthPolicy"},
+    {0x0000012D, "TPM2_PP_Commands"},
+    {0x0000012E, "TPM2_SetPrimaryPolicy"},
+    {0x0000012F, "TPM2_FieldUpgradeStart"},
+    {0x00000130, "TPM2_ClockRateAdjust"},
+    {0x00000131, "TPM2_CreatePrimary"},
+    {0x00000132, "TPM2_NV_GlobalWriteLock"},
+    {0x00000133, "TPM2_GetCommandAuditDigest"},
+    {0x00000134, "TPM2_NV_Increment"},
+    {0x00000135, "TPM2_NV_SetBits"},
+    {0x00000136, "TPM2_NV_Extend"},
+    {0x00000137, "TPM2_NV_Write"},
+    {0x00000138, "TPM2_NV_WriteLock"},
+    {0x00000139, "TPM2_DictionaryAttackLockReset"},
+    {0x0000013A, "TPM2_DictionaryAttackParameters"},
+    {0x0000013B, "TPM2_NV_ChangeAuth"},
+    {0x0000013C, "TPM2_PCR_Event"},
+    {0x0000013D, "TPM2_PCR_Reset"},
+    {0x0000013E, "TPM2_SequenceComplete"},
+    {0x0000013F, "TPM2_SetAlgorithmSet"},
+    {0x00000140, "TPM2_SetCommandCodeAuditStatus"},
+    {0x00000141, "TPM2_FieldUpgradeData"},
+    {0x00000142, "TPM2_IncrementalSelfTest"},
+    {0x00000143, "TPM2_SelfTest"},
+    {0x00000144, "TPM2_Startup"},
+    {0x00000145, "TPM2_Shutdown"},
+    {0x00000146, "TPM2_StirRandom"},
+    {0x00000147, "TPM2_ActivateCredential"},
+    {0x00000148, "TPM2_Certify"},
+    {0x00000149, "TPM2_PolicyNV"},
+    {0x0000014A, "TPM2_CertifyCreation"},
+    {0x0000014B, "TPM2_Duplicate"},
+    {0x0000014C, "TPM2_GetTime"},
+    {0x0000014D, "TPM2_GetSessionAuditDigest"},
+    {0x0000014E, "TPM2_NV_Read"},
+    {0x0000014F, "TPM2_NV_ReadLock"},
+    {0x00000150, "TPM2_ObjectChangeAuth"},
+    {0x00000151, "TPM2_PolicySecret"},
+    {0x00000152, "TPM2_Rewrap"},
+    {0x00000153, "TPM2_Create"},
+    {0x00000154, "TPM2_ECDH_ZGen"},
+    {0x00000155, "TPM2_HMAC"},
+    {0x00000156, "TPM2_Import"},
+    {0x00000157, "TPM2_Load"},
+    {0x00000158, "TPM2_Quote"},
+    {0x00000159, "TPM2_RSA_Decrypt"},
+    {0x0000015B, "TPM2_HMAC_Start"},
+    {0x0000015C, "TPM2_SequenceUpdate"},
+    {0x0000015D, "TPM2_Sign"},
+    {0x0000015E, "TPM2_Unseal"},
+    {0x00000160, "TPM2_PolicySigned"},
+    {0x00000161, "TPM2_ContextLoad"},
+    {0x00000162, "TPM2_ContextSave"},
+    {0x00000163, "TPM2_ECDH_KeyGen"},
+    {0x00000164, "TPM2_EncryptDecrypt"},
+    {0x00000165, "TPM2_FlushContext"},
+    {0x00000167, "TPM2_LoadExternal"},
+    {0x00000168, "TPM2_MakeCredential"},
+    {0x00000169, "TPM2_NV_ReadPublic"},
+    {0x0000016A, "TPM2_PolicyAuthorize"},
+    {0x0000016B, "TPM2_PolicyAuthValue"},
+    {0x0000016C, "TPM2_PolicyCommandCode"},
+    {0x0000016D, "TPM2_PolicyCounterTimer"},
+    {0x0000016E, "TPM2_PolicyCpHash"},
+    {0x0000016F, "TPM2_PolicyLocality"},
+    {0x00000170, "TPM2_PolicyNameHash"},
+    {0x00000171, "TPM2_PolicyOR"},
+    {0x00000172, "TPM2_PolicyTicket"},
+    {0x00000173, "TPM2_ReadPublic"},
+    {0x00000174, "TPM2_RSA_Encrypt"},
+    {0x00000176, "TPM2_StartAuthSession"},
+    {0x00000177, "TPM2_VerifySignature"},
+    {0x00000178, "TPM2_ECC_Parameters"},
+    {0x00000179, "TPM2_FirmwareRead"},
+    {0x0000017A, "TPM2_GetCapability"},
+    {0x0000017B, "TPM2_GetRandom"},
+    {0x0000017C, "TPM2_GetTestResult"},
+    {0x0000017D, "TPM2_Hash"},
+    {0x0000017E, "TPM2_PCR_Read"},
+    {0x0000017F, "TPM2_PolicyPCR"},
+    {0x00000180, "TPM2_PolicyRestart"},
+    {0x00000181, "TPM2_ReadClock"},
+    {0x00000182, "TPM2_PCR_Extend"},
+    {0x00000183, "TPM2_PCR_SetAuthValue"},
+    {0x00000184, "TPM2_NV_Certify"},
+    {0x00000185, "TPM2_EventSequenceComplete"},
+    {0x00000186, "TPM2_HashSequenceStart"},
+    {0x00000187, "TPM2_PolicyPhysicalPresence"},
+    {0x00000188, "TPM2_PolicyDuplicationSelect"},
+    {0x00000189, "TPM2_PolicyGetDigest"},
+    {0x0000018A, "TPM2_TestParms"},
+    {0x0000018B, "TPM2_Commit"},
+    {0x0000018C, "TPM2_PolicyPassword"},
+    {0x0000018D, "TPM2_ZGen_2Phase"},
+    {0x0000018E, "TPM2_EC_Ephemeral"},
+    {0x0000018F, "TPM2_PolicyNvWritten"},
+    {0x00000190, "TPM2_PolicyTemplate"},
+    {0x00000191, "TPM2_CreateLoaded"},
+    {0x00000192, "TPM2_PolicyAuthorizeNV"},
+    {0x00000193, "TPM2_EncryptDecrypt2"},
+    {0x00000194, "TPM2_AC_GetCapability"},
+    {0x00000195, "TPM2_AC_Send"},
+    {0x00000196, "TPM2_Policy_AC_SendSelect"},
+    {0x00000197, "TPM2_CertifyX509"},
+    {0x00000198, "TPM2_ACT_SetTimeout"},
+    {0x00000199, "TPM2_ECC_Encrypt"},
+    {0x0000019A, "TPM2_ECC_Decrypt"},
+    {0x20000000, "TPM2_Vendor_TCG_Test"},
+    {0x20000211, "NTC2_PreConfig"},
+    {0x20000212, "NTC2_LockPreConfig"},
+    {0x20000213, "NTC2_GetConfig"},
+    {0x20000214, "NTC2_EncryptDecryptStart"},
+    {0x20000215, "NTC2_EncryptDecryptUpdate"},
+};
+
+/* D.8.3. Functions */
+/* D.8.3.1. CommandName() */
+/* This function returns the name of a command code, or NULL if it is not known. */
+const char *
+CommandName(
+	    uint32_t         commandCode
+	    )
+{
+    size_t           i;
+    for(i = 0; i < sizeof(s_commandNames) / sizeof(s_commandNames[0]); i++)
+	if(s_commandNames[i].commandCode == commandCode)
+	    return s_commandNames[i].name;
+    return NULL;
+}
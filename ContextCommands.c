@@ -136,6 +136,8 @@ TPM2_ContextSave(
 			  <= sizeof(out->context.contextBlob.t.buffer));
 		  // Copy the whole internal OBJECT structure to context blob
 		  MemoryCopy(outObject, object, objectSize);
+		  // The saved context does not carry the expanded symmetric key
+		  CryptSymFlushKeySchedules(object);
 		  // Increment object context ID
 		  gr.objectContextID++;
 		  // If object context ID overflows, TPM should be put in failure mode
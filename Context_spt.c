@@ -168,6 +168,9 @@ SequenceDataExport(
 {
     // If the hash object is not an event, then only one hash context is needed
     int                   count = (object->attributes.eventSeq) ? HASH_COUNT : 1;
+    // A symmetric sequence has no hash context and is saved as it is
+    if(object->attributes.symSeq)
+	return;
     for(count--; count >= 0; count--)
 	{
 	    HASH_STATE          *hash = &object->state.hashState[count];
@@ -191,6 +194,14 @@ SequenceDataImport(
 {
     // If the hash object is not an event, then only one hash context is needed
     int                   count = (object->attributes.eventSeq) ? HASH_COUNT : 1;
+    // A symmetric sequence has no hash context so its state is copied as it is
+    if(object->attributes.symSeq)
+	{
+	    MemoryCopy(&object->state.symState,
+		       &((BYTE *)exportObject)[offsetof(HASH_OBJECT, state)],
+		       sizeof(object->state.symState));
+	    return;
+	}
     for(count--; count >= 0; count--)
 	{
 	    HASH_STATE          *hash = &object->state.hashState[count];
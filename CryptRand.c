@@ -67,6 +67,10 @@ const BYTE DRBG_NistTestVector_GeneratedInterm[] =
 const BYTE DRBG_NistTestVector_EntropyReseed[] =
     {DRBG_TEST_RESEED_ENTROPY};
 const BYTE DRBG_NistTestVector_Generated[] = {DRBG_TEST_GENERATED};
+/* The pool of output of the default DRBG (see DRBG_Generate()). The s_drbgPoolAvailable bytes at
+   the end of s_drbgPool have not been returned yet and the rest of it is zero. */
+static BYTE          s_drbgPool[DRBG_POOL_SIZE] INSTANCE_STATE;
+static UINT32        s_drbgPoolAvailable INSTANCE_STATE;
 
 /* 10.2.16.2.2 Derivation Function Defines and Structures */
 #define     DF_COUNT (DRBG_KEY_SIZE_WORDS / DRBG_IV_SIZE_WORDS + 1)
@@ -275,7 +279,8 @@ IncrementIv(
 /* 10.2.16.2.10 EncryptDRBG() */
 /* This does the encryption operation for the DRBG. It will encrypt the input state counter (IV)
    using the state key. Into the output buffer for as many times as it takes to generate the
-   required number of bytes. */
+   required number of bytes. The counter values for up to DRBG_BATCH_BLOCKS blocks are made first
+   and then encrypted with the multi-block method of the cipher. */
 static BOOL
 EncryptDRBG(
 	    BYTE                *dOut,
@@ -285,62 +290,49 @@ EncryptDRBG(
 	    UINT32              *lastValue      // Points to the last output value
 	    )
 {
-#if FIPS_COMPLIANT
-    // For FIPS compliance, the DRBG has to do a continuous self-test to make sure that
-    // no two consecutive values are the same. This overhead is not incurred if the TPM
-    // is not required to be FIPS compliant
-    //
-    UINT32           temp[DRBG_IV_SIZE_BYTES / sizeof(UINT32)];
-    int              i;
-    BYTE            *p;
+    BYTE             temp[DRBG_BATCH_BLOCKS * DRBG_IV_SIZE_BYTES];
+    UINT32           blocks;
+    UINT32           i;
+#if DRBG_IV_SIZE_BITS != 128
+#error  "Unsuppored IV size in DRBG"
+#endif
+#if !FIPS_COMPLIANT
+    NOT_REFERENCED(lastValue);
+#endif
     for(; dOutBytes > 0;)
 	{
+	    blocks = MIN(DRBG_BATCH_BLOCKS,
+			 (dOutBytes + DRBG_IV_SIZE_BYTES - 1) / DRBG_IV_SIZE_BYTES);
 	    // Increment the IV before each encryption (this is what makes this
 	    // different from normal counter-mode encryption
-	    IncrementIv(iv);
-	    DRBG_ENCRYPT(keySchedule, iv, temp);
-	    // Expect a 16 byte block
-#if DRBG_IV_SIZE_BITS != 128
-#error  "Unsuppored IV size in DRBG"
-#endif
-	    if((lastValue[0] == temp[0])
-	       && (lastValue[1] == temp[1])
-	       && (lastValue[2] == temp[2])
-	       && (lastValue[3] == temp[3])
-	       )
+	    for(i = 0; i < blocks; i++)
 		{
-		    LOG_FAILURE(FATAL_ERROR_ENTROPY);
-		    return FALSE;
+		    IncrementIv(iv);
+		    memcpy(&temp[i * DRBG_IV_SIZE_BYTES], iv, DRBG_IV_SIZE_BYTES);
+		}
+	    DRBG_ENCRYPT_BLOCKS(keySchedule, blocks * DRBG_IV_SIZE_BYTES, temp, temp);
+#if FIPS_COMPLIANT
+	    // For FIPS compliance, the DRBG has to do a continuous self-test to make sure
+	    // that no two consecutive values are the same. This overhead is not incurred
+	    // if the TPM is not required to be FIPS compliant
+	    for(i = 0; i < blocks; i++)
+		{
+		    BYTE        *block = &temp[i * DRBG_IV_SIZE_BYTES];
+		    if(memcmp(lastValue, block, DRBG_IV_SIZE_BYTES) == 0)
+			{
+			    memset(temp, 0, sizeof(temp));
+			    LOG_FAILURE(FATAL_ERROR_ENTROPY);
+			    return FALSE;
+			}
+		    memcpy(lastValue, block, DRBG_IV_SIZE_BYTES);
 		}
-	    lastValue[0] = temp[0];
-	    lastValue[1] = temp[1];
-	    lastValue[2] = temp[2];
-	    lastValue[3] = temp[3];
-	    i = MIN(dOutBytes, DRBG_IV_SIZE_BYTES);
+#endif
+	    i = MIN(dOutBytes, blocks * DRBG_IV_SIZE_BYTES);
+	    memcpy(dOut, temp, i);
+	    dOut += i;
 	    dOutBytes -= i;
-	    for(p = (BYTE *)temp; i > 0; i--)
-		*dOut++ = *p++;
 	}
-#else // version without continuous self-test
-    NOT_REFERENCED(lastValue);
-    for(; dOutBytes >= DRBG_IV_SIZE_BYTES;
-	dOut = &dOut[DRBG_IV_SIZE_BYTES], dOutBytes -= DRBG_IV_SIZE_BYTES)
-	{
-	    // Increment the IV
-	    IncrementIv(iv);
-	    DRBG_ENCRYPT(keySchedule, iv, dOut);
-	}
-    // If there is a partial, generate into a block-sized
-    // temp buffer and copy to the output.
-    if(dOutBytes != 0)
-	{
-	    BYTE        temp[DRBG_IV_SIZE_BYTES];
-	    // Increment the IV
-	    IncrementIv(iv);
-	    DRBG_ENCRYPT(keySchedule, iv, temp);
-	    memcpy(dOut, temp, dOutBytes);
-	}
-#endif
+    memset(temp, 0, sizeof(temp));
     return TRUE;
 }
 /* 10.2.16.2.11 DRBG_Update() */
@@ -389,7 +381,19 @@ DRBG_Update(
     // don't need to copy the resulting 'temp' to drbgState->seed
     return TRUE;
 }
-/* 10.2.16.2.12 DRBG_Reseed() */
+/* 10.2.16.2.12 DrbgPoolFlush() */
+/* This function erases the pool of output of the default DRBG. It is called whenever the state of
+   the default DRBG is set other than by generating output, so that no output from the old state is
+   returned after a reseed. */
+static void
+DrbgPoolFlush(
+	      void
+	      )
+{
+    memset(s_drbgPool, 0, sizeof(s_drbgPool));
+    s_drbgPoolAvailable = 0;
+}
+/* 10.2.16.2.13 DRBG_Reseed() */
 /* This function is used when reseeding of the DRBG is required. If entropy is provided, it is used
    in lieu of using hardware entropy. */
 /* NOTE: the provided entropy must be the required size. */
@@ -405,6 +409,8 @@ DRBG_Reseed(
 {
     DRBG_SEED            seed;
     pAssert((drbgState != NULL) && (drbgState->magic == DRBG_MAGIC));
+    if(drbgState == &drbgDefault)
+	DrbgPoolFlush();
     if(providedEntropy == NULL)
 	{
 	    providedEntropy = &seed;
@@ -422,7 +428,7 @@ DRBG_Reseed(
     drbgState->reseedCounter = 1;
     return TRUE;
 }
-/* 10.2.16.2.13 DRBG_SelfTest() */
+/* 10.2.16.2.14 DRBG_SelfTest() */
 /* This is run when the DRBG is instantiated and at startup */
 /* Return Values Meaning */
 /* FALSE test failed */
@@ -531,6 +537,7 @@ CryptRandomStir(
 	    memset(drbgDefault.seed.bytes, 0, sizeof(drbgDefault.seed.bytes));
 	    memcpy(drbgDefault.seed.bytes, additionalData,
 		   MIN(additionalDataSize, sizeof(drbgDefault.seed.bytes)));
+	    DrbgPoolFlush();
 	}
     drbgDefault.reseedCounter = 1;
     return TPM_RC_SUCCESS;
@@ -666,8 +673,108 @@ CryptRandInit(
 #if !USE_DEBUG_RNG
     _plat__GetEntropy(NULL, 0);
 #endif
+    DrbgPoolFlush();
     return DRBG_SelfTest();
 }
+/* 10.2.16.4 Output Pool */
+/* Requests for a few bytes from the default DRBG (nonces, salts, TPM2_GetRandom()) are served from a
+   pool that is filled by a single DRBG generate request. This replaces a key schedule setup, an
+   encryption and a DRBG_Update() for each request with one of each per DRBG_POOL_SIZE bytes. Each
+   fill is a generate request of its own, so the reseed counter and the continuous test apply to the
+   pool as they do to any other request. The pool is refilled when it runs dry or, ahead of time,
+   when the TPM is idle (CryptRandPoolRefill()). */
+/* 10.2.16.4.1 DrbgGenerate() */
+/* This function does a SP800-90A generate request on a DRBG. It returns the number of bytes
+   produced, which is 0 if a required reseed failed or the continuous test failed. */
+static UINT16
+DrbgGenerate(
+	     DRBG_STATE      *drbgState,
+	     BYTE            *random,        // OUT: buffer to receive the random values
+	     UINT16           randomSize     // IN: the number of bytes to generate
+	     )
+{
+    DRBG_KEY_SCHEDULE    keySchedule;
+    DRBG_SEED           *seed = &drbgState->seed;
+    if(drbgState->reseedCounter >= CTR_DRBG_MAX_REQUESTS_PER_RESEED)
+	{
+	    if(drbgState == &drbgDefault)
+		{
+		    DRBG_Reseed(drbgState, NULL, NULL);
+		    if(IsEntropyBad() && !IsSelfTest())
+			return 0;
+		}
+	    else
+		{
+		    // If this is a PRNG then the only way to get
+		    // here is if the SW has run away.
+		    LOG_FAILURE(FATAL_ERROR_INTERNAL);
+		    return 0;
+		}
+	}
+    // if the allowed number of bytes in a request is larger than the
+    // less than the number of bytes that can be requested, then check
+#if UINT16_MAX >=  CTR_DRBG_MAX_BYTES_PER_REQUEST
+    if(randomSize > CTR_DRBG_MAX_BYTES_PER_REQUEST)
+	randomSize = CTR_DRBG_MAX_BYTES_PER_REQUEST;
+#endif
+    // Create  encryption schedule
+    if(DRBG_ENCRYPT_SETUP((BYTE *)pDRBG_KEY(seed),
+			  DRBG_KEY_SIZE_BITS, &keySchedule) != 0)
+	{
+	    LOG_FAILURE(FATAL_ERROR_INTERNAL);
+	    return 0;
+	}
+    // Generate the random data
+    if(!EncryptDRBG(random, randomSize, &keySchedule, pDRBG_IV(seed),
+		    drbgState->lastValue))
+	return 0;
+    // Do a key update
+    DRBG_Update(drbgState, &keySchedule, NULL);
+    // Increment the reseed counter
+    drbgState->reseedCounter += 1;
+    return randomSize;
+}
+/* 10.2.16.4.2 DrbgPoolFill() */
+/* This function discards what is left in the pool and fills it with new output of the default
+   DRBG. */
+/* TRUE the pool was filled */
+/* FALSE the generate request failed and the pool is empty */
+static BOOL
+DrbgPoolFill(
+	     void
+	     )
+{
+    DrbgPoolFlush();
+    if(DrbgGenerate(&drbgDefault, s_drbgPool, DRBG_POOL_SIZE) != DRBG_POOL_SIZE)
+	{
+	    DrbgPoolFlush();
+	    return FALSE;
+	}
+    s_drbgPoolAvailable = DRBG_POOL_SIZE;
+    return TRUE;
+}
+/* 10.2.16.4.3 CryptRandPoolLow() */
+/* This function returns TRUE if less than half of the pool of the default DRBG is left. */
+LIB_EXPORT BOOL
+CryptRandPoolLow(
+		 void
+		 )
+{
+    return (drbgDefault.magic == DRBG_MAGIC)
+	&& (s_drbgPoolAvailable < (DRBG_POOL_SIZE / 2));
+}
+/* 10.2.16.4.4 CryptRandPoolRefill() */
+/* This function is called when the TPM has no command to process. It refills the pool of the
+   default DRBG if less than half of it is left so that the following requests do not have to wait
+   for it. */
+LIB_EXPORT void
+CryptRandPoolRefill(
+		    void
+		    )
+{
+    if(CryptRandPoolLow())
+	DrbgPoolFill();
+}
 /* 10.2.16.5 DRBG_Generate() */
 /* This function generates a random sequence according SP800-90A. If random is not NULL, then
    randomSize bytes of random values are generated. If random is NULL or randomSize is zero, then
@@ -756,44 +863,17 @@ DRBG_Generate(
     else if(state->drbg.magic == DRBG_MAGIC)
 	{
 	    DRBG_STATE          *drbgState = (DRBG_STATE *)state;
-	    DRBG_KEY_SCHEDULE    keySchedule;
-	    DRBG_SEED           *seed = &drbgState->seed;
-	    if(drbgState->reseedCounter >= CTR_DRBG_MAX_REQUESTS_PER_RESEED)
-		{
-		    if(drbgState == &drbgDefault)
-			{
-			    DRBG_Reseed(drbgState, NULL, NULL);
-			    if(IsEntropyBad() && !IsSelfTest())
-				return 0;
-			}
-		    else
-			{
-			    // If this is a PRNG then the only way to get
-			    // here is if the SW has run away.
-			    LOG_FAILURE(FATAL_ERROR_INTERNAL);
-			    return 0;
-			}
-		}
-	    // if the allowed number of bytes in a request is larger than the
-	    // less than the number of bytes that can be requested, then check
-#if UINT16_MAX >=  CTR_DRBG_MAX_BYTES_PER_REQUEST
-	    if(randomSize > CTR_DRBG_MAX_BYTES_PER_REQUEST)
-		randomSize = CTR_DRBG_MAX_BYTES_PER_REQUEST;
-#endif
-	    // Create  encryption schedule
-	    if(DRBG_ENCRYPT_SETUP((BYTE *)pDRBG_KEY(seed),
-				  DRBG_KEY_SIZE_BITS, &keySchedule) != 0)
-		{
-		    LOG_FAILURE(FATAL_ERROR_INTERNAL);
-		    return 0;
-		}
-	    // Generate the random data
-	    EncryptDRBG(random, randomSize, &keySchedule, pDRBG_IV(seed),
-			drbgState->lastValue);
-	    // Do a key update
-	    DRBG_Update(drbgState, &keySchedule, NULL);
-	    // Increment the reseed counter
-	    drbgState->reseedCounter += 1;
+	    BYTE                *pool;
+	    if((drbgState != &drbgDefault) || (randomSize > DRBG_POOL_MAX_REQUEST))
+		return DrbgGenerate(drbgState, random, randomSize);
+	    // Small requests on the default DRBG are served from the pool. Bytes are
+	    // erased from the pool as they are returned so each is only used once.
+	    if((s_drbgPoolAvailable < randomSize) && !DrbgPoolFill())
+		return 0;
+	    pool = &s_drbgPool[DRBG_POOL_SIZE - s_drbgPoolAvailable];
+	    memcpy(random, pool, randomSize);
+	    memset(pool, 0, randomSize);
+	    s_drbgPoolAvailable -= randomSize;
 	}
     else
 	{
@@ -849,6 +929,8 @@ DRBG_Uninstantiate(
 {
     if((drbgState == NULL) || (drbgState->magic != DRBG_MAGIC))
 	return TPM_RC_VALUE;
+    if(drbgState == &drbgDefault)
+	DrbgPoolFlush();
     memset(drbgState, 0, sizeof(DRBG_STATE));
     return TPM_RC_SUCCESS;
 }
@@ -80,6 +80,8 @@ typedef tpmKeyScheduleAES DRBG_KEY_SCHEDULE;
     TpmCryptSetEncryptKeyAES(key, keySizeInBits, schedule)
 #define DRBG_ENCRYPT(keySchedule, in, out)				\
     TpmCryptEncryptAES(SWIZZLE_ENC(keySchedule, in, out))
+#define DRBG_ENCRYPT_BLOCKS(keySchedule, size, in, out)			\
+    TpmCryptEncryptBlocksAES(SWIZZLE_BLOCKS_ENC(keySchedule, size, in, out))
 #if     ((DRBG_KEY_SIZE_BITS % RADIX_BITS) != 0)	\
     || ((DRBG_IV_SIZE_BITS % RADIX_BITS) != 0)
 #error "Key size and IV for DRBG must be even multiples of the radix"
@@ -118,6 +120,13 @@ typedef union
 #   define CTR_DRBG_MIN_ENTROPY_INPUT_LENGTH    DRBG_SEED_SIZE_BYTES
 #   define CTR_DRBG_MAX_ENTROPY_INPUT_LENGTH    DRBG_SEED_SIZE_BYTES
 #   define CTR_DRBG_MAX_ADDITIONAL_INPUT_LENGTH DRBG_SEED_SIZE_BYTES
+/* EncryptDRBG() makes up to DRBG_BATCH_BLOCKS counter blocks at a time and encrypts them with one
+   call. */
+#define DRBG_BATCH_BLOCKS                       16
+/* Requests of up to DRBG_POOL_MAX_REQUEST bytes from the default DRBG are served from a pool of
+   DRBG_POOL_SIZE bytes that is generated with one DRBG request. */
+#define DRBG_POOL_SIZE                          1024
+#define DRBG_POOL_MAX_REQUEST                   128
 #define     TESTING         (1 << 0)
 #define     ENTROPY         (1 << 1)
 #define     TESTED          (1 << 2)
@@ -123,6 +123,14 @@ LIB_EXPORT BOOL
 CryptRandInit(
 	      void
 	      );
+LIB_EXPORT BOOL
+CryptRandPoolLow(
+		 void
+		 );
+LIB_EXPORT void
+CryptRandPoolRefill(
+		    void
+		    );
 LIB_EXPORT UINT16
 DRBG_Generate(
 	      RAND_STATE      *state,
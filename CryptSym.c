@@ -62,8 +62,9 @@
 /* 10.2.19 CryptSym.c */
 /* 10.2.19.1 Introduction */
 /* This file contains the implementation of the symmetric block cipher modes allowed for a
-   TPM. These functions only use the single block encryption functions of the selected symmetric
-   crypto library. */
+   TPM. The modes that can work on several blocks at once (ECB, CTR, and CBC and CFB decryption) use
+   the multi-block methods of the algorithm when the library has them and the single block
+   encryption functions otherwise. The other modes only use the single block functions. */
 
 /* 10.2.19.2	Includes, Defines, and Typedefs */
 #include "Tpm.h"
@@ -76,6 +77,17 @@
 
 FOR_EACH_SYM(KEY_BLOCK_SIZES)
 
+static const SYM_BULK_METHODS    s_symBulkMethods[] = {
+    FOR_EACH_SYM(BULK_METHODS)
+};
+
+/* The number of blocks the parallel modes hand to the multi-block methods at a time */
+#define SYM_BULK_BLOCKS     16
+
+/* Key schedules of loaded objects. The entries are used in turn when all are taken. */
+static SYM_SCHEDULE_CACHE_ENTRY      s_symScheduleCache[SYM_SCHEDULE_CACHE_SIZE] INSTANCE_STATE;
+static UINT32                        s_symScheduleNext INSTANCE_STATE;
+
 /* 10.2.19.3	Initialization and Data Access Functions */
 /* 10.2.19.3.1	CryptSymInit() */
 /* This function is called to do _TPM_Init() processing */
@@ -84,15 +96,18 @@ CryptSymInit(
 	     void
 	     )
 {
+    CryptSymFlushKeySchedules(NULL);
     return TRUE;
 }
 /* 10.2.19.3.2	CryptSymStartup() */
-/* This function is called to do TPM2_Startup() processing */
+/* This function is called to do TPM2_Startup() processing. No object is loaded after
+   TPM2_Startup(), so none of the cached key schedules is kept. */
 BOOL
 CryptSymStartup(
 		void
 		)
 {
+    CryptSymFlushKeySchedules(NULL);
     return TRUE;
 }
 /* 10.2.20.4 Data Access Functions */
@@ -145,38 +160,286 @@ CryptGetSymmetricBlockSize(
     return sizes[i];
 }
 
+/* 10.2.20.4.2 SymBulkMethods() */
+/* This function returns the multi-block methods for an algorithm. An algorithm that is not in the
+   table gets an entry with no methods, so that only the single block function is used. */
+static const SYM_BULK_METHODS *
+SymBulkMethods(
+	       TPM_ALG_ID      algorithm      // IN: the symmetric algorithm
+	       )
+{
+    static const SYM_BULK_METHODS    singleBlock = {TPM_ALG_NULL, NULL, NULL, NULL};
+    UINT32           i;
+    //
+    for(i = 0; i < sizeof(s_symBulkMethods) / sizeof(s_symBulkMethods[0]); i++)
+	if(s_symBulkMethods[i].algorithm == algorithm)
+	    return &s_symBulkMethods[i];
+    return &singleBlock;
+}
+/* 10.2.20.4.3 SymXor() */
+/* This function XORs size bytes of a and b into out a word at a time. out may be the same as a or
+   b. */
+static void
+SymXor(
+       BYTE            *out,          // OUT: a XOR b
+       const BYTE      *a,            // IN:
+       const BYTE      *b,            // IN:
+       INT32            size          // IN: number of bytes
+       )
+{
+    UINT64           x;
+    UINT64           y;
+    //
+    for(; size >= (INT32)sizeof(UINT64); size -= sizeof(UINT64))
+	{
+	    memcpy(&x, a, sizeof(x));
+	    memcpy(&y, b, sizeof(y));
+	    x ^= y;
+	    memcpy(out, &x, sizeof(x));
+	    out += sizeof(x);
+	    a += sizeof(x);
+	    b += sizeof(x);
+	}
+    for(; size > 0; size--)
+	*out++ = *a++ ^ *b++;
+}
+/* 10.2.20.4.4 SymEncryptBlocks() */
+/* This function encrypts size bytes of whole blocks in ECB fashion, with the multi-block method when
+   the algorithm has one. dIn and dOut may be the same. */
+static void
+SymEncryptBlocks(
+		 TpmCryptSetSymKeyCall_t  encrypt,       // IN: single block function
+		 TpmCryptBlocksCall_t     encryptBlocks, // IN: multi-block function or NULL
+		 tpmCryptKeySchedule_t   *keySchedule,   // IN: encryption schedule
+		 INT16                    blockSize,     // IN: cipher block size
+		 INT32                    size,          // IN: multiple of blockSize
+		 const BYTE              *dIn,           // IN: input blocks
+		 BYTE                    *dOut           // OUT: output blocks
+		 )
+{
+    if(encryptBlocks != NULL)
+	ENCRYPT_BLOCKS(keySchedule, size, dIn, dOut);
+    else
+	for(; size > 0; size -= blockSize)
+	    {
+		ENCRYPT(keySchedule, dIn, dOut);
+		dIn = &dIn[blockSize];
+		dOut = &dOut[blockSize];
+	    }
+}
+/* 10.2.20.4.5 SymDecryptBlocks() */
+/* This function is SymEncryptBlocks() for decryption. */
+static void
+SymDecryptBlocks(
+		 TpmCryptSetSymKeyCall_t  decrypt,       // IN: single block function
+		 TpmCryptBlocksCall_t     decryptBlocks, // IN: multi-block function or NULL
+		 tpmCryptKeySchedule_t   *keySchedule,   // IN: decryption schedule
+		 INT16                    blockSize,     // IN: cipher block size
+		 INT32                    size,          // IN: multiple of blockSize
+		 const BYTE              *dIn,           // IN: input blocks
+		 BYTE                    *dOut           // OUT: output blocks
+		 )
+{
+    if(decryptBlocks != NULL)
+	DECRYPT_BLOCKS(keySchedule, size, dIn, dOut);
+    else
+	for(; size > 0; size -= blockSize)
+	    {
+		DECRYPT(keySchedule, dIn, dOut);
+		dIn = &dIn[blockSize];
+		dOut = &dOut[blockSize];
+	    }
+}
+/* 10.2.20.4.6 SymCtr() */
+/* This function does CTR mode, which is the same for encryption and decryption. The counter in iv
+   is incremented once for each block, including a partial last block. Without a CTR method, a run
+   of counter blocks is encrypted with SymEncryptBlocks() and XORed into the data. dIn and dOut may
+   be the same. */
+static void
+SymCtr(
+       TpmCryptSetSymKeyCall_t  encrypt,       // IN: single block function
+       const SYM_BULK_METHODS  *bulk,          // IN: multi-block methods
+       tpmCryptKeySchedule_t   *keySchedule,   // IN: encryption schedule
+       INT16                    blockSize,     // IN: cipher block size
+       BYTE                    *iv,            // IN/OUT: counter
+       INT32                    dSize,         // IN: data size
+       const BYTE              *dIn,           // IN: data buffer
+       BYTE                    *dOut           // OUT: result
+       )
+{
+    BYTE                 stream[SYM_BULK_BLOCKS * MAX_SYM_BLOCK_SIZE];
+    TpmCryptCtrCall_t    ctr = bulk->ctr;
+    INT32                blocks;
+    INT32                size;
+    INT32                j;
+    int                  i;
+    //
+    if(ctr != NULL)
+	{
+	    CTR_CRYPT(keySchedule, dSize, iv, dIn, dOut);
+	    return;
+	}
+    for(; dSize > 0; dSize -= size)
+	{
+	    blocks = (dSize + blockSize - 1) / blockSize;
+	    if(blocks > SYM_BULK_BLOCKS)
+		blocks = SYM_BULK_BLOCKS;
+	    for(j = 0; j < blocks; j++)
+		{
+		    memcpy(&stream[j * blockSize], iv, blockSize);
+		    //increment the counter (counter is big-endian so start at end)
+		    for(i = blockSize - 1; i >= 0; i--)
+			if((iv[i] += 1) != 0)
+			    break;
+		}
+	    SymEncryptBlocks(encrypt, bulk->encryptBlocks, keySchedule, blockSize,
+			     blocks * blockSize, stream, stream);
+	    size = (dSize < blocks * blockSize) ? dSize : blocks * blockSize;
+	    SymXor(dOut, dIn, stream, size);
+	    dIn = &dIn[size];
+	    dOut = &dOut[size];
+	}
+}
+/* 10.2.20.4.7 SymSetKeySchedule() */
+/* This function expands a key into keySchedule and returns the single block function that goes
+   with it. */
+/* Error Returns Meaning */
+/* TPM_RC_SYMMETRIC algorithm is not supported */
+static TPM_RC
+SymSetKeySchedule(
+		  TPM_ALG_ID                algorithm,       // IN: the symmetric algorithm
+		  UINT16                    keySizeInBits,   // IN: key size in bits
+		  const BYTE               *key,             // IN: key buffer
+		  BOOL                      decryptSchedule, // IN: TRUE for a decryption schedule
+		  tpmCryptKeySchedule_t    *keySchedule,     // OUT: the expanded key
+		  TpmCryptSetSymKeyCall_t  *call             // OUT: the block function
+		  )
+{
+    TpmCryptSetSymKeyCall_t   encrypt = NULL;
+    TpmCryptSetSymKeyCall_t   decrypt = NULL;
+    //
+    memset((void *)keySchedule, 0, sizeof(*keySchedule));	/* silence false positive */
+    if(decryptSchedule)
+	{
+	    switch(algorithm)
+		{
+		    FOR_EACH_SYM(DECRYPT_SCHEDULE_CASE)
+		  default:
+		    return TPM_RC_SYMMETRIC;
+		}
+	    *call = decrypt;
+	}
+    else
+	{
+	    switch(algorithm)
+		{
+		    FOR_EACH_SYM(ENCRYPT_SCHEDULE_CASE)
+		  default:
+		    return TPM_RC_SYMMETRIC;
+		}
+	    *call = encrypt;
+	}
+    return TPM_RC_SUCCESS;
+}
+/* 10.2.20.4.8 SymGetKeySchedule() */
+/* This function returns the key schedule for a key. When owner is not NULL, the schedule comes from
+   the cache entry that owner has for the same key, and the entry is made if there is none. When
+   owner is NULL, the key is expanded into localSchedule. */
+/* Return Values Meaning */
+/* NULL algorithm is not supported */
+/* != NULL the key schedule */
+static tpmCryptKeySchedule_t *
+SymGetKeySchedule(
+		  const void               *owner,           // IN: object with the key, or NULL
+		  TPM_ALG_ID                algorithm,       // IN: the symmetric algorithm
+		  UINT16                    keySizeInBits,   // IN: key size in bits
+		  const BYTE               *key,             // IN: key buffer
+		  BOOL                      decryptSchedule, // IN: TRUE for a decryption schedule
+		  tpmCryptKeySchedule_t    *localSchedule,   // IN: the schedule to use without a cache
+		  TpmCryptSetSymKeyCall_t  *call             // OUT: the block function
+		  )
+{
+    SYM_SCHEDULE_CACHE_ENTRY    *entry;
+    UINT16                       keySize = BITS_TO_BYTES(keySizeInBits);
+    UINT32                       i;
+    //
+    if(owner == NULL || keySize > MAX_SYM_KEY_BYTES)
+	{
+	    if(SymSetKeySchedule(algorithm, keySizeInBits, key, decryptSchedule,
+				 localSchedule, call) != TPM_RC_SUCCESS)
+		return NULL;
+	    return localSchedule;
+	}
+    for(i = 0; i < SYM_SCHEDULE_CACHE_SIZE; i++)
+	{
+	    entry = &s_symScheduleCache[i];
+	    if(entry->owner == owner
+	       && entry->algorithm == algorithm
+	       && entry->keySizeInBits == keySizeInBits
+	       && entry->decryptSchedule == decryptSchedule
+	       && MemoryEqual(entry->key, key, keySize))
+		{
+		    *call = entry->call;
+		    return &entry->keySchedule;
+		}
+	}
+    // Not cached. Take a free entry if there is one and the next one in turn if not.
+    for(i = 0; i < SYM_SCHEDULE_CACHE_SIZE; i++)
+	if(s_symScheduleCache[i].owner == NULL)
+	    break;
+    if(i == SYM_SCHEDULE_CACHE_SIZE)
+	{
+	    i = s_symScheduleNext;
+	    s_symScheduleNext = (i + 1) % SYM_SCHEDULE_CACHE_SIZE;
+	}
+    entry = &s_symScheduleCache[i];
+    MemorySet(entry, 0, sizeof(*entry));
+    if(SymSetKeySchedule(algorithm, keySizeInBits, key, decryptSchedule,
+			 &entry->keySchedule, call) != TPM_RC_SUCCESS)
+	{
+	    MemorySet(entry, 0, sizeof(*entry));
+	    return NULL;
+	}
+    entry->owner = owner;
+    entry->algorithm = algorithm;
+    entry->keySizeInBits = keySizeInBits;
+    entry->decryptSchedule = decryptSchedule;
+    entry->call = *call;
+    MemoryCopy(entry->key, key, keySize);
+    return &entry->keySchedule;
+}
 /* 10.2.20.5 Symmetric Encryption */
-/* This function performs symmetric encryption based on the mode. */
+/* This function performs symmetric encryption based on the mode. When owner is not NULL, the key
+   schedule is kept in the cache for owner (see SymGetKeySchedule()). */
 /* Error Returns Meaning */
 /* TPM_RC_SIZE dSize is not a multiple of the block size for an algorithm that requires it */
 /* TPM_RC_FAILURE Fatal error */
-LIB_EXPORT TPM_RC
-CryptSymmetricEncrypt(
-		      BYTE                *dOut,          // OUT:
-		      TPM_ALG_ID           algorithm,     // IN: the symmetric algorithm
-		      UINT16               keySizeInBits, // IN: key size in bits
-		      const BYTE          *key,           // IN: key buffer. The size of this buffer
-		      //     in bytes is (keySizeInBits + 7) / 8
-		      TPM2B_IV            *ivInOut,       // IN/OUT: IV for decryption.
-		      TPM_ALG_ID           mode,          // IN: Mode to use
-		      INT32                dSize,         // IN: data size (may need to be a
-		      //     multiple of the blockSize)
-		      const BYTE          *dIn            // IN: data buffer
-		      )
+static TPM_RC
+SymmetricEncrypt(
+		 const void          *owner,         // IN: object with the key, or NULL
+		 BYTE                *dOut,          // OUT:
+		 TPM_ALG_ID           algorithm,     // IN: the symmetric algorithm
+		 UINT16               keySizeInBits, // IN: key size in bits
+		 const BYTE          *key,           // IN: key buffer. The size of this buffer
+		 //     in bytes is (keySizeInBits + 7) / 8
+		 TPM2B_IV            *ivInOut,       // IN/OUT: IV for decryption.
+		 TPM_ALG_ID           mode,          // IN: Mode to use
+		 INT32                dSize,         // IN: data size (may need to be a
+		 //     multiple of the blockSize)
+		 const BYTE          *dIn            // IN: data buffer
+		 )
 {
     BYTE                *pIv;
     int                  i;
-    BYTE                 tmp[MAX_SYM_BLOCK_SIZE];
-    BYTE                *pT;
-    tpmCryptKeySchedule_t        keySchedule;
+    tpmCryptKeySchedule_t        localSchedule;
+    tpmCryptKeySchedule_t       *keySchedule;
     INT16                blockSize;
     TpmCryptSetSymKeyCall_t        encrypt;
+    const SYM_BULK_METHODS        *bulk;
     BYTE                *iv;
     BYTE                 defaultIv[MAX_SYM_BLOCK_SIZE] = {0};
     //
     pAssert(dOut != NULL && key != NULL && dIn != NULL);
-    memset((void *)&keySchedule, 0, sizeof(keySchedule));	/* silence false positive */
-    memset(tmp, 0, sizeof(tmp));
     if(dSize == 0)
 	return TPM_RC_SUCCESS;
     TEST(algorithm);
@@ -194,31 +457,17 @@ CryptSymmetricEncrypt(
     else
 	iv = defaultIv;
     pIv = iv;
-    // Create encrypt key schedule and set the encryption function pointer.
-    switch (algorithm)
-	{
-	    FOR_EACH_SYM(ENCRYPT_CASE)
-
-	  default:
-	    return TPM_RC_SYMMETRIC;
-	}
+    // Get the encrypt key schedule and the encryption function pointer.
+    keySchedule = SymGetKeySchedule(owner, algorithm, keySizeInBits, key, FALSE,
+				    &localSchedule, &encrypt);
+    if(keySchedule == NULL)
+	return TPM_RC_SYMMETRIC;
+    bulk = SymBulkMethods(algorithm);
     switch(mode)
 	{
 #if ALG_CTR
 	  case TPM_ALG_CTR:
-	    for(; dSize > 0; dSize -= blockSize)
-		{
-		    // Encrypt the current value of the IV(counter)
-		    ENCRYPT(&keySchedule, iv, tmp);
-		    //increment the counter (counter is big-endian so start at end)
-		    for(i = blockSize - 1; i >= 0; i--)
-			if((iv[i] += 1) != 0)
-			    break;
-		    // XOR the encrypted counter value with input and put into output
-		    pT = tmp;
-		    for(i = (dSize < blockSize) ? dSize : blockSize; i > 0; i--)
-			*dOut++ = *dIn++ ^ *pT++;
-		}
+	    SymCtr(encrypt, bulk, keySchedule, blockSize, iv, dSize, dIn, dOut);
 	    break;
 #endif
 #if ALG_OFB
@@ -227,7 +476,7 @@ CryptSymmetricEncrypt(
 	    for(; dSize > 0; dSize -= blockSize)
 		{
 		    // Encrypt the current value of the "IV"
-		    ENCRYPT(&keySchedule, iv, iv);
+		    ENCRYPT(keySchedule, iv, iv);
 		    // XOR the encrypted IV into dIn to create the cipher text (dOut)
 		    pIv = iv;
 		    for(i = (dSize < blockSize) ? dSize : blockSize; i > 0; i--)
@@ -248,7 +497,7 @@ CryptSymmetricEncrypt(
 		    pIv = iv;
 		    for(i = blockSize; i > 0; i--)
 			*pIv++ ^= *dIn++;
-		    ENCRYPT(&keySchedule, iv, iv);
+		    ENCRYPT(keySchedule, iv, iv);
 		    pIv = iv;
 		    for(i = blockSize; i > 0; i--)
 			*dOut++ = *pIv++;
@@ -261,7 +510,7 @@ CryptSymmetricEncrypt(
 	    for(; dSize > 0; dSize -= blockSize)
 		{
 		    // Encrypt the current value of the IV
-		    ENCRYPT(&keySchedule, iv, iv);
+		    ENCRYPT(keySchedule, iv, iv);
 		    pIv = iv;
 		    for(i = (int)(dSize < blockSize) ? dSize : blockSize; i > 0; i--)
 			// XOR the data into the IV to create the cipher text
@@ -281,13 +530,9 @@ CryptSymmetricEncrypt(
 	    // cipher block size
 	    if((dSize % blockSize) != 0)
 		return TPM_RC_SIZE;
-	    // Encrypt the input block to the output block
-	    for(; dSize > 0; dSize -= blockSize)
-		{
-		    ENCRYPT(&keySchedule, dIn, dOut);
-		    dIn = &dIn[blockSize];
-		    dOut = &dOut[blockSize];
-		}
+	    // Encrypt the input blocks to the output blocks
+	    SymEncryptBlocks(encrypt, bulk->encryptBlocks, keySchedule, blockSize,
+			     dSize, dIn, dOut);
 	    break;
 #endif
 	  default:
@@ -295,37 +540,42 @@ CryptSymmetricEncrypt(
 	}
     return TPM_RC_SUCCESS;
 }
-/* 10.2.20.5.1 CryptSymmetricDecrypt() */
-/* This function performs symmetric decryption based on the mode. */
+/* 10.2.20.5.1 SymmetricDecrypt() */
+/* This function performs symmetric decryption based on the mode. When owner is not NULL, the key
+   schedule is kept in the cache for owner. */
 /* Error Returns Meaning */
 /* TPM_RC_FAILURE A fatal error */
 /* TPM_RCS_SIZE dSize is not a multiple of the block size for an algorithm that requires it */
-LIB_EXPORT TPM_RC
-CryptSymmetricDecrypt(
-		      BYTE                *dOut,          // OUT: decrypted data
-		      TPM_ALG_ID           algorithm,     // IN: the symmetric algorithm
-		      UINT16               keySizeInBits, // IN: key size in bits
-		      const BYTE          *key,           // IN: key buffer. The size of this buffer
-		      //     in bytes is (keySizeInBits + 7) / 8
-		      TPM2B_IV            *ivInOut,       // IN/OUT: IV for decryption.
-		      TPM_ALG_ID           mode,          // IN: Mode to use
-		      INT32                dSize,         // IN: data size (may need to be a
-		      //     multiple of the blockSize)
-		      const BYTE          *dIn            // IN: data buffer
-		      )
+static TPM_RC
+SymmetricDecrypt(
+		 const void          *owner,         // IN: object with the key, or NULL
+		 BYTE                *dOut,          // OUT: decrypted data
+		 TPM_ALG_ID           algorithm,     // IN: the symmetric algorithm
+		 UINT16               keySizeInBits, // IN: key size in bits
+		 const BYTE          *key,           // IN: key buffer. The size of this buffer
+		 //     in bytes is (keySizeInBits + 7) / 8
+		 TPM2B_IV            *ivInOut,       // IN/OUT: IV for decryption.
+		 TPM_ALG_ID           mode,          // IN: Mode to use
+		 INT32                dSize,         // IN: data size (may need to be a
+		 //     multiple of the blockSize)
+		 const BYTE          *dIn            // IN: data buffer
+		 )
 {
     BYTE                *pIv;
     int                  i;
     BYTE                 tmp[MAX_SYM_BLOCK_SIZE];
-    BYTE                *pT;
-    tpmCryptKeySchedule_t        keySchedule;
+    tpmCryptKeySchedule_t        localSchedule;
+    tpmCryptKeySchedule_t       *keySchedule;
     INT16                blockSize;
     BYTE                *iv;
     TpmCryptSetSymKeyCall_t        encrypt;
     TpmCryptSetSymKeyCall_t        decrypt;
+    const SYM_BULK_METHODS        *bulk;
+    BYTE                 buffer[SYM_BULK_BLOCKS * MAX_SYM_BLOCK_SIZE];
+    INT32                size;
+    INT32                j;
     BYTE                 defaultIv[MAX_SYM_BLOCK_SIZE] = {0};
 
-    memset((void *)&keySchedule, 0, sizeof(keySchedule));	/* silence false positive */
     memset(tmp, 0, sizeof(tmp));
     // These are used but the compiler can't tell because they are initialized
     // in case statements and it can't tell if they are always initialized
@@ -363,90 +613,74 @@ CryptSymmetricDecrypt(
 	    // cipher block size
 	    if((dSize % blockSize) != 0)
 		return TPM_RC_SIZE;
-	    switch (algorithm)
-		{
-		    FOR_EACH_SYM(DECRYPT_CASE)
-		  default:
-		    return TPM_RC_SYMMETRIC;
-		}
+	    keySchedule = SymGetKeySchedule(owner, algorithm, keySizeInBits, key, TRUE,
+					    &localSchedule, &decrypt);
 	    break;
 #endif
 	  default:
 	    // For the remaining stream ciphers, use encryption to decrypt
-	    switch (algorithm)
-		{
-		    FOR_EACH_SYM(ENCRYPT_CASE)
-		  default:
-		    return TPM_RC_SYMMETRIC;
-		}
+	    keySchedule = SymGetKeySchedule(owner, algorithm, keySizeInBits, key, FALSE,
+					    &localSchedule, &encrypt);
+	    break;
 	}
+    if(keySchedule == NULL)
+	return TPM_RC_SYMMETRIC;
+    bulk = SymBulkMethods(algorithm);
     // Now do the mode-dependent decryption
     switch(mode)
 	{
 #if ALG_CBC
 	  case TPM_ALG_CBC:
-	    // Copy the input data to a temp buffer, decrypt the buffer into the
-	    // output, XOR in the IV, and copy the temp buffer to the IV and repeat.
-	    for(; dSize > 0; dSize -= blockSize)
+	    // Decrypt a run of blocks into a buffer, then XOR each block with the
+	    // previous cipher text block (the IV for the first one). The last
+	    // cipher text block is the IV for the next run. The XOR goes from the
+	    // last block to the first so that dIn and dOut may be the same.
+	    for(; dSize > 0; dSize -= size)
 		{
-		    pT = tmp;
-		    for(i = blockSize; i > 0; i--)
-			*pT++ = *dIn++;
-		    DECRYPT(&keySchedule, tmp, dOut);
-		    pIv = iv;
-		    pT = tmp;
-		    for(i = blockSize; i > 0; i--)
-			{
-			    *dOut++ ^= *pIv;
-			    *pIv++ = *pT++;
-			}
+		    size = (dSize < SYM_BULK_BLOCKS * blockSize)
+			   ? dSize : SYM_BULK_BLOCKS * blockSize;
+		    SymDecryptBlocks(decrypt, bulk->decryptBlocks, keySchedule,
+				     blockSize, size, dIn, buffer);
+		    memcpy(tmp, &dIn[size - blockSize], blockSize);
+		    for(j = size - blockSize; j > 0; j -= blockSize)
+			SymXor(&dOut[j], &buffer[j], &dIn[j - blockSize], blockSize);
+		    SymXor(dOut, buffer, iv, blockSize);
+		    memcpy(iv, tmp, blockSize);
+		    dIn = &dIn[size];
+		    dOut = &dOut[size];
 		}
 	    break;
 #endif
 	  case TPM_ALG_CFB:
-	    for(; dSize > 0; dSize -= blockSize)
+	    // The key stream for a block is the encryption of the previous cipher
+	    // text block (the IV for the first one), so a run of blocks can be
+	    // encrypted together. A partial last block is padded with zeros to make
+	    // the IV for the next round.
+	    for(; dSize > 0; dSize -= size)
 		{
-		    // Encrypt the IV into the temp buffer
-		    ENCRYPT(&keySchedule, iv, tmp);
-		    pT = tmp;
-		    pIv = iv;
-		    for(i = (dSize < blockSize) ? dSize : blockSize; i > 0; i--)
-			// Copy the current cipher text to IV, XOR
-			// with the temp buffer and put into the output
-			*dOut++ = *pT++ ^ (*pIv++ = *dIn++);
+		    size = (dSize < SYM_BULK_BLOCKS * blockSize)
+			   ? dSize : SYM_BULK_BLOCKS * blockSize;
+		    j = ((size - 1) / blockSize) * blockSize;
+		    memcpy(buffer, iv, blockSize);
+		    memcpy(&buffer[blockSize], dIn, j);
+		    memset(iv, 0, blockSize);
+		    memcpy(iv, &dIn[j], size - j);
+		    SymEncryptBlocks(encrypt, bulk->encryptBlocks, keySchedule,
+				     blockSize, j + blockSize, buffer, buffer);
+		    SymXor(dOut, dIn, buffer, size);
+		    dIn = &dIn[size];
+		    dOut = &dOut[size];
 		}
-	    // If the inner loop (i loop) was smaller than blockSize, then dSize
-	    // would have been smaller than blockSize and it is now negative
-	    // If it is negative, then it indicates how may fill bytes
-	    // are needed to pad out the IV for the next round.
-	    for(; dSize < 0; dSize++)
-		*pIv++ = 0;
 	    break;
 #if ALG_CTR
 	  case TPM_ALG_CTR:
-	    for(; dSize > 0; dSize -= blockSize)
-		{
-		    // Encrypt the current value of the IV(counter)
-		    ENCRYPT(&keySchedule, iv, tmp);
-		    //increment the counter (counter is big-endian so start at end)
-		    for(i = blockSize - 1; i >= 0; i--)
-			if((iv[i] += 1) != 0)
-			    break;
-		    // XOR the encrypted counter value with input and put into output
-		    pT = tmp;
-		    for(i = (dSize < blockSize) ? dSize : blockSize; i > 0; i--)
-			*dOut++ = *dIn++ ^ *pT++;
-		}
+	    SymCtr(encrypt, bulk, keySchedule, blockSize, iv, dSize, dIn, dOut);
 	    break;
 #endif
 #if ALG_ECB
 	  case TPM_ALG_ECB:
-	    for(; dSize > 0; dSize -= blockSize)
-		{
-		    DECRYPT(&keySchedule, dIn, dOut);
-		    dIn = &dIn[blockSize];
-		    dOut = &dOut[blockSize];
-		}
+	    SymDecryptBlocks(decrypt, bulk->decryptBlocks, keySchedule, blockSize,
+			     dSize, dIn, dOut);
 	    break;
 #endif
 #if ALG_OFB
@@ -455,7 +689,7 @@ CryptSymmetricDecrypt(
 	    for(; dSize > 0; dSize -= blockSize)
 		{
 		    // Encrypt the current value of the "IV"
-		    ENCRYPT(&keySchedule, iv, iv);
+		    ENCRYPT(keySchedule, iv, iv);
 		    // XOR the encrypted IV into dIn to create the cipher text (dOut)
 		    pIv = iv;
 		    for(i = (dSize < blockSize) ? dSize : blockSize; i > 0; i--)
@@ -468,7 +702,137 @@ CryptSymmetricDecrypt(
 	}
     return TPM_RC_SUCCESS;
 }
-/* 10.2.20.5.2 CryptSymKeyValidate() */
+/* 10.2.20.5.2 CryptSymmetricEncrypt() */
+/* This function performs symmetric encryption based on the mode. */
+/* Error Returns Meaning */
+/* TPM_RC_SIZE dSize is not a multiple of the block size for an algorithm that requires it */
+/* TPM_RC_FAILURE Fatal error */
+LIB_EXPORT TPM_RC
+CryptSymmetricEncrypt(
+		      BYTE                *dOut,          // OUT:
+		      TPM_ALG_ID           algorithm,     // IN: the symmetric algorithm
+		      UINT16               keySizeInBits, // IN: key size in bits
+		      const BYTE          *key,           // IN: key buffer. The size of this buffer
+		      //     in bytes is (keySizeInBits + 7) / 8
+		      TPM2B_IV            *ivInOut,       // IN/OUT: IV for decryption.
+		      TPM_ALG_ID           mode,          // IN: Mode to use
+		      INT32                dSize,         // IN: data size (may need to be a
+		      //     multiple of the blockSize)
+		      const BYTE          *dIn            // IN: data buffer
+		      )
+{
+    return SymmetricEncrypt(NULL, dOut, algorithm, keySizeInBits, key, ivInOut,
+			    mode, dSize, dIn);
+}
+/* 10.2.20.5.3 CryptSymmetricDecrypt() */
+/* This function performs symmetric decryption based on the mode. */
+/* Error Returns Meaning */
+/* TPM_RC_FAILURE A fatal error */
+/* TPM_RCS_SIZE dSize is not a multiple of the block size for an algorithm that requires it */
+LIB_EXPORT TPM_RC
+CryptSymmetricDecrypt(
+		      BYTE                *dOut,          // OUT: decrypted data
+		      TPM_ALG_ID           algorithm,     // IN: the symmetric algorithm
+		      UINT16               keySizeInBits, // IN: key size in bits
+		      const BYTE          *key,           // IN: key buffer. The size of this buffer
+		      //     in bytes is (keySizeInBits + 7) / 8
+		      TPM2B_IV            *ivInOut,       // IN/OUT: IV for decryption.
+		      TPM_ALG_ID           mode,          // IN: Mode to use
+		      INT32                dSize,         // IN: data size (may need to be a
+		      //     multiple of the blockSize)
+		      const BYTE          *dIn            // IN: data buffer
+		      )
+{
+    return SymmetricDecrypt(NULL, dOut, algorithm, keySizeInBits, key, ivInOut,
+			    mode, dSize, dIn);
+}
+/* 10.2.20.5.4 CryptSymmetricEncryptObject() */
+/* This function is CryptSymmetricEncrypt() with the algorithm and key of a loaded symmetric key
+   object. The expanded key schedule is kept for the object, so later calls with the same object do
+   not expand the key again. */
+/* Error Returns Meaning */
+/* TPM_RC_SIZE dSize is not a multiple of the block size for an algorithm that requires it */
+/* TPM_RC_FAILURE Fatal error */
+LIB_EXPORT TPM_RC
+CryptSymmetricEncryptObject(
+			    BYTE                *dOut,          // OUT:
+			    OBJECT              *symKey,        // IN: the symmetric key object
+			    TPM2B_IV            *ivInOut,       // IN/OUT: IV for decryption.
+			    TPM_ALG_ID           mode,          // IN: Mode to use
+			    INT32                dSize,         // IN: data size
+			    const BYTE          *dIn            // IN: data buffer
+			    )
+{
+    TPMT_SYM_DEF_OBJECT     *sym = &symKey->publicArea.parameters.symDetail.sym;
+    //
+    return SymmetricEncrypt(symKey, dOut, sym->algorithm, sym->keyBits.sym,
+			    symKey->sensitive.sensitive.sym.t.buffer, ivInOut,
+			    mode, dSize, dIn);
+}
+/* 10.2.20.5.5 CryptSymmetricDecryptObject() */
+/* This function is CryptSymmetricDecrypt() with the algorithm and key of a loaded symmetric key
+   object, with the key schedule kept as for CryptSymmetricEncryptObject(). */
+/* Error Returns Meaning */
+/* TPM_RC_FAILURE A fatal error */
+/* TPM_RCS_SIZE dSize is not a multiple of the block size for an algorithm that requires it */
+LIB_EXPORT TPM_RC
+CryptSymmetricDecryptObject(
+			    BYTE                *dOut,          // OUT: decrypted data
+			    OBJECT              *symKey,        // IN: the symmetric key object
+			    TPM2B_IV            *ivInOut,       // IN/OUT: IV for decryption.
+			    TPM_ALG_ID           mode,          // IN: Mode to use
+			    INT32                dSize,         // IN: data size
+			    const BYTE          *dIn            // IN: data buffer
+			    )
+{
+    TPMT_SYM_DEF_OBJECT     *sym = &symKey->publicArea.parameters.symDetail.sym;
+    //
+    return SymmetricDecrypt(symKey, dOut, sym->algorithm, sym->keyBits.sym,
+			    symKey->sensitive.sensitive.sym.t.buffer, ivInOut,
+			    mode, dSize, dIn);
+}
+/* 10.2.20.5.6 CryptSymmetricSequenceUpdate() */
+/* This function encrypts or decrypts the next dSize bytes of the data stream of a symmetric
+   sequence object and chains the IV in the sequence state. The key schedule is kept for the
+   sequence as for CryptSymmetricEncryptObject(). */
+/* Error Returns Meaning */
+/* TPM_RC_FAILURE A fatal error */
+/* TPM_RCS_SIZE dSize is not a multiple of the block size for an algorithm that requires it */
+LIB_EXPORT TPM_RC
+CryptSymmetricSequenceUpdate(
+			     BYTE                *dOut,          // OUT: the output data
+			     HASH_OBJECT         *sequence,      // IN/OUT: the sequence object
+			     INT32                dSize,         // IN: data size
+			     const BYTE          *dIn            // IN: data buffer
+			     )
+{
+    SYM_SEQUENCE_STATE      *state = &sequence->state.symState;
+    //
+    if(state->decrypt == YES)
+	return SymmetricDecrypt(sequence, dOut, state->sym.algorithm,
+				state->sym.keyBits.sym, state->key.t.buffer,
+				&state->iv, state->sym.mode.sym, dSize, dIn);
+    return SymmetricEncrypt(sequence, dOut, state->sym.algorithm,
+			    state->sym.keyBits.sym, state->key.t.buffer,
+			    &state->iv, state->sym.mode.sym, dSize, dIn);
+}
+/* 10.2.20.5.7 CryptSymFlushKeySchedules() */
+/* This function erases the key schedules kept for owner, or all of them when owner is NULL. It is
+   called when an object is flushed or its context is saved. */
+LIB_EXPORT void
+CryptSymFlushKeySchedules(
+			  const void          *owner          // IN: object, or NULL for all
+			  )
+{
+    UINT32               i;
+    //
+    for(i = 0; i < SYM_SCHEDULE_CACHE_SIZE; i++)
+	if(owner == NULL || s_symScheduleCache[i].owner == owner)
+	    MemorySet(&s_symScheduleCache[i], 0, sizeof(s_symScheduleCache[i]));
+    if(owner == NULL)
+	s_symScheduleNext = 0;
+}
+/* 10.2.20.5.8 CryptSymKeyValidate() */
 /* Validate that a provided symmetric key meets the requirements of the TPM */
 /* Error Returns Meaning */
 /* TPM_RC_KEY_SIZE Key size specifiers do not match */
@@ -132,4 +132,60 @@ typedef union tpmCryptKeySchedule_t {
     decrypt = (TpmCryptSetSymKeyCall_t)TpmCryptDecrypt##ALG;		\
     break;
 
+/* The multi-block methods of each algorithm, found with the algorithm ID. A NULL entry means that
+   the algorithm does not have that method and the single block call is used instead. */
+
+typedef struct SYM_BULK_METHODS
+{
+    TPM_ALG_ID               algorithm;
+    TpmCryptBlocksCall_t     encryptBlocks;
+    TpmCryptBlocksCall_t     decryptBlocks;
+    TpmCryptCtrCall_t        ctr;
+} SYM_BULK_METHODS;
+
+#define BULK_METHODS(ALG, alg)						\
+    { TPM_ALG_##ALG,							\
+      (TpmCryptBlocksCall_t)TpmCryptEncryptBlocks##ALG,		\
+      (TpmCryptBlocksCall_t)TpmCryptDecryptBlocks##ALG,		\
+      (TpmCryptCtrCall_t)TpmCryptCtr##ALG },
+
+/* The same as ENCRYPT_CASE and DECRYPT_CASE for a key schedule that is referenced through a
+   pointer */
+
+#define ENCRYPT_SCHEDULE_CASE(ALG, alg)					\
+    case TPM_ALG_##ALG:							\
+    TpmCryptSetEncryptKey##ALG(key, keySizeInBits, &keySchedule->alg);	\
+    encrypt = (TpmCryptSetSymKeyCall_t)TpmCryptEncrypt##ALG;		\
+    break;
+#define DECRYPT_SCHEDULE_CASE(ALG, alg)					\
+    case TPM_ALG_##ALG:							\
+    TpmCryptSetDecryptKey##ALG(key, keySizeInBits, &keySchedule->alg);	\
+    decrypt = (TpmCryptSetSymKeyCall_t)TpmCryptDecrypt##ALG;		\
+    break;
+
+/* An expanded key schedule kept for a loaded object, so that repeated commands with the same key
+   do not expand it again. The key is kept with the schedule and compared on each use, so a slot
+   that is reused for another key never gets the old schedule. */
+
+typedef struct SYM_SCHEDULE_CACHE_ENTRY
+{
+    const void                  *owner;             // NULL when the entry is free
+    TPM_ALG_ID                   algorithm;
+    UINT16                       keySizeInBits;
+    BOOL                         decryptSchedule;
+    TpmCryptSetSymKeyCall_t      call;
+    BYTE                         key[MAX_SYM_KEY_BYTES];
+    tpmCryptKeySchedule_t        keySchedule;
+} SYM_SCHEDULE_CACHE_ENTRY;
+
+/* An object can have an encryption and a decryption schedule */
+#define SYM_SCHEDULE_CACHE_SIZE     (2 * MAX_LOADED_OBJECTS)
+
+#   define ENCRYPT_BLOCKS(keySchedule, size, in, out)			\
+    encryptBlocks(SWIZZLE_BLOCKS_ENC(keySchedule, size, in, out))
+#   define DECRYPT_BLOCKS(keySchedule, size, in, out)			\
+    decryptBlocks(SWIZZLE_BLOCKS_DEC(keySchedule, size, in, out))
+#   define CTR_CRYPT(keySchedule, size, counter, in, out)		\
+    ctr(SWIZZLE_CTR(keySchedule, size, counter, in, out))
+
 #endif
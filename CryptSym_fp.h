@@ -101,6 +101,35 @@ CryptSymmetricDecrypt(
 		      //     multiple of the blockSize)
 		      const BYTE          *dIn            // IN: data buffer
 		      );
+LIB_EXPORT TPM_RC
+CryptSymmetricEncryptObject(
+			    BYTE                *dOut,          // OUT:
+			    OBJECT              *symKey,        // IN: the symmetric key object
+			    TPM2B_IV            *ivInOut,       // IN/OUT: IV for decryption.
+			    TPM_ALG_ID           mode,          // IN: Mode to use
+			    INT32                dSize,         // IN: data size
+			    const BYTE          *dIn            // IN: data buffer
+			    );
+LIB_EXPORT TPM_RC
+CryptSymmetricDecryptObject(
+			    BYTE                *dOut,          // OUT: decrypted data
+			    OBJECT              *symKey,        // IN: the symmetric key object
+			    TPM2B_IV            *ivInOut,       // IN/OUT: IV for decryption.
+			    TPM_ALG_ID           mode,          // IN: Mode to use
+			    INT32                dSize,         // IN: data size
+			    const BYTE          *dIn            // IN: data buffer
+			    );
+LIB_EXPORT TPM_RC
+CryptSymmetricSequenceUpdate(
+			     BYTE                *dOut,          // OUT: the output data
+			     HASH_OBJECT         *sequence,      // IN/OUT: the sequence object
+			     INT32                dSize,         // IN: data size
+			     const BYTE          *dIn            // IN: data buffer
+			     );
+LIB_EXPORT void
+CryptSymFlushKeySchedules(
+			  const void          *owner          // IN: object, or NULL for all
+			  );
 TPM_RC
 CryptSymKeyValidate(
 		    TPMT_SYM_DEF_OBJECT *symDef,
@@ -82,7 +82,6 @@ EncryptDecryptShared(
     OBJECT              *symKey;
     UINT16               keySize;
     UINT16               blockSize;
-    BYTE                *key;
     TPM_ALG_ID           alg;
     TPM_ALG_ID           mode;
     TPM_RC               result;
@@ -143,23 +142,22 @@ EncryptDecryptShared(
     // will modify the output buffer, not the input buffer
     out->ivOut = *ivIn;
     // Command Output
-    key = symKey->sensitive.sensitive.sym.t.buffer;
     // For symmetric encryption, the cipher data size is the same as plain data
     // size.
     out->outData.t.size = inData->t.size;
     if(decryptIn == YES)
 	{
 	    // Decrypt data to output
-	    result = CryptSymmetricDecrypt(out->outData.t.buffer, alg, keySize, key,
-					   &(out->ivOut), mode, inData->t.size,
-					   inData->t.buffer);
+	    result = CryptSymmetricDecryptObject(out->outData.t.buffer, symKey,
+						 &(out->ivOut), mode, inData->t.size,
+						 inData->t.buffer);
 	}
     else
 	{
 	    // Encrypt data to output
-	    result = CryptSymmetricEncrypt(out->outData.t.buffer, alg, keySize, key,
-					   &(out->ivOut), mode, inData->t.size,
-					   inData->t.buffer);
+	    result = CryptSymmetricEncryptObject(out->outData.t.buffer, symKey,
+						 &(out->ivOut), mode, inData->t.size,
+						 inData->t.buffer);
 	}
     return result;
 }
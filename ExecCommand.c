@@ -64,6 +64,7 @@
    TPM command execution. */
 #include "Tpm.h"
 #include "ExecCommand_fp.h"
+#include "StatsPlat.h"
 
 extern int verbose;
 
@@ -110,7 +111,13 @@ ExecuteCommand(
     COMMAND              command;
     // Response local variables
     UINT32               maxResponse = *responseSize;
+    BYTE                *responseEnd = *response;  // end of what was marshaled
     TPM_RC               result;            // return code for the command
+    UINT64               traceStart;        // 0 when the command trace is off
+    UINT32               traceHandleNum = 0;  // CommandDispatcher() reuses command.handleNum
+    // End time of each phase of the command for the latency statistics, 0 if not run
+    UINT64               statsStart;
+    UINT64               phaseEnd[STATS_PHASES] = {0};
     // This next function call is used in development to size the command and response
     // buffers. The values printed are the sizes of the internal structures and
     // not the sizes of the canonical forms of he command response structures. Also,
@@ -136,6 +143,12 @@ ExecuteCommand(
     // is not available later when it is necessary to write to NV, then the TPM
     // will go into failure mode.
     NvCheckState();
+    // Record the command in the binary trace. The command code and session count are cleared so
+    // that a command that fails before they are parsed is recorded without them.
+    traceStart = _plat__TraceCommandStart(requestSize, request);
+    statsStart = _plat__StatsCommandStart();
+    command.code = 0;
+    command.sessionNum = 0;
     // Due to the limitations of the simulation, TPM clock must be explicitly
     // synchronized with the system clock whenever a command is received.
     // This function call is not necessary in a hardware TPM. However, taking
@@ -213,13 +226,17 @@ ExecuteCommand(
 	    }
     // Start regular command process.
     NvIndexCacheInit();
+    phaseEnd[STATS_PHASE_UNMARSHAL] = _plat__StatsTime();
     // Parse Handle buffer.
     result = ParseHandleBuffer(&command);
+    traceHandleNum = command.handleNum;
+    phaseEnd[STATS_PHASE_HANDLES] = _plat__StatsTime();
     if(result != TPM_RC_SUCCESS)
 	goto Cleanup;
     // All handles in the handle area are required to reference TPM-resident
     // entities.
     result = EntityGetLoadStatus(&command);
+    phaseEnd[STATS_PHASE_LOAD] = _plat__StatsTime();
     if(result != TPM_RC_SUCCESS)
 	goto Cleanup;
     // Authorization session handling for the command.
@@ -262,6 +279,7 @@ ExecuteCommand(
 	    if(result != TPM_RC_SUCCESS)
 		goto Cleanup;
 	}
+    phaseEnd[STATS_PHASE_SESSIONS] = _plat__StatsTime();
     // Set up the response buffer pointers. CommandDispatch will marshal the
     // response parameters starting at the address in command.responseBuffer.
     //    *response = MemoryGetResponseBuffer(command.index);
@@ -276,10 +294,13 @@ ExecuteCommand(
     // buffer if it succeeds. It will also set the parameterSize field in the
     // buffer if the tag is TPM_RC_SESSIONS.
     result = CommandDispatcher(&command);
+    responseEnd = command.responseBuffer;
+    phaseEnd[STATS_PHASE_DISPATCH] = _plat__StatsTime();
     if(result != TPM_RC_SUCCESS)
 	goto Cleanup;
     // Build the session area at the end of the parameter area.
     BuildResponseSession(&command);
+    responseEnd = command.responseBuffer;
  Cleanup:
     if(g_clearOrderly == TRUE
        && NV_IS_ORDERLY)
@@ -299,6 +320,7 @@ ExecuteCommand(
     // The parameters and sessions have been marshaled. Now tack on the header and
     // set the sizes
     BuildResponseHeader(&command, *response, result);
+    phaseEnd[STATS_PHASE_RESPONSE] = _plat__StatsTime();
     // Try to commit all the writes to NV if any NV write happened during this
     // command execution. This check should be made for both succeeded and failed
     // commands, because a failed one may trigger a NV write in DA logic as well.
@@ -311,10 +333,22 @@ ExecuteCommand(
 	    if(!NvCommit())
 		FAIL(FATAL_ERROR_INTERNAL);
 	    g_updateNV = UT_NONE;
+	    phaseEnd[STATS_PHASE_NV_COMMIT] = _plat__StatsTime();
 	}
+    _plat__StatsCommandEnd(statsStart, command.code, phaseEnd);
     pAssert((UINT32)command.parameterSize <= maxResponse);
-    // Clear unused bits in response buffer.
-    MemorySet(*response + *responseSize, 0, maxResponse - *responseSize);
+    // Clear the bytes that were marshaled but are not part of the response, as happens when the
+    // response is replaced by an error. The rest of the response buffer was not written.
+    if(responseEnd > *response + command.parameterSize)
+	MemorySet(*response + command.parameterSize, 0,
+		  (UINT32)(responseEnd - (*response + command.parameterSize)));
+    if(traceStart != 0)
+	_plat__TraceCommandEnd(traceStart, command.code, result,
+			       traceHandleNum, command.handles,
+			       command.sessionNum, SessionGetCommandHandles(),
+			       requestSize, (UINT32)command.parameterSize, *response,
+			       (result == TPM_RC_SUCCESS && IsHandleInResponse(command.index))
+			       ? BYTE_ARRAY_TO_UINT32(*response + STD_RESPONSE_HEADER) : 0);
     // as a final act, and not before, update the response size.
     *responseSize = (UINT32)command.parameterSize;
     return;
@@ -171,6 +171,8 @@ typedef struct
     //        parent
     unsigned            external : 1;       //17) SET when the object is loaded with
     //    TPM2_LoadExternal();
+    unsigned            symSeq : 1;         //18) SET for a symmetric encryption
+    //    sequence object
 } OBJECT_ATTRIBUTES;
 
 #if ALG_RSA
@@ -207,7 +209,21 @@ typedef struct OBJECT
     // to avoid repeatedly computing it.
 } OBJECT;
 
-/* 5.9.3.4	HASH_OBJECT Structure */
+/* 5.9.3.4	SYM_SEQUENCE_STATE Structure */
+/* This structure holds the key and chaining state of a symmetric encryption sequence object. The
+   key is kept rather than its expanded schedule so that the state has no pointers and can be saved
+   with the sequence context. */
+typedef struct SYM_SEQUENCE_STATE
+{
+    TPMT_SYM_DEF_OBJECT sym;                // algorithm, key size, and mode
+    TPMI_YES_NO         decrypt;            // YES for a decryption sequence
+    BOOL                closed;             // SET after an update that was not a
+    //    whole number of blocks
+    TPM2B_IV            iv;                 // the chained IV
+    TPM2B_SYM_KEY       key;                // the key
+} SYM_SEQUENCE_STATE;
+
+/* 5.9.3.5	HASH_OBJECT Structure */
 /* This structure holds a hash sequence object or an event sequence object. */
 /* The first four components of this structure are manually set to be the same as the first four
    components of the object structure. This prevents the object from being inadvertently misused as
@@ -226,11 +242,12 @@ typedef struct HASH_OBJECT
     {
 	HASH_STATE      hashState[HASH_COUNT];
 	HMAC_STATE      hmacState;
+	SYM_SEQUENCE_STATE symState;
     }                   state;
 } HASH_OBJECT;
 typedef BYTE  HASH_OBJECT_BUFFER[sizeof(HASH_OBJECT)];
 
-/* 5.9.3.5	ANY_OBJECT */
+/* 5.9.3.6	ANY_OBJECT */
 /* This is the union for holding either a sequence object or a regular object. for ContextSave() and
    ContextLoad() */
 typedef union ANY_OBJECT
@@ -425,6 +442,35 @@ typedef struct NV_INDEX
 typedef UINT32           NV_REF;
 typedef BYTE            *NV_RAM_REF;
 
+/* 5.9.8.2.1	NV_HANDLE_ENTRY */
+/* An entry in the RAM-resident handle index of the NV dynamic area. It maps the handle of an NV
+   Index or persistent object to the NV_REF of its entry so that a lookup does not have to walk the
+   list. A handle of zero marks an unused slot. */
+typedef struct
+{
+    TPM_HANDLE      handle;
+    NV_REF          ref;
+} NV_HANDLE_ENTRY;
+
+/* 5.9.8.2.2	NV_FREE_SLAB */
+/* The location and size of a free slab in the NV dynamic area. */
+typedef struct
+{
+    NV_REF          ref;
+    UINT32          size;
+} NV_FREE_SLAB;
+
+/* 5.9.8.2.3	NV_COUNTER_ENTRY */
+/* A non-orderly NV counter whose value is kept in RAM. value is the current value of the counter
+   and reserved is the value last written to NV. value is never more than reserved, so the counter
+   stays monotonic when the RAM value is lost. A handle of zero marks an unused entry. */
+typedef struct
+{
+    TPM_HANDLE      handle;
+    UINT64          value;
+    UINT64          reserved;
+} NV_COUNTER_ENTRY;
+
 /* 5.9.8.3	NV_PIN */
 /* This structure deals with the possible endianess differences between the canonical form of the
    TPMS_NV_PIN_COUNTER_PARAMETERS structure and the internal value. The structures allow the data in
@@ -475,7 +521,7 @@ EXTERN ALGORITHM_VECTOR     g_toTest;
 	    TPM_RC_5, TPM_RC_6, TPM_RC_7, TPM_RC_8,			\
 	    TPM_RC_9, TPM_RC_A, TPM_RC_B, TPM_RC_C,			\
 	    TPM_RC_D, TPM_RC_E, TPM_RC_F }
-EXTERN const UINT16     g_rcIndex[15] INITIALIZER(g_rcIndexInitializer);
+EXTERN_CONST UINT16     g_rcIndex[15] INITIALIZER(g_rcIndexInitializer);
 
 /* 5.9.10.4	g_exclusiveAuditSession */
 /* This location holds the session handle for the current exclusive audit session. If there is no
@@ -944,7 +990,7 @@ EXTERN STATE_RESET_DATA gr;
 #define NV_ORDERLY_DATA     (NV_STATE_CLEAR_DATA + sizeof(STATE_CLEAR_DATA))
 #define NV_INDEX_RAM_DATA   (NV_ORDERLY_DATA + sizeof(ORDERLY_DATA))
 #define NV_USER_DYNAMIC     (NV_INDEX_RAM_DATA + sizeof(s_indexOrderlyRam))
-#define NV_USER_DYNAMIC_END     NV_MEMORY_SIZE
+#define NV_USER_DYNAMIC_END     _plat__NvMemorySize()
 
 /* 5.9.13 Global Macro Definitions */
 /* The NV_READ_PERSISTENT and NV_WRITE_PERSISTENT macros are used to access members of the
@@ -1013,8 +1059,8 @@ typedef struct _COMMAND_
 	} t;								\
 	TPM2B   b;							\
     } TPM2B_##name##_;							\
-    EXTERN  const TPM2B_##name##_      name##_ INITIALIZER(STRING_INITIALIZER(value)); \
-    EXTERN  const TPM2B               *name INITIALIZER(&name##_.b)
+    EXTERN_CONST TPM2B_##name##_      name##_ INITIALIZER(STRING_INITIALIZER(value)); \
+    EXTERN_CONST TPM2B                *const name INITIALIZER(&name##_.b)
 TPM2B_STRING(PRIMARY_OBJECT_CREATION, "Primary Object Creation");
 TPM2B_STRING(CFB_KEY, "CFB");
 TPM2B_STRING(CONTEXT_KEY, "CONTEXT");
@@ -1141,6 +1187,33 @@ EXTERN      NV_INDEX         s_cachedNvIndex;
 EXTERN      NV_REF           s_cachedNvRef;
 EXTERN      BYTE            *s_cachedNvRamRef;
 
+/* This is the handle index for the NV dynamic area. It is an open addressed hash table with an
+   entry for every NV Index and persistent object. There can be at most NV_ENTITIES_MAX of those, so
+   the table is never more than half full. s_nvHandleDirectory holds the same s_nvHandleCount handles
+   in ascending order, so that they can be enumerated in order from any start handle.
+   s_nvListEnd caches the reference to the end-of-list marker. */
+/* The entries of deleted entities are left in place as free slabs, and s_nvFreeList holds their
+   references and sizes so that a new entity of the same size can reuse one. s_nvFreeBytes is
+   their total size. */
+/* All of these are derived from the NV image and are rebuilt from it whenever
+   s_nvHandleIndexValid is FALSE. */
+#define     NV_HANDLE_INDEX_SIZE    (2 * NV_ENTITIES_MAX + 1)
+EXTERN      NV_HANDLE_ENTRY  s_nvHandleIndex[NV_HANDLE_INDEX_SIZE];
+EXTERN      UINT32           s_nvHandleCount;
+EXTERN      TPM_HANDLE       s_nvHandleDirectory[NV_ENTITIES_MAX];
+EXTERN      NV_REF           s_nvListEnd;
+EXTERN      NV_FREE_SLAB     s_nvFreeList[NV_ENTITIES_MAX];
+EXTERN      UINT32           s_nvFreeCount;
+EXTERN      UINT32           s_nvFreeBytes;
+EXTERN      BOOL             s_nvHandleIndexValid;
+
+#if NV_COUNTER_CACHE_SIZE > 0
+/* This is the RAM copy of the most recently incremented non-orderly NV counters. An increment only
+   writes NV when the value passes the reserved value, and then moves the reserved value
+   NV_COUNTER_RESERVE ahead. After a power loss the counter resumes from the reserved value. */
+EXTERN      NV_COUNTER_ENTRY s_nvCounterCache[NV_COUNTER_CACHE_SIZE];
+#endif
+
 /* Initial NV Index/evict object iterator value */
 #define     NV_REF_INIT     (NV_REF)0xFFFFFFFF
 #endif
@@ -1207,7 +1280,13 @@ EXTERN int               s_freeSessionSlots;
 
 /* The value of s_actionIoAllocation is the number of UINT64 values allocated. It is used to set the
    pointer for the response structure.  */
+#ifdef TPM_NUVOTON
+/* The NTC2 stream commands take and return NTC2_MAX_STREAM_BUFFER bytes, which needs more than the
+   768 UINT64 that the library commands use. */
+EXTERN UINT64   s_actionIoBuffer[1024];     // action I/O buffer
+#else
 EXTERN UINT64   s_actionIoBuffer[768];      // action I/O buffer
+#endif
 EXTERN UINT32   s_actionIoAllocation;       // number of UIN64 allocated for the action input
 					    // structure
 #endif // MEMORY_LIB_C
@@ -327,13 +327,17 @@
 // These macros determine if the values in this file are referenced or instanced.
 // Global.c defines GLOBAL_C so all the values in this file will be instanced in
 // Global.obj. For all other files that include this file, the values will simply
-// be external references. For constants, there can be an initializer.
+// be external references. For constants, there can be an initializer. The instanced
+// variables are part of the TPM instance state (INSTANCE_STATE) while constants use
+// EXTERN_CONST so that they stay in read-only memory.
 
 #ifdef GLOBAL_C
-#define EXTERN
+#define EXTERN          INSTANCE_STATE
+#define EXTERN_CONST    const
 #define INITIALIZER(_value_)  = _value_
 #else
-#define EXTERN  extern
+#define EXTERN          extern
+#define EXTERN_CONST    extern const
 #define INITIALIZER(_value_)
 #endif
 
@@ -341,7 +345,7 @@
 // 0x06 indicating an OID fallowed by an octet indicating the number of octets in the
 // rest of the OID. This allows a user of this OID to know how much/little to copy.
 #define MAKE_OID(NAME)							\
-    EXTERN  const BYTE OID##NAME[] INITIALIZER({OID##NAME##_VALUE})
+    EXTERN_CONST BYTE OID##NAME[] INITIALIZER({OID##NAME##_VALUE})
 
 /* This definition is moved from TpmProfile.h because it is not actually vendor- specific. It has to
    be the same size as the sequence parameter of a TPMS_CONTEXT and that is a UINT64. So, this is an
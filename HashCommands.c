@@ -222,8 +222,8 @@ TPM2_SequenceUpdate(
     // Get sequence object pointer
     object = HandleToObject(in->sequenceHandle);
     hashObject = (HASH_OBJECT *)object;
-    // Check that referenced object is a sequence object.
-    if(!ObjectIsSequence(object))
+    // Check that referenced object is a hash, HMAC, or event sequence object.
+    if(!ObjectIsSequence(object) || object->attributes.symSeq == SET)
 	return TPM_RCS_MODE + RC_SequenceUpdate_sequenceHandle;
     // Internal Data Update
     if(object->attributes.eventSeq == SET)
@@ -0,0 +1,557 @@
+/********************************************************************************/
+/*										*/
+/*			TPM Instance Context Support				*/
+/*            $Id: InstancePlat.c $						*/
+/*										*/
+/*  Licenses and Notices							*/
+/*										*/
+/*  1. Copyright Licenses:							*/
+/*										*/
+/*  - Trusted Computing Group (TCG) grants to the user of the source code in	*/
+/*    this specification (the "Source Code") a worldwide, irrevocable, 		*/
+/*    nonexclusive, royalty free, copyright license to reproduce, create 	*/
+/*    derivative works, distribute, display and perform the Source Code and	*/
+/*    derivative works thereof, and to grant others the rights granted herein.	*/
+/*										*/
+/*  - The TCG grants to the user of the other parts of the specification 	*/
+/*    (other than the Source Code) the rights to reproduce, distribute, 	*/
+/*    display, and perform the specification solely for the purpose of 		*/
+/*    developing products based on such documents.				*/
+/*										*/
+/*  2. Source Code Distribution Conditions:					*/
+/*										*/
+/*  - Redistributions of Source Code must retain the above copyright licenses, 	*/
+/*    this list of conditions and the following disclaimers.			*/
+/*										*/
+/*  - Redistributions in binary form must reproduce the above copyright 	*/
+/*    licenses, this list of conditions	and the following disclaimers in the 	*/
+/*    documentation and/or other materials provided with the distribution.	*/
+/*										*/
+/*  3. Disclaimers:								*/
+/*										*/
+/*  - THE COPYRIGHT LICENSES SET FORTH ABOVE DO NOT REPRESENT ANY FORM OF	*/
+/*  LICENSE OR WAIVER, EXPRESS OR IMPLIED, BY ESTOPPEL OR OTHERWISE, WITH	*/
+/*  RESPECT TO PATENT RIGHTS HELD BY TCG MEMBERS (OR OTHER THIRD PARTIES)	*/
+/*  THAT MAY BE NECESSARY TO IMPLEMENT THIS SPECIFICATION OR OTHERWISE.		*/
+/*  Contact TCG Administration (admin@trustedcomputinggroup.org) for 		*/
+/*  information on specification licensing rights available through TCG 	*/
+/*  membership agreements.							*/
+/*										*/
+/*  - THIS SPECIFICATION IS PROVIDED "AS IS" WITH NO EXPRESS OR IMPLIED 	*/
+/*    WARRANTIES WHATSOEVER, INCLUDING ANY WARRANTY OF MERCHANTABILITY OR 	*/
+/*    FITNESS FOR A PARTICULAR PURPOSE, ACCURACY, COMPLETENESS, OR 		*/
+/*    NONINFRINGEMENT OF INTELLECTUAL PROPERTY RIGHTS, OR ANY WARRANTY 		*/
+/*    OTHERWISE ARISING OUT OF ANY PROPOSAL, SPECIFICATION OR SAMPLE.		*/
+/*										*/
+/*  - Without limitation, TCG and its members and licensors disclaim all 	*/
+/*    liability, including liability for infringement of any proprietary 	*/
+/*    rights, relating to use of information in this specification and to the	*/
+/*    implementation of this specification, and TCG disclaims all liability for	*/
+/*    cost of procurement of substitute goods or services, lost profits, loss 	*/
+/*    of use, loss of data or any incidental, consequential, direct, indirect, 	*/
+/*    or special damages, whether under contract, tort, warranty or otherwise, 	*/
+/*    arising in any way out of use or reliance upon this specification or any 	*/
+/*    information herein.							*/
+/*										*/
+/*  (c) Copyright IBM Corp. and others, 2016 - 2026				*/
+/*										*/
+/********************************************************************************/
+
+/* C.16 InstancePlat.c */
+/* C.16.1. Description */
+/* This file allows one process to host several independent TPM instances. All of the TPM state
+   (Global.h) and the platform state (PlatformData.h) is instanced in the tpm_instance_state linker
+   section (see INSTANCE_STATE in TpmBuildSwitches.h). A TPM_INSTANCE holds a private copy of that
+   section. Selecting an instance saves the section into the previously selected instance and loads
+   it from the new one, so that the TPM code, the crypto library, and the code pages are shared
+   while the state is not. The copy is only made when the selected instance changes, so a stream of
+   commands to the same instance costs nothing extra. A change copies the whole section out and
+   the new one in, _plat__InstanceStateSize() bytes each way, so commands that alternate between
+   instances pay for both copies on each command. tpm_server -instances serves each instance on
+   ports of its own. The process resources of an instance, such as its NV file, are in the
+   tpm_instance_local section (INSTANCE_LOCAL) and are switched the same way. */
+/* The instance that is selected when the process starts is the default instance. It is the one
+   used by the simulator when no instance is selected, and it is never destroyed. */
+/* Only one instance can be selected at a time. A caller that runs instances from several threads
+   must serialize the selection and everything that is done with the selected instance. The ACT
+   ticks are the exception. They come from a thread of their own and go to every instance through
+   _plat__InstanceForEach(), which holds off the selection while it runs. */
+/* A snapshot is the instance state and the NV image of the selected instance in a file. Restoring
+   it, in this or in another process running the same build, puts the TPM back at the point where
+   the snapshot was taken, without manufacturing, starting up, or provisioning it again. The local
+   state is not part of a snapshot, so the restored instance keeps its own NV file, which is brought
+   up to date with the NV image of the snapshot. */
+/* C.16.2. Includes and locals */
+#define _GNU_SOURCE         // dl_iterate_phdr() in link.h
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Platform.h"
+
+#if INSTANCE_CONTEXT
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <link.h>
+#include <pthread.h>
+
+struct TPM_INSTANCE
+{
+    unsigned char   *state;     // copy of the instance and local state while not selected
+    TPM_INSTANCE    *next;      // next instance in the list that starts at the default instance
+};
+
+// Bounds of the instance state sections provided by the linker
+extern unsigned char    __start_tpm_instance_state[];
+extern unsigned char    __stop_tpm_instance_state[];
+extern unsigned char    __start_tpm_instance_local[];
+extern unsigned char    __stop_tpm_instance_local[];
+
+#define INSTANCE_STATE_START    (__start_tpm_instance_state)
+#define INSTANCE_STATE_SIZE						\
+    ((size_t)(__stop_tpm_instance_state - __start_tpm_instance_state))
+#define INSTANCE_LOCAL_START    (__start_tpm_instance_local)
+#define INSTANCE_LOCAL_SIZE						\
+    ((size_t)(__stop_tpm_instance_local - __start_tpm_instance_local))
+#define INSTANCE_SIZE           (INSTANCE_STATE_SIZE + INSTANCE_LOCAL_SIZE)
+
+#define INSTANCE_SNAPSHOT_MAGIC     0x54504d53      // "TPMS"
+#define INSTANCE_SNAPSHOT_VERSION   2
+/* A snapshot file is this header, the instance state, and the NV image, in host byte order. */
+typedef struct
+{
+    uint32_t         magic;
+    uint32_t         version;
+    uint32_t         stateSize;
+    uint32_t         nvSize;
+    uint64_t         stateAddress;      // where the instance state was, to move pointers into it
+    uint64_t         codeOffset;        // from the instance state to the code, the same in a build
+    uint64_t         layoutHash;        // InstanceLayoutHash() of the build that wrote it
+} INSTANCE_SNAPSHOT_HEADER;
+
+#define FNV_OFFSET_BASIS    0xcbf29ce484222325ULL
+#define FNV_PRIME           0x100000001b3ULL
+
+static TPM_INSTANCE      s_defaultInstance;
+static TPM_INSTANCE     *s_currentInstance = &s_defaultInstance;
+// Held while the instance state is swapped or read by _plat__InstanceForEach()
+static pthread_mutex_t   s_instanceLock = PTHREAD_MUTEX_INITIALIZER;
+// Image of the instance state as it is at process start. A new instance starts from this.
+static unsigned char    *s_pristineState;
+
+/* C.16.3. Functions */
+/* C.16.3.1. InstanceSave() */
+/* This function copies the instance state and the local state to a buffer of INSTANCE_SIZE
+   bytes. */
+static void
+InstanceSave(
+	     unsigned char   *to
+	     )
+{
+    memcpy(to, INSTANCE_STATE_START, INSTANCE_STATE_SIZE);
+    memcpy(to + INSTANCE_STATE_SIZE, INSTANCE_LOCAL_START, INSTANCE_LOCAL_SIZE);
+}
+/* C.16.3.2. InstanceLoad() */
+/* This function is the reverse of InstanceSave(). */
+static void
+InstanceLoad(
+	     const unsigned char     *from
+	     )
+{
+    memcpy(INSTANCE_STATE_START, from, INSTANCE_STATE_SIZE);
+    memcpy(INSTANCE_LOCAL_START, from + INSTANCE_STATE_SIZE, INSTANCE_LOCAL_SIZE);
+}
+/* C.16.3.3. InstanceCapturePristine() */
+/* This function runs before main() and saves the initial values of the instance state so that a
+   new instance starts out exactly as the default instance did when the process started. */
+static void InstanceCapturePristine(void) __attribute__((constructor));
+static void
+InstanceCapturePristine(
+			void
+			)
+{
+    s_pristineState = malloc(INSTANCE_SIZE);
+    if(s_pristineState != NULL)
+	InstanceSave(s_pristineState);
+}
+/* C.16.3.4. InstanceFindBuildId() */
+/* This dl_iterate_phdr() callback adds the GNU build ID of the program or library that holds the
+   instance state to the hash in data. It returns 1, which ends the iteration, for that object. */
+static int
+InstanceFindBuildId(
+		    struct dl_phdr_info     *info,
+		    size_t                   size,
+		    void                    *data
+		    )
+{
+    uint64_t                *hash = data;
+    uintptr_t                state = (uintptr_t)INSTANCE_STATE_START;
+    const ElfW(Nhdr)        *note;
+    const unsigned char     *at;
+    const unsigned char     *end;
+    const unsigned char     *id;
+    int                      found = 0;
+    int                      i;
+    uint32_t                 j;
+    //
+    NOT_REFERENCED(size);
+    // the state is in one of the loaded segments of its object
+    for(i = 0; i < info->dlpi_phnum && !found; i++)
+	found = info->dlpi_phdr[i].p_type == PT_LOAD
+		&& state >= info->dlpi_addr + info->dlpi_phdr[i].p_vaddr
+		&& state < (info->dlpi_addr + info->dlpi_phdr[i].p_vaddr
+			    + info->dlpi_phdr[i].p_memsz);
+    if(!found)
+	return 0;
+    for(i = 0; i < info->dlpi_phnum; i++)
+	{
+	    if(info->dlpi_phdr[i].p_type != PT_NOTE)
+		continue;
+	    at = (const unsigned char *)(info->dlpi_addr + info->dlpi_phdr[i].p_vaddr);
+	    end = at + info->dlpi_phdr[i].p_memsz;
+	    while(at + sizeof(*note) <= end)
+		{
+		    note = (const ElfW(Nhdr) *)at;
+		    id = at + sizeof(*note) + ((note->n_namesz + 3) & ~3);
+		    at = id + ((note->n_descsz + 3) & ~3);
+		    if(at > end || note->n_type != NT_GNU_BUILD_ID || note->n_namesz != 4
+		       || memcmp(note + 1, "GNU", 4) != 0)
+			continue;
+		    for(j = 0; j < note->n_descsz; j++)
+			*hash = (*hash ^ id[j]) * FNV_PRIME;
+		    return 1;
+		}
+	}
+    return 1;
+}
+/* C.16.3.5. InstanceLayoutHash() */
+/* The restored state is copied over the instance state as it is, so a snapshot can only be used
+   by the build that wrote it. This function hashes the build ID and the size of the instance
+   state with FNV-1a. Without a build ID only the size is hashed. */
+static uint64_t
+InstanceLayoutHash(
+		   void
+		   )
+{
+    uint64_t         hash = FNV_OFFSET_BASIS;
+    uint32_t         size = (uint32_t)INSTANCE_STATE_SIZE;
+    unsigned int     i;
+    //
+    dl_iterate_phdr(InstanceFindBuildId, &hash);
+    for(i = 0; i < sizeof(size); i++)
+	hash = (hash ^ ((size >> (8 * i)) & 0xff)) * FNV_PRIME;
+    return hash;
+}
+
+#endif // INSTANCE_CONTEXT
+
+/* C.16.3.6. _plat__InstanceStateSize() */
+/* This function returns the number of bytes of state that are switched for each instance. It is 0
+   when INSTANCE_CONTEXT is not enabled. */
+LIB_EXPORT uint32_t
+_plat__InstanceStateSize(
+			 void
+			 )
+{
+#if INSTANCE_CONTEXT
+    return (uint32_t)INSTANCE_SIZE;
+#else
+    return 0;
+#endif
+}
+
+/* C.16.3.7. _plat__InstanceCreate() */
+/* This function creates a new TPM instance. The instance starts in the state of a freshly started
+   simulator: powered off, with no NV contents. The caller selects the instance and then runs the
+   same power on, NV enable, and manufacture sequence as for the default instance. */
+/* Return Values Meaning */
+/* != NULL the new instance */
+/* NULL allocation failure or INSTANCE_CONTEXT not enabled */
+LIB_EXPORT TPM_INSTANCE *
+_plat__InstanceCreate(
+		      void
+		      )
+{
+#if INSTANCE_CONTEXT
+    TPM_INSTANCE        *instance;
+    //
+    if(s_pristineState == NULL)
+	return NULL;
+    instance = malloc(sizeof(TPM_INSTANCE));
+    if(instance == NULL)
+	return NULL;
+    instance->state = malloc(INSTANCE_SIZE);
+    if(instance->state == NULL)
+	{
+	    free(instance);
+	    return NULL;
+	}
+    memcpy(instance->state, s_pristineState, INSTANCE_SIZE);
+    pthread_mutex_lock(&s_instanceLock);
+    instance->next = s_defaultInstance.next;
+    s_defaultInstance.next = instance;
+    pthread_mutex_unlock(&s_instanceLock);
+    return instance;
+#else
+    return NULL;
+#endif
+}
+
+/* C.16.3.8. _plat__InstanceDestroy() */
+/* This function releases an instance created by _plat__InstanceCreate(). If the instance is
+   selected, the default instance is selected first. The saved state holds secrets (seeds, proofs,
+   DRBG state) so it is cleared before it is freed, and so is the NV image of the instance, which
+   is allocated outside the instance state. The NV file of the instance, if any, should be closed
+   with _plat__NVDisable() before the instance is destroyed. */
+LIB_EXPORT void
+_plat__InstanceDestroy(
+		       TPM_INSTANCE    *instance
+		       )
+{
+#if INSTANCE_CONTEXT
+    TPM_INSTANCE        *previous;
+    TPM_INSTANCE       **link;
+    //
+    if(instance == NULL || instance == &s_defaultInstance)
+	return;
+    previous = (instance == s_currentInstance) ? NULL : _plat__InstanceCurrent();
+    // Select the instance to reach its NV image, then leave it for good
+    if(_plat__InstanceSelect(instance) == 0)
+	_plat__NvMemoryFree();
+    _plat__InstanceSelect(previous);
+    pthread_mutex_lock(&s_instanceLock);
+    for(link = &s_defaultInstance.next; *link != NULL; link = &(*link)->next)
+	if(*link == instance)
+	    {
+		*link = instance->next;
+		break;
+	    }
+    pthread_mutex_unlock(&s_instanceLock);
+    memset(instance->state, 0, INSTANCE_SIZE);
+    free(instance->state);
+    free(instance);
+#else
+    NOT_REFERENCED(instance);
+#endif
+}
+
+/* C.16.3.9. _plat__InstanceSelect() */
+/* This function makes instance the target of all subsequent TPM and platform calls. A NULL
+   instance selects the default instance. */
+/* Return Values Meaning */
+/* 0 success */
+/* non-0 the default instance state could not be saved */
+LIB_EXPORT int
+_plat__InstanceSelect(
+		      TPM_INSTANCE    *instance
+		      )
+{
+#if INSTANCE_CONTEXT
+    if(instance == NULL)
+	instance = &s_defaultInstance;
+    if(instance == s_currentInstance)
+	return 0;
+    // The default instance only needs a save area once another instance is used
+    if(s_currentInstance->state == NULL)
+	{
+	    s_currentInstance->state = malloc(INSTANCE_SIZE);
+	    if(s_currentInstance->state == NULL)
+		return 1;
+	}
+    pthread_mutex_lock(&s_instanceLock);
+    InstanceSave(s_currentInstance->state);
+    InstanceLoad(instance->state);
+    s_currentInstance = instance;
+    pthread_mutex_unlock(&s_instanceLock);
+    return 0;
+#else
+    return (instance == NULL) ? 0 : 1;
+#endif
+}
+
+/* C.16.3.10. _plat__InstanceCurrent() */
+/* This function returns the selected instance. NULL indicates the default instance. */
+LIB_EXPORT TPM_INSTANCE *
+_plat__InstanceCurrent(
+		       void
+		       )
+{
+#if INSTANCE_CONTEXT
+    return (s_currentInstance == &s_defaultInstance) ? NULL : s_currentInstance;
+#else
+    return NULL;
+#endif
+}
+
+/* C.16.3.11. _plat__InstanceSnapshot() */
+/* This function writes a snapshot of the selected instance to fileName. It is called between
+   commands, with the NV image loaded. The snapshot holds the primary seeds, so the file is only
+   readable by its owner, and a symbolic link is not followed to write it. */
+/* Return Values Meaning */
+/* 0 success */
+/* non-0 the file could not be written, or INSTANCE_CONTEXT is not enabled */
+LIB_EXPORT int
+_plat__InstanceSnapshot(
+			const char      *fileName
+			)
+{
+#if INSTANCE_CONTEXT
+    INSTANCE_SNAPSHOT_HEADER     header;
+    FILE                        *file;
+    int                          fd;
+    int                          OK;
+    //
+    if(s_NV == NULL)
+	return 1;
+    memset(&header, 0, sizeof(header));
+    header.magic = INSTANCE_SNAPSHOT_MAGIC;
+    header.version = INSTANCE_SNAPSHOT_VERSION;
+    header.stateSize = (uint32_t)INSTANCE_STATE_SIZE;
+    header.nvSize = s_NvSize;
+    header.stateAddress = (uintptr_t)INSTANCE_STATE_START;
+    header.codeOffset = (uintptr_t)_plat__InstanceSnapshot - (uintptr_t)INSTANCE_STATE_START;
+    header.layoutHash = InstanceLayoutHash();
+    fd = open(fileName, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, 0600);
+    // an existing file keeps its mode otherwise
+    if(fd >= 0 && fchmod(fd, 0600) != 0)
+	{
+	    close(fd);
+	    return 1;
+	}
+    file = (fd >= 0) ? fdopen(fd, "wb") : NULL;
+    if(file == NULL)
+	{
+	    if(fd >= 0)
+		close(fd);
+	    return 1;
+	}
+    pthread_mutex_lock(&s_instanceLock);
+    OK = fwrite(&header, sizeof(header), 1, file) == 1
+	 && fwrite(INSTANCE_STATE_START, INSTANCE_STATE_SIZE, 1, file) == 1
+	 && fwrite(s_NV, s_NvSize, 1, file) == 1;
+    pthread_mutex_unlock(&s_instanceLock);
+    OK = (fclose(file) == 0) && OK;
+    return OK ? 0 : 1;
+#else
+    NOT_REFERENCED(fileName);
+    return 1;
+#endif
+}
+
+/* C.16.3.12. _plat__InstanceRestore() */
+/* This function replaces the state of the selected instance with the snapshot in fileName. It
+   enables NV if it is not, adopts the NV size of the snapshot if the NV image is not allocated
+   yet, and writes the NV image of the snapshot to the NV file. Nothing is changed when the
+   snapshot cannot be used. The header, the layout hash, and the length of the file are all
+   checked before anything is copied into the instance state. */
+/* The TPM state holds a few pointers into the program, such as the hash methods of a sequence
+   object. delta is the distance that the program moved since the snapshot was taken, which
+   TPM_Rebase() applies to them. */
+/* Return Values Meaning */
+/* 0 success */
+/* non-0 the file is not a snapshot of this build, the NV sizes differ, or NV can not be enabled
+   or written */
+LIB_EXPORT int
+_plat__InstanceRestore(
+		       const char      *fileName,
+		       intptr_t        *delta
+		       )
+{
+#if INSTANCE_CONTEXT
+    INSTANCE_SNAPSHOT_HEADER     header;
+    FILE                        *file;
+    unsigned char               *state = NULL;
+    unsigned char               *nv = NULL;
+    int                          OK;
+    //
+    file = fopen(fileName, "rb");
+    if(file == NULL)
+	return 1;
+    OK = fread(&header, sizeof(header), 1, file) == 1
+	 && header.magic == INSTANCE_SNAPSHOT_MAGIC
+	 && header.version == INSTANCE_SNAPSHOT_VERSION
+	 && header.stateSize == INSTANCE_STATE_SIZE
+	 && header.codeOffset == ((uintptr_t)_plat__InstanceSnapshot
+				  - (uintptr_t)INSTANCE_STATE_START)
+	 && header.layoutHash == InstanceLayoutHash()
+	 && (header.nvSize == _plat__NvMemorySize() || _plat__NvSetSize(header.nvSize) == 0);
+    if(OK)
+	{
+	    state = malloc(header.stateSize);
+	    nv = malloc(header.nvSize);
+	    OK = state != NULL && nv != NULL
+		 && fread(state, header.stateSize, 1, file) == 1
+		 && fread(nv, header.nvSize, 1, file) == 1
+		 && fgetc(file) == EOF;
+	}
+    fclose(file);
+    // NV is enabled before the state is replaced, since enabling it resets the simulated errors
+    OK = OK && _plat__NVEnable(NULL) >= 0;
+    if(OK)
+	{
+	    pthread_mutex_lock(&s_instanceLock);
+	    memcpy(INSTANCE_STATE_START, state, INSTANCE_STATE_SIZE);
+	    pthread_mutex_unlock(&s_instanceLock);
+	    // The TPM time goes on from the snapshot, against the clock of this process
+	    s_lastSystemTime = 0;
+	    OK = _plat__NvMemoryWrite(0, header.nvSize, nv) && _plat__NvCommit() == 0;
+	    *delta = (intptr_t)((uintptr_t)INSTANCE_STATE_START - (uintptr_t)header.stateAddress);
+	}
+    // both hold secrets
+    if(state != NULL)
+	memset(state, 0, header.stateSize);
+    if(nv != NULL)
+	memset(nv, 0, header.nvSize);
+    free(state);
+    free(nv);
+    return OK ? 0 : 1;
+#else
+    NOT_REFERENCED(fileName);
+    NOT_REFERENCED(delta);
+    return 1;
+#endif
+}
+
+/* C.16.3.13. _plat__InstanceForEach() */
+/* This function calls function for every instance, the default instance as NULL. No instance is
+   selected, created, or destroyed until it returns, so function can be run from another thread
+   than the one that runs the instances. function reaches the state of an instance with
+   _plat__InstanceVariable() and must not select an instance. */
+LIB_EXPORT void
+_plat__InstanceForEach(
+		       void (*function)(TPM_INSTANCE *instance)
+		       )
+{
+#if INSTANCE_CONTEXT
+    TPM_INSTANCE        *instance;
+    //
+    pthread_mutex_lock(&s_instanceLock);
+    for(instance = &s_defaultInstance; instance != NULL; instance = instance->next)
+	function((instance == &s_defaultInstance) ? NULL : instance);
+    pthread_mutex_unlock(&s_instanceLock);
+#else
+    function(NULL);
+#endif
+}
+
+/* C.16.3.14. _plat__InstanceVariable() */
+/* This function returns where variable, which is in the instance state, is for instance. That is
+   variable itself for the selected instance and its place in the saved state for the others. It is
+   only used by the function given to _plat__InstanceForEach(). */
+LIB_EXPORT void *
+_plat__InstanceVariable(
+			TPM_INSTANCE    *instance,
+			void            *variable
+			)
+{
+#if INSTANCE_CONTEXT
+    if(instance == NULL)
+	instance = &s_defaultInstance;
+    if(instance == s_currentInstance)
+	return variable;
+    return instance->state + ((unsigned char *)variable - INSTANCE_STATE_START);
+#else
+    NOT_REFERENCED(instance);
+    return variable;
+#endif
+}
@@ -183,3 +183,40 @@ TpmEndSimulation(
 #endif
 #endif // SIMULATION
 }
+/* 9.9.3.4 TPM_Rebase() */
+/* The simulator calls this function after the TPM state was loaded from a snapshot (see
+   _plat__InstanceRestore()). The TPM state holds a few pointers to constants and functions of the
+   program, which moved by delta if the snapshot was taken in another process. They are moved
+   along. The NV index cache, which points into the state, is dropped, and so are the cached
+   symmetric key schedules, which hold pointers to the objects, to the code, and into the crypto
+   library, which does not move by delta. */
+LIB_EXPORT void
+TPM_Rebase(
+	   intptr_t         delta
+	   )
+{
+    NvIndexCacheInit();
+    CryptSymFlushKeySchedules(NULL);
+    ObjectRebase(delta);
+}
+/* 9.9.3.5 TPM_Idle() */
+/* The simulator calls this function when there is no command to process. It does work that would
+   otherwise be done while processing a later command. */
+LIB_EXPORT void
+TPM_Idle(
+	 void
+	 )
+{
+    if(TPM_IdlePending())
+	CryptRandPoolRefill();
+}
+/* 9.9.3.6 TPM_IdlePending() */
+/* This function returns non-zero if TPM_Idle() has work to do. A simulator that runs several TPM
+   instances uses it to call TPM_Idle() only for the instances that need it. */
+LIB_EXPORT int
+TPM_IdlePending(
+		void
+		)
+{
+    return TPMIsStarted() && !g_inFailureMode && CryptRandPoolLow();
+}
@@ -62,6 +62,7 @@
 #ifndef MANUFACTURE_FP_H
 #define MANUFACTURE_FP_H
 
+#include <stdint.h>
 #include "CompilerDependencies.h"	/* kgold */
 
 LIB_EXPORT int
@@ -76,6 +77,18 @@ LIB_EXPORT void
 TpmEndSimulation(
 		 void
 		 );
+LIB_EXPORT void
+TPM_Rebase(
+	   intptr_t         delta
+	   );
+LIB_EXPORT void
+TPM_Idle(
+	 void
+	 );
+LIB_EXPORT int
+TPM_IdlePending(
+		void
+		);
 
 
 #endif
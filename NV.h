@@ -104,10 +104,17 @@ typedef struct {
     UINT32      size;
     TPM_HANDLE  handle;
 } NV_ENTRY_HEADER;
+/* The entries in the NV dynamic area are allocated in slabs that are a multiple of NV_SLAB_GRANULE
+   octets, so that the slab of a deleted entity can be reused by a new entity of the same size
+   class without moving anything. A free slab keeps its size and has NV_SLAB_FREE as its handle. */
+#define NV_SLAB_GRANULE     32
+#define NV_SLAB_SIZE(size)						\
+    (((size) + NV_SLAB_GRANULE - 1) & ~(NV_SLAB_GRANULE - 1))
+#define NV_SLAB_FREE        TPM_RH_UNASSIGNED
 #define NV_EVICT_OBJECT_SIZE						\
-    (sizeof(UINT32)  + sizeof(TPM_HANDLE) + sizeof(OBJECT))
+    NV_SLAB_SIZE(sizeof(UINT32)  + sizeof(TPM_HANDLE) + sizeof(OBJECT))
 #define NV_INDEX_COUNTER_SIZE						\
-    (sizeof(UINT32) + sizeof(NV_INDEX) + sizeof(UINT64))
+    NV_SLAB_SIZE(sizeof(UINT32) + sizeof(NV_INDEX) + sizeof(UINT64))
 #define NV_RAM_INDEX_COUNTER_SIZE			\
     (sizeof(NV_RAM_HEADER) + sizeof(UINT64))
 typedef struct {
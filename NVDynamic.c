@@ -101,44 +101,263 @@ NvNext(
 	*handle = header.handle;
     return currentAddr;
 }
-/* 8.4.3.2 NvNextByType() */
-/* This function returns a reference to the next NV entry of the desired type */
-/* Return Values Meaning */
-/* 0 end of list */
-/* != 0 the next entry of the indicated type */
-static NV_REF
-NvNextByType(
-	     TPM_HANDLE      *handle,        // OUT: the handle of the found type or 0
-	     NV_REF          *iter,          // IN: the iterator
-	     TPM_HT           type           // IN: the handle type to look for
+/* 8.4.3.1.1 NvHandleSlot() */
+/* This function returns the home slot of a handle in the handle index. */
+static UINT32
+NvHandleSlot(
+	     TPM_HANDLE       handle         // IN: the handle to hash
 	     )
 {
-    NV_REF           addr;
-    TPM_HANDLE       nvHandle = 0;
-    while((addr = NvNext(iter, &nvHandle)) != 0)
+    // Handles of one type only differ in their low-order bits so spread them
+    // over the table before reducing
+    return (UINT32)((handle * 0x9E3779B1u) % NV_HANDLE_INDEX_SIZE);
+}
+/* 8.4.3.1.2 NvHandleIndexFind() */
+/* This function returns the slot in the handle index that holds handle or, if the handle is not in
+   the index, the empty slot that ends its probe sequence. */
+static UINT32
+NvHandleIndexFind(
+		  TPM_HANDLE       handle         // IN: the handle to look for
+		  )
+{
+    UINT32          slot = NvHandleSlot(handle);
+    // The index is never more than half full so there is always an empty slot
+    // to stop the probe
+    while(s_nvHandleIndex[slot].handle != 0
+	  && s_nvHandleIndex[slot].handle != handle)
+	slot = (slot + 1) % NV_HANDLE_INDEX_SIZE;
+    return slot;
+}
+/* 8.4.3.1.2.1 NvHandleDirectoryFind() */
+/* This function returns the position of the first handle in the handle directory that is not less
+   than handle. */
+static UINT32
+NvHandleDirectoryFind(
+		      TPM_HANDLE       handle         // IN: the handle to look for
+		      )
+{
+    UINT32          low = 0;
+    UINT32          high = s_nvHandleCount;
+    UINT32          mid;
+    //
+    while(low < high)
+	{
+	    mid = low + (high - low) / 2;
+	    if(s_nvHandleDirectory[mid] < handle)
+		low = mid + 1;
+	    else
+		high = mid;
+	}
+    return low;
+}
+/* 8.4.3.1.3 NvHandleIndexInsert() */
+/* This function adds the entry for handle to the handle index and to the handle directory. */
+static void
+NvHandleIndexInsert(
+		    TPM_HANDLE       handle,        // IN: the handle of the entity
+		    NV_REF           ref            // IN: the reference to the entity
+		    )
+{
+    UINT32          slot = NvHandleIndexFind(handle);
+    UINT32          position;
+    if(s_nvHandleIndex[slot].handle == 0)
 	{
-	    // addr: the address of the location containing the handle of the value
-	    // iter: the next location.
-	    if(HandleGetType(nvHandle) == type)
+	    pAssert(s_nvHandleCount < NV_ENTITIES_MAX);
+	    position = NvHandleDirectoryFind(handle);
+	    MemoryCopy(&s_nvHandleDirectory[position + 1], &s_nvHandleDirectory[position],
+		       (s_nvHandleCount - position) * sizeof(TPM_HANDLE));
+	    s_nvHandleDirectory[position] = handle;
+	    s_nvHandleCount++;
+	}
+    s_nvHandleIndex[slot].handle = handle;
+    s_nvHandleIndex[slot].ref = ref;
+}
+/* 8.4.3.1.4 NvHandleIndexRemove() */
+/* This function removes the entry for handle from the handle index and the handle directory. The
+   index entries that follow it in the probe sequence are shifted back so that no tombstones are
+   needed. */
+static void
+NvHandleIndexRemove(
+		    TPM_HANDLE       handle         // IN: the handle to remove
+		    )
+{
+    UINT32          hole = NvHandleIndexFind(handle);
+    UINT32          next = hole;
+    UINT32          home;
+    UINT32          position;
+    //
+    if(s_nvHandleIndex[hole].handle == 0)
+	return;
+    position = NvHandleDirectoryFind(handle);
+    s_nvHandleCount--;
+    MemoryCopy(&s_nvHandleDirectory[position], &s_nvHandleDirectory[position + 1],
+	       (s_nvHandleCount - position) * sizeof(TPM_HANDLE));
+    for(;;)
+	{
+	    next = (next + 1) % NV_HANDLE_INDEX_SIZE;
+	    if(s_nvHandleIndex[next].handle == 0)
 		break;
+	    home = NvHandleSlot(s_nvHandleIndex[next].handle);
+	    // Move the entry into the hole unless its home slot lies cyclically
+	    // in (hole, next]
+	    if((hole < next) ? (home <= hole || home > next)
+	       : (home <= hole && home > next))
+		{
+		    s_nvHandleIndex[hole] = s_nvHandleIndex[next];
+		    hole = next;
+		}
+	}
+    s_nvHandleIndex[hole].handle = 0;
+}
+/* 8.4.3.1.5 NvFreeSlabAdd() */
+/* This function adds a free slab to the free list. */
+/* Return Values Meaning */
+/* TRUE the slab was added */
+/* FALSE the free list is full */
+static BOOL
+NvFreeSlabAdd(
+	      NV_REF           ref,           // IN: the start of the slab
+	      UINT32           size           // IN: the size of the slab
+	      )
+{
+    if(s_nvFreeCount >= NV_ENTITIES_MAX)
+	return FALSE;
+    s_nvFreeList[s_nvFreeCount].ref = ref;
+    s_nvFreeList[s_nvFreeCount].size = size;
+    s_nvFreeCount++;
+    s_nvFreeBytes += size;
+    return TRUE;
+}
+/* 8.4.3.1.6 NvFreeSlabTake() */
+/* This function removes a free slab from the free list. If end is zero, the slab is one of exactly
+   size octets. Otherwise it is the one that ends at end. */
+/* Return Values Meaning */
+/* 0 there is no such slab */
+/* != 0 the start of the slab */
+static NV_REF
+NvFreeSlabTake(
+	       UINT32           size,          // IN: the size of the slab
+	       NV_REF           end            // IN: the end of the slab, or 0
+	       )
+{
+    UINT32          i;
+    NV_REF          ref;
+    //
+    for(i = 0; i < s_nvFreeCount; i++)
+	{
+	    if((end == 0) ? (s_nvFreeList[i].size == size)
+	       : (s_nvFreeList[i].ref + s_nvFreeList[i].size == end))
+		{
+		    ref = s_nvFreeList[i].ref;
+		    s_nvFreeBytes -= s_nvFreeList[i].size;
+		    s_nvFreeList[i] = s_nvFreeList[--s_nvFreeCount];
+		    return ref;
+		}
+	}
+    return 0;
+}
+/* 8.4.3.1.7 NvHandleIndexRebuild() */
+/* This function rebuilds the handle index, the free list and the cached end-of-list reference from
+   the NV image. A free slab that does not fit in the free list is not reused until the list is
+   compacted. */
+static void
+NvHandleIndexRebuild(
+		     void
+		     )
+{
+    NV_REF          iter = NV_REF_INIT;
+    NV_REF          currentAddr;
+    TPM_HANDLE      handle;
+    //
+    MemorySet(s_nvHandleIndex, 0, sizeof(s_nvHandleIndex));
+    s_nvHandleCount = 0;
+    s_nvFreeCount = 0;
+    s_nvFreeBytes = 0;
+    while((currentAddr = NvNext(&iter, &handle)) != 0)
+	{
+	    // NvNext() has moved the iterator to the next entry
+	    if(handle == NV_SLAB_FREE)
+		NvFreeSlabAdd(currentAddr - sizeof(UINT32),
+			      iter - (currentAddr - sizeof(UINT32)));
+	    else
+		NvHandleIndexInsert(handle, currentAddr);
 	}
+    // NvNext() leaves the iterator pointing at the end-of-list marker
+    s_nvListEnd = iter;
+    s_nvHandleIndexValid = TRUE;
+}
+/* 8.4.3.1.8 NvHandleIndexNext() */
+/* This function is used to iterate through the entities of one type in handle order. *slot needs
+   to be initialized to 0. It returns the reference to the next entity of the indicated type, or 0
+   when there are no more. */
+static NV_REF
+NvHandleIndexNext(
+		  UINT32          *slot,          // IN/OUT: the directory iterator
+		  TPM_HT           type,          // IN: the handle type to look for
+		  TPM_HANDLE      *handle         // OUT: the handle of the entity
+		  )
+{
+    TPM_HANDLE          nextHandle;
+    //
+    if(!s_nvHandleIndexValid)
+	NvHandleIndexRebuild();
+    // Start at the first handle of the type
+    if(*slot == 0)
+	*slot = NvHandleDirectoryFind((TPM_HANDLE)type << HR_SHIFT);
+    if(*slot >= s_nvHandleCount
+       || HandleGetType(s_nvHandleDirectory[*slot]) != type)
+	return 0;
+    nextHandle = s_nvHandleDirectory[(*slot)++];
     if(handle != NULL)
-	*handle = nvHandle;
-    return addr;
+	*handle = nextHandle;
+    return s_nvHandleIndex[NvHandleIndexFind(nextHandle)].ref;
 }
-/* 8.4.3.3 NvNextIndex() */
-/* This function returns the reference to the next NV Index entry.  A value of 0 indicates the end
-   of the list. */
+/* 8.4.3.1.9 NvCapGetHandles() */
+/* This function returns the handles of the entities of the type of handle, starting at handle, in
+   ascending order. */
 /* Return Values Meaning */
-/* 0 end of list */
-/* != 0 the next */
-#define NvNextIndex(handle, iter)		\
-    NvNextByType(handle, iter, TPM_HT_NV_INDEX)
-/*     8.4.3.4 NvNextEvict() */
-/* This function returns the offset in NV of the next evict object entry.  A value of 0 indicates
-   the end of the list. */
-#define NvNextEvict(handle, iter)			\
-    NvNextByType(handle, iter, TPM_HT_PERSISTENT)
+/* YES if there are more handles available */
+/* NO all the available handles has been returned */
+static TPMI_YES_NO
+NvCapGetHandles(
+		TPM_HANDLE       handle,        // IN: start handle
+		UINT32           count,         // IN: maximum number of returned handles
+		TPML_HANDLE     *handleList     // OUT: list of handle
+		)
+{
+    TPM_HT          type = HandleGetType(handle);
+    UINT32          position;
+    //
+    if(!s_nvHandleIndexValid)
+	NvHandleIndexRebuild();
+    // Initialize output handle list
+    handleList->count = 0;
+    // The maximum count of handles we may return is MAX_CAP_HANDLES
+    if(count > MAX_CAP_HANDLES) count = MAX_CAP_HANDLES;
+    // Copy the run of handles of the type that starts at handle
+    for(position = NvHandleDirectoryFind(handle);
+	position < s_nvHandleCount
+	    && HandleGetType(s_nvHandleDirectory[position]) == type;
+	position++)
+	{
+	    if(handleList->count == count)
+		return YES;
+	    handleList->handle[handleList->count++] = s_nvHandleDirectory[position];
+	}
+    return NO;
+}
+/* 8.4.3.1.10 NvCapGetNumber() */
+/* This function returns the number of entities of a type. */
+static UINT32
+NvCapGetNumber(
+	       TPM_HT           type           // IN: the handle type to count
+	       )
+{
+    if(!s_nvHandleIndexValid)
+	NvHandleIndexRebuild();
+    return NvHandleDirectoryFind((TPM_HANDLE)(type + 1) << HR_SHIFT)
+	- NvHandleDirectoryFind((TPM_HANDLE)type << HR_SHIFT);
+}
 /*     8.4.3.5 NvGetEnd() */
 /* Function to find the end of the NV dynamic data list */
 static NV_REF
@@ -146,11 +365,9 @@ NvGetEnd(
 	 void
 	 )
 {
-    NV_REF          iter = NV_REF_INIT;
-    NV_REF          currentAddr;
-    // Scan until the next address is 0
-    while((currentAddr = NvNext(&iter, NULL)) != 0);
-    return iter;
+    if(!s_nvHandleIndexValid)
+	NvHandleIndexRebuild();
+    return s_nvListEnd;
 }
 /* 8.4.3.6 NvGetFreeBytes */
 /* This function returns the number of free octets in NV space. */
@@ -163,7 +380,44 @@ NvGetFreeBytes(
     // that is larger than s_evictNvEnd. This is because there is always a 'stop'
     // word in the NV memory that terminates the search for the end before the
     // value can go past s_evictNvEnd.
-    return s_evictNvEnd - NvGetEnd();
+    NV_REF          end = NvGetEnd();
+    // The free slabs count as well because NvAdd() can compact the list to
+    // gather them at the end
+    return s_evictNvEnd - end + s_nvFreeBytes;
+}
+/* 8.4.3.6.1 NvCompact() */
+/* This function moves the entities in the NV dynamic area over the free slabs, so that all of the
+   free space is at the end of the list. It is only needed when the free space is too scattered for
+   a new entity. */
+static void
+NvCompact(
+	  void
+	  )
+{
+    NV_REF           src = NV_USER_DYNAMIC;
+    NV_REF           dst = NV_USER_DYNAMIC;
+    NV_ENTRY_HEADER  header;
+    //
+    for(;; src += header.size)
+	{
+	    NvRead(&header, src, sizeof(NV_ENTRY_HEADER));
+	    if(header.size == 0)
+		break;
+	    if(header.handle != NV_SLAB_FREE)
+		{
+		    if(dst != src)
+			_plat__NvMemoryMove(src, dst, header.size);
+		    dst += header.size;
+		}
+	}
+    if(dst != src)
+	{
+	    NvWriteNvListEnd(dst);
+	    _plat__NvMemoryClear(dst + sizeof(NV_LIST_TERMINATOR), src - dst);
+	}
+    // The entities have moved, including the one in the NV Index cache
+    NvHandleIndexRebuild();
+    NvIndexCacheInit();
 }
 /* 8.4.3.7 NvTestSpace() */
 /* This function will test if there is enough space to add a new entity. */
@@ -178,8 +432,11 @@ NvTestSpace(
 	    )
 {
     UINT32      remainBytes = NvGetFreeBytes();
-    UINT32      reserved = sizeof(UINT32)       // size of the forward pointer
-			   + sizeof(NV_LIST_TERMINATOR);
+    UINT32      reserved = sizeof(NV_LIST_TERMINATOR);
+    // The entity is stored in a slab with its size
+    size = NV_SLAB_SIZE(sizeof(UINT32) + size);
+    if(s_nvHandleCount >= NV_ENTITIES_MAX)
+	return FALSE;
     // Do a compile time sanity check on the setting for NV_MEMORY_SIZE
 #if NV_MEMORY_SIZE < 1024
 #error "NV_MEMORY_SIZE probably isn't large enough"
@@ -255,9 +512,23 @@ NvAdd(
 {
     NV_REF          newAddr;        // IN: where the new entity will start
     NV_REF          nextAddr;
+    UINT32          entrySize;
     RETURN_IF_NV_IS_NOT_AVAILABLE;
-    // Get the end of data list
-    newAddr = NvGetEnd();
+    entrySize = NV_SLAB_SIZE(sizeof(UINT32)
+			     + ((handle != TPM_RH_UNASSIGNED) ? sizeof(TPM_HANDLE) : 0)
+			     + totalSize);
+    // Reuse a free slab of the same size. Otherwise, take a new slab at the end of
+    // the list, after compacting the list if the free space is scattered.
+    newAddr = NvFreeSlabTake(entrySize, 0);
+    if(newAddr == 0)
+	{
+	    if(s_evictNvEnd - NvGetEnd() < entrySize + sizeof(NV_LIST_TERMINATOR))
+		NvCompact();
+	    newAddr = NvGetEnd();
+	    // Write the list terminator
+	    s_nvListEnd = newAddr + entrySize;
+	    NvWriteNvListEnd(s_nvListEnd);
+	}
     // Step over the forward pointer
     nextAddr = newAddr + sizeof(UINT32);
     // Optionally write the handle. For indexes, the handle is TPM_RH_UNASSIGNED
@@ -269,19 +540,18 @@ NvAdd(
 	}
     // Write entity data
     NvWrite((UINT32)nextAddr, bufferSize, entity);
-    // Advance the pointer by the amount of the total
-    nextAddr += totalSize;
-    // Finish by writing the link value
-    // Write the next offset (relative addressing)
-    totalSize = nextAddr - newAddr;
-    // Write link value
-    NvWrite((UINT32)newAddr, sizeof(UINT32), &totalSize);
-    // Write the list terminator
-    NvWriteNvListEnd(nextAddr);
+    // Finish by writing the link value (relative addressing)
+    NvWrite((UINT32)newAddr, sizeof(UINT32), &entrySize);
+    // For an index, the handle is the first element of the NV_INDEX
+    if(handle == TPM_RH_UNASSIGNED)
+	NvRead(&handle, newAddr + sizeof(UINT32), sizeof(TPM_HANDLE));
+    NvHandleIndexInsert(handle, newAddr + sizeof(UINT32));
     return TPM_RC_SUCCESS;
 }
 /* 8.4.3.10 NvDelete() */
-/* This function is used to delete an NV Index or persistent object from NV memory. */
+/* This function is used to delete an NV Index or persistent object from NV memory. The entry is
+   cleared and left in place as a free slab, so nothing else moves. If it is the last entry, it is
+   released, together with any free slabs before it, by moving the end of the list. */
 static TPM_RC
 NvDelete(
 	 NV_REF           entityRef      // IN: reference to entity to be deleted
@@ -291,32 +561,38 @@ NvDelete(
     // adjust entityAddr to back up and point to the forward pointer
     NV_REF          entryRef = entityRef - sizeof(UINT32);
     NV_REF          endRef = NvGetEnd();
-    NV_REF          nextAddr; // address of the next entry
+    NV_REF          freeRef;
+    TPM_HANDLE      handle;
+    TPM_HANDLE      freeHandle = NV_SLAB_FREE;
     RETURN_IF_NV_IS_NOT_AVAILABLE;
-    // Get the offset of the next entry. That is, back up and point to the size
-    // field of the entry
+    // Get the size of the entry. That is, back up and point to the size field of
+    // the entry
     NvRead(&entrySize, entryRef, sizeof(UINT32));
-    // The next entry after the one being deleted is at a relative offset
-    // from the current entry
-    nextAddr = entryRef + entrySize;
-    // If this is not the last entry, move everything up
-    if(nextAddr < endRef)
+    NvRead(&handle, entityRef, sizeof(TPM_HANDLE));
+    NvHandleIndexRemove(handle);
+    if(entryRef + entrySize == endRef)
 	{
-	    pAssert(nextAddr > entryRef);
-	    _plat__NvMemoryMove(nextAddr,
-				entryRef,
-				(endRef - nextAddr));
+	    s_nvListEnd = entryRef;
+	    while((freeRef = NvFreeSlabTake(0, s_nvListEnd)) != 0)
+		s_nvListEnd = freeRef;
+	    // Write the end marker, and clear the reclaimed memory after it. This
+	    // will automatically update the NV value for maxCounter
+	    // NOTE: This is the call that sets flag to cause NV to be updated
+	    NvWriteNvListEnd(s_nvListEnd);
+	    _plat__NvMemoryClear(s_nvListEnd + sizeof(NV_LIST_TERMINATOR),
+				 endRef - s_nvListEnd);
+	}
+    else
+	{
+	    // Mark the slab free and clear its contents
+	    NvWrite(entityRef, sizeof(TPM_HANDLE), &freeHandle);
+	    _plat__NvMemoryClear(entityRef + sizeof(TPM_HANDLE),
+				 entrySize - sizeof(NV_ENTRY_HEADER));
+	    // Rewrite the end marker with the current value of maxCounter
+	    NvWriteNvListEnd(endRef);
+	    if(!NvFreeSlabAdd(entryRef, entrySize))
+		NvCompact();
 	}
-    // The end of the used space is now moved up by the amount of space we just
-    // reclaimed
-    endRef -= entrySize;
-    // Write the end marker, and make the new end equal to the first byte after
-    // the just added end value. This will automatically update the NV value for
-    // maxCounter
-    // NOTE: This is the call that sets flag to cause NV to be updated
-    endRef = NvWriteNvListEnd(endRef);
-    // Clear the reclaimed memory
-    _plat__NvMemoryClear(endRef, entrySize);
     return TPM_RC_SUCCESS;
 }
 /* 8.4.4 RAM-based NV Index Data Access Functions */
@@ -730,6 +1006,131 @@ NvIndexCacheInit(
     s_cachedNvIndex.publicArea.nvIndex = TPM_RH_UNASSIGNED;
     return;
 }
+/* 8.4.5.5.1 NvHandleIndexInit() */
+/* This function is called when the NV image has been loaded or replaced. It discards the handle
+   index and the cached end-of-list reference so that they are rebuilt from NV on their next use. */
+void
+NvHandleIndexInit(
+		  void
+		  )
+{
+    s_nvHandleIndexValid = FALSE;
+    return;
+}
+#if NV_COUNTER_CACHE_SIZE > 0
+/* 8.4.5.5.2 NvCounterCacheFind() */
+/* This function returns the counter cache entry for handle, or NULL if the counter is not in the
+   cache. A handle of zero finds an unused entry. */
+static NV_COUNTER_ENTRY *
+NvCounterCacheFind(
+		   TPM_HANDLE       handle         // IN: the handle of the counter
+		   )
+{
+    UINT32          i;
+    //
+    for(i = 0; i < NV_COUNTER_CACHE_SIZE; i++)
+	{
+	    if(s_nvCounterCache[i].handle == handle)
+		return &s_nvCounterCache[i];
+	}
+    return NULL;
+}
+/* 8.4.5.5.3 NvCounterCacheWrite() */
+/* This function sets the value of a non-orderly counter that has been written. The value is kept
+   in RAM, and NV is only written when the value passes the value reserved in NV. If the cache is
+   full, or if TPM2_Shutdown() has already saved the cached counters, the value is written to NV
+   directly. */
+/* Error Returns Meaning */
+/* TPM_RC_NV_RATE NV is rate limiting so retry */
+/* TPM_RC_NV_UNAVAILABLE NV is not available */
+static TPM_RC
+NvCounterCacheWrite(
+		    NV_INDEX        *nvIndex,       // IN: the description of the index
+		    UINT64           value          // IN: the new counter value
+		    )
+{
+    NV_COUNTER_ENTRY    *entry = NvCounterCacheFind(nvIndex->publicArea.nvIndex);
+    BYTE                 bytes[8];
+    UINT64               reserved;
+    TPM_RC               result;
+    //
+    // After TPM2_Shutdown(), nothing saves the RAM value again before the next startup, so the
+    // value is written through to keep the shutdown orderly for this counter
+    if(NV_IS_ORDERLY)
+	{
+	    UINT64_TO_BYTE_ARRAY(value, bytes);
+	    result = NvWriteIndexData(nvIndex, 0, 8, bytes);
+	    if(result == TPM_RC_SUCCESS && entry != NULL)
+		entry->reserved = entry->value = value;
+	    return result;
+	}
+    if(entry == NULL)
+	{
+	    entry = NvCounterCacheFind(0);
+	    if(entry == NULL)
+		{
+		    UINT64_TO_BYTE_ARRAY(value, bytes);
+		    return NvWriteIndexData(nvIndex, 0, 8, bytes);
+		}
+	    // The value in NV is the one that is reserved so far
+	    entry->reserved = NvGetUINT64Data(nvIndex, s_cachedNvRef);
+	    entry->value = entry->reserved;
+	    entry->handle = nvIndex->publicArea.nvIndex;
+	}
+    if(value > entry->reserved)
+	{
+	    reserved = (value > UINT64_MAX - NV_COUNTER_RESERVE)
+		       ? value : value + NV_COUNTER_RESERVE;
+	    UINT64_TO_BYTE_ARRAY(reserved, bytes);
+	    result = NvWriteIndexData(nvIndex, 0, 8, bytes);
+	    if(result != TPM_RC_SUCCESS)
+		return result;
+	    entry->reserved = reserved;
+	}
+    entry->value = value;
+    return TPM_RC_SUCCESS;
+}
+/* 8.4.5.5.4 NvCounterCacheRemove() */
+/* This function drops a counter from the counter cache when its index is deleted. */
+static void
+NvCounterCacheRemove(
+		     TPM_HANDLE       handle         // IN: the handle of the counter
+		     )
+{
+    NV_COUNTER_ENTRY    *entry = NvCounterCacheFind(handle);
+    //
+    if(entry != NULL)
+	entry->handle = 0;
+    return;
+}
+#endif // NV_COUNTER_CACHE_SIZE
+/* 8.4.5.5.5 NvCounterCacheFlush() */
+/* This function writes the RAM value of the cached counters to NV so that they do not skip ahead
+   at the next startup. It is called when the TPM is shut down. */
+void
+NvCounterCacheFlush(
+		    void
+		    )
+{
+#if NV_COUNTER_CACHE_SIZE > 0
+    NV_COUNTER_ENTRY    *entry;
+    NV_REF               locator;
+    BYTE                 bytes[8];
+    //
+    for(entry = &s_nvCounterCache[0];
+	entry < &s_nvCounterCache[NV_COUNTER_CACHE_SIZE]; entry++)
+	{
+	    if(entry->handle == 0 || entry->value == entry->reserved)
+		continue;
+	    locator = NvFindHandle(entry->handle);
+	    pAssert(locator != 0);
+	    UINT64_TO_BYTE_ARRAY(entry->value, bytes);
+	    NvWrite(locator + sizeof(NV_INDEX), sizeof(bytes), bytes);
+	    entry->reserved = entry->value;
+	}
+#endif
+    return;
+}
 /* 8.4.5.6 NvGetIndexData() */
 /* This function is used to access the data in an NV Index. The data is returned as a byte
    sequence. */
@@ -745,6 +1146,10 @@ NvGetIndexData(
 	       )
 {
     TPMA_NV             nvAttributes;
+#if NV_COUNTER_CACHE_SIZE > 0
+    NV_COUNTER_ENTRY    *entry;
+    BYTE                 bytes[8];
+#endif
     //
     pAssert(nvIndex != NULL);
     nvAttributes = nvIndex->publicArea.attributes;
@@ -758,6 +1163,16 @@ NvGetIndexData(
 				     sizeof(NV_RAM_HEADER) - offset));
 	    MemoryCopy(data, ramAddr + sizeof(NV_RAM_HEADER) + offset, size);
 	}
+#if NV_COUNTER_CACHE_SIZE > 0
+    else if(IsNvCounterIndex(nvAttributes)
+	    && (entry = NvCounterCacheFind(nvIndex->publicArea.nvIndex)) != NULL)
+	{
+	    // Get a counter kept in RAM from the counter cache
+	    pAssert(offset <= 8 && size <= 8 - offset);
+	    UINT64_TO_BYTE_ARRAY(entry->value, bytes);
+	    MemoryCopy(data, bytes + offset, size);
+	}
+#endif
     else
 	{
 	    // Validate that read falls within range of the index
@@ -1004,6 +1419,13 @@ NvWriteUINT64Data(
 		  )
 {
     BYTE            bytes[8];
+#if NV_COUNTER_CACHE_SIZE > 0
+    // A non-orderly counter that has been written is kept in RAM
+    if(IsNvCounterIndex(nvIndex->publicArea.attributes)
+       && !IS_ATTRIBUTE(nvIndex->publicArea.attributes, TPMA_NV, ORDERLY)
+       && IS_ATTRIBUTE(nvIndex->publicArea.attributes, TPMA_NV, WRITTEN))
+	return NvCounterCacheWrite(nvIndex, intValue);
+#endif
     UINT64_TO_BYTE_ARRAY(intValue, bytes);
     return NvWriteIndexData(nvIndex, 0, 8, &bytes);
 }
@@ -1149,6 +1571,11 @@ NvDeleteIndex(
 	    result = NvDelete(entityAddr);
 	    if(result != TPM_RC_SUCCESS)
 		return result;
+#if NV_COUNTER_CACHE_SIZE > 0
+	    // Drop a counter kept in RAM
+	    if(IsNvCounterIndex(nvIndex->publicArea.attributes))
+		NvCounterCacheRemove(nvIndex->publicArea.nvIndex);
+#endif
 	    // If the NV Index is RAM backed, delete the RAM data as well
 	    if(IS_ATTRIBUTE(nvIndex->publicArea.attributes, TPMA_NV, ORDERLY))
 		NvDeleteRAM(nvIndex->publicArea.nvIndex);
@@ -1182,21 +1609,17 @@ NvFlushHierarchy(
 		 TPMI_RH_HIERARCHY    hierarchy      // IN: hierarchy to be flushed.
 		 )
 {
-    NV_REF           iter = NV_REF_INIT;
+    UINT32           slot = 0;
     NV_REF           currentAddr;
-    TPM_HANDLE       entityHandle;
     TPM_RC           result = TPM_RC_SUCCESS;
     //
-    while((currentAddr = NvNext(&iter, &entityHandle)) != 0)
+    // If flush endorsement or platform hierarchy, no NV Index would be flushed
+    if(hierarchy == TPM_RH_OWNER)
 	{
-	    if(HandleGetType(entityHandle) == TPM_HT_NV_INDEX)
+	    while((currentAddr = NvHandleIndexNext(&slot, TPM_HT_NV_INDEX, NULL)) != 0)
 		{
 		    NV_INDEX        nvIndex;
 		    //
-		    // If flush endorsement or platform hierarchy, no NV Index would be
-		    // flushed
-		    if(hierarchy == TPM_RH_ENDORSEMENT || hierarchy == TPM_RH_PLATFORM)
-			continue;
 		    // Get the index information
 		    NvReadNvIndexInfo(currentAddr, &nvIndex);
 		    // For storage hierarchy, flush OwnerCreated index
@@ -1206,37 +1629,35 @@ NvFlushHierarchy(
 			    // Delete the index (including RAM for orderly)
 			    result = NvDeleteIndex(&nvIndex, currentAddr);
 			    if(result != TPM_RC_SUCCESS)
-				break;
-			    // Re-iterate from beginning after a delete
-			    iter = NV_REF_INIT;
+				return result;
+			    // The handle directory closes up over the deleted handle, so
+			    // the next handle is now at the position of this one
+			    slot--;
 			}
 		}
-	    else if(HandleGetType(entityHandle) == TPM_HT_PERSISTENT)
-		{
-		    OBJECT_ATTRIBUTES           attributes;
-		    //
-		    NvRead(&attributes,
-			   (UINT32)(currentAddr
-				    + sizeof(TPM_HANDLE)
-				    + offsetof(OBJECT, attributes)),
-			   sizeof(OBJECT_ATTRIBUTES));
-		    // If the evict object belongs to the hierarchy to be flushed...
-		    if((hierarchy == TPM_RH_PLATFORM && attributes.ppsHierarchy == SET)
-		       || (hierarchy == TPM_RH_OWNER && attributes.spsHierarchy == SET)
-		       || (hierarchy == TPM_RH_ENDORSEMENT
-			   &&  attributes.epsHierarchy == SET))
-			{
-			    // ...then delete the evict object
-			    result = NvDelete(currentAddr);
-			    if(result != TPM_RC_SUCCESS)
-				break;
-			    // Re-iterate from beginning after a delete
-			    iter = NV_REF_INIT;
-			}
-		}
-	    else
+	}
+    slot = 0;
+    while((currentAddr = NvHandleIndexNext(&slot, TPM_HT_PERSISTENT, NULL)) != 0)
+	{
+	    OBJECT_ATTRIBUTES           attributes;
+	    //
+	    NvRead(&attributes,
+		   (UINT32)(currentAddr
+			    + sizeof(TPM_HANDLE)
+			    + offsetof(OBJECT, attributes)),
+		   sizeof(OBJECT_ATTRIBUTES));
+	    // If the evict object belongs to the hierarchy to be flushed...
+	    if((hierarchy == TPM_RH_PLATFORM && attributes.ppsHierarchy == SET)
+	       || (hierarchy == TPM_RH_OWNER && attributes.spsHierarchy == SET)
+	       || (hierarchy == TPM_RH_ENDORSEMENT
+		   &&  attributes.epsHierarchy == SET))
 		{
-		    FAIL(FATAL_ERROR_INTERNAL);
+		    // ...then delete the evict object
+		    result = NvDelete(currentAddr);
+		    if(result != TPM_RC_SUCCESS)
+			break;
+		    // Continue from the position of the deleted handle
+		    slot--;
 		}
 	}
     return result;
@@ -1252,14 +1673,14 @@ NvSetGlobalLock(
 		void
 		)
 {
-    NV_REF           iter = NV_REF_INIT;
+    UINT32           slot = 0;
     NV_RAM_REF       ramIter = NV_RAM_REF_INIT;
     NV_REF           currentAddr;
     NV_RAM_REF       currentRamAddr;
     TPM_RC           result = TPM_RC_SUCCESS;
     //
     // Check all normal indexes
-    while((currentAddr = NvNextIndex(NULL, &iter)) != 0)
+    while((currentAddr = NvHandleIndexNext(&slot, TPM_HT_NV_INDEX, NULL)) != 0)
 	{
 	    TPMA_NV         attributes = NvReadNvIndexAttributes(currentAddr);
 	    //
@@ -1286,49 +1707,6 @@ NvSetGlobalLock(
 	}
     return result;
 }
-/* 8.4.5.21 InsertSort() */
-/* Sort a handle into handle list in ascending order.  The total handle number in the list should
-   not exceed MAX_CAP_HANDLES */
-static void
-InsertSort(
-	   TPML_HANDLE     *handleList,    // IN/OUT: sorted handle list
-	   UINT32           count,         // IN: maximum count in the handle list
-	   TPM_HANDLE       entityHandle   // IN: handle to be inserted
-	   )
-{
-    UINT32          i, j;
-    UINT32          originalCount;
-    // For a corner case that the maximum count is 0, do nothing
-    if(count == 0)
-	return;
-    // For empty list, add the handle at the beginning and return
-    if(handleList->count == 0)
-	{
-	    handleList->handle[0] = entityHandle;
-	    handleList->count++;
-	    return;
-	}
-    // Check if the maximum of the list has been reached
-    originalCount = handleList->count;
-    if(originalCount < count)
-	handleList->count++;
-    // Insert the handle to the list
-    for(i = 0; i < originalCount; i++)
-	{
-	    if(handleList->handle[i] > entityHandle)
-		{
-		    for(j = handleList->count - 1; j > i; j--)
-			{
-			    handleList->handle[j] = handleList->handle[j - 1];
-			}
-		    break;
-		}
-	}
-    // If a slot was found, insert the handle in this position
-    if(i < originalCount || handleList->count > originalCount)
-	handleList->handle[i] = entityHandle;
-    return;
-}
 /* 8.4.5.22 NvCapGetPersistent() */
 /* This function is used to get a list of handles of the persistent objects, starting at handle. */
 /* Handle must be in valid persistent object handle range, but does not have to reference an
@@ -1343,33 +1721,8 @@ NvCapGetPersistent(
 		   TPML_HANDLE     *handleList     // OUT: list of handle
 		   )
 {
-    TPMI_YES_NO              more = NO;
-    NV_REF                   iter = NV_REF_INIT;
-    NV_REF                   currentAddr;
-    TPM_HANDLE               entityHandle;
     pAssert(HandleGetType(handle) == TPM_HT_PERSISTENT);
-    // Initialize output handle list
-    handleList->count = 0;
-    // The maximum count of handles we may return is MAX_CAP_HANDLES
-    if(count > MAX_CAP_HANDLES) count = MAX_CAP_HANDLES;
-    while((currentAddr = NvNextEvict(&entityHandle, &iter)) != 0)
-	{
-	    // Ignore persistent handles that have values less than the input handle
-	    if(entityHandle < handle)
-		continue;
-	    // if the handles in the list have reached the requested count, and there
-	    // are still handles need to be inserted, indicate that there are more.
-	    if(handleList->count == count)
-		more = YES;
-	    // A handle with a value larger than start handle is a candidate
-	    // for return. Insert sort it to the return list.  Insert sort algorithm
-	    // is chosen here for simplicity based on the assumption that the total
-	    // number of NV Indexes is small.  For an implementation that may allow
-	    // large number of NV Indexes, a more efficient sorting algorithm may be
-	    // used here.
-	    InsertSort(handleList, count, entityHandle);
-	}
-    return more;
+    return NvCapGetHandles(handle, count, handleList);
 }
 /* 8.4.5.23 NvCapGetIndex() */
 /* This function returns a list of handles of NV Indexes, starting from handle. Handle must be in
@@ -1384,33 +1737,8 @@ NvCapGetIndex(
 	      TPML_HANDLE     *handleList     // OUT: list of handle
 	      )
 {
-    TPMI_YES_NO              more = NO;
-    NV_REF                   iter = NV_REF_INIT;
-    NV_REF                   currentAddr;
-    TPM_HANDLE               nvHandle;
     pAssert(HandleGetType(handle) == TPM_HT_NV_INDEX);
-    // Initialize output handle list
-    handleList->count = 0;
-    // The maximum count of handles we may return is MAX_CAP_HANDLES
-    if(count > MAX_CAP_HANDLES) count = MAX_CAP_HANDLES;
-    while((currentAddr = NvNextIndex(&nvHandle, &iter)) != 0)
-	{
-	    // Ignore index handles that have values less than the 'handle'
-	    if(nvHandle < handle)
-		continue;
-	    // if the count of handles in the list has reached the requested count,
-	    // and there are still handles to report, set more.
-	    if(handleList->count == count)
-		more = YES;
-	    // A handle with a value larger than start handle is a candidate
-	    // for return. Insert sort it to the return list.  Insert sort algorithm
-	    // is chosen here for simplicity based on the assumption that the total
-	    // number of NV Indexes is small.  For an implementation that may allow
-	    // large number of NV Indexes, a more efficient sorting algorithm may be
-	    // used here.
-	    InsertSort(handleList, count, nvHandle);
-	}
-    return more;
+    return NvCapGetHandles(handle, count, handleList);
 }
 /* 8.4.5.24 NvCapGetIndexNumber() */
 /* This function returns the count of NV Indexes currently defined. */
@@ -1419,11 +1747,7 @@ NvCapGetIndexNumber(
 		    void
 		    )
 {
-    UINT32          num = 0;
-    NV_REF         iter = NV_REF_INIT;
-    while(NvNextIndex(NULL, &iter) != 0)
-	num++;
-    return num;
+    return NvCapGetNumber(TPM_HT_NV_INDEX);
 }
 /* 8.4.5.25 NvCapGetPersistentNumber() */
 /* Function returns the count of persistent objects currently in NV memory. */
@@ -1432,12 +1756,7 @@ NvCapGetPersistentNumber(
 			 void
 			 )
 {
-    UINT32          num = 0;
-    NV_REF         iter = NV_REF_INIT;
-    TPM_HANDLE      handle;
-    while(NvNextEvict(&handle, &iter) != 0)
-	num++;
-    return num;
+    return NvCapGetNumber(TPM_HT_PERSISTENT);
 }
 /* 8.4.5.26 NvCapGetPersistentAvail() */
 /* This function returns an estimate of the number of additional persistent objects that could be
@@ -1470,10 +1789,10 @@ NvCapGetCounterNumber(
 		      void
 		      )
 {
-    NV_REF           iter = NV_REF_INIT;
+    UINT32           slot = 0;
     NV_REF           currentAddr;
     UINT32           num = 0;
-    while((currentAddr = NvNextIndex(NULL, &iter)) != 0)
+    while((currentAddr = NvHandleIndexNext(&slot, TPM_HT_NV_INDEX, NULL)) != 0)
 	{
 	    TPMA_NV             attributes = NvReadNvIndexAttributes(currentAddr);
 	    if(IsNvCounterIndex(attributes))
@@ -1520,12 +1839,17 @@ NvEntityStartup(
 		STARTUP_TYPE     type           // IN: start up type
 		)
 {
-    NV_REF               iter = NV_REF_INIT;
+    UINT32               slot = 0;
     NV_RAM_REF           ramIter = NV_RAM_REF_INIT;
     NV_REF               currentAddr;        // offset points to the current entity
     NV_RAM_REF           currentRamAddr;
-    TPM_HANDLE           nvHandle;
     TPMA_NV              attributes;
+    // Rebuild the handle index from the NV image
+    NvHandleIndexRebuild();
+#if NV_COUNTER_CACHE_SIZE > 0
+    // The counters kept in RAM start again from their value in NV
+    MemorySet(s_nvCounterCache, 0, sizeof(s_nvCounterCache));
+#endif
     // Restore RAM index data
     NvRead(s_indexOrderlyRam, NV_INDEX_RAM_DATA, sizeof(s_indexOrderlyRam));
     // Initialize the max NV counter value
@@ -1534,7 +1858,7 @@ NvEntityStartup(
     if(type == SU_RESUME)
 	return TRUE;
     // Iterate all the NV Index to clear the locks
-    while((currentAddr = NvNextIndex(&nvHandle, &iter)) != 0)
+    while((currentAddr = NvHandleIndexNext(&slot, TPM_HT_NV_INDEX, NULL)) != 0)
 	{
 	    attributes = NvReadNvIndexAttributes(currentAddr);
 	    // If this is an orderly index, defer processing until loop below
@@ -1609,15 +1933,11 @@ NvFindHandle(
 	     TPM_HANDLE       handle
 	     )
 {
-    NV_REF           addr;
-    NV_REF           iter = NV_REF_INIT;
-    TPM_HANDLE       nextHandle;
-    while((addr = NvNext(&iter, &nextHandle)) != 0)
-	{
-	    if(nextHandle == handle)
-		break;
-	}
-    return addr;
+    UINT32           slot;
+    if(!s_nvHandleIndexValid)
+	NvHandleIndexRebuild();
+    slot = NvHandleIndexFind(handle);
+    return (s_nvHandleIndex[slot].handle == handle) ? s_nvHandleIndex[slot].ref : 0;
 }
 /* 8.4.6 NV Max Counter */
 /* 8.4.6.1 Introduction */
@@ -1667,13 +1987,9 @@ NvGetMaxCount(
 	      void
 	      )
 {
-    NV_REF               iter = NV_REF_INIT;
-    NV_REF               currentAddr;
     UINT64               maxCount;
-    // Find the end of list marker and initialize the NV Max Counter value.
-    while((currentAddr = NvNext(&iter, NULL )) != 0);
-    // 'iter' should be pointing at the end of list marker so read in the current
-    // value of the s_maxCounter.
-    NvRead(&maxCount, iter + sizeof(UINT32), sizeof(maxCount));
+    // Find the end of list marker and read in the current value of the
+    // s_maxCounter.
+    NvRead(&maxCount, NvGetEnd() + sizeof(UINT32), sizeof(maxCount));
     return maxCount;
 }
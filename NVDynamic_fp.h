@@ -106,6 +106,14 @@ NvIndexCacheInit(
 		 void
 		 );
 void
+NvHandleIndexInit(
+		  void
+		  );
+void
+NvCounterCacheFlush(
+		    void
+		    );
+void
 NvGetIndexData(
 	       NV_INDEX        *nvIndex,       // IN: the in RAM index descriptor
 	       NV_REF           locator,       // IN: where the data is located
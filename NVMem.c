@@ -67,12 +67,126 @@
 /* C.6.2. Includes and Local */
 // #include <memory.h>
 #include <string.h>
+#include <stdlib.h>
 #include <assert.h>
 #include "Platform.h"
 #if FILE_BACKED_NV
 #   include         <stdio.h>
-static FILE                *s_NvFile = NULL;		/* kgold made these static */
-static int                 s_NeedsManufacture = FALSE;
+#   ifdef TPM_POSIX
+#       include     <unistd.h>
+#   endif
+static FILE                *s_NvFile INSTANCE_LOCAL = NULL;	/* kgold made these static */
+static int                 s_NeedsManufacture INSTANCE_LOCAL = FALSE;
+/* NV file name passed to _plat__NVEnable(), NULL for the default */
+static const char          *s_NvFileName INSTANCE_LOCAL = NULL;
+#endif
+
+/* The journal needs positioned writes and a sync that covers only the journal file. */
+#if FILE_BACKED_NV && NV_JOURNAL && defined TPM_POSIX
+#   define USE_NV_JOURNAL   YES
+#   include         <fcntl.h>
+#   include         <stdlib.h>
+#   include         <sys/uio.h>
+#   include         <sys/eventfd.h>
+#   include         <pthread.h>
+#   include         <time.h>
+#   define NV_JOURNAL_MAGIC         0x4e564a52      // "NVJR"
+/* A journal record is the header followed by rangeCount ranges of {uint32_t offset, uint32_t
+   size, uint8_t[size]}, in host byte order. */
+typedef struct
+{
+    uint32_t         magic;
+    uint32_t         sequence;          // 1 for the first record after a checkpoint
+    uint32_t         rangeCount;
+    uint32_t         length;            // bytes of ranges after the header
+    uint32_t         checksum;          // CRC-32 of the header with checksum 0, then the ranges
+} NV_JOURNAL_RECORD;
+// A commit that changes more separate runs of pages than this is merged into this many ranges
+#   define NV_JOURNAL_MAX_RANGES    64
+#   define NV_JOURNAL_MAX_LENGTH    (s_NvSize + NV_JOURNAL_MAX_RANGES * 2 * sizeof(uint32_t))
+#   define NV_PAGE_COUNT(size)      (((size) + NV_DIRTY_PAGE_SIZE - 1) / NV_DIRTY_PAGE_SIZE)
+#   define NV_PAGE_IS_SET(map, page) (((map)[(page) / 32] >> ((page) % 32)) & 1)
+typedef struct
+{
+    int              fd;                // -1 when the journal is not open
+    int              file;              // the NV file, for checkpoints
+    uint32_t         records;           // since the last checkpoint
+    off_t            size;
+} NV_JOURNAL_STATE;
+static NV_JOURNAL_STATE    s_NvJournal INSTANCE_LOCAL = {-1, -1, 0, 0};
+/* With a durability mode other than sync, the commits are handed to a flusher thread that appends
+   them to the journal in the background. Commits that come in while the thread is writing are
+   written together, with one sync. The flusher works on its own copy of the NV image and owns the
+   journal while it runs, and it is allocated outside of the instance state because the instance
+   state is swapped under it when another instance is selected. */
+/* A flush that fails is not retried. The commits that it and the later ones of the same flusher
+   hold are never written, and the next commit puts the TPM into failure mode. */
+#   define NV_DURABILITY_SYNC       0   // commit before the response, without a flusher
+#   define NV_DURABILITY_GROUP      1   // the response waits until its commit is in the journal
+#   define NV_DURABILITY_ASYNC      2   // the response does not wait for the journal
+/* The flushes of an instance, as its event loop sees them. The commit numbers go on from one
+   flusher to the next, and the status is kept until the NV image is freed, so that it outlives the
+   flushers, which stop whenever NV is disabled. */
+struct NV_FLUSH_STATUS
+{
+    pthread_mutex_t  lock;
+    pthread_cond_t   done;              // a flush finished or failed
+    uint64_t         durable;           // the last commit that is in the journal
+    uint64_t         failedFrom;        // the commits from failedFrom to failedTo were lost, or 0
+    uint64_t         failedTo;
+};
+typedef struct
+{
+    pthread_t        thread;
+    pthread_mutex_t  lock;
+    pthread_cond_t   wake;              // a commit was handed over or the thread is to stop
+    NV_FLUSH_STATUS *status;
+    int              mode;
+    int              stop;
+    int              failed;            // a flush failed, so the next commit fails
+    uint64_t         committed;         // the last commit handed over
+    uint64_t         handed;            // the one of the last command, 0 once it is waited for
+    uint64_t         durable;           // the last commit that is in the journal
+    uint32_t         written;           // bytes written that the statistics have not seen
+    uint32_t         size;
+    unsigned char   *pending;           // the NV image as of the last commit handed over
+    uint32_t        *pendingDirty;      // and its pages that the thread has not taken yet
+    unsigned char   *image;             // the NV image that the thread is writing
+    uint32_t        *dirty;
+    NV_JOURNAL_STATE journal;
+} NV_FLUSHER;
+static int                 s_NvDurability INSTANCE_LOCAL = NV_DURABILITY_SYNC;
+static NV_FLUSHER          *s_NvFlusher INSTANCE_LOCAL = NULL;
+static NV_FLUSH_STATUS     *s_NvFlushStatus INSTANCE_LOCAL = NULL;
+static uint64_t            s_NvFlushSequence INSTANCE_LOCAL = 0;   // of a stopped flusher
+/* An eventfd that a flusher writes after each flush. It is the same for every instance. */
+static int                 s_NvFlushNotify = -1;
+#else
+#   define USE_NV_JOURNAL   NO
+#endif
+
+/* A mapped NV file is the NV image itself. s_NV points into a shared mapping of the file instead of
+   the memory that NvMemoryAllocate() allocated, so enabling NV does not read the file. A commit
+   syncs the pages that changed. There is no journal, and the kernel can write a changed page back
+   before the commit. The NV file is locked, so that a second process cannot map it too. */
+/* A new NV file can start from a template, a manufactured NV file that is only read. The template
+   is mapped copy-on-write, so the processes that start from it share its pages until they change
+   them. The NV file gets a copy of the template and the commits are written to it as when the NV
+   file is read, through the journal if there is one. The mapping is kept across power cycles, and
+   a later process maps the NV file itself. */
+#if FILE_BACKED_NV && defined TPM_POSIX
+#   define USE_NV_MMAP      YES
+#   include         <sys/mman.h>
+#   include         <sys/file.h>
+#   include         <sys/stat.h>
+#   include         <errno.h>
+static int                 s_NvMapFile INSTANCE_LOCAL = FALSE;     // set by _plat__NvSetMapped()
+static const char          *s_NvTemplate INSTANCE_LOCAL = NULL;    // set by _plat__NvSetTemplate()
+static unsigned char       *s_NvMap INSTANCE_LOCAL = NULL;         // the mapping while NV is enabled
+static int                 s_NvMapPrivate INSTANCE_LOCAL = FALSE;  // it is the template's
+static unsigned char       *s_NvHeap INSTANCE_LOCAL = NULL;        // the allocated image meanwhile
+#else
+#   define USE_NV_MMAP      NO
 #endif
 
 #if defined(__ALTERA_ONCHIP_FLASH)
@@ -83,18 +197,15 @@ static int                 s_NeedsManufacture = FALSE;
 #endif
 
 /* C.6.2. Functions */
-/* C.6.2.1.	NvFileOpen() */
 
 #if FILE_BACKED_NV
 
-/* This function opens the file used to hold the NV image.
-   Return Type: int */
-/* Return Value	Meaning */
-/* >=0	success */
-/* -1	error */
-static int
-NvFileOpen(
-	   const char      *mode
+/* NvFilePath() */
+/* This function returns the name of the NV file: the one given to _plat__NVEnable() for this
+   instance, NV_FILE_PATH, or NVChip. */
+static const char *
+NvFilePath(
+	   void
 	   )
 {
 #if defined(NV_FILE_PATH)
@@ -106,6 +217,23 @@ NvFileOpen(
 #else
     const char* s_NvFilePath = "NVChip";
 #endif
+    // A TPM instance can have its own NV file
+    if(s_NvFileName != NULL)
+	s_NvFilePath = s_NvFileName;
+    return s_NvFilePath;
+}
+/* C.6.2.1.	NvFileOpen() */
+/* This function opens the file used to hold the NV image.
+   Return Type: int */
+/* Return Value	Meaning */
+/* >=0	success */
+/* -1	error */
+static int
+NvFileOpen(
+	   const char      *mode
+	   )
+{
+    const char* s_NvFilePath = NvFilePath();
 
     // Try to open an exist NVChip file for read/write
 #   if defined _MSC_VER && 1
@@ -119,28 +247,33 @@ NvFileOpen(
 	return (s_NvFile == NULL) ? -1 : 0;
 }
 
-/* C.6.2.2.	NvFileCommit() */
-/* Write all of the contents of the NV image to a file. */
+/* C.6.2.2.	NvFileWrite() */
+/* Write a range of the NV image to the same place in the file. */
 /* Return Value	Meaning */
 /* TRUE	success */
 /* FALSE failure */
 static int
-NvFileCommit(
-	     void
-	     	)
+NvFileWrite(
+	    unsigned int     startOffset,
+	    unsigned int     size
+	    )
 {
-    int         OK;
-    // If NV file is not available, return failure
-    if(s_NvFile == NULL){
-		return 1;
+#ifdef TPM_POSIX
+#   if USE_NV_MMAP
+    // the mapped pages are the file already, so they only have to be written back
+    if(s_NvMap != NULL && !s_NvMapPrivate)
+	{
+	    unsigned int     pageMask = (unsigned int)sysconf(_SC_PAGESIZE) - 1;
+	    return 0 == msync(&s_NvMap[startOffset & ~pageMask], size + (startOffset & pageMask),
+			      MS_SYNC);
 	}
-    // Write RAM data to NV
-    fseek(s_NvFile, 0, SEEK_SET);
-    OK = (NV_MEMORY_SIZE == fwrite(s_NV, 1, NV_MEMORY_SIZE, s_NvFile));
-    
-    OK = OK && (0 == fflush(s_NvFile));
-    assert(OK);
-    return OK;
+#   endif
+    // a positioned write does not go through the stdio buffer, so there is nothing to flush
+    return (ssize_t)size == pwrite(fileno(s_NvFile), &s_NV[startOffset], size, startOffset);
+#else
+    return (0 == fseek(s_NvFile, startOffset, SEEK_SET))
+	&& (size == fwrite(&s_NV[startOffset], 1, size, s_NvFile));
+#endif
 }
 /* C.6.2.3.	NvFileSize() */
 /* This function gets the size of the NV file and puts the file pointer where desired using the seek
@@ -194,20 +327,18 @@ NvFileOpen(
 	return (s_NvFile == NULL) ? -1 : 0;
 }
 
-/* C.6.2.2.	NvFileCommit() */
-/* Write all of the contents of the NV image to a file. */
+/* C.6.2.2.	NvFileWrite() */
+/* Write a range of the NV image to the same place in the flash. */
 /* Return Value	Meaning */
 /* TRUE	success */
 /* FALSE failure */
 static int
-NvFileCommit(
-	     void
-	     	)
+NvFileWrite(
+	    unsigned int     startOffset,
+	    unsigned int     size
+	    )
 {
-	int OK;
-	OK = (0 == alt_write_flash(s_NvFile, 0, s_NV, NV_MEMORY_SIZE));
-    assert(OK);
-    return OK;
+	return (0 == alt_write_flash(s_NvFile, startOffset, &s_NV[startOffset], size));
 }
 
 /* C.6.2.3.	NvFileSize() */
@@ -219,9 +350,738 @@ NvFileSize(
 	   int         leaveAt
 	   )
 {
-	return NV_MEMORY_SIZE;
+	return s_NvSize;
+}
+
+#endif
+
+#if USE_NV_JOURNAL
+/* The table is the CRC-32 (polynomial 0xedb88320) of each byte value. It is constant, so the
+   flushers of all the instances can use it at once. */
+static const uint32_t   s_NvJournalCrcTable[256] = {
+	0x00000000, 0x77073096, 0xee0e612c, 0x990951ba, 0x076dc419, 0x706af48f,
+	0xe963a535, 0x9e6495a3, 0x0edb8832, 0x79dcb8a4, 0xe0d5e91e, 0x97d2d988,
+	0x09b64c2b, 0x7eb17cbd, 0xe7b82d07, 0x90bf1d91, 0x1db71064, 0x6ab020f2,
+	0xf3b97148, 0x84be41de, 0x1adad47d, 0x6ddde4eb, 0xf4d4b551, 0x83d385c7,
+	0x136c9856, 0x646ba8c0, 0xfd62f97a, 0x8a65c9ec, 0x14015c4f, 0x63066cd9,
+	0xfa0f3d63, 0x8d080df5, 0x3b6e20c8, 0x4c69105e, 0xd56041e4, 0xa2677172,
+	0x3c03e4d1, 0x4b04d447, 0xd20d85fd, 0xa50ab56b, 0x35b5a8fa, 0x42b2986c,
+	0xdbbbc9d6, 0xacbcf940, 0x32d86ce3, 0x45df5c75, 0xdcd60dcf, 0xabd13d59,
+	0x26d930ac, 0x51de003a, 0xc8d75180, 0xbfd06116, 0x21b4f4b5, 0x56b3c423,
+	0xcfba9599, 0xb8bda50f, 0x2802b89e, 0x5f058808, 0xc60cd9b2, 0xb10be924,
+	0x2f6f7c87, 0x58684c11, 0xc1611dab, 0xb6662d3d, 0x76dc4190, 0x01db7106,
+	0x98d220bc, 0xefd5102a, 0x71b18589, 0x06b6b51f, 0x9fbfe4a5, 0xe8b8d433,
+	0x7807c9a2, 0x0f00f934, 0x9609a88e, 0xe10e9818, 0x7f6a0dbb, 0x086d3d2d,
+	0x91646c97, 0xe6635c01, 0x6b6b51f4, 0x1c6c6162, 0x856530d8, 0xf262004e,
+	0x6c0695ed, 0x1b01a57b, 0x8208f4c1, 0xf50fc457, 0x65b0d9c6, 0x12b7e950,
+	0x8bbeb8ea, 0xfcb9887c, 0x62dd1ddf, 0x15da2d49, 0x8cd37cf3, 0xfbd44c65,
+	0x4db26158, 0x3ab551ce, 0xa3bc0074, 0xd4bb30e2, 0x4adfa541, 0x3dd895d7,
+	0xa4d1c46d, 0xd3d6f4fb, 0x4369e96a, 0x346ed9fc, 0xad678846, 0xda60b8d0,
+	0x44042d73, 0x33031de5, 0xaa0a4c5f, 0xdd0d7cc9, 0x5005713c, 0x270241aa,
+	0xbe0b1010, 0xc90c2086, 0x5768b525, 0x206f85b3, 0xb966d409, 0xce61e49f,
+	0x5edef90e, 0x29d9c998, 0xb0d09822, 0xc7d7a8b4, 0x59b33d17, 0x2eb40d81,
+	0xb7bd5c3b, 0xc0ba6cad, 0xedb88320, 0x9abfb3b6, 0x03b6e20c, 0x74b1d29a,
+	0xead54739, 0x9dd277af, 0x04db2615, 0x73dc1683, 0xe3630b12, 0x94643b84,
+	0x0d6d6a3e, 0x7a6a5aa8, 0xe40ecf0b, 0x9309ff9d, 0x0a00ae27, 0x7d079eb1,
+	0xf00f9344, 0x8708a3d2, 0x1e01f268, 0x6906c2fe, 0xf762575d, 0x806567cb,
+	0x196c3671, 0x6e6b06e7, 0xfed41b76, 0x89d32be0, 0x10da7a5a, 0x67dd4acc,
+	0xf9b9df6f, 0x8ebeeff9, 0x17b7be43, 0x60b08ed5, 0xd6d6a3e8, 0xa1d1937e,
+	0x38d8c2c4, 0x4fdff252, 0xd1bb67f1, 0xa6bc5767, 0x3fb506dd, 0x48b2364b,
+	0xd80d2bda, 0xaf0a1b4c, 0x36034af6, 0x41047a60, 0xdf60efc3, 0xa867df55,
+	0x316e8eef, 0x4669be79, 0xcb61b38c, 0xbc66831a, 0x256fd2a0, 0x5268e236,
+	0xcc0c7795, 0xbb0b4703, 0x220216b9, 0x5505262f, 0xc5ba3bbe, 0xb2bd0b28,
+	0x2bb45a92, 0x5cb36a04, 0xc2d7ffa7, 0xb5d0cf31, 0x2cd99e8b, 0x5bdeae1d,
+	0x9b64c2b0, 0xec63f226, 0x756aa39c, 0x026d930a, 0x9c0906a9, 0xeb0e363f,
+	0x72076785, 0x05005713, 0x95bf4a82, 0xe2b87a14, 0x7bb12bae, 0x0cb61b38,
+	0x92d28e9b, 0xe5d5be0d, 0x7cdcefb7, 0x0bdbdf21, 0x86d3d2d4, 0xf1d4e242,
+	0x68ddb3f8, 0x1fda836e, 0x81be16cd, 0xf6b9265b, 0x6fb077e1, 0x18b74777,
+	0x88085ae6, 0xff0f6a70, 0x66063bca, 0x11010b5c, 0x8f659eff, 0xf862ae69,
+	0x616bffd3, 0x166ccf45, 0xa00ae278, 0xd70dd2ee, 0x4e048354, 0x3903b3c2,
+	0xa7672661, 0xd06016f7, 0x4969474d, 0x3e6e77db, 0xaed16a4a, 0xd9d65adc,
+	0x40df0b66, 0x37d83bf0, 0xa9bcae53, 0xdebb9ec5, 0x47b2cf7f, 0x30b5ffe9,
+	0xbdbdf21c, 0xcabac28a, 0x53b39330, 0x24b4a3a6, 0xbad03605, 0xcdd70693,
+	0x54de5729, 0x23d967bf, 0xb3667a2e, 0xc4614ab8, 0x5d681b02, 0x2a6f2b94,
+	0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d
+};
+/* C.6.2.3.1. NvJournalCrc() */
+/* This function continues the CRC-32 crc over size more bytes. */
+static uint32_t
+NvJournalCrc(
+	     uint32_t         crc,
+	     const void      *data,
+	     size_t           size
+	     )
+{
+    const unsigned char *p = data;
+    crc = ~crc;
+    while(size-- > 0)
+	crc = s_NvJournalCrcTable[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+/* C.6.2.3.2. NvJournalCheckpoint() */
+/* This function writes the NV image to the NV file, syncs it and empties the journal. */
+/* Return Value	Meaning */
+/* TRUE	success */
+/* FALSE failure */
+static int
+NvJournalCheckpoint(
+		    NV_JOURNAL_STATE        *journal,
+		    const unsigned char     *image,     // the NV image
+		    uint32_t                 size
+		    )
+{
+    int                  OK;
+    OK = ((ssize_t)size == pwrite(journal->file, image, size, 0))
+	 && (0 == fsync(journal->file))
+	 && (0 == ftruncate(journal->fd, 0))
+	 && (0 == fdatasync(journal->fd));
+    if(OK)
+	{
+	    journal->records = 0;
+	    journal->size = 0;
+	}
+    return OK;
+}
+/* C.6.2.3.3. NvJournalAppend() */
+/* This function appends the pages of the NV image that are marked in dirty to the journal as one
+   record and syncs the journal. A commit with more than NV_JOURNAL_MAX_RANGES runs of dirty pages
+   has its last range extended over the rest of them, clean pages included, so that every commit is
+   in a record before it reaches the NV file. Every NV_JOURNAL_CHECKPOINT records the journal is
+   folded into the NV file. written is increased by the number of bytes written. */
+/* Return Value	Meaning */
+/* TRUE	success */
+/* FALSE failure */
+static int
+NvJournalAppend(
+		NV_JOURNAL_STATE        *journal,
+		const unsigned char     *image,     // the NV image
+		uint32_t                 size,
+		const uint32_t          *dirty,     // its pages that changed
+		uint32_t                *written
+		)
+{
+    NV_JOURNAL_RECORD    record;
+    uint32_t             ranges[NV_JOURNAL_MAX_RANGES][2];
+    struct iovec         iov[1 + 2 * NV_JOURNAL_MAX_RANGES];
+    int                  iovCount = 1;
+    unsigned int         page;
+    unsigned int         last;
+    uint32_t             crc;
+    size_t               total;
+    int                  i;
+    int                  OK;
+
+    memset(&record, 0, sizeof(record));
+    record.magic = NV_JOURNAL_MAGIC;
+    record.sequence = journal->records + 1;
+    for(page = 0; page < NV_PAGE_COUNT(size); page = last)
+	{
+	    last = (dirty[page / 32] == 0) ? (page | 31) + 1 : page + 1;
+	    if(!NV_PAGE_IS_SET(dirty, page))
+		continue;
+	    while(last < NV_PAGE_COUNT(size) && NV_PAGE_IS_SET(dirty, last))
+		last++;
+	    // Out of ranges, so the last one grows to the end of this run
+	    if(record.rangeCount == NV_JOURNAL_MAX_RANGES)
+		{
+		    i = record.rangeCount - 1;
+		    record.length -= ranges[i][1];
+		    ranges[i][1] = MIN(last * NV_DIRTY_PAGE_SIZE, size) - ranges[i][0];
+		    iov[iovCount - 1].iov_len = ranges[i][1];
+		    record.length += ranges[i][1];
+		    continue;
+		}
+	    ranges[record.rangeCount][0] = page * NV_DIRTY_PAGE_SIZE;
+	    ranges[record.rangeCount][1] = MIN(last * NV_DIRTY_PAGE_SIZE, size)
+					   - page * NV_DIRTY_PAGE_SIZE;
+	    iov[iovCount].iov_base = ranges[record.rangeCount];
+	    iov[iovCount++].iov_len = sizeof(ranges[0]);
+	    iov[iovCount].iov_base = (void *)&image[ranges[record.rangeCount][0]];
+	    iov[iovCount++].iov_len = ranges[record.rangeCount][1];
+	    record.length += sizeof(ranges[0]) + ranges[record.rangeCount][1];
+	    record.rangeCount++;
+	}
+    if(record.rangeCount == 0)
+	return TRUE;
+    crc = NvJournalCrc(0, &record, sizeof(record));
+    for(i = 1; i < iovCount; i++)
+	crc = NvJournalCrc(crc, iov[i].iov_base, iov[i].iov_len);
+    record.checksum = crc;
+    iov[0].iov_base = &record;
+    iov[0].iov_len = sizeof(record);
+    total = sizeof(record) + record.length;
+    if((ssize_t)total != writev(journal->fd, iov, iovCount)
+       || 0 != fdatasync(journal->fd))
+	{
+	    // do not leave a partial record for the next one to follow. The commit fails either way.
+	    OK = (0 == ftruncate(journal->fd, journal->size));
+	    NOT_REFERENCED(OK);
+	    return FALSE;
+	}
+    journal->size += total;
+    journal->records++;
+    *written += total;
+    if(journal->records >= NV_JOURNAL_CHECKPOINT)
+	{
+	    *written += size;
+	    return NvJournalCheckpoint(journal, image, size);
+	}
+    return TRUE;
+}
+/* C.6.2.3.4. NvJournalReplay() */
+/* This function applies the journal records to the NV image. It stops at the first record that
+   is incomplete or damaged, which is where a crash interrupted an append, and returns the number
+   of records applied. */
+static uint32_t
+NvJournalReplay(
+		void
+		)
+{
+    NV_JOURNAL_RECORD    record;
+    unsigned char       *data = malloc(NV_JOURNAL_MAX_LENGTH);
+    uint32_t             checksum;
+    uint32_t             range[2];
+    uint32_t             offset;
+    uint32_t             i;
+    int                  OK;
+
+    s_NvJournal.records = 0;
+    s_NvJournal.size = 0;
+    while(data != NULL
+	  && sizeof(record) == pread(s_NvJournal.fd, &record, sizeof(record), s_NvJournal.size)
+	  && record.magic == NV_JOURNAL_MAGIC
+	  && record.sequence == s_NvJournal.records + 1
+	  && record.length <= NV_JOURNAL_MAX_LENGTH
+	  && (ssize_t)record.length == pread(s_NvJournal.fd, data, record.length,
+					     s_NvJournal.size + sizeof(record)))
+	{
+	    checksum = record.checksum;
+	    record.checksum = 0;
+	    if(checksum != NvJournalCrc(NvJournalCrc(0, &record, sizeof(record)),
+					data, record.length))
+		break;
+	    // check every range before applying any
+	    for(OK = TRUE, i = 0, offset = 0; OK && i < record.rangeCount; i++)
+		{
+		    OK = (offset + sizeof(range) <= record.length);
+		    if(OK)
+			{
+			    memcpy(range, &data[offset], sizeof(range));
+			    offset += sizeof(range);
+			    OK = (range[1] <= record.length - offset)
+				 && (range[0] <= s_NvSize)
+				 && (range[1] <= s_NvSize - range[0]);
+			    offset += range[1];
+			}
+		}
+	    if(!OK || offset != record.length)
+		break;
+	    for(i = 0, offset = 0; i < record.rangeCount; i++)
+		{
+		    memcpy(range, &data[offset], sizeof(range));
+		    offset += sizeof(range);
+		    memcpy(&s_NV[range[0]], &data[offset], range[1]);
+		    offset += range[1];
+		}
+	    s_NvJournal.size += sizeof(record) + record.length;
+	    s_NvJournal.records++;
+	}
+    free(data);
+    return s_NvJournal.records;
+}
+/* C.6.2.3.5. NvJournalOpen() */
+/* This function opens the journal of the NV file. If replay is TRUE, the journal records are
+   applied to the NV image that was read from the NV file. Otherwise the NV file was just
+   initialized and the journal is discarded. In both cases the NV file is brought up to date and
+   the journal emptied. */
+/* Return Value	Meaning */
+/* >=0	success */
+/* -1	error */
+static int
+NvJournalOpen(
+	      int              replay
+	      )
+{
+    char                 path[FILENAME_MAX];
+    off_t                fileSize;
+    if(snprintf(path, sizeof(path), "%s.journal", NvFilePath()) >= (int)sizeof(path))
+	return -1;
+    s_NvJournal.fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0666);
+    if(s_NvJournal.fd < 0)
+	return -1;
+    s_NvJournal.file = fileno(s_NvFile);
+    s_NvJournal.records = 0;
+    s_NvJournal.size = 0;
+    fileSize = lseek(s_NvJournal.fd, 0, SEEK_END);
+    if(fileSize > 0)
+	{
+	    if(replay)
+		NvJournalReplay();
+	    if(!NvJournalCheckpoint(&s_NvJournal, s_NV, s_NvSize))
+		{
+		    close(s_NvJournal.fd);
+		    s_NvJournal.fd = -1;
+		    return -1;
+		}
+	}
+    return 0;
+}
+/* C.6.2.3.5.1. NvFlusherTake() */
+/* This function copies the pages that are marked in the bitmap from, from the NV image source to
+   the NV image target, and moves the marks to the bitmap to. It returns the number of bytes
+   copied. */
+static uint32_t
+NvFlusherTake(
+	      unsigned char           *target,
+	      uint32_t                *to,
+	      const unsigned char     *source,
+	      uint32_t                *from,
+	      uint32_t                 size
+	      )
+{
+    uint32_t             page;
+    uint32_t             start;
+    uint32_t             copied = 0;
+    for(page = 0; page < NV_PAGE_COUNT(size); page++)
+	{
+	    if(from[page / 32] == 0)
+		{
+		    page |= 31;
+		    continue;
+		}
+	    if(!NV_PAGE_IS_SET(from, page))
+		continue;
+	    start = page * NV_DIRTY_PAGE_SIZE;
+	    memcpy(&target[start], &source[start], MIN(NV_DIRTY_PAGE_SIZE, size - start));
+	    copied += MIN(NV_DIRTY_PAGE_SIZE, size - start);
+	}
+    for(page = 0; page < (NV_PAGE_COUNT(size) + 31) / 32; page++)
+	{
+	    to[page] |= from[page];
+	    from[page] = 0;
+	}
+    return copied;
+}
+/* C.6.2.3.5.2. NvFlusherMain() */
+/* This is the flusher thread. It waits for commits, takes all of the ones that were handed over
+   so far and appends them to the journal as one record. In the async mode it first waits up to
+   NV_FLUSH_INTERVAL milliseconds for more commits. When it is stopped it writes what is left
+   first. After a failed flush it only waits to be stopped. */
+static void *
+NvFlusherMain(
+	      void            *arg
+	      )
+{
+    NV_FLUSHER          *f = arg;
+    struct timespec      deadline;
+    uint64_t             sequence;
+    uint64_t             one = 1;
+    uint32_t             written;
+    int                  notify;
+    int                  OK;
+
+    pthread_mutex_lock(&f->lock);
+    for(;;)
+	{
+	    while(!f->stop && (f->committed == f->durable || f->failed))
+		pthread_cond_wait(&f->wake, &f->lock);
+	    if(f->committed == f->durable || f->failed)
+		break;
+	    if(f->mode == NV_DURABILITY_ASYNC)
+		{
+		    clock_gettime(CLOCK_REALTIME, &deadline);
+		    deadline.tv_nsec += NV_FLUSH_INTERVAL * 1000000L;
+		    deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+		    deadline.tv_nsec %= 1000000000L;
+		    while(!f->stop
+			  && pthread_cond_timedwait(&f->wake, &f->lock, &deadline) == 0);
+		}
+	    NvFlusherTake(f->image, f->dirty, f->pending, f->pendingDirty, f->size);
+	    sequence = f->committed;
+	    pthread_mutex_unlock(&f->lock);
+	    written = 0;
+	    OK = NvJournalAppend(&f->journal, f->image, f->size, f->dirty, &written);
+	    memset(f->dirty, 0, (NV_PAGE_COUNT(f->size) + 31) / 32 * sizeof(uint32_t));
+	    pthread_mutex_lock(&f->lock);
+	    pthread_mutex_lock(&f->status->lock);
+	    if(OK)
+		f->durable = f->status->durable = sequence;
+	    else
+		{
+		    // the commits from here on are lost until the flusher is stopped
+		    f->failed = TRUE;
+		    f->status->failedFrom = f->durable + 1;
+		    f->status->failedTo = UINT64_MAX;
+		}
+	    pthread_cond_broadcast(&f->status->done);
+	    pthread_mutex_unlock(&f->status->lock);
+	    f->written += written;
+	    notify = __atomic_load_n(&s_NvFlushNotify, __ATOMIC_ACQUIRE);
+	    if(notify >= 0)
+		{
+		    OK = (write(notify, &one, sizeof(one)) == sizeof(one));
+		    NOT_REFERENCED(OK);
+		}
+	}
+    pthread_mutex_unlock(&f->lock);
+    return NULL;
+}
+/* C.6.2.3.5.3. NvFlusherFree() */
+static void
+NvFlusherFree(
+	      NV_FLUSHER      *f
+	      )
+{
+    free(f->pending);
+    free(f->pendingDirty);
+    free(f->image);
+    free(f->dirty);
+    free(f);
+}
+/* C.6.2.3.5.4. NvFlusherStart() */
+/* This function starts a flusher thread for the NV image, which has to be in the NV file. The
+   thread takes over the journal. */
+/* Return Value	Meaning */
+/* 0	success */
+/* -1	error, the commits stay synchronous */
+static int
+NvFlusherStart(
+	       void
+	       )
+{
+    NV_FLUSHER          *f;
+    if(s_NvFlushStatus == NULL)
+	{
+	    s_NvFlushStatus = calloc(1, sizeof(NV_FLUSH_STATUS));
+	    if(s_NvFlushStatus == NULL)
+		return -1;
+	    pthread_mutex_init(&s_NvFlushStatus->lock, NULL);
+	    pthread_cond_init(&s_NvFlushStatus->done, NULL);
+	    s_NvFlushStatus->durable = s_NvFlushSequence;
+	}
+    f = calloc(1, sizeof(NV_FLUSHER));
+    if(f == NULL)
+	return -1;
+    f->status = s_NvFlushStatus;
+    f->mode = s_NvDurability;
+    f->size = s_NvSize;
+    f->committed = f->durable = s_NvFlushSequence;
+    f->journal = s_NvJournal;
+    f->pending = malloc(s_NvSize);
+    f->image = malloc(s_NvSize);
+    f->pendingDirty = calloc(NV_DIRTY_WORDS, sizeof(uint32_t));
+    f->dirty = calloc(NV_DIRTY_WORDS, sizeof(uint32_t));
+    if(f->pending == NULL || f->image == NULL || f->pendingDirty == NULL || f->dirty == NULL)
+	{
+	    NvFlusherFree(f);
+	    return -1;
+	}
+    memcpy(f->pending, s_NV, s_NvSize);
+    memcpy(f->image, s_NV, s_NvSize);
+    pthread_mutex_init(&f->lock, NULL);
+    pthread_cond_init(&f->wake, NULL);
+    if(pthread_create(&f->thread, NULL, NvFlusherMain, f) != 0)
+	{
+	    pthread_cond_destroy(&f->wake);
+	    pthread_mutex_destroy(&f->lock);
+	    NvFlusherFree(f);
+	    return -1;
+	}
+    s_NvFlusher = f;
+    return 0;
+}
+/* C.6.2.3.5.5. NvFlusherStop() */
+/* This function waits for the flusher thread to write the commits that are left, stops it and
+   takes the journal back. The commits of a flusher that failed are lost. */
+static void
+NvFlusherStop(
+	      void
+	      )
+{
+    NV_FLUSHER          *f = s_NvFlusher;
+    if(f == NULL)
+	return;
+    pthread_mutex_lock(&f->lock);
+    f->stop = TRUE;
+    pthread_cond_signal(&f->wake);
+    pthread_mutex_unlock(&f->lock);
+    pthread_join(f->thread, NULL);
+    s_NvJournal = f->journal;
+    // the next flusher numbers its commits after all of the ones of this flusher
+    s_NvFlushSequence = f->committed;
+    if(f->failed)
+	{
+	    pthread_mutex_lock(&f->status->lock);
+	    f->status->failedTo = f->committed;
+	    pthread_mutex_unlock(&f->status->lock);
+	}
+    s_NvFlusher = NULL;
+    pthread_cond_destroy(&f->wake);
+    pthread_mutex_destroy(&f->lock);
+    NvFlusherFree(f);
+}
+/* C.6.2.3.5.6. NvFlusherCommit() */
+/* This function hands the pages of the NV image that changed since the last commit to the flusher
+   thread. It fails, and hands nothing over, if an earlier flush failed. */
+/* Return Value	Meaning */
+/* TRUE	success */
+/* FALSE failure */
+static int
+NvFlusherCommit(
+		void
+		)
+{
+    NV_FLUSHER          *f = s_NvFlusher;
+    uint32_t             written;
+    int                  OK;
+    pthread_mutex_lock(&f->lock);
+    OK = !f->failed;
+    if(OK && NvFlusherTake(f->pending, f->pendingDirty, s_NV, s_NvDirty, s_NvSize) != 0)
+	{
+	    f->handed = ++f->committed;
+	    pthread_cond_signal(&f->wake);
+	}
+    written = f->written;
+    f->written = 0;
+    pthread_mutex_unlock(&f->lock);
+    _plat__StatsNvCommit(written);
+    return OK;
+}
+/* C.6.2.3.5.7. NvFlushResult() */
+/* This function tells, with the lock of status held, whether commit sequence is written (1), not
+   written yet (0), or lost (-1). The commits before a lost one were written. */
+static int
+NvFlushResult(
+	      NV_FLUSH_STATUS     *status,
+	      uint64_t             sequence
+	      )
+{
+    if(status->failedFrom != 0 && sequence >= status->failedFrom
+       && sequence <= status->failedTo)
+	return -1;
+    return (status->durable >= sequence) ? 1 : 0;
+}
+#endif
+
+#if FILE_BACKED_NV || defined(__ALTERA_ONCHIP_FLASH)
+/* C.6.2.3.6. NvFileCommit() */
+/* Write the pages of the NV image that changed since the last commit to the file, or to the
+   journal when it is open. Adjacent changed pages are written together. */
+/* Return Value	Meaning */
+/* TRUE	success */
+/* FALSE failure */
+static int
+NvFileCommit(
+	     void
+	     )
+{
+    int                  OK = TRUE;
+    unsigned int         page;
+    unsigned int         last;
+    unsigned int         start;
+    unsigned int         size;
+    uint32_t             written = 0;
+    // If NV file is not available, return failure
+    if(s_NvFile == NULL){
+		return 1;
+	}
+#if USE_NV_JOURNAL
+    if(s_NvFlusher != NULL)
+	return NvFlusherCommit();
+    if(s_NvJournal.fd >= 0)
+	OK = NvJournalAppend(&s_NvJournal, s_NV, s_NvSize, s_NvDirty, &written);
+    else
+#endif
+	for(page = 0; OK && page < NV_DIRTY_PAGES; page = last)
+	    {
+		// skip a word of clean pages at a time
+		last = (s_NvDirty[page / 32] == 0) ? (page | 31) + 1 : page + 1;
+		if(!NV_PAGE_IS_DIRTY(page))
+		    continue;
+		while(last < NV_DIRTY_PAGES && NV_PAGE_IS_DIRTY(last))
+		    last++;
+		start = page * NV_DIRTY_PAGE_SIZE;
+		size = MIN(last * NV_DIRTY_PAGE_SIZE, s_NvSize) - start;
+		OK = NvFileWrite(start, size);
+		written += size;
+	    }
+#if FILE_BACKED_NV && !defined TPM_POSIX
+    OK = OK && (0 == fflush(s_NvFile));
+#endif
+    if(OK)
+	memset(s_NvDirty, 0, NV_DIRTY_WORDS * sizeof(uint32_t));
+    _plat__StatsNvCommit(written);
+    assert(OK);
+    return OK;
 }
+#endif
 
+#if USE_NV_MMAP
+/* C.6.2.3.7. NvFileMapTemplate() */
+/* This function maps the template copy-on-write and copies it to the NV file, whose descriptor is
+   fd. */
+/* Return Value	Meaning */
+/* != MAP_FAILED	the mapping */
+/* MAP_FAILED	the template cannot be read or has another size than the NV image */
+static void *
+NvFileMapTemplate(
+		  int              fd
+		  )
+{
+    void                *map = MAP_FAILED;
+    struct stat          status;
+    int                  template;
+    //
+    template = open(s_NvTemplate, O_RDONLY | O_CLOEXEC);
+    if(template < 0)
+	return MAP_FAILED;
+    if(fstat(template, &status) == 0 && status.st_size == (off_t)s_NvSize)
+	map = mmap(NULL, s_NvSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, template, 0);
+    close(template);
+    // reading the pages to copy them does not copy them in memory
+    if(map != MAP_FAILED
+       && (ftruncate(fd, 0) != 0 || (ssize_t)s_NvSize != pwrite(fd, map, s_NvSize, 0)
+	   || fdatasync(fd) != 0))
+	{
+	    munmap(map, s_NvSize);
+	    map = MAP_FAILED;
+	}
+    if(map == MAP_FAILED)
+	printf("NV template %s cannot be used\n", s_NvTemplate);
+    return map;
+}
+/* C.6.2.3.8. NvFileUnmap() */
+/* This function unmaps the NV file or the template and points s_NV back to the allocated image.
+   Changes to the NV file that were not committed are still written back by the kernel. */
+static void
+NvFileUnmap(
+	    void
+	    )
+{
+    if(s_NvMap == NULL)
+	return;
+    munmap(s_NvMap, s_NvSize);
+    s_NV = s_NvHeap;
+    s_NvMap = NULL;
+    s_NvMapPrivate = FALSE;
+    s_NvHeap = NULL;
+}
+/* C.6.2.3.9. NvFileReload() */
+/* This function reads the pages of a kept template mapping that changed since the last commit back
+   from the NV file. */
+/* Return Value	Meaning */
+/* TRUE	success */
+/* FALSE	the NV file cannot be read */
+static int
+NvFileReload(
+	     void
+	     )
+{
+    unsigned int         page;
+    unsigned int         start;
+    unsigned int         size;
+    //
+    for(page = 0; page < NV_DIRTY_PAGES; page++)
+	{
+	    if(!NV_PAGE_IS_DIRTY(page))
+		continue;
+	    start = page * NV_DIRTY_PAGE_SIZE;
+	    size = MIN(start + NV_DIRTY_PAGE_SIZE, s_NvSize) - start;
+	    if((ssize_t)size != pread(fileno(s_NvFile), &s_NV[start], size, start))
+		return FALSE;
+	}
+    memset(s_NvDirty, 0, NV_DIRTY_WORDS * sizeof(uint32_t));
+    return TRUE;
+}
+/* C.6.2.3.10. NvFileMapped() */
+/* This function completes NvFileMap() for a template mapping. The commits go to the NV file as
+   when it is read, so its journal is opened as then. replay is for NvJournalOpen(). */
+/* Return Value	Meaning */
+/* 0	success */
+static int
+NvFileMapped(
+	     int              replay
+	     )
+{
+#if USE_NV_JOURNAL
+    NvJournalOpen(replay);
+    if(s_NvDurability != NV_DURABILITY_SYNC && s_NvJournal.fd >= 0)
+	NvFlusherStart();
+#endif
+    return 0;
+}
+/* C.6.2.3.11. NvFileMap() */
+/* This function opens and locks the NV file and maps it as the NV image. An NV file that does not
+   exist or has another size starts as a copy of the template, if there is one, and is initialized
+   otherwise. The commits that a run without the mapping left in the journal are applied. A template
+   mapping that NV kept from before the power cycle is used again. */
+/* Return Value	Meaning */
+/* 0	success */
+/* -1	error, or another process has the NV file */
+static int
+NvFileMap(
+	  void
+	  )
+{
+    void                *map = MAP_FAILED;
+    int                  fd;
+    //
+    // the file is created without being truncated, in case another process has it
+    fd = open(NvFilePath(), O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+    if(fd < 0)
+	return -1;
+    if(flock(fd, LOCK_EX | LOCK_NB) != 0 || (s_NvFile = fdopen(fd, "r+b")) == NULL)
+	{
+	    if(errno == EWOULDBLOCK)
+		printf("NV file %s is used by another process\n", NvFilePath());
+	    close(fd);
+	    return -1;
+	}
+    s_NeedsManufacture = (NvFileSize(SEEK_SET) != (long)s_NvSize);
+    if(s_NvMap != NULL)
+	{
+	    // The changes that were not committed are discarded, as if the file was read
+	    if(!s_NeedsManufacture && NvFileReload())
+		return NvFileMapped(TRUE);
+	    NvFileUnmap();
+	}
+    s_NvMapPrivate = s_NeedsManufacture && s_NvTemplate != NULL;
+    if(s_NvMapPrivate)
+	map = NvFileMapTemplate(fd);
+    // Extending the file adds zeros, so it is emptied first and erased through the mapping
+    else if(!s_NeedsManufacture || (ftruncate(fd, 0) == 0 && ftruncate(fd, s_NvSize) == 0))
+	map = mmap(NULL, s_NvSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(map == MAP_FAILED)
+	{
+	    // closing the file releases the lock
+	    fclose(s_NvFile);
+	    s_NvFile = NULL;
+	    s_NvMapPrivate = FALSE;
+	    return -1;
+	}
+    s_NvHeap = s_NV;
+    s_NV = s_NvMap = map;
+    memset(s_NvDirty, 0, NV_DIRTY_WORDS * sizeof(uint32_t));
+    if(s_NvMapPrivate)
+	{
+	    // the template is manufactured, and the journal of an earlier NV file is discarded
+	    s_NeedsManufacture = FALSE;
+	    return NvFileMapped(FALSE);
+	}
+    if(s_NeedsManufacture)
+	{
+	    _plat__NvMemoryClear(0, s_NvSize);
+	    NvFileCommit();
+	}
+#if USE_NV_JOURNAL
+    if(NvJournalOpen(!s_NeedsManufacture) >= 0)
+	{
+	    close(s_NvJournal.fd);
+	    s_NvJournal.fd = -1;
+	}
+#endif
+    return 0;
+}
 #endif
 
 /* C.6.2.4. _plat__NvErrors() */
@@ -236,9 +1096,172 @@ _plat__NvErrors(
     s_NV_unrecoverable = unrecoverable;
     s_NV_recoverable = recoverable;
 }
+/* C.6.2.4.1. _plat__NvSetSize() */
+/* This function sets the size of the NV image. It has to be called before NV is first enabled,
+   and the size can only be raised above NV_MEMORY_SIZE, since the TPM is built to fit its reserved
+   data into that. An NV file of another size is initialized again and the TPM remanufactured. */
+/* Return Values Meaning */
+/* 0 success */
+/* non-0 the NV image already exists or the size is out of range */
+LIB_EXPORT int
+_plat__NvSetSize(
+		 uint32_t         size           // IN: size of the NV image in bytes
+		 )
+{
+    if(s_NV != NULL || size < NV_MEMORY_SIZE || size > NV_MEMORY_SIZE_MAX)
+	return 1;
+    s_NvSize = size;
+    return 0;
+}
+/* C.6.2.4.2. _plat__NvMemorySize() */
+/* This function returns the size of the NV image. */
+LIB_EXPORT uint32_t
+_plat__NvMemorySize(
+		    void
+		    )
+{
+    return (s_NvSize != 0) ? s_NvSize : NV_MEMORY_SIZE;
+}
+/* C.6.2.4.3. NvMemoryAllocate() */
+/* This function allocates the NV image and its dirty page bitmap the first time NV is enabled. The
+   image keeps its contents across later power cycles. */
+/* Return Values Meaning */
+/* 0 success */
+/* non-0 allocation failure */
+static int
+NvMemoryAllocate(
+		 void
+		 )
+{
+    if(s_NV != NULL)
+	return 0;
+    s_NvSize = _plat__NvMemorySize();
+    // Zeroed, so that the image starts out as it did when it was a static array
+    s_NV = calloc(s_NvSize, 1);
+    s_NvDirty = calloc(NV_DIRTY_WORDS, sizeof(uint32_t));
+    if(s_NV == NULL || s_NvDirty == NULL)
+	{
+	    free(s_NV);
+	    free(s_NvDirty);
+	    s_NV = NULL;
+	    s_NvDirty = NULL;
+	    return 1;
+	}
+    return 0;
+}
+/* C.6.2.4.4. _plat__NvMemoryFree() */
+/* This function releases the NV image and the NV flush status. The NV file, if any, should be
+   closed first with _plat__NVDisable(). The image can hold secrets so it is cleared before it is
+   freed. */
+LIB_EXPORT void
+_plat__NvMemoryFree(
+		    void
+		    )
+{
+#if USE_NV_MMAP
+    NvFileUnmap();
+#endif
+    if(s_NV != NULL)
+	memset(s_NV, 0, s_NvSize);
+    free(s_NV);
+    free(s_NvDirty);
+    s_NV = NULL;
+    s_NvDirty = NULL;
+#if USE_NV_JOURNAL
+    if(s_NvFlushStatus != NULL)
+	{
+	    pthread_cond_destroy(&s_NvFlushStatus->done);
+	    pthread_mutex_destroy(&s_NvFlushStatus->lock);
+	    free(s_NvFlushStatus);
+	    s_NvFlushStatus = NULL;
+	}
+#endif
+}
+/* C.6.2.4.5. _plat__NvSetDurability() */
+/* This function chooses when the commits are written to the NV file. It has to be called before NV
+   is enabled. The mode is one of */
+/* sync - the commit is written before the response is sent, which is the default */
+/* group - a flusher thread writes the commit and the response is held until it is written. The
+   commits of the commands that run meanwhile are written with it. */
+/* async - the response is sent right away and the flusher thread writes the commit within about
+   NV_FLUSH_INTERVAL milliseconds */
+/* The modes other than sync need the NV journal. */
+/* Return Values Meaning */
+/* 0 success */
+/* 1 the mode is not known or not supported, or NV is enabled */
+LIB_EXPORT int
+_plat__NvSetDurability(
+		       const char      *mode
+		       )
+{
+#if USE_NV_JOURNAL
+    static const char   *const modes[] = {"sync", "group", "async"};
+    int                  i;
+    if(s_NvFile != NULL)
+	return 1;
+    for(i = 0; i < (int)(sizeof(modes) / sizeof(modes[0])); i++)
+	{
+	    if(strcmp(mode, modes[i]) == 0)
+		{
+		    s_NvDurability = i;
+		    return 0;
+		}
+	}
+    return 1;
+#else
+    return (strcmp(mode, "sync") != 0);
+#endif
+}
+/* C.6.2.4.6. _plat__NvSetMapped() */
+/* This function chooses whether the NV image is a shared mapping of the NV file rather than a copy
+   that is read when NV is enabled. It has to be called before NV is enabled. A mapped NV file has
+   no journal, so the durability mode does not apply and every commit is synced. */
+/* Return Values Meaning */
+/* 0 success */
+/* 1 mapping is not supported, or NV is enabled */
+LIB_EXPORT int
+_plat__NvSetMapped(
+		   int              mapped
+		   )
+{
+#if USE_NV_MMAP
+    if(s_NvFile != NULL)
+	return 1;
+    s_NvMapFile = mapped;
+    return 0;
+#else
+    return (mapped != 0);
+#endif
+}
+
+/* C.6.2.4.7. _plat__NvSetTemplate() */
+/* This function sets the template that a new NV file starts from, and maps the NV file. fileName is
+   an NV file of the NV size that is not changed. It is kept and used each time NV is enabled. It
+   has to be called before NV is enabled. */
+/* Return Values Meaning */
+/* 0 success */
+/* 1 mapping is not supported, or NV is enabled */
+LIB_EXPORT int
+_plat__NvSetTemplate(
+		     const char      *fileName
+		     )
+{
+#if USE_NV_MMAP
+    if(s_NvFile != NULL)
+	return 1;
+    s_NvTemplate = fileName;
+    s_NvMapFile = TRUE;
+    return 0;
+#else
+    NOT_REFERENCED(fileName);
+    return 1;
+#endif
+}
+
 /* C.6.2.5. _plat__NVEnable() */
 /* Enable NV memory. */
-/* This version just pulls in data from a file. In a real TPM, with NV on chip, this function would
+/* This version just pulls in data from a file. When platParameter is not NULL, it is the name of
+   the NV file to use instead of the default. In a real TPM, with NV on chip, this function would
    verify the integrity of the saved context. If the NV memory was not on chip but was in something
    like RPMB, the NV state would be read in, decrypted and integrity checked. */
 /* The recovery from an integrity failure depends on where the error occurred. It it was in the
@@ -255,14 +1278,23 @@ _plat__NVEnable(
 {
     NOT_REFERENCED(platParameter);          // to keep compiler quiet
     //
+    if(NvMemoryAllocate() != 0)
+	return -1;
     // Start assuming everything is OK
     s_NV_unrecoverable = FALSE;
     s_NV_recoverable = FALSE;
 #if FILE_BACKED_NV
     if(s_NvFile != NULL)
 	return 0;
+    // The TPM enables NV again at each power on without a name, which keeps the name it has
+    if(platParameter != NULL)
+	s_NvFileName = (const char *)platParameter;
+#if USE_NV_MMAP
+    if(s_NvMapFile)
+	return (NvFileMap() != 0 || s_NV_unrecoverable) ? -1 : s_NV_recoverable;
+#endif
     // Initialize all the bytes in the ram copy of the NV
-    _plat__NvMemoryClear(0, NV_MEMORY_SIZE);
+    _plat__NvMemoryClear(0, s_NvSize);
     
     // If the file exists
     if(NvFileOpen("r+b") >= 0)
@@ -271,14 +1303,20 @@ _plat__NVEnable(
 	    // file pointer at the start
 	    //
 	    // If the size is right, read the data
-	    if(NV_MEMORY_SIZE == fileSize)
+	    if(s_NvSize == fileSize)
 		{
 		    s_NeedsManufacture =
-			fread(s_NV, 1, NV_MEMORY_SIZE, s_NvFile) != NV_MEMORY_SIZE;
+			fread(s_NV, 1, s_NvSize, s_NvFile) != s_NvSize;
+		    // the file matches the NV image
+		    memset(s_NvDirty, 0, NV_DIRTY_WORDS * sizeof(uint32_t));
 		}
 	    else
 		{
-		    NvFileCommit();     // for any other size, initialize it
+		    // For any other size, initialize it.  A longer file is emptied first,
+		    // or its size would still be wrong at the next NV enable.
+		    fclose(s_NvFile);
+		    if(NvFileOpen("w+b") >= 0)
+			NvFileCommit();
 		    s_NeedsManufacture = TRUE;
 		}
 	}
@@ -289,11 +1327,19 @@ _plat__NVEnable(
 	    s_NeedsManufacture = TRUE;
 	}
     assert(NULL != s_NvFile);       // Just in case we are broken for some reason.
+#if USE_NV_JOURNAL
+    // Apply the commits that are still in the journal, unless the NV file was just initialized.
+    // Without a journal the NV file is updated in place.
+    NvJournalOpen(!s_NeedsManufacture);
+    // Without a flusher, the commits stay synchronous
+    if(s_NvDurability != NV_DURABILITY_SYNC && s_NvJournal.fd >= 0)
+	NvFlusherStart();
+#endif
 #elif defined(__ALTERA_ONCHIP_FLASH)
     if(s_NvFile != NULL)
 	return 0;
     // Initialize all the bytes in the ram copy of the NV
-    _plat__NvMemoryClear(0, NV_MEMORY_SIZE);
+    _plat__NvMemoryClear(0, s_NvSize);
     
     // If the file exists
     if(NvFileOpen("r+b") >= 0)
@@ -302,9 +1348,11 @@ _plat__NVEnable(
 	    // file pointer at the start
 	    //
 	    // If the size is right, read the data
-	    if(NV_MEMORY_SIZE == fileSize)
+	    if(s_NvSize == fileSize)
 		{
-		    s_NeedsManufacture = alt_read_flash(s_NvFile, 0,s_NV, NV_MEMORY_SIZE);
+		    s_NeedsManufacture = alt_read_flash(s_NvFile, 0,s_NV, s_NvSize);
+		    // the flash matches the NV image
+		    memset(s_NvDirty, 0, NV_DIRTY_WORDS * sizeof(uint32_t));
 		}
 	    else
 		{
@@ -336,6 +1384,21 @@ _plat__NVDisable(
 		 )
 {
 #if  FILE_BACKED_NV
+#if USE_NV_JOURNAL
+    // Write what the flusher has not written yet
+    NvFlusherStop();
+    // A deleted NV file is initialized again when NV is next enabled, which discards the journal
+    if(s_NvJournal.fd >= 0)
+	{
+	    close(s_NvJournal.fd);
+	    s_NvJournal.fd = -1;
+	}
+#endif
+#if USE_NV_MMAP
+    // A template mapping is kept for the next power on, so that its pages stay shared
+    if(delete || !s_NvMapPrivate)
+	NvFileUnmap();
+#endif
     if(NULL != s_NvFile)
 	{
 	    fclose(s_NvFile);    // Close NV file
@@ -407,7 +1470,7 @@ _plat__NvMemoryRead(
 		    void            *data           // OUT: data buffer
 		    )
 {
-    assert(startOffset + size <= NV_MEMORY_SIZE);
+    assert(startOffset + size <= s_NvSize);
     memcpy(data, &s_NV[startOffset], size);	// Copy data from RAM
     return;
 }
@@ -426,12 +1489,26 @@ _plat__NvIsDifferent(
 {
     return (memcmp(&s_NV[startOffset], data, size) != 0);
 }
+/* C.6.2.9.1. NvMarkDirty() */
+/* This function notes the pages of the NV image that a change touches, so that _plat__NvCommit()
+   only writes those pages. */
+static void
+NvMarkDirty(
+	    unsigned int     startOffset,   // IN: change start
+	    unsigned int     size           // IN: size of the change
+	    )
+{
+    unsigned int         page;
+    if(size == 0)
+	return;
+    for(page = startOffset / NV_DIRTY_PAGE_SIZE;
+	page <= (startOffset + size - 1) / NV_DIRTY_PAGE_SIZE; page++)
+	NV_PAGE_SET_DIRTY(page);
+}
 /* C.6.2.10. _plat__NvMemoryWrite() */
 /* This function is used to update NV memory. The write is to a memory copy of NV. At the end of the
-   current command, any changes are written to the actual NV memory. */
-/* NOTE: A useful optimization would be for this code to compare the current contents of NV with the
-   local copy and note the blocks that have changed. Then only write those blocks when
-   _plat__NvCommit() is called. */
+   current command, the pages that changed are written to the actual NV memory. A write that does
+   not change the NV contents does not make a page dirty. */
 
 LIB_EXPORT int
 _plat__NvMemoryWrite(
@@ -440,9 +1517,14 @@ _plat__NvMemoryWrite(
 		     void            *data           // OUT: data buffer
 		     )
 {
-    if(startOffset + size <= NV_MEMORY_SIZE)
+    if(startOffset + size <= s_NvSize)
 	{
-	    memcpy(&s_NV[startOffset], data, size);     // Copy the data to the NV image
+	    if(memcmp(&s_NV[startOffset], data, size) != 0)
+		{
+		    memcpy(&s_NV[startOffset], data, size);     // Copy the data to the NV image
+		    NvMarkDirty(startOffset, size);
+		    _plat__StatsNvWrite(size);
+		}
 	    return TRUE;
 	}
     return FALSE;
@@ -456,9 +1538,11 @@ _plat__NvMemoryClear(
 		     unsigned int     size           // IN: number of bytes to clear
 		     )
 {
-    assert(start + size <= NV_MEMORY_SIZE);
+    assert(start + size <= s_NvSize);
     // In this implementation, assume that the erase value for NV is all 1s
     memset(&s_NV[start], 0xff, size);
+    NvMarkDirty(start, size);
+    _plat__StatsNvWrite(size);
 }
 /* C.6.2.12. _plat__NvMemoryMove() */
 /* Function: Move a chunk of NV memory from source to destination This function should ensure that
@@ -470,14 +1554,16 @@ _plat__NvMemoryMove(
 		    unsigned int     size           // IN: size of data being moved
 		    )
 {
-    assert(sourceOffset + size <= NV_MEMORY_SIZE);
-    assert(destOffset + size <= NV_MEMORY_SIZE);
+    assert(sourceOffset + size <= s_NvSize);
+    assert(destOffset + size <= s_NvSize);
     memmove(&s_NV[destOffset], &s_NV[sourceOffset], size);	// Move data in RAM
+    NvMarkDirty(destOffset, size);
+    _plat__StatsNvWrite(size);
     return;
 }
 /* C.6.2.13. _plat__NvCommit() */
-/* This function writes the local copy of NV to NV for permanent store. It will write NV_MEMORY_SIZE
-   bytes to NV. If a file is use, the entire file is written. */
+/* This function writes the local copy of NV to NV for permanent store. Only the pages that changed
+   since the last commit are written. */
 /* Return Values Meaning */
 /* 0 NV write success */
 /* non-0 NV write fail */
@@ -491,10 +1577,112 @@ _plat__NvCommit(
 #elif defined(__ALTERA_ONCHIP_FLASH)
 	return (NvFileCommit() ? 0 : 1);
 #else
+    // nothing to write, the NV image is the NV
+    memset(s_NvDirty, 0, NV_DIRTY_WORDS * sizeof(uint32_t));
+    _plat__StatsNvCommit(0);
     return 0;
 #endif
 }
 
+/* C.6.2.13.1. _plat__NvFlushPending() */
+/* In the group durability mode, this function returns the commit that has to be written before
+   the response to the last command may be sent. status is set to the flush status of the selected
+   instance, which stays valid until its NV image is freed, so that the commit can be checked with
+   any instance selected. */
+/* Return Values Meaning */
+/* 0 the response can be sent */
+/* > 0 the commit to wait for with _plat__NvFlushDone() or _plat__NvFlushWait() */
+LIB_EXPORT uint64_t
+_plat__NvFlushPending(
+		      NV_FLUSH_STATUS     **status
+		      )
+{
+    uint64_t             sequence = 0;
+#if USE_NV_JOURNAL
+    NV_FLUSHER          *f = s_NvFlusher;
+    if(f != NULL && f->mode == NV_DURABILITY_GROUP)
+	{
+	    // After a flush failed, only a response whose own commit was taken waits, to learn that
+	    // it was lost. The commits after it are refused, so the others come from the failure mode.
+	    pthread_mutex_lock(&f->lock);
+	    if(f->failed)
+		sequence = f->handed;
+	    else if(f->durable < f->committed)
+		sequence = f->committed;
+	    f->handed = 0;
+	    pthread_mutex_unlock(&f->lock);
+	}
+    *status = s_NvFlushStatus;
+#else
+    *status = NULL;
+#endif
+    return sequence;
+}
+/* C.6.2.13.2. _plat__NvFlushDone() */
+/* This function checks whether a commit returned by _plat__NvFlushPending() has been written. */
+/* Return Values Meaning */
+/* 1 the commit is written */
+/* 0 the commit is not written yet */
+/* -1 the commit could not be written. The response that waits for it must not be sent. */
+LIB_EXPORT int
+_plat__NvFlushDone(
+		   NV_FLUSH_STATUS     *status,
+		   uint64_t             sequence
+		   )
+{
+    int                  done = 1;
+#if USE_NV_JOURNAL
+    if(status != NULL)
+	{
+	    pthread_mutex_lock(&status->lock);
+	    done = NvFlushResult(status, sequence);
+	    pthread_mutex_unlock(&status->lock);
+	}
+#else
+    NOT_REFERENCED(status);
+    NOT_REFERENCED(sequence);
+#endif
+    return done;
+}
+/* C.6.2.13.3. _plat__NvFlushWait() */
+/* This function waits until a commit returned by _plat__NvFlushPending() is written or could not
+   be written. It returns the result of _plat__NvFlushDone(). */
+LIB_EXPORT int
+_plat__NvFlushWait(
+		   NV_FLUSH_STATUS     *status,
+		   uint64_t             sequence
+		   )
+{
+    int                  done = 1;
+#if USE_NV_JOURNAL
+    if(status != NULL)
+	{
+	    pthread_mutex_lock(&status->lock);
+	    while((done = NvFlushResult(status, sequence)) == 0)
+		pthread_cond_wait(&status->done, &status->lock);
+	    pthread_mutex_unlock(&status->lock);
+	}
+#else
+    NOT_REFERENCED(status);
+    NOT_REFERENCED(sequence);
+#endif
+    return done;
+}
+/* C.6.2.13.4. _plat__NvFlushNotify() */
+/* This function sets an eventfd that the flusher threads of all instances write after each
+   flush, so that an event loop can send the responses that were held. -1 removes it. */
+LIB_EXPORT void
+_plat__NvFlushNotify(
+		     int              fd
+		     )
+{
+#if USE_NV_JOURNAL
+    __atomic_store_n(&s_NvFlushNotify, fd, __ATOMIC_RELEASE);
+#else
+    NOT_REFERENCED(fd);
+#endif
+}
+
 /* C.6.2.14. _plat__SetNvAvail() */
 /* Set the current NV state to available.  This function is for testing purpose only.  It is not
    part of the platform NV logic */
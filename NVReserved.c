@@ -74,7 +74,7 @@ NvInitStatic(
     // In some implementations, the end of NV is variable and is set at boot time.
     // This value will be the same for each boot, but is not necessarily known
     // at compile time.
-    s_evictNvEnd = (NV_REF)NV_MEMORY_SIZE;
+    s_evictNvEnd = (NV_REF)_plat__NvMemorySize();
     return;
 }
 /* 8.5.3.2 NvCheckState() */
@@ -125,6 +125,8 @@ NvPowerOn(
 	    if((nvError = _plat__NVEnable(0)) < 0)
 		FAIL(FATAL_ERROR_NV_UNRECOVERABLE);
 	    NvInitStatic();
+	    // The NV image was reloaded so the handle index has to be rebuilt
+	    NvHandleIndexInit();
 	}
     return nvError == 0;
 }
@@ -139,7 +141,7 @@ NvManufacture(
 {
 #if SIMULATION
     // Simulate the NV memory being in the erased state.
-    _plat__NvMemoryClear(0, NV_MEMORY_SIZE);
+    _plat__NvMemoryClear(0, _plat__NvMemorySize());
 #endif
     // Initialize static variables
     NvInitStatic();
@@ -153,6 +155,7 @@ NvManufacture(
     // Put the end of list marker at the end of memory. This contains the MaxCount
     // value as well as the end marker.
     NvWriteNvListEnd(NV_USER_DYNAMIC);
+    NvHandleIndexInit();
     return;
 }
 /* 8.5.3.6 NvRead() */
@@ -165,7 +168,7 @@ NvRead(
        )
 {
     // Input type should be valid
-    pAssert(nvOffset + size < NV_MEMORY_SIZE);
+    pAssert(nvOffset + size < _plat__NvMemorySize());
     _plat__NvMemoryRead(nvOffset, size, outBuffer);
     return;
 }
@@ -180,7 +183,7 @@ NvWrite(
 	)
 {
     // Input type should be valid
-    if(nvOffset + size <= NV_MEMORY_SIZE)
+    if(nvOffset + size <= _plat__NvMemorySize())
 	{
 	    // Set the flag that a NV write happened
 	    SET_NV_UPDATE(UT_NV);
@@ -149,7 +149,7 @@
 SHA1_OID(_);        // Expands to:
 //     MAKE_OID(_SHA1)
 // which expands to:
-//     EXTERN  const BYTE OID_SHA1[] INITIALIZER({OID_SHA1_VALUE})
+//     EXTERN_CONST BYTE OID_SHA1[] INITIALIZER({OID_SHA1_VALUE})
 // which, depending on the setting of EXTERN and
 // INITIALIZER, expands to either:
 //      extern const BYTE    OID_SHA1[]
@@ -67,15 +67,15 @@
 #include "Tpm.h"
 /* 8.6.3 Functions */
 /* 8.6.3.1 ObjectFlush() */
-/* This function marks an object slot as available. Since there is no checking of the input
-   parameters, it should be used judiciously. */
-/* NOTE: This could be converted to a macro. */
+/* This function marks an object slot as available and erases any symmetric key schedule kept for
+   it. Since there is no checking of the input parameters, it should be used judiciously. */
 void
 ObjectFlush(
 	    OBJECT          *object
 	    )
 {
     object->attributes.occupied = CLEAR;
+    CryptSymFlushKeySchedules(object);
 }
 /* 8.6.3.2 ObjectSetInUse() */
 /* This access function sets the occupied attribute of an object slot. */
@@ -150,8 +150,8 @@ IsObjectPresent(
 /* This function is used to check if the object is a sequence object. This function should not be
    called if the handle does not reference a loaded object. */
 /* Return Values Meaning */
-/* TRUE object is an HMAC, hash, or event sequence object */
-/* FALSE object is not an HMAC, hash, or event sequence object */
+/* TRUE object is an HMAC, hash, event, or symmetric sequence object */
+/* FALSE object is not an HMAC, hash, event, or symmetric sequence object */
 BOOL
 ObjectIsSequence(
 		 OBJECT          *object         // IN: handle to be checked
@@ -160,7 +160,8 @@ ObjectIsSequence(
     pAssert(object != NULL);
     return (object->attributes.hmacSeq == SET
 	    || object->attributes.hashSeq == SET
-	    || object->attributes.eventSeq == SET);
+	    || object->attributes.eventSeq == SET
+	    || object->attributes.symSeq == SET);
 }
 /* 8.6.3.7 HandleToObject() */
 /* This function is used to find the object structure associated with a handle. */
@@ -584,6 +585,39 @@ ObjectCreateEventSequence(
 	CryptHashStart(&hashObject->state.hashState[count], hash);
     return TPM_RC_SUCCESS;
 }
+/* 8.6.3.19.1 ObjectCreateSymSequence() */
+/* This function creates a symmetric encryption sequence object. The sequence gets a copy of the key
+   of keyObject, so it is not affected if keyObject is flushed. The caller has checked that
+   keyObject is a symmetric key that may be used for the operation and that mode and ivIn are
+   compatible with it. */
+/* Error Returns Meaning */
+/* TPM_RC_OBJECT_MEMORY if there is no free slot for an object */
+TPM_RC
+ObjectCreateSymSequence(
+			OBJECT          *keyObject,     // IN: the symmetric key object
+			TPMI_YES_NO      decrypt,       // IN: YES for a decryption sequence
+			TPM_ALG_ID       mode,          // IN: the block cipher mode
+			TPM2B_IV        *ivIn,          // IN: the initial IV
+			TPM2B_AUTH      *auth,          // IN: authValue
+			TPMI_DH_OBJECT  *newHandle      // OUT: sequence object handle
+			)
+{
+    HASH_OBJECT         *symObject = AllocateSequenceSlot(newHandle, auth);
+    SYM_SEQUENCE_STATE  *state;
+    // See if slot allocated
+    if(symObject == NULL)
+	return TPM_RC_OBJECT_MEMORY;
+    // Set the symmetric sequence attribute
+    symObject->attributes.symSeq = SET;
+    state = &symObject->state.symState;
+    state->sym = keyObject->publicArea.parameters.symDetail.sym;
+    state->sym.mode.sym = mode;
+    state->decrypt = decrypt;
+    state->closed = FALSE;
+    state->iv = *ivIn;
+    state->key = keyObject->sensitive.sensitive.sym;
+    return TPM_RC_SUCCESS;
+}
 /* 8.6.3.20 ObjectTerminateEvent() */
 /* This function is called to close out the event sequence and clean up the hash context states. */
 void
@@ -657,6 +691,7 @@ FlushObject(
     // Clear all the object attributes
     MemorySet((BYTE*)&(s_objects[index].attributes),
 	      0, sizeof(OBJECT_ATTRIBUTES));
+    CryptSymFlushKeySchedules(&s_objects[index]);
     return;
 }
 /* 8.6.3.23 ObjectFlushHierarchy() */
@@ -677,15 +712,15 @@ ObjectFlushHierarchy(
 			{
 			  case TPM_RH_PLATFORM:
 			    if(s_objects[i].attributes.ppsHierarchy == SET)
-				s_objects[i].attributes.occupied = FALSE;
+				ObjectFlush(&s_objects[i]);
 			    break;
 			  case TPM_RH_OWNER:
 			    if(s_objects[i].attributes.spsHierarchy == SET)
-				s_objects[i].attributes.occupied = FALSE;
+				ObjectFlush(&s_objects[i]);
 			    break;
 			  case TPM_RH_ENDORSEMENT:
 			    if(s_objects[i].attributes.epsHierarchy == SET)
-				s_objects[i].attributes.occupied = FALSE;
+				ObjectFlush(&s_objects[i]);
 			    break;
 			  default:
 			    FAIL(FATAL_ERROR_INTERNAL);
@@ -926,3 +961,59 @@ ObjectGetProperties(
 {
     return HandleToObject(handle)->attributes;
 }
+/* 8.6.3.33.1 HashStateRebase() */
+/* This function moves the pointers into the program that a hash state holds by delta. */
+static void
+HashStateRebase(
+		HASH_STATE      *state,
+		intptr_t         delta
+		)
+{
+    switch(state->type)
+	{
+	  case HASH_STATE_HASH:
+	  case HASH_STATE_HMAC:
+	    if(state->def != NULL)
+		state->def = (PHASH_DEF)((uintptr_t)state->def + delta);
+	    break;
+#if SMAC_IMPLEMENTED
+	  case HASH_STATE_SMAC:
+	    state->state.smac.smacMethods.data = (SMAC_DATA_METHOD)
+		((uintptr_t)state->state.smac.smacMethods.data + delta);
+	    state->state.smac.smacMethods.end = (SMAC_END_METHOD)
+		((uintptr_t)state->state.smac.smacMethods.end + delta);
+	    break;
+#endif
+	  default:
+	    break;
+	}
+}
+/* 8.6.3.33 ObjectRebase() */
+/* This function moves the pointers into the program that the loaded sequence objects hold by
+   delta. It is used by TPM_Rebase(). */
+void
+ObjectRebase(
+	     intptr_t         delta
+	     )
+{
+    HASH_OBJECT     *hashObject;
+    UINT32           i;
+    UINT32           j;
+    //
+    if(delta == 0)
+	return;
+    for(i = 0; i < MAX_LOADED_OBJECTS; i++)
+	{
+	    if(!s_objects[i].attributes.occupied || !ObjectIsSequence(&s_objects[i]))
+		continue;
+	    hashObject = (HASH_OBJECT *)&s_objects[i];
+	    // A symmetric sequence holds no pointers
+	    if(hashObject->attributes.symSeq == SET)
+		continue;
+	    if(hashObject->attributes.hmacSeq == SET)
+		HashStateRebase(&hashObject->state.hmacState.hashState, delta);
+	    else
+		for(j = 0; j < HASH_COUNT; j++)
+		    HashStateRebase(&hashObject->state.hashState[j], delta);
+	}
+}
@@ -153,6 +153,15 @@ ObjectCreateEventSequence(
 			  TPM2B_AUTH      *auth,          // IN: authValue
 			  TPMI_DH_OBJECT  *newHandle      // OUT: sequence object handle
 			  );
+TPM_RC
+ObjectCreateSymSequence(
+			OBJECT          *keyObject,     // IN: the symmetric key object
+			TPMI_YES_NO      decrypt,       // IN: YES for a decryption sequence
+			TPM_ALG_ID       mode,          // IN: the block cipher mode
+			TPM2B_IV        *ivIn,          // IN: the initial IV
+			TPM2B_AUTH      *auth,          // IN: authValue
+			TPMI_DH_OBJECT  *newHandle      // OUT: sequence object handle
+			);
 void
 ObjectTerminateEvent(
 		     void
@@ -222,6 +231,10 @@ OBJECT_ATTRIBUTES
 ObjectGetProperties(
 		    TPM_HANDLE       handle
 		    );
+void
+ObjectRebase(
+	     intptr_t         delta
+	     );
 
 
 #endif
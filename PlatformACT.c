@@ -62,6 +62,17 @@
 /* C.16.1.	Includes */
 #include "Platform.h"
 #include "PlatformACT_fp.h"
+/* The ticks come from a thread of their own while the TPM uses the ACTs of the selected instance,
+   so both take s_actLock. It is taken inside the instance lock of _plat__InstanceForEach(). */
+#if INSTANCE_CONTEXT
+#include <pthread.h>
+static pthread_mutex_t  s_actLock = PTHREAD_MUTEX_INITIALIZER;
+#   define ACT_LOCK()       pthread_mutex_lock(&s_actLock)
+#   define ACT_UNLOCK()     pthread_mutex_unlock(&s_actLock)
+#else
+#   define ACT_LOCK()
+#   define ACT_UNLOCK()
+#endif
 /* C.16.2.	Functions */
 /* C.16.2.1.	ActSignal() */
 /* Function called when there is an ACT event to signal or unsignal */
@@ -192,9 +203,11 @@ _plat__ACT_GetRemaining(
     //
     if(actData == NULL)
 	return 0;
+    ACT_LOCK();
     remain = actData->remaining;
     if(actData->pending)
 	remain = actData->newValue;
+    ACT_UNLOCK();
     return remain;
 }
 /* C.16.2.5.	_plat__ACT_GetSignaled() */
@@ -204,10 +217,14 @@ _plat__ACT_GetSignaled(
 		       )
 {
     P_ACT_DATA              actData = ActGetDataPointer(act);
+    int                     signaled;
     //
     if(actData == NULL)
 	return 0;
-    return (int)actData->signaled;
+    ACT_LOCK();
+    signaled = (int)actData->signaled;
+    ACT_UNLOCK();
+    return signaled;
 }
 /* C.16.2.6.	_plat__ACT_SetSignaled() */
 LIB_EXPORT void
@@ -216,7 +233,9 @@ _plat__ACT_SetSignaled(
 		       int                 on
 		       )
 {
+    ACT_LOCK();
     ActSignal(ActGetDataPointer(act), on);
+    ACT_UNLOCK();
 }
 /* C.16.2.7.	_plat__ACT_GetPending() */
 LIB_EXPORT int
@@ -225,10 +244,14 @@ _plat__ACT_GetPending(
 		      )
 {
     P_ACT_DATA              actData = ActGetDataPointer(act);
+    int                     pending;
     //
     if(actData == NULL)
 	return 0;
-    return (int)actData->pending;
+    ACT_LOCK();
+    pending = (int)actData->pending;
+    ACT_UNLOCK();
+    return pending;
 }
 /* C.16.2.8.	_plat__ACT_UpdateCounter() */
 /* This function is used to write the newValue for the counter. If an update is pending, then no
@@ -246,11 +269,16 @@ _plat__ACT_UpdateCounter(
 	// actData doesn't exist but pretend update is pending rather than indicate
 	// that a retry is necessary.
 	return TRUE;
+    ACT_LOCK();
     // if an update is pending then return FALSE so that there will be a retry
     if(actData->pending != 0)
-	return FALSE;
+	{
+	    ACT_UNLOCK();
+	    return FALSE;
+	}
     actData->newValue = newValue;
     actData->pending = TRUE;
+    ACT_UNLOCK();
     
     return TRUE;
 }
@@ -263,7 +291,9 @@ _plat__ACT_EnableTicks(
 		       int 	enable
 		       )
 {
+    ACT_LOCK();
     actTicksAllowed = enable;
+    ACT_UNLOCK();
 }
 /* C.16.2.10.	ActDecrement() */
 /* If newValue is non-zero it is copied to remaining and then newValue is set to zero. Then
@@ -300,24 +330,38 @@ ActDecrement(
     if(actData->signaled && (actData->remaining > 0))
 	ActSignal(actData, FALSE);
 }
-/* C.16.2.11.	_plat__ACT_Tick() */
-/* This processes the once-per-second clock tick from the hardware. This is set up for the simulator to use the control interface to send ticks to the TPM. These ticks do not have to be on a per second basis. They can be as slow or as fast as desired so that the simulation can be tested. */
-LIB_EXPORT void
-_plat__ACT_Tick(
-		void
+/* C.16.2.11.	ActTickInstance() */
+/* This function processes a tick for the ACTs of instance. The ACT data of an instance that is not
+   selected is in its saved state. */
+static void
+ActTickInstance(
+		TPM_INSTANCE    *instance
 		)
 {
+    ACT_LOCK();
     // Ticks processing is turned off at certain times just to make sure that nothing
     // strange is happening before pointers and things are
-    if(actTicksAllowed)
+    if(*(int *)_plat__InstanceVariable(instance, &actTicksAllowed))
 	{
 	    // Handle the update for each counter.
-#define DECREMENT_COUNT(N)   ActDecrement(&ACT_##N);
+#define DECREMENT_COUNT(N)   ActDecrement(_plat__InstanceVariable(instance, &ACT_##N));
 	    
 	    FOR_EACH_ACT(DECREMENT_COUNT)
 		}
+    ACT_UNLOCK();
+}
+/* C.16.2.12.	_plat__ACT_Tick() */
+/* This processes the once-per-second clock tick from the hardware. This is set up for the simulator to use the control interface to send ticks to the TPM. These ticks do not have to be on a per second basis. They can be as slow or as fast as desired so that the simulation can be tested. */
+/* The tick goes to every instance, so that the ACTs of an instance run whether or not it is
+   selected. */
+LIB_EXPORT void
+_plat__ACT_Tick(
+		void
+		)
+{
+    _plat__InstanceForEach(ActTickInstance);
 }
-/* C.16.2.12.	ActZero() */
+/* C.16.2.13.	ActZero() */
 /* This function initializes a single ACT */
 static void
 ActZero(
@@ -331,16 +375,18 @@ ActZero(
     actData->number = (uint8_t)act;
     ActSignal(actData, FALSE);
 }
-/* C.16.2.13.	_plat__ACT_Initialize() */
+/* C.16.2.14.	_plat__ACT_Initialize() */
 /* This function initializes the ACT hardware and data structures */
 LIB_EXPORT int
 _plat__ACT_Initialize(
 		      void
 		      )
 {
+    ACT_LOCK();
     actTicksAllowed = 0;
 #define ZERO_ACT(N)  ActZero(0x##N, &ACT_##N);
     FOR_EACH_ACT(ZERO_ACT)
+	ACT_UNLOCK();
 	
 	return TRUE;
 }
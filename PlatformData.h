@@ -61,14 +61,18 @@
 
 /* c.8 PlatformData.h */
 /* This file contains the instance data for the Platform module. It is collected in this file so
-   that the state of the module is easier to manage. */
+   that the state of the module is easier to manage. The variables are part of the TPM instance
+   state so that they are saved and restored along with the TPM state in Global.h. The variables
+   declared with EXTERN_LOCAL refer to resources of the process and are left out of a snapshot. */
 
 #ifndef _PLATFORM_DATA_H_
 #define _PLATFORM_DATA_H_
 #ifdef  _PLATFORM_DATA_C_
-#define EXTERN
+#define EXTERN  INSTANCE_STATE
+#define EXTERN_LOCAL  INSTANCE_LOCAL
 #else
 #define EXTERN  extern
+#define EXTERN_LOCAL  extern
 #endif
 
 /* From Cancel.c Cancel flag.  It is initialized as FALSE, which indicate the command is not being
@@ -118,7 +122,30 @@ EXTERN unsigned char s_locality;
 // #   define      FILE_BACKED_NV          YES
 // #endif // SIMULATION
 
-EXTERN unsigned char    s_NV[NV_MEMORY_SIZE];
+// With a file backed NV on POSIX, each commit is appended to a journal next to the NV file and
+// synced, and the journal is folded into the NV file every NV_JOURNAL_CHECKPOINT commits. A crash
+// can then not leave a partly written NV file. Otherwise the NV file is updated in place.
+#if !(defined NV_JOURNAL) || ((NV_JOURNAL != NO) && (NV_JOURNAL != YES))
+#   undef   NV_JOURNAL
+#   define  NV_JOURNAL              YES     // Default: Either YES or NO
+#endif
+#define NV_JOURNAL_CHECKPOINT       256
+// In the async durability mode, a commit reaches the journal at most about this many milliseconds
+// after the response was sent.
+#define NV_FLUSH_INTERVAL           10
+
+/* The NV image is allocated when NV is first enabled. Its size is NV_MEMORY_SIZE unless
+   _plat__NvSetSize() chose a larger one, up to NV_MEMORY_SIZE_MAX. */
+EXTERN_LOCAL unsigned char   *s_NV;
+EXTERN_LOCAL uint32_t         s_NvSize;
+/* Pages of s_NV that changed since the last _plat__NvCommit(), one bit per page. The bitmap is
+   allocated with s_NV. */
+#define NV_DIRTY_PAGE_SIZE      512
+#define NV_DIRTY_PAGES          ((s_NvSize + NV_DIRTY_PAGE_SIZE - 1) / NV_DIRTY_PAGE_SIZE)
+#define NV_DIRTY_WORDS          ((NV_DIRTY_PAGES + 31) / 32)
+#define NV_PAGE_IS_DIRTY(page)  ((s_NvDirty[(page) / 32] >> ((page) % 32)) & 1)
+#define NV_PAGE_SET_DIRTY(page) (s_NvDirty[(page) / 32] |= (uint32_t)1 << ((page) % 32))
+EXTERN_LOCAL uint32_t        *s_NvDirty;
 EXTERN int              s_NvIsAvailable;
 EXTERN int              s_NV_unrecoverable;
 EXTERN int              s_NV_recoverable;
@@ -65,6 +65,12 @@
 
 #include "BaseTypes.h"
 
+/* A TPM instance (see InstancePlat.c). The structure is private to the platform. */
+typedef struct TPM_INSTANCE TPM_INSTANCE;
+/* The progress of the background NV flushes of an instance (see NVMem.c). The structure is private
+   to the platform. */
+typedef struct NV_FLUSH_STATUS NV_FLUSH_STATUS;
+
 /* C.8.1. From Cancel.c */
 /* C.8.1.1. _plat__IsCanceled() */
 /* Check if the cancel flag is set */
@@ -182,6 +188,46 @@ _plat__NvErrors(
 		int              recoverable,
 		int            unrecoverable
 		);
+/* C.8.5.1.1. _plat__NvSetSize() */
+/* This function sets the size of the NV image. It has to be called before NV is first enabled and
+   the size can only be raised above NV_MEMORY_SIZE. */
+LIB_EXPORT int
+_plat__NvSetSize(
+		 uint32_t         size
+		 );
+/* C.8.5.1.2. _plat__NvMemorySize() */
+/* This function returns the size of the NV image. */
+LIB_EXPORT uint32_t
+_plat__NvMemorySize(
+		    void
+		    );
+/* C.8.5.1.3. _plat__NvMemoryFree() */
+/* This function releases the NV image. */
+LIB_EXPORT void
+_plat__NvMemoryFree(
+		    void
+		    );
+/* C.8.5.1.4. _plat__NvSetDurability() */
+/* This function chooses when the commits are written to the NV file, "sync", "group" or "async".
+   It has to be called before NV is enabled. */
+LIB_EXPORT int
+_plat__NvSetDurability(
+		       const char      *mode
+		       );
+/* C.8.5.1.5. _plat__NvSetMapped() */
+/* This function chooses whether the NV image is a shared mapping of the NV file. It has to be
+   called before NV is enabled. */
+LIB_EXPORT int
+_plat__NvSetMapped(
+		   int              mapped
+		   );
+/* C.8.5.1.6. _plat__NvSetTemplate() */
+/* This function sets the NV file that a new NV file starts from, mapped copy-on-write. It has to
+   be called before NV is enabled. */
+LIB_EXPORT int
+_plat__NvSetTemplate(
+		     const char      *fileName
+		     );
 /* C.8.5.2. _plat__NVEnable() */
 /* Enable NV memory. */
 /* This version just pulls in data from a file. In a real TPM, with NV on chip, this function would
@@ -273,6 +319,39 @@ LIB_EXPORT int
 _plat__NvCommit(
 		void
 		);
+/* C.8.5.10.1. _plat__NvFlushPending() */
+/* In the group durability mode, this function returns the commit that has to be written before
+   the response to the last command may be sent, or 0. status is set to where the progress of the
+   commit can be checked without selecting the instance. */
+LIB_EXPORT uint64_t
+_plat__NvFlushPending(
+		      NV_FLUSH_STATUS     **status
+		      );
+/* C.8.5.10.2. _plat__NvFlushDone() */
+/* This function checks whether a commit returned by _plat__NvFlushPending() has been written. */
+/* Return Values Meaning */
+/* 1 the commit is written */
+/* 0 the commit is not written yet */
+/* -1 the commit could not be written */
+LIB_EXPORT int
+_plat__NvFlushDone(
+		   NV_FLUSH_STATUS     *status,
+		   uint64_t             sequence
+		   );
+/* C.8.5.10.3. _plat__NvFlushWait() */
+/* This function waits until a commit returned by _plat__NvFlushPending() is written or could not
+   be written, and returns the result as _plat__NvFlushDone() does. */
+LIB_EXPORT int
+_plat__NvFlushWait(
+		   NV_FLUSH_STATUS     *status,
+		   uint64_t             sequence
+		   );
+/* C.8.5.10.4. _plat__NvFlushNotify() */
+/* This function sets an eventfd that is written after each background flush, or -1 for none. */
+LIB_EXPORT void
+_plat__NvFlushNotify(
+		     int              fd
+		     );
 /* C.8.5.11. _plat__SetNvAvail() */
 /* Set the current NV state to available.  This function is for testing purpose only.  It is not
    part of the platform NV logic */
@@ -367,7 +446,17 @@ _plat__RunCommand(
 		  uint32_t        *responseSize,  // IN/OUT: response buffer size
 		  unsigned char   **response      // IN/OUT: response buffer
 		  );
-/* C.8.8.2. _plat__Fail() */
+/* C.8.8.2. _plat__RunInstanceCommand() */
+/* This function selects instance (NULL for the default instance) and runs the command in it. */
+LIB_EXPORT void
+_plat__RunInstanceCommand(
+			  TPM_INSTANCE    *instance,      // IN: TPM instance
+			  uint32_t         requestSize,   // IN: command buffer size
+			  unsigned char   *request,       // IN: command buffer
+			  uint32_t        *responseSize,  // IN/OUT: response buffer size
+			  unsigned char   **response      // IN/OUT: response buffer
+			  );
+/* C.8.8.3. _plat__Fail() */
 /* This is the platform depended failure exit for the TPM. */
 LIB_EXPORT NORETURN void
 _plat__Fail(
@@ -387,4 +476,173 @@ _plat__GetUnique(
 		 uint32_t             bSize,         // size of the buffer
 		 unsigned char       *b              // output buffer
 		 );
+/* C.8.10. From InstancePlat.c */
+/* C.8.10.1. _plat__InstanceStateSize() */
+/* This function returns the number of bytes of state that are switched for each instance. It is 0
+   when INSTANCE_CONTEXT is not enabled. */
+LIB_EXPORT uint32_t
+_plat__InstanceStateSize(
+			 void
+			 );
+/* C.8.10.2. _plat__InstanceCreate() */
+/* This function creates a new TPM instance in the state of a freshly started simulator. */
+/* Return Values Meaning */
+/* != NULL the new instance */
+/* NULL allocation failure or INSTANCE_CONTEXT not enabled */
+LIB_EXPORT TPM_INSTANCE *
+_plat__InstanceCreate(
+		      void
+		      );
+/* C.8.10.3. _plat__InstanceDestroy() */
+/* This function clears and releases an instance created by _plat__InstanceCreate(). */
+LIB_EXPORT void
+_plat__InstanceDestroy(
+		       TPM_INSTANCE    *instance
+		       );
+/* C.8.10.4. _plat__InstanceSelect() */
+/* This function makes instance the target of all subsequent TPM and platform calls. A NULL
+   instance selects the default instance. */
+/* Return Values Meaning */
+/* 0 success */
+/* non-0 the default instance state could not be saved */
+LIB_EXPORT int
+_plat__InstanceSelect(
+		      TPM_INSTANCE    *instance
+		      );
+/* C.8.10.5. _plat__InstanceCurrent() */
+/* This function returns the selected instance. NULL indicates the default instance. */
+LIB_EXPORT TPM_INSTANCE *
+_plat__InstanceCurrent(
+		       void
+		       );
+/* C.8.10.6. _plat__InstanceSnapshot() */
+/* This function writes the instance state and the NV image of the selected instance to
+   fileName. */
+/* Return Values Meaning */
+/* 0 success */
+/* non-0 failure */
+LIB_EXPORT int
+_plat__InstanceSnapshot(
+			const char      *fileName
+			);
+/* C.8.10.7. _plat__InstanceRestore() */
+/* This function loads a snapshot written by _plat__InstanceSnapshot() into the selected instance
+   and writes its NV image to the NV file. delta is for TPM_Rebase(). */
+/* Return Values Meaning */
+/* 0 success */
+/* non-0 failure, the snapshot is not from this build or does not fit */
+LIB_EXPORT int
+_plat__InstanceRestore(
+		       const char      *fileName,
+		       intptr_t        *delta
+		       );
+/* C.8.10.8. _plat__InstanceForEach() */
+/* This function calls function for every instance, the default instance as NULL, while no instance
+   can be selected. */
+LIB_EXPORT void
+_plat__InstanceForEach(
+		       void (*function)(TPM_INSTANCE *instance)
+		       );
+/* C.8.10.9. _plat__InstanceVariable() */
+/* This function returns where variable, in the instance state, is for instance. It is used from
+   the function given to _plat__InstanceForEach(). */
+LIB_EXPORT void *
+_plat__InstanceVariable(
+			TPM_INSTANCE    *instance,
+			void            *variable
+			);
+/* C.8.11. From TracePlat.c */
+/* C.8.11.1. _plat__TraceEnable() */
+/* This function starts recording commands in a ring of recordCount records (TRACE_DEFAULT_RECORDS
+   if 0). If payload is not 0, the start of each command and response is kept too. The ring is
+   written to fileName at exit and, on POSIX, on SIGUSR1. */
+/* Return Values Meaning */
+/* 0 success */
+/* != 0 already enabled or allocation failure */
+LIB_EXPORT int
+_plat__TraceEnable(
+		   const char      *fileName,
+		   uint32_t         recordCount,
+		   int              payload
+		   );
+/* C.8.11.2. _plat__TraceDump() */
+/* This function writes the trace file now. */
+/* Return Values Meaning */
+/* 0 success */
+/* != 0 tracing is not enabled or the file could not be written */
+LIB_EXPORT int
+_plat__TraceDump(
+		 void
+		 );
+/* C.8.11.3. _plat__TraceCommandStart() */
+/* This function is called when a command arrives. It returns the start time that is passed to
+   _plat__TraceCommandEnd(), or 0 when tracing is off. */
+LIB_EXPORT uint64_t
+_plat__TraceCommandStart(
+			 uint32_t              requestSize,
+			 const unsigned char  *request
+			 );
+/* C.8.11.4. _plat__TraceCommandEnd() */
+/* This function completes the record of a command when its response is ready. */
+LIB_EXPORT void
+_plat__TraceCommandEnd(
+		       uint64_t              startTime,
+		       uint32_t              commandCode,
+		       uint32_t              responseCode,
+		       uint32_t              handleNum,
+		       const uint32_t       *handles,
+		       uint32_t              sessionNum,
+		       const uint32_t       *sessions,
+		       uint32_t              requestSize,
+		       uint32_t              responseSize,
+		       const unsigned char  *response,
+		       uint32_t              responseHandle
+		       );
+/* C.8.12. From StatsPlat.c */
+/* C.8.12.1. _plat__StatsTime() */
+/* This function returns a monotonic time in ns. */
+LIB_EXPORT uint64_t
+_plat__StatsTime(
+		 void
+		 );
+/* C.8.12.2. _plat__StatsCommandStart() */
+/* This function is called when a command arrives. It returns the start time that is passed to
+   _plat__StatsCommandEnd(). */
+LIB_EXPORT uint64_t
+_plat__StatsCommandStart(
+			 void
+			 );
+/* C.8.12.3. _plat__StatsCommandEnd() */
+/* This function records an executed command. phaseEnd[] holds the time at which each of the
+   STATS_PHASES phases ended, or 0 for a phase that was not run. */
+LIB_EXPORT void
+_plat__StatsCommandEnd(
+		       uint64_t         startTime,
+		       uint32_t         commandCode,
+		       const uint64_t  *phaseEnd
+		       );
+/* C.8.12.4. _plat__StatsNvWrite() */
+/* This function counts bytes of the NV image written, cleared or moved. */
+LIB_EXPORT void
+_plat__StatsNvWrite(
+		    uint32_t         size
+		    );
+/* C.8.12.5. _plat__StatsNvCommit() */
+/* This function counts a commit of the NV image that wrote size bytes to the backing store. */
+LIB_EXPORT void
+_plat__StatsNvCommit(
+		     uint32_t         size
+		     );
+/* C.8.12.6. _plat__StatsGet() */
+/* This function copies the statistics to buffer as described in StatsPlat.h and, if reset is not
+   0, clears them. If buffer is too small, nothing is copied or cleared. */
+/* Return Values Meaning */
+/* > bufferSize the number of bytes needed */
+/* other the number of bytes copied */
+LIB_EXPORT uint32_t
+_plat__StatsGet(
+		void            *buffer,
+		uint32_t         bufferSize,
+		int              reset
+		);
 #endif  // _PLATFORM_FP_H_
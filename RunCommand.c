@@ -100,7 +100,27 @@ _plat__RunCommand(
    //  setjmp(s_jumpBuffer);
    ExecuteCommand(requestSize, request, responseSize, response);
 }
-/* C.11.3.2. _plat__Fail() */
+/* C.11.3.2. _plat__RunInstanceCommand() */
+/* This function selects instance (NULL for the default instance) and then runs the command in it
+   as _plat__RunCommand() does. If the instance cannot be selected, the response size is set to
+   0. */
+LIB_EXPORT void
+_plat__RunInstanceCommand(
+			  TPM_INSTANCE    *instance,      // IN: TPM instance
+			  uint32_t         requestSize,   // IN: command buffer size
+			  unsigned char   *request,       // IN: command buffer
+			  uint32_t        *responseSize,  // IN/OUT: response buffer size
+			  unsigned char   **response      // IN/OUT: response buffer
+			  )
+{
+    if(_plat__InstanceSelect(instance) != 0)
+	{
+	    *responseSize = 0;
+	    return;
+	}
+    _plat__RunCommand(requestSize, request, responseSize, response);
+}
+/* C.11.3.3. _plat__Fail() */
 /* This is the platform depended failure exit for the TPM. */
 LIB_EXPORT NORETURN void
 _plat__Fail(
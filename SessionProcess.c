@@ -1997,3 +1997,13 @@ SessionRemoveAssociationToHandle(
 		}
 	}
 }
+/* 6.4.5.14 SessionGetCommandHandles() */
+/* This function returns the session handles of the command being processed, in the order of the
+   session area. COMMAND.sessionNum of them are valid. */
+const TPM_HANDLE *
+SessionGetCommandHandles(
+			 void
+			 )
+{
+    return s_sessionHandles;
+}
@@ -92,6 +92,10 @@ void
 SessionRemoveAssociationToHandle(
 				 TPM_HANDLE       handle
 				 );
+const TPM_HANDLE *
+SessionGetCommandHandles(
+			 void
+			 );
 
 
 #endif
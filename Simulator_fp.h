@@ -183,6 +183,30 @@ bool
 _rpc__ACT_GetSignaled(
 		      uint32_t actHandle
 		      );
+/* D.2.2.16. _rpc__Signal_Snapshot() */
+/* This function writes a snapshot of the TPM state and NV memory to fileName. */
+int
+_rpc__Signal_Snapshot(
+		      const char      *fileName
+		      );
+/* D.2.2.17. _rpc__Signal_Restore() */
+/* This function brings the TPM to the state of the snapshot in fileName. */
+int
+_rpc__Signal_Restore(
+		     const char      *fileName
+		     );
+/* D.2.2.18. _rpc__Idle() */
+/* This function lets the TPM do background work while there is no request. */
+void
+_rpc__Idle(
+	   void
+	   );
+/* D.2.2.19. _rpc__IdlePending() */
+/* This function returns true if _rpc__Idle() has work to do in the selected TPM. */
+bool
+_rpc__IdlePending(
+		  void
+		  );
 
 /* D.2.3. From TPMCmds.c */
 /* D.2.3.1. main() */
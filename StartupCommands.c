@@ -323,6 +323,8 @@ TPM2_Shutdown(
     ActShutdown(in->shutdownType);
     // Save RAM backed NV index data
     NvUpdateIndexOrderlyData();
+    // Save the counters kept in RAM
+    NvCounterCacheFlush();
 #if ACCUMULATE_SELF_HEAL_TIMER
     // Save the current time value
     go.time = g_time;
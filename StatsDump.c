@@ -0,0 +1,290 @@
+/********************************************************************************/
+/*										*/
+/*			Print the Command Latency Statistics			*/
+/*            $Id: StatsDump.c $						*/
+/*										*/
+/*  Licenses and Notices							*/
+/*										*/
+/*  1. Copyright Licenses:							*/
+/*										*/
+/*  - Trusted Computing Group (TCG) grants to the user of the source code in	*/
+/*    this specification (the "Source Code") a worldwide, irrevocable, 		*/
+/*    nonexclusive, royalty free, copyright license to reproduce, create 	*/
+/*    derivative works, distribute, display and perform the Source Code and	*/
+/*    derivative works thereof, and to grant others the rights granted herein.	*/
+/*										*/
+/*  - The TCG grants to the user of the other parts of the specification 	*/
+/*    (other than the Source Code) the rights to reproduce, distribute, 	*/
+/*    display, and perform the specification solely for the purpose of 		*/
+/*    developing products based on such documents.				*/
+/*										*/
+/*  2. Source Code Distribution Conditions:					*/
+/*										*/
+/*  - Redistributions of Source Code must retain the above copyright licenses, 	*/
+/*    this list of conditions and the following disclaimers.			*/
+/*										*/
+/*  - Redistributions in binary form must reproduce the above copyright 	*/
+/*    licenses, this list of conditions	and the following disclaimers in the 	*/
+/*    documentation and/or other materials provided with the distribution.	*/
+/*										*/
+/*  3. Disclaimers:								*/
+/*										*/
+/*  - THE COPYRIGHT LICENSES SET FORTH ABOVE DO NOT REPRESENT ANY FORM OF	*/
+/*  LICENSE OR WAIVER, EXPRESS OR IMPLIED, BY ESTOPPEL OR OTHERWISE, WITH	*/
+/*  RESPECT TO PATENT RIGHTS HELD BY TCG MEMBERS (OR OTHER THIRD PARTIES)	*/
+/*  THAT MAY BE NECESSARY TO IMPLEMENT THIS SPECIFICATION OR OTHERWISE.		*/
+/*  Contact TCG Administration (admin@trustedcomputinggroup.org) for 		*/
+/*  information on specification licensing rights available through TCG 	*/
+/*  membership agreements.							*/
+/*										*/
+/*  - THIS SPECIFICATION IS PROVIDED "AS IS" WITH NO EXPRESS OR IMPLIED 	*/
+/*    WARRANTIES WHATSOEVER, INCLUDING ANY WARRANTY OF MERCHANTABILITY OR 	*/
+/*    FITNESS FOR A PARTICULAR PURPOSE, ACCURACY, COMPLETENESS, OR 		*/
+/*    NONINFRINGEMENT OF INTELLECTUAL PROPERTY RIGHTS, OR ANY WARRANTY 		*/
+/*    OTHERWISE ARISING OUT OF ANY PROPOSAL, SPECIFICATION OR SAMPLE.		*/
+/*										*/
+/*  - Without limitation, TCG and its members and licensors disclaim all 	*/
+/*    liability, including liability for infringement of any proprietary 	*/
+/*    rights, relating to use of information in this specification and to the	*/
+/*    implementation of this specification, and TCG disclaims all liability for	*/
+/*    cost of procurement of substitute goods or services, lost profits, loss 	*/
+/*    of use, loss of data or any incidental, consequential, direct, indirect, 	*/
+/*    or special damages, whether under contract, tort, warranty or otherwise, 	*/
+/*    arising in any way out of use or reliance upon this specification or any 	*/
+/*    information herein.							*/
+/*										*/
+/*  (c) Copyright IBM Corp. and others, 2016 - 2026				*/
+/*										*/
+/********************************************************************************/
+
+/* D.9 StatsDump.c */
+/* D.9.1. Description */
+/* This is a standalone program that reads the command latency statistics of a running simulator
+   through the TPM_GET_COMMAND_STATS platform signal and prints them, the command codes with the
+   most total time first. The percentiles are the upper bounds of the power of two histogram
+   buckets. */
+/* D.9.2. Includes and Data Definitions */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "TpmTcpProtocol.h"
+#include "StatsPlat.h"
+#include "CommandNames_fp.h"
+
+#define DEFAULT_TPM_PORT 2321
+
+static const char *s_phaseNames[STATS_HISTOGRAMS] = {
+    "unmarshal",
+    "handles",
+    "load",
+    "sessions",
+    "dispatch",
+    "response",
+    "nv commit",
+    "total"
+};
+
+/* D.9.3. Functions */
+/* D.9.3.1. Usage() */
+static void
+Usage(
+      const char      *programName
+      )
+{
+    fprintf(stderr, "Usage:\n");
+    fprintf(stderr, "%s [-port PortNum] [-unix Path] [-reset]\n", programName);
+    fprintf(stderr, "\t-port PortNum - the simulator listens on PortNum, PortNum+1 (default %d)\n",
+	    DEFAULT_TPM_PORT);
+    fprintf(stderr, "\t-unix Path - the simulator listens on Path, Path.platform\n");
+    fprintf(stderr, "\t-reset - clear the statistics after reading them\n");
+    exit(1);
+}
+/* D.9.3.2. ReadBytes() */
+static int
+ReadBytes(
+	  int              fd,
+	  void            *buffer,
+	  size_t           length
+	  )
+{
+    unsigned char   *p = buffer;
+    ssize_t          n;
+    while(length > 0)
+	{
+	    n = read(fd, p, length);
+	    if(n <= 0)
+		return -1;
+	    p += n;
+	    length -= n;
+	}
+    return 0;
+}
+/* D.9.3.3. Percentile() */
+/* This function returns the upper bound in ns of the bucket that holds the given fraction of the
+   samples. */
+static double
+Percentile(
+	   const STATS_HISTOGRAM   *histogram,
+	   double                   fraction
+	   )
+{
+    uint64_t         target = (uint64_t)(fraction * histogram->count);
+    uint64_t         seen = 0;
+    uint32_t         i;
+    for(i = 0; i < STATS_BUCKETS - 1; i++)
+	{
+	    seen += histogram->buckets[i];
+	    if(seen > target)
+		break;
+	}
+    // no sample is above the largest one
+    if(i == STATS_BUCKETS - 1 || (2ULL << i) > histogram->maxTime)
+	return histogram->maxTime;
+    return (double)(2ULL << i);
+}
+/* D.9.3.4. CompareTotalTime() */
+/* qsort() comparison that puts the command with the most total time first. */
+static int
+CompareTotalTime(
+		 const void      *a,
+		 const void      *b
+		 )
+{
+    uint64_t         ta = ((const STATS_COMMAND *)a)->phase[STATS_PHASE_TOTAL].totalTime;
+    uint64_t         tb = ((const STATS_COMMAND *)b)->phase[STATS_PHASE_TOTAL].totalTime;
+    return (ta < tb) - (ta > tb);
+}
+/* D.9.3.5. main() */
+int
+main(
+     int              argc,
+     char            *argv[]
+     )
+{
+    int                  portNum = DEFAULT_TPM_PORT;
+    const char          *unixPath = NULL;
+    uint32_t             reset = 0;
+    int                  fd;
+    uint32_t             request[2];
+    uint32_t             size;
+    uint32_t             ack;
+    unsigned char       *stats;
+    STATS_HEADER         header;
+    STATS_COMMAND       *commands;
+    uint32_t             i;
+    uint32_t             j;
+
+    for(i = 1; i < (uint32_t)argc; i++)
+	{
+	    if(strcmp(argv[i], "-port") == 0 && i + 1 < (uint32_t)argc)
+		{
+		    portNum = atoi(argv[++i]);
+		    if(portNum <= 0 || portNum >= 65535)
+			Usage(argv[0]);
+		}
+	    else if(strcmp(argv[i], "-unix") == 0 && i + 1 < (uint32_t)argc)
+		unixPath = argv[++i];
+	    else if(strcmp(argv[i], "-reset") == 0)
+		reset = 1;
+	    else
+		Usage(argv[0]);
+	}
+    if(unixPath != NULL)
+	{
+	    struct sockaddr_un   sun;
+	    memset(&sun, 0, sizeof(sun));
+	    sun.sun_family = AF_UNIX;
+	    if(snprintf(sun.sun_path, sizeof(sun.sun_path), "%s.platform", unixPath)
+	       >= (int)sizeof(sun.sun_path))
+		{
+		    fprintf(stderr, "Unix socket path %s is too long\n", unixPath);
+		    return 1;
+		}
+	    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	    if(fd < 0 || connect(fd, (struct sockaddr *)&sun, sizeof(sun)) != 0)
+		{
+		    fprintf(stderr, "Cannot connect to %s\n", sun.sun_path);
+		    return 1;
+		}
+	}
+    else
+	{
+	    struct sockaddr_in   sin;
+	    memset(&sin, 0, sizeof(sin));
+	    sin.sin_family = AF_INET;
+	    sin.sin_port = htons((uint16_t)(portNum + 1));
+	    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	    fd = socket(AF_INET, SOCK_STREAM, 0);
+	    if(fd < 0 || connect(fd, (struct sockaddr *)&sin, sizeof(sin)) != 0)
+		{
+		    fprintf(stderr, "Cannot connect to platform port %d\n", portNum + 1);
+		    return 1;
+		}
+	}
+    request[0] = htonl(TPM_GET_COMMAND_STATS);
+    request[1] = htonl(reset);
+    if(write(fd, request, sizeof(request)) != sizeof(request)
+       || ReadBytes(fd, &size, sizeof(size)) != 0)
+	{
+	    fprintf(stderr, "The simulator did not answer TPM_GET_COMMAND_STATS\n");
+	    return 1;
+	}
+    size = ntohl(size);
+    stats = malloc(size);
+    if(size < sizeof(STATS_HEADER) || stats == NULL
+       || ReadBytes(fd, stats, size) != 0 || ReadBytes(fd, &ack, sizeof(ack)) != 0)
+	{
+	    fprintf(stderr, "Bad statistics of %u bytes\n", size);
+	    return 1;
+	}
+    close(fd);
+    memcpy(&header, stats, sizeof(header));
+    if(header.version != STATS_VERSION || header.phases != STATS_PHASES
+       || header.buckets != STATS_BUCKETS
+       || size != sizeof(header) + header.commandCount * sizeof(STATS_COMMAND))
+	{
+	    fprintf(stderr, "The simulator statistics are of another version\n");
+	    return 1;
+	}
+    commands = (STATS_COMMAND *)(stats + sizeof(header));
+    qsort(commands, header.commandCount, sizeof(STATS_COMMAND), CompareTotalTime);
+    if(header.commandCount == 0)
+	printf("No commands were executed\n");
+    for(i = 0; i < header.commandCount; i++)
+	{
+	    const STATS_COMMAND *command = &commands[i];
+	    const char          *name = CommandName(command->commandCode);
+	    printf("%s %08x: %llu commands, %llu NV bytes written\n",
+		   (command->commandCode == 0) ? "other" : (name != NULL) ? name : "unknown",
+		   command->commandCode,
+		   (unsigned long long)command->phase[STATS_PHASE_TOTAL].count,
+		   (unsigned long long)command->nvWriteBytes);
+	    if(command->nvCommits != 0)
+		printf("\t%llu NV commits, %llu bytes committed, mean %llu max %u bytes per commit\n",
+		       (unsigned long long)command->nvCommits,
+		       (unsigned long long)command->nvCommitBytes,
+		       (unsigned long long)(command->nvCommitBytes / command->nvCommits),
+		       command->nvCommitMax);
+	    printf("\t%-10s %10s %12s %10s %10s %10s\n",
+		   "phase", "count", "mean us", "p50 us", "p99 us", "max us");
+	    for(j = 0; j < STATS_HISTOGRAMS; j++)
+		{
+		    const STATS_HISTOGRAM *h = &command->phase[j];
+		    if(h->count == 0)
+			continue;
+		    printf("\t%-10s %10llu %12.2f %10.2f %10.2f %10.2f\n",
+			   s_phaseNames[j], (unsigned long long)h->count,
+			   (double)h->totalTime / h->count / 1000,
+			   Percentile(h, 0.5) / 1000, Percentile(h, 0.99) / 1000,
+			   (double)h->maxTime / 1000);
+		}
+	}
+    free(stats);
+    return 0;
+}
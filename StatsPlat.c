@@ -0,0 +1,234 @@
+/********************************************************************************/
+/*										*/
+/*			Command Latency Statistics				*/
+/*            $Id: StatsPlat.c $						*/
+/*										*/
+/*  Licenses and Notices							*/
+/*										*/
+/*  1. Copyright Licenses:							*/
+/*										*/
+/*  - Trusted Computing Group (TCG) grants to the user of the source code in	*/
+/*    this specification (the "Source Code") a worldwide, irrevocable, 		*/
+/*    nonexclusive, royalty free, copyright license to reproduce, create 	*/
+/*    derivative works, distribute, display and perform the Source Code and	*/
+/*    derivative works thereof, and to grant others the rights granted herein.	*/
+/*										*/
+/*  - The TCG grants to the user of the other parts of the specification 	*/
+/*    (other than the Source Code) the rights to reproduce, distribute, 	*/
+/*    display, and perform the specification solely for the purpose of 		*/
+/*    developing products based on such documents.				*/
+/*										*/
+/*  2. Source Code Distribution Conditions:					*/
+/*										*/
+/*  - Redistributions of Source Code must retain the above copyright licenses, 	*/
+/*    this list of conditions and the following disclaimers.			*/
+/*										*/
+/*  - Redistributions in binary form must reproduce the above copyright 	*/
+/*    licenses, this list of conditions	and the following disclaimers in the 	*/
+/*    documentation and/or other materials provided with the distribution.	*/
+/*										*/
+/*  3. Disclaimers:								*/
+/*										*/
+/*  - THE COPYRIGHT LICENSES SET FORTH ABOVE DO NOT REPRESENT ANY FORM OF	*/
+/*  LICENSE OR WAIVER, EXPRESS OR IMPLIED, BY ESTOPPEL OR OTHERWISE, WITH	*/
+/*  RESPECT TO PATENT RIGHTS HELD BY TCG MEMBERS (OR OTHER THIRD PARTIES)	*/
+/*  THAT MAY BE NECESSARY TO IMPLEMENT THIS SPECIFICATION OR OTHERWISE.		*/
+/*  Contact TCG Administration (admin@trustedcomputinggroup.org) for 		*/
+/*  information on specification licensing rights available through TCG 	*/
+/*  membership agreements.							*/
+/*										*/
+/*  - THIS SPECIFICATION IS PROVIDED "AS IS" WITH NO EXPRESS OR IMPLIED 	*/
+/*    WARRANTIES WHATSOEVER, INCLUDING ANY WARRANTY OF MERCHANTABILITY OR 	*/
+/*    FITNESS FOR A PARTICULAR PURPOSE, ACCURACY, COMPLETENESS, OR 		*/
+/*    NONINFRINGEMENT OF INTELLECTUAL PROPERTY RIGHTS, OR ANY WARRANTY 		*/
+/*    OTHERWISE ARISING OUT OF ANY PROPOSAL, SPECIFICATION OR SAMPLE.		*/
+/*										*/
+/*  - Without limitation, TCG and its members and licensors disclaim all 	*/
+/*    liability, including liability for infringement of any proprietary 	*/
+/*    rights, relating to use of information in this specification and to the	*/
+/*    implementation of this specification, and TCG disclaims all liability for	*/
+/*    cost of procurement of substitute goods or services, lost profits, loss 	*/
+/*    of use, loss of data or any incidental, consequential, direct, indirect, 	*/
+/*    or special damages, whether under contract, tort, warranty or otherwise, 	*/
+/*    arising in any way out of use or reliance upon this specification or any 	*/
+/*    information herein.							*/
+/*										*/
+/*  (c) Copyright IBM Corp. and others, 2016 - 2026				*/
+/*										*/
+/********************************************************************************/
+
+/* C.18 StatsPlat.c */
+/* C.18.2. Description */
+/* This file keeps latency histograms of the commands executed by the TPM, by command code and by
+   ExecuteCommand() phase, with the NV commits and NV bytes written by each command code. The
+   statistics are always collected. They are read with _plat__StatsGet() or the
+   TPM_GET_COMMAND_STATS platform signal. */
+/* C.18.3. Includes and locals */
+#include <string.h>
+#include <time.h>
+#include "Platform.h"
+#include "StatsPlat.h"
+
+static struct
+{
+    STATS_COMMAND        commands[STATS_COMMANDS];
+    // NV activity of the command being executed
+    uint64_t             nvCommits;
+    uint64_t             nvCommitBytes;
+    uint32_t             nvCommitMax;
+    uint64_t             nvWriteBytes;
+} s_stats;
+
+/* C.18.4. Functions */
+/* C.18.4.1. StatsBucket() */
+/* This function returns the histogram bucket of a time in ns. */
+static uint32_t
+StatsBucket(
+	    uint64_t         time
+	    )
+{
+    uint32_t         bucket;
+    if(time < 2)
+	return 0;
+#ifdef __GNUC__
+    bucket = 63 - __builtin_clzll(time);
+#else
+    for(bucket = 0; (time >> (bucket + 1)) != 0; bucket++);
+#endif
+    return MIN(bucket, STATS_BUCKETS - 1);
+}
+/* C.18.4.2. StatsRecord() */
+static void
+StatsRecord(
+	    STATS_HISTOGRAM     *histogram,
+	    uint64_t             time
+	    )
+{
+    histogram->count++;
+    histogram->totalTime += time;
+    if(time > histogram->maxTime)
+	histogram->maxTime = (uint32_t)MIN(time, 0xffffffff);
+    histogram->buckets[StatsBucket(time)]++;
+}
+/* C.18.4.3. _plat__StatsTime() */
+/* This function returns a monotonic time in ns. */
+LIB_EXPORT uint64_t
+_plat__StatsTime(
+		 void
+		 )
+{
+    struct timespec      ts;
+#ifdef TPM_POSIX
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#else
+    timespec_get(&ts, TIME_UTC);
+#endif
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+/* C.18.4.4. _plat__StatsCommandStart() */
+/* This function is called when a command arrives. It returns the start time that is passed to
+   _plat__StatsCommandEnd(). */
+LIB_EXPORT uint64_t
+_plat__StatsCommandStart(
+			 void
+			 )
+{
+    s_stats.nvCommits = 0;
+    s_stats.nvCommitBytes = 0;
+    s_stats.nvCommitMax = 0;
+    s_stats.nvWriteBytes = 0;
+    return _plat__StatsTime();
+}
+/* C.18.4.5. _plat__StatsCommandEnd() */
+/* This function records an executed command. phaseEnd[] holds the time at which each of the
+   STATS_PHASES phases ended, or 0 for a phase that was not run. */
+LIB_EXPORT void
+_plat__StatsCommandEnd(
+		       uint64_t         startTime,
+		       uint32_t         commandCode,
+		       const uint64_t  *phaseEnd
+		       )
+{
+    STATS_COMMAND       *command;
+    uint64_t             last = startTime;
+    uint32_t             i;
+
+    if(commandCode >= STATS_CC_FIRST && commandCode - STATS_CC_FIRST < STATS_COMMANDS - 1)
+	command = &s_stats.commands[commandCode - STATS_CC_FIRST];
+    else
+	command = &s_stats.commands[STATS_COMMANDS - 1];
+    for(i = 0; i < STATS_PHASES; i++)
+	{
+	    if(phaseEnd[i] == 0)
+		continue;
+	    StatsRecord(&command->phase[i], phaseEnd[i] - last);
+	    last = phaseEnd[i];
+	}
+    StatsRecord(&command->phase[STATS_PHASE_TOTAL], last - startTime);
+    command->nvCommits += s_stats.nvCommits;
+    command->nvCommitBytes += s_stats.nvCommitBytes;
+    command->nvCommitMax = MAX(command->nvCommitMax, s_stats.nvCommitMax);
+    command->nvWriteBytes += s_stats.nvWriteBytes;
+}
+/* C.18.4.6. _plat__StatsNvWrite() */
+/* This function counts bytes of the NV image written, cleared or moved. */
+LIB_EXPORT void
+_plat__StatsNvWrite(
+		    uint32_t         size
+		    )
+{
+    s_stats.nvWriteBytes += size;
+}
+/* C.18.4.7. _plat__StatsNvCommit() */
+/* This function counts a commit of the NV image that wrote size bytes to the backing store. */
+LIB_EXPORT void
+_plat__StatsNvCommit(
+		     uint32_t         size
+		     )
+{
+    s_stats.nvCommits++;
+    s_stats.nvCommitBytes += size;
+    s_stats.nvCommitMax = MAX(s_stats.nvCommitMax, size);
+}
+/* C.18.4.8. _plat__StatsGet() */
+/* This function copies the statistics to buffer as described in StatsPlat.h and, if reset is not
+   0, clears them. If buffer is too small, nothing is copied or cleared. */
+/* Return Values Meaning */
+/* > bufferSize the number of bytes needed */
+/* other the number of bytes copied */
+LIB_EXPORT uint32_t
+_plat__StatsGet(
+		void            *buffer,
+		uint32_t         bufferSize,
+		int              reset
+		)
+{
+    STATS_HEADER         header;
+    unsigned char       *out = buffer;
+    uint32_t             size = sizeof(header);
+    uint32_t             i;
+
+    memset(&header, 0, sizeof(header));
+    header.version = STATS_VERSION;
+    header.phases = STATS_PHASES;
+    header.buckets = STATS_BUCKETS;
+    for(i = 0; i < STATS_COMMANDS; i++)
+	if(s_stats.commands[i].phase[STATS_PHASE_TOTAL].count != 0)
+	    header.commandCount++;
+    size += header.commandCount * sizeof(STATS_COMMAND);
+    if(size > bufferSize)
+	return size;
+    memcpy(out, &header, sizeof(header));
+    out += sizeof(header);
+    for(i = 0; i < STATS_COMMANDS; i++)
+	{
+	    if(s_stats.commands[i].phase[STATS_PHASE_TOTAL].count == 0)
+		continue;
+	    s_stats.commands[i].commandCode = (i < STATS_COMMANDS - 1) ? STATS_CC_FIRST + i : 0;
+	    memcpy(out, &s_stats.commands[i], sizeof(STATS_COMMAND));
+	    out += sizeof(STATS_COMMAND);
+	}
+    if(reset)
+	memset(s_stats.commands, 0, sizeof(s_stats.commands));
+    return size;
+}
@@ -0,0 +1,125 @@
+/********************************************************************************/
+/*										*/
+/*			Command Latency Statistics				*/
+/*            $Id: StatsPlat.h $						*/
+/*										*/
+/*  Licenses and Notices							*/
+/*										*/
+/*  1. Copyright Licenses:							*/
+/*										*/
+/*  - Trusted Computing Group (TCG) grants to the user of the source code in	*/
+/*    this specification (the "Source Code") a worldwide, irrevocable, 		*/
+/*    nonexclusive, royalty free, copyright license to reproduce, create 	*/
+/*    derivative works, distribute, display and perform the Source Code and	*/
+/*    derivative works thereof, and to grant others the rights granted herein.	*/
+/*										*/
+/*  - The TCG grants to the user of the other parts of the specification 	*/
+/*    (other than the Source Code) the rights to reproduce, distribute, 	*/
+/*    display, and perform the specification solely for the purpose of 		*/
+/*    developing products based on such documents.				*/
+/*										*/
+/*  2. Source Code Distribution Conditions:					*/
+/*										*/
+/*  - Redistributions of Source Code must retain the above copyright licenses, 	*/
+/*    this list of conditions and the following disclaimers.			*/
+/*										*/
+/*  - Redistributions in binary form must reproduce the above copyright 	*/
+/*    licenses, this list of conditions	and the following disclaimers in the 	*/
+/*    documentation and/or other materials provided with the distribution.	*/
+/*										*/
+/*  3. Disclaimers:								*/
+/*										*/
+/*  - THE COPYRIGHT LICENSES SET FORTH ABOVE DO NOT REPRESENT ANY FORM OF	*/
+/*  LICENSE OR WAIVER, EXPRESS OR IMPLIED, BY ESTOPPEL OR OTHERWISE, WITH	*/
+/*  RESPECT TO PATENT RIGHTS HELD BY TCG MEMBERS (OR OTHER THIRD PARTIES)	*/
+/*  THAT MAY BE NECESSARY TO IMPLEMENT THIS SPECIFICATION OR OTHERWISE.		*/
+/*  Contact TCG Administration (admin@trustedcomputinggroup.org) for 		*/
+/*  information on specification licensing rights available through TCG 	*/
+/*  membership agreements.							*/
+/*										*/
+/*  - THIS SPECIFICATION IS PROVIDED "AS IS" WITH NO EXPRESS OR IMPLIED 	*/
+/*    WARRANTIES WHATSOEVER, INCLUDING ANY WARRANTY OF MERCHANTABILITY OR 	*/
+/*    FITNESS FOR A PARTICULAR PURPOSE, ACCURACY, COMPLETENESS, OR 		*/
+/*    NONINFRINGEMENT OF INTELLECTUAL PROPERTY RIGHTS, OR ANY WARRANTY 		*/
+/*    OTHERWISE ARISING OUT OF ANY PROPOSAL, SPECIFICATION OR SAMPLE.		*/
+/*										*/
+/*  - Without limitation, TCG and its members and licensors disclaim all 	*/
+/*    liability, including liability for infringement of any proprietary 	*/
+/*    rights, relating to use of information in this specification and to the	*/
+/*    implementation of this specification, and TCG disclaims all liability for	*/
+/*    cost of procurement of substitute goods or services, lost profits, loss 	*/
+/*    of use, loss of data or any incidental, consequential, direct, indirect, 	*/
+/*    or special damages, whether under contract, tort, warranty or otherwise, 	*/
+/*    arising in any way out of use or reliance upon this specification or any 	*/
+/*    information herein.							*/
+/*										*/
+/*  (c) Copyright IBM Corp. and others, 2016 - 2026				*/
+/*										*/
+/********************************************************************************/
+
+/* C.18.1 StatsPlat.h */
+/* This file describes the command latency statistics kept by StatsPlat.c. The same layout is
+   returned by _plat__StatsGet() and by the TPM_GET_COMMAND_STATS platform signal, in host byte
+   order. */
+
+#ifndef STATSPLAT_H
+#define STATSPLAT_H
+
+#include <stdint.h>
+
+#define STATS_VERSION           2
+
+/* ExecuteCommand() phases. A command that fails skips the phases that follow the failure up to
+   STATS_PHASE_RESPONSE. The time of a phase that is left before it ends is counted in
+   STATS_PHASE_RESPONSE. */
+#define STATS_PHASE_UNMARSHAL   0       // command header and command code checks
+#define STATS_PHASE_HANDLES     1       // ParseHandleBuffer()
+#define STATS_PHASE_LOAD        2       // EntityGetLoadStatus()
+#define STATS_PHASE_SESSIONS    3       // ParseSessionBuffer() or CheckAuthNoSession()
+#define STATS_PHASE_DISPATCH    4       // CommandDispatcher()
+#define STATS_PHASE_RESPONSE    5       // BuildResponseSession() and the response header
+#define STATS_PHASE_NV_COMMIT   6       // NvCommit(), only when the command changed NV
+#define STATS_PHASES            7
+#define STATS_PHASE_TOTAL       STATS_PHASES
+#define STATS_HISTOGRAMS        (STATS_PHASES + 1)
+
+/* Bucket 0 counts times below 2 ns, bucket i times in [2^i, 2^(i+1)) ns, and the last bucket
+   everything from 2^(STATS_BUCKETS-1) ns (about 2 s). */
+#define STATS_BUCKETS           32
+
+/* Commands are kept by command code from STATS_CC_FIRST. Vendor commands, unknown command
+   codes and commands that fail before the command code is read share the last entry, which is
+   reported with command code 0. */
+#define STATS_CC_FIRST          0x0000011f
+#define STATS_COMMANDS          0x81
+
+typedef struct
+{
+    uint64_t         count;
+    uint64_t         totalTime;         // ns
+    uint32_t         maxTime;           // ns
+    uint32_t         reserved;
+    uint32_t         buckets[STATS_BUCKETS];
+} STATS_HISTOGRAM;
+
+typedef struct
+{
+    uint32_t         commandCode;
+    uint32_t         nvCommitMax;       // bytes written by the largest NV commit
+    uint64_t         nvCommits;         // NV commits made by the command
+    uint64_t         nvCommitBytes;     // bytes written to the NV backing store
+    uint64_t         nvWriteBytes;      // bytes of the NV image written, cleared or moved
+    STATS_HISTOGRAM  phase[STATS_HISTOGRAMS];
+} STATS_COMMAND;
+
+/* The statistics are the header followed by commandCount STATS_COMMANDs, one for each command
+   code that was executed since the last reset. */
+typedef struct
+{
+    uint32_t         version;
+    uint32_t         commandCount;
+    uint32_t         phases;
+    uint32_t         buckets;
+} STATS_HEADER;
+
+#endif  // STATSPLAT_H
@@ -81,7 +81,6 @@ TPM2_EncryptDecrypt(
     OBJECT              *symKey;
     UINT16               keySize;
     UINT16               blockSize;
-    BYTE                *key;
     TPM_ALG_ID           alg;
     TPM_ALG_ID           mode;
     TPM_RC               result;
@@ -151,23 +150,22 @@ TPM2_EncryptDecrypt(
     // will modify the output buffer, not the input buffer
     out->ivOut = in->ivIn;
     // Command Output
-    key = symKey->sensitive.sensitive.sym.t.buffer;
     // For symmetric encryption, the cipher data size is the same as plain data
     // size.
     out->outData.t.size = in->inData.t.size;
     if(in->decrypt == YES)
 	{
 	    // Decrypt data to output
-	    result = CryptSymmetricDecrypt(out->outData.t.buffer, alg, keySize, key,
-					   &(out->ivOut), mode, in->inData.t.size,
-					   in->inData.t.buffer);
+	    result = CryptSymmetricDecryptObject(out->outData.t.buffer, symKey,
+						 &(out->ivOut), mode, in->inData.t.size,
+						 in->inData.t.buffer);
 	}
     else
 	{
 	    // Encrypt data to output
-	    result = CryptSymmetricEncrypt(out->outData.t.buffer, alg, keySize, key,
-					   &(out->ivOut), mode, in->inData.t.size,
-					   in->inData.t.buffer);
+	    result = CryptSymmetricEncryptObject(out->outData.t.buffer, symKey,
+						 &(out->ivOut), mode, in->inData.t.size,
+						 in->inData.t.buffer);
 	}
     return result;
 #endif // CC_EncryptDecrypt2
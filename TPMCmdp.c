@@ -94,7 +94,7 @@
 #endif
 #include "TpmProfile.h"		/* kgold */
 
-static bool     s_isPowerOn = false;
+static bool     s_isPowerOn INSTANCE_STATE = false;
 /* D.4.3. Functions */
 /* D.4.3.1. Signal_PowerOn() */
 /* This function processes a power-on indication. Among other things, it calls the _TPM_Init()
@@ -328,3 +328,56 @@ _rpc__ACT_GetSignaled(
 	return _plat__ACT_GetSignaled(actHandle - TPM_RH_ACT_0);
     return false;
 }
+/* D.4.2.16.	_rpc__Signal_Snapshot() */
+/* This function writes the complete state of the powered on TPM, including its NV memory, to
+   fileName. */
+/* Return Values Meaning */
+/* 0 success */
+/* non-0 the TPM is powered off or the snapshot could not be written */
+int
+_rpc__Signal_Snapshot(
+		      const char      *fileName
+		      )
+{
+    if(!s_isPowerOn)
+	return 1;
+    return _plat__InstanceSnapshot(fileName);
+}
+/* D.4.2.17.	_rpc__Signal_Restore() */
+/* This function replaces the TPM state with a snapshot written by _rpc__Signal_Snapshot(). The TPM
+   is then powered on and at the point where the snapshot was taken, so the next command does not
+   need to be TPM2_Startup(). */
+/* Return Values Meaning */
+/* 0 success */
+/* non-0 the snapshot could not be used */
+int
+_rpc__Signal_Restore(
+		     const char      *fileName
+		     )
+{
+    intptr_t        delta;
+    if(_plat__InstanceRestore(fileName, &delta) != 0)
+	return 1;
+    TPM_Rebase(delta);
+    return 0;
+}
+/* D.4.2.18.	_rpc__Idle() */
+/* The server calls this function before it waits for the next request. */
+void
+_rpc__Idle(
+	   void
+	   )
+{
+    // If TPM power is on
+    if(s_isPowerOn)
+	TPM_Idle();
+}
+/* D.4.2.19.	_rpc__IdlePending() */
+/* This function returns true if _rpc__Idle() has work to do in the selected TPM. */
+bool
+_rpc__IdlePending(
+		  void
+		  )
+{
+    return s_isPowerOn && TPM_IdlePending();
+}
@@ -84,10 +84,15 @@
 #include "TcpServerPosix_fp.h"
 #endif
 #include "TpmProfile.h"		/* kgold */
+#include "TracePlat.h"
 
 #define PURPOSE							\
     "TPM Reference Simulator.\nCopyright Microsoft Corp.\n"
 #define DEFAULT_TPM_PORT 2321
+/* Instance i of -instances listens on the ports PortNum+2*i, PortNum+2*i+1 and keeps its NV in the
+   file NVChip.i */
+#define MAX_TPM_INSTANCES 1024
+#define INSTANCE_NV_FILE "NVChip.%d"
 
 int verbose = 0;
 
@@ -107,14 +112,83 @@ Usage(
     fprintf(stderr,  "%s -port PortNum - Starts the TPM server listening on port PortNum, PortNum+1\n",
 	    pszProgramName);
     fprintf(stderr,  "%s -rm remanufacture the TPM before starting\n", pszProgramName);
+    fprintf(stderr,  "%s -nvsize Bytes - NV memory size, at least %u. "
+	    "Changing it remanufactures the TPM\n", pszProgramName, NV_MEMORY_SIZE);
+    fprintf(stderr,  "%s -nvdurability sync|group|async - When an NV change reaches the NV file:\n"
+	    "\tbefore the response (the default), in a group commit before the response,\n"
+	    "\tor shortly after the response\n", pszProgramName);
+    fprintf(stderr,  "%s -restore File - Start from the snapshot File, taken with the\n"
+	    "\tTPM_SNAPSHOT_SAVE platform signal, instead of powering on\n", pszProgramName);
+    fprintf(stderr,  "%s -nvmmap - Map the NV file instead of reading it, and sync the changed\n"
+	    "\tpages on each commit\n", pszProgramName);
+    fprintf(stderr,  "%s -nvtemplate File - Start a new NV file as a copy of the manufactured NV\n"
+	    "\tfile File, which is mapped copy-on-write and shared between processes\n",
+	    pszProgramName);
+#ifdef TPM_POSIX
+    fprintf(stderr,  "%s -unix Path - Also listens on the Unix sockets Path, Path.platform\n",
+	    pszProgramName);
+    fprintf(stderr,  "%s -snapshotdir Dir - Accept the TPM_SNAPSHOT_SAVE and TPM_SNAPSHOT_RESTORE\n"
+	    "\tplatform signals, for plain file names in Dir\n", pszProgramName);
+    fprintf(stderr,  "%s -instances N - Runs N TPMs in this process. TPM i listens on the ports\n"
+	    "\tPortNum+2*i, PortNum+2*i+1 (and the Unix sockets Path.i, Path.i.platform) and\n"
+	    "\tkeeps its NV in NVChip.i. Each switch between TPMs copies %u bytes\n"
+	    "\tof TPM state out and the same amount in\n",
+	    pszProgramName, _plat__InstanceStateSize());
+#endif
     fprintf(stderr,  "%s -h      - This message\n", pszProgramName);
-    fprintf(stderr,  "%s -v      - Verbose trace to trace.txt\n", pszProgramName);
+    fprintf(stderr,  "%s -trace File - Binary command trace to File, dumped at exit and on SIGUSR1\n",
+	    pszProgramName);
+    fprintf(stderr,  "%s -v      - Verbose trace with command and response bytes to %s\n",
+	    pszProgramName, TRACE_DEFAULT_FILE);
+    fprintf(stderr,  "\tDecode the trace with tracedecode\n");
     exit(1);
 }
 
 
 
-/* D.5.3.2. main() */
+/* D.5.3.2. InstanceManufacture() */
+/* This function enables the NV memory of the selected TPM instance and manufactures the TPM if
+   that is requested or if its NV memory is new. nvFile is the name of the NV file, NULL for the
+   default. */
+
+static void
+InstanceManufacture(
+		    const char          *nvFile,
+		    int                  manufacture
+		    )
+{
+    if (_plat__NVEnable((void *)nvFile) < 0) {
+	printf("Cannot enable %u bytes of NV memory\n", _plat__NvMemorySize());
+	exit(1);
+    }
+    if (manufacture || _plat__NVNeedsManufacture())
+	{
+	    printf("Manufacturing NV state...\n");
+	    if(TPM_Manufacture(1) != 0)
+		{
+		    // if the manufacture didn't work, then make sure that the NV file doesn't
+		    // survive. This prevents manufacturing failures from being ignored the
+		    // next time the code is run.
+		    _plat__NVDisable(1);
+		    exit(1);
+		}
+	    // Coverage test - repeated manufacturing attempt
+	    if(TPM_Manufacture(0) != 1)
+		{
+		    exit(2);
+		}
+	    // Coverage test - re-manufacturing
+	    TPM_TearDown();
+	    if(TPM_Manufacture(1) != 0)
+		{
+		    exit(3);
+		}
+	}
+    // Disable NV memory
+    _plat__NVDisable(0);
+}
+
+/* D.5.3.3. main() */
 /* This is the main entry point for the simulator. */
 /* It registers the interface and starts listening for clients */
 
@@ -209,6 +283,19 @@ main(
     int manufacture = 0;
     int portNum = DEFAULT_TPM_PORT;
     int portNumPlat;
+    const char *unixPath = NULL;
+    const char *snapshotDir = NULL;
+    const char *traceFile = NULL;
+    const char *restoreFile = NULL;
+    unsigned long nvSize = 0;
+    const char *nvDurability = NULL;
+    int nvMapped = 0;
+    const char *nvTemplate = NULL;
+#ifdef TPM_POSIX
+    int instanceCount = 1;
+    TPM_INSTANCE **instances;
+    char *nvFile;
+#endif
     setvbuf(stdout, 0, _IONBF, 0);      /* output may be going through pipe to log file */
 
     for (i=1 ; i<argc ; i++) {
@@ -228,6 +315,114 @@ main(
 		Usage(argv[0]);
 	    }
 	}
+#ifdef TPM_POSIX
+	else if (strcmp(argv[i],"-unix") == 0) {
+	    i++;
+	    if (i < argc) {
+		unixPath = argv[i];
+	    }
+	    else {
+		printf("Missing parameter for -unix\n");
+		Usage(argv[0]);
+	    }
+	}
+	else if (strcmp(argv[i],"-snapshotdir") == 0) {
+	    i++;
+	    if (i < argc) {
+		snapshotDir = argv[i];
+	    }
+	    else {
+		printf("Missing parameter for -snapshotdir\n");
+		Usage(argv[0]);
+	    }
+	}
+	else if (strcmp(argv[i],"-instances") == 0) {
+	    i++;
+	    if (i < argc) {
+		instanceCount = atoi(argv[i]);
+		if (instanceCount < 1 || instanceCount > MAX_TPM_INSTANCES
+		    || (instanceCount > 1 && _plat__InstanceStateSize() == 0)) {
+		    printf("-instances %s is not between 1 and %d, or not supported\n",
+			   argv[i], (_plat__InstanceStateSize() == 0) ? 1 : MAX_TPM_INSTANCES);
+		    Usage(argv[0]);
+		}
+	    }
+	    else {
+		printf("Missing parameter for -instances\n");
+		Usage(argv[0]);
+	    }
+	}
+#endif
+	else if (strcmp(argv[i],"-nvsize") == 0) {
+	    i++;
+	    if (i < argc) {
+		nvSize = strtoul(argv[i], NULL, 0);
+		if (nvSize > UINT32_MAX || _plat__NvSetSize((uint32_t)nvSize) != 0) {
+		    printf("-nvsize %s is not between %u and %u\n", argv[i],
+			   NV_MEMORY_SIZE, NV_MEMORY_SIZE_MAX);
+		    Usage(argv[0]);
+		}
+	    }
+	    else {
+		printf("Missing parameter for -nvsize\n");
+		Usage(argv[0]);
+	    }
+	}
+	else if (strcmp(argv[i],"-nvdurability") == 0) {
+	    i++;
+	    if (i < argc) {
+		nvDurability = argv[i];
+		if (_plat__NvSetDurability(nvDurability) != 0) {
+		    printf("-nvdurability %s is not supported\n", argv[i]);
+		    Usage(argv[0]);
+		}
+	    }
+	    else {
+		printf("Missing parameter for -nvdurability\n");
+		Usage(argv[0]);
+	    }
+	}
+	else if (strcmp(argv[i],"-restore") == 0) {
+	    i++;
+	    if (i < argc) {
+		restoreFile = argv[i];
+	    }
+	    else {
+		printf("Missing parameter for -restore\n");
+		Usage(argv[0]);
+	    }
+	}
+	else if (strcmp(argv[i],"-nvmmap") == 0) {
+	    nvMapped = 1;
+	    if (_plat__NvSetMapped(1) != 0) {
+		printf("-nvmmap is not supported\n");
+		Usage(argv[0]);
+	    }
+	}
+	else if (strcmp(argv[i],"-nvtemplate") == 0) {
+	    i++;
+	    if (i < argc) {
+		nvTemplate = argv[i];
+		if (_plat__NvSetTemplate(nvTemplate) != 0) {
+		    printf("-nvtemplate is not supported\n");
+		    Usage(argv[0]);
+		}
+	    }
+	    else {
+		printf("Missing parameter for -nvtemplate\n");
+		Usage(argv[0]);
+	    }
+	}
+	else if (strcmp(argv[i],"-trace") == 0) {
+	    i++;
+	    if (i < argc) {
+		traceFile = argv[i];
+	    }
+	    else {
+		printf("Missing parameter for -trace\n");
+		Usage(argv[0]);
+	    }
+	}
 	else if (strcmp(argv[i],"-v") == 0) {
 	    verbose = 1;
 	}
@@ -241,44 +436,85 @@ main(
     }
     printf("LIBRARY_COMPATIBILITY_CHECK is %s\n",
 	   (LIBRARY_COMPATIBILITY_CHECK ? "ON" : "OFF"));
-    // Enable NV memory
-    _plat__NVEnable(NULL);
-    
-    if (manufacture || _plat__NVNeedsManufacture())
-	{
-	    printf("Manufacturing NV state...\n");
-	    if(TPM_Manufacture(1) != 0)
-		{
-		    // if the manufacture didn't work, then make sure that the NV file doesn't
-		    // survive. This prevents manufacturing failures from being ignored the
-		    // next time the code is run.
-		    _plat__NVDisable(1);
-		    exit(1);
-		}
-	    // Coverage test - repeated manufacturing attempt
-	    if(TPM_Manufacture(0) != 1)
-		{
-		    exit(2);
-		}
-	    // Coverage test - re-manufacturing
-	    TPM_TearDown();
-	    if(TPM_Manufacture(1) != 0)
-		{
-		    exit(3);
-		}
+    // Enable NV memory.  A restored TPM gets its NV memory, and its size, from the snapshot.
+    if (restoreFile == NULL)
+	InstanceManufacture(NULL, manufacture);
+    // Start the command trace. -v adds the command and response bytes.
+    if (verbose || traceFile != NULL) {
+	if (traceFile == NULL)
+	    traceFile = TRACE_DEFAULT_FILE;
+	if (_plat__TraceEnable(traceFile, 0, verbose) != 0) {
+	    printf("Cannot allocate the command trace\n");
+	    exit(1);
 	}
-    // Disable NV memory
-    _plat__NVDisable(0);
-    /* power on the TPM  - kgold MS simulator comes up powered off */
-    _rpc__Signal_PowerOn(FALSE);
-    _rpc__Signal_NvOn();
+    }
+    if (restoreFile != NULL) {
+	// the snapshot was taken with the TPM powered on
+	if (_rpc__Signal_Restore(restoreFile) != 0) {
+	    printf("Cannot restore the snapshot %s\n", restoreFile);
+	    exit(1);
+	}
+    }
+    else {
+	/* power on the TPM  - kgold MS simulator comes up powered off */
+	_rpc__Signal_PowerOn(FALSE);
+	_rpc__Signal_NvOn();
+    }
 
 	// sm3test();
 	// sm4test();
 
     portNumPlat = portNum + 1;
 
+#ifdef TPM_POSIX
+    // The default instance is the first TPM.  The others start from scratch in their own NV files
+    // with the same NV settings.
+    if (portNum + 2 * (instanceCount - 1) + 1 > 65535) {
+	printf("-instances %d needs ports beyond 65535\n", instanceCount);
+	exit(1);
+    }
+    instances = calloc(instanceCount, sizeof(TPM_INSTANCE *));
+    if (instances == NULL) {
+	printf("Cannot allocate %d TPM instances\n", instanceCount);
+	exit(1);
+    }
+    for (i = 1 ; i < instanceCount ; i++) {
+	instances[i] = _plat__InstanceCreate();
+	nvFile = malloc(sizeof(INSTANCE_NV_FILE) + 10);
+	if (instances[i] == NULL || nvFile == NULL
+	    || _plat__InstanceSelect(instances[i]) != 0) {
+	    printf("Cannot create TPM instance %d\n", i);
+	    exit(1);
+	}
+	snprintf(nvFile, sizeof(INSTANCE_NV_FILE) + 10, INSTANCE_NV_FILE, i);
+	if ((nvSize != 0 && _plat__NvSetSize((uint32_t)nvSize) != 0)
+	    || (nvDurability != NULL && _plat__NvSetDurability(nvDurability) != 0)
+	    || (nvMapped && _plat__NvSetMapped(1) != 0)
+	    || (nvTemplate != NULL && _plat__NvSetTemplate(nvTemplate) != 0)) {
+	    printf("Cannot set up the NV memory of TPM instance %d\n", i);
+	    exit(1);
+	}
+	InstanceManufacture(nvFile, manufacture);
+	_rpc__Signal_PowerOn(FALSE);
+	_rpc__Signal_NvOn();
+    }
+    _plat__InstanceSelect(NULL);
+    irc = StartTcpServer(&portNum, &portNumPlat, unixPath, snapshotDir,
+			 instances, instanceCount);
+    // Write the NV changes that are still in flight
+    for (i = instanceCount - 1 ; i >= 0 ; i--) {
+	_plat__InstanceSelect(instances[i]);
+	_plat__NVDisable(0);
+    }
+#else
+    NOT_REFERENCED(nvDurability);
+    NOT_REFERENCED(nvMapped);
+    NOT_REFERENCED(nvTemplate);
+    NOT_REFERENCED(snapshotDir);
     irc = StartTcpServer(&portNum, &portNumPlat);
+    // Write the NV changes that are still in flight
+    _plat__NVDisable(0);
+#endif
     if (irc == 0) {
 	return EXIT_SUCCESS;
     }
@@ -69,7 +69,13 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <fcntl.h>
 #include <pthread.h>
 
 #include "string.h"
@@ -84,22 +90,17 @@
 #include "TpmProfile.h"		/* kgold */
 #include "Platform_fp.h"	/* kgold */
 #include "PlatformACT_fp.h"	/* added kgold */
-extern int verbose;
-bool				/* kgold */
-ReadUINT32(
-	   SOCKET           s,
-	   uint32_t 	    *val
-	   );
-
 
 #define IPVER(len) ((len) == sizeof(struct sockaddr_in6) ? 6 :		\
 		    ((len) == sizeof(struct sockaddr_in) ? 4 : 0))
+// ipver of an AF_UNIX connection
+#define IPVER_UNIX 0
 
 #ifndef __IGNORE_STATE__
 static uint32_t ServerVersion = 1;
+// Clients that report at least this version in TPM_REMOTE_HANDSHAKE may use TPM_SEND_COMMAND_BATCH
+#define SERVER_VERSION_BATCH 2
 #define MAX_BUFFER 1048576
-char InputBuffer[MAX_BUFFER];       //The input data buffer for the simulator.
-char OutputBuffer[MAX_BUFFER];      //The output data buffer for the simulator.
 
 struct {
     uint32_t    largestCommandSize;
@@ -110,6 +111,75 @@ struct {
 
 #endif // __IGNORE_STATE___
 
+#define SERVER_MAX_EVENTS       64
+// Initial size of the connection input and output buffers
+#define CONNECTION_BUFFER_SIZE  8192
+// A connection's requests are not processed while it has this much response data that the client
+// has not read yet.
+#define CONNECTION_MAX_PENDING  (64 * 1024)
+
+// The directory of the snapshot files named in TPM_SNAPSHOT_SAVE and TPM_SNAPSHOT_RESTORE, NULL
+// to refuse them
+static const char       *SnapshotDirectory;
+
+typedef enum {
+    LISTEN_COMMAND,
+    LISTEN_PLATFORM,
+    CONNECTION_COMMAND,
+    CONNECTION_PLATFORM,
+    CONNECTION_RING,
+    CONNECTION_NV_FLUSH                 // the eventfd that tells that an NV flush finished
+} CONNECTION_TYPE;
+
+typedef struct CONNECTION
+{
+    SOCKET               s;
+    CONNECTION_TYPE      type;
+    int                  ipver;
+    uint32_t             events;        // epoll events registered for the socket
+    bool                 queued;        // on the ready queue
+    bool                 closing;       // close once the pending output has been sent
+    bool                 closed;        // freed at the end of the event loop pass
+    bool                 batch;         // TPM_SEND_COMMAND_BATCH was negotiated
+    struct CONNECTION   *next;          // ready queue or listener list link
+    char                *in;            // received bytes, the TPM commands are executed in place
+    uint32_t             inSize;
+    uint32_t             inUsed;
+    uint32_t             inStart;       // the first byte that is not processed yet
+    char                *out;           // response bytes that are not sent yet
+    uint32_t             outSize;
+    uint32_t             outUsed;
+    uint32_t             outSent;
+    int                  passFd[3];     // descriptors sent with the output from passOffset on
+    uint32_t             passCount;
+    uint32_t             passOffset;
+    struct CONNECTION   *attached;      // a ring and the AF_UNIX connection that attached it
+    TPM_INSTANCE        *instance;      // the TPM that the connection talks to, NULL the default
+    uint64_t             nvWait;        // the NV commit to be written before the output is sent
+    NV_FLUSH_STATUS     *nvStatus;      // where nvWait is checked, without selecting the instance
+    bool                 nvWaiting;     // on the NV wait list
+    struct CONNECTION   *nvNext;
+    // CONNECTION_RING only.  s is the request eventfd.
+    TPM_SHM_RING        *ring;
+    size_t               ringLength;
+    int                  ringDoorbell;  // response eventfd
+    uint32_t             ringNext;      // the next slot to execute
+    bool                 ringNotify;    // slots were completed since the last doorbell
+} CONNECTION;
+
+typedef struct
+{
+    int                  epollFd;
+    CONNECTION          *listeners;
+    CONNECTION          *readyHead;     // connections with a complete request, in arrival order
+    CONNECTION          *readyTail;
+    CONNECTION          *closed;        // connections to free once no event refers to them
+    CONNECTION          *nvFlush;
+    CONNECTION          *nvWaiting;     // connections with output held for an NV commit
+    TPM_INSTANCE       **idle;          // the instances with work for the idle time
+    int                  idleCount;
+} SERVER;
+
 // D.3.3.	Functions
 // D.3.3.1.	CreateSocket()
 // This function creates a socket listening on PortNumber.
@@ -184,7 +254,7 @@ CreateSocket(
 	    return -1;
 	}
     // listen/wait for server connections
-    res= listen(*listenSocket,3);
+    res= listen(*listenSocket,SOMAXCONN);
     if(res != 0)
 	{
 	    close(*listenSocket);
@@ -192,665 +262,1624 @@ CreateSocket(
             printf("Listen error.  Error is %d %s\n", errno, strerror(errno));
 	    return -1;
 	}
+    // connections are accepted by the event loop, which must not block
+    res = fcntl(*listenSocket, F_SETFL, fcntl(*listenSocket, F_GETFL, 0) | O_NONBLOCK);
+    if(res != 0)
+	{
+	    close(*listenSocket);
+	    *listenSocket = -1;
+	    printf("fcntl error.  Error is %d %s\n", errno, strerror(errno));
+	    return -1;
+	}
     return 0;
 }
 
-// D.3.3.2.	PlatformServer()
-// This function processes incoming platform requests.
 
-bool
-PlatformServer(
-	       SOCKET           s
-	       )
+// This function creates an AF_UNIX socket listening on path.  A stale socket file left by an
+// earlier run is replaced.
+
+static int
+CreateUnixSocket(
+		 const char          *path,
+		 SOCKET              *listenSocket
+		 )
 {
-    bool                 ok = true;
-    uint32_t             Command;
+    struct sockaddr_un   MyAddress;
+    int                  res;
 
-    for(;;)
+    if(strlen(path) >= sizeof(MyAddress.sun_path))
 	{
-	    ok = ReadBytes(s, (char*) &Command, 4);
-	    // client disconnected (or other error).  We stop processing this client
-	    // and return to our caller who can stop the server or listen for another
-	    // connection.
-	    if(!ok) return true;
-	    Command = ntohl(Command);
-	    switch(Command)
-		{
-		  case TPM_SIGNAL_POWER_ON:
-		    _rpc__Signal_PowerOn(false);
-		    break;
-		  case TPM_SIGNAL_POWER_OFF:
-		    _rpc__Signal_PowerOff();
-		    break;
-		  case TPM_SIGNAL_RESET:
-		    _rpc__Signal_PowerOn(true);
-		    break;
-		  case TPM_SIGNAL_PHYS_PRES_ON:
-		    _rpc__Signal_PhysicalPresenceOn();
-		    break;
-		  case TPM_SIGNAL_PHYS_PRES_OFF:
-		    _rpc__Signal_PhysicalPresenceOff();
-		    break;
-		  case TPM_SIGNAL_CANCEL_ON:
-		    _rpc__Signal_CancelOn();
-		    break;
-		  case TPM_SIGNAL_CANCEL_OFF:
-		    _rpc__Signal_CancelOff();
-		    break;
-		  case TPM_SIGNAL_NV_ON:
-		    _rpc__Signal_NvOn();
-		    break;
-		  case TPM_SIGNAL_NV_OFF:
-		    _rpc__Signal_NvOff();
-		    break;
-		  case TPM_SESSION_END:
-		    // Client signaled end-of-session
-		    TpmEndSimulation();
-		    return true;
-		  case TPM_STOP:
-		    // Client requested the simulator to exit
-		    return false;
-		  case TPM_TEST_FAILURE_MODE:
-		    _rpc__ForceFailureMode();
-		    break;
-		  case TPM_GET_COMMAND_RESPONSE_SIZES:
-		    ok = WriteVarBytes(s, (char *)&CommandResponseSizes,
-				       sizeof(CommandResponseSizes));
-		    memset(&CommandResponseSizes, 0, sizeof(CommandResponseSizes));
-		    if(!ok)
-			return true;
-		    break;
-		  case TPM_ACT_GET_SIGNALED:
-		      {
-			  uint32_t actHandle;
-			  ok = ReadUINT32(s, &actHandle);
-			  WriteUINT32(s, _rpc__ACT_GetSignaled(actHandle));
-			  break;
-		      }
-		  default:
-		    printf("Unrecognized platform interface command %08x\n", Command);
-		    WriteUINT32(s, 1);
-		    return true;
-		}
-	    WriteUINT32(s,0);
+	    printf("Unix socket path %s is too long\n", path);
+	    return -1;
 	}
-    return false;
-}
-
-// D.3.3.3.	PlatformSvcRoutine()
-// This function is called to set up the socket interfaces to listen for commands.
-
-int
-PlatformSvcRoutine(
-		   void *port
-		   )
-{
-    int                  PortNumber = *(int *)port;
-
-    SOCKET               listenSocket[2], maxListenSocket, serverSocket;
-    struct               sockaddr_storage HerAddress;
-    fd_set               sockSet;
-    int                  res, i;
-    int                  nSock = 0;
-    socklen_t            length[2];
-    BOOL                 continueServing = true;	/* kgold initialized */
-
-    if (CreateSocket(PortNumber, &listenSocket[nSock], &length[nSock],
-		     AF_INET) == 0) {
-        nSock++;
-
-    }
-    if (CreateSocket(PortNumber, &listenSocket[nSock], &length[nSock],
-		     AF_INET6) == 0) {
-        nSock++;
-    }
-    if (nSock == 0) {
-	printf("Create platform service socket fail\n");
-	exit(5);
-    }
-
-    maxListenSocket = listenSocket[0];
-    if ((nSock == 2) && (listenSocket[1] > maxListenSocket)) {
-        maxListenSocket = listenSocket[1];
-    }
-
-    // Loop accepting connections one-by-one until we are killed or asked to stop
-    // Note the platform service is single-threaded so we don't listen for a new
-    // connection until the prior connection drops.
-    do {
-        printf("Platform server listening on port %d\n", PortNumber);
-
-	// Select both IPv4 and IPv6 sockets or whatever is available
-	FD_ZERO(&sockSet);
-	FD_SET(listenSocket[0], &sockSet);
-	if (nSock == 2)
-	    FD_SET(listenSocket[1], &sockSet);
-	do {
-	    res = select(maxListenSocket + 1, &sockSet, NULL, NULL, NULL);
-	}
-	while ((res == -1) && (errno == EINTR));
-	if (res == -1) {
-	    printf("Platform server select error.  Error is %d %s\n",
+    *listenSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(*listenSocket == -1)
+	{
+	    printf("Cannot create server listen Unix socket.  Error is %d %s\n",
 		   errno, strerror(errno));
 	    return -1;
 	}
-
-	for (i = 0; i < nSock; i++) {
-	    int ipver = IPVER(length[i]);
-
-	    if (!FD_ISSET(listenSocket[i], &sockSet))
-		{
-		    continue;
-		}
-	    // blocking accept
-	    serverSocket = accept(listenSocket[i],
-				  (struct sockaddr*) &HerAddress,
-				  &length[i]);
-	    if(serverSocket < 0)
-		{
-		    printf("Platform server IPv%d Accept error.  Error is %d %s\n",
-			   ipver, errno, strerror(errno));
-		    return -1;
-		};
-	    printf("Platform IPv%d client accepted\n", ipver);
-
-	    // normal behavior on client disconnection is to wait for a new
-	    // client to connect
-	    continueServing = PlatformServer(serverSocket);
-	    close(serverSocket);
-	    serverSocket = -1;
+    memset(&MyAddress, 0, sizeof(MyAddress));
+    MyAddress.sun_family = AF_UNIX;
+    strcpy(MyAddress.sun_path, path);
+    unlink(path);
+    res = bind(*listenSocket, (struct sockaddr*) &MyAddress, sizeof(MyAddress));
+    if(res == 0)
+	res = listen(*listenSocket, SOMAXCONN);
+    if(res == 0)
+	res = fcntl(*listenSocket, F_SETFL, fcntl(*listenSocket, F_GETFL, 0) | O_NONBLOCK);
+    if(res != 0)
+	{
+	    printf("Unix socket %s error.  Error is %d %s\n", path, errno, strerror(errno));
+	    close(*listenSocket);
+	    *listenSocket = -1;
+	    return -1;
 	}
-    }
-    while(continueServing);
     return 0;
 }
 
-// D.3.3.4.	PlatformSignalService()
+// D.3.3.2.	Connection buffers
 
-// This function starts a new thread waiting for platform signals. Platform signals are processed
-// one at a time in the order in which they are received.
+// Each client connection owns an input buffer that collects the bytes of its requests and an
+// output buffer that collects the responses that have not been sent yet.  The buffers grow as
+// needed, up to the size of the largest request or response.
 
-int
-PlatformSignalService(
-		      int              *PortNumberPlatform
-		      )
-{
-    unsigned long       thread;
-    int                 irc = 0;
-    pthread_t           *pthread = (pthread_t *)&thread;
-
-    irc = pthread_create(pthread,
-                         NULL,
-                         (void * (*)(void *))PlatformSvcRoutine,      /* thread entry function */
-                         (void *)PortNumberPlatform); 	          /* thread function parameters */
-    if (irc != 0) {
-	printf("Thread Creation failed\n");
-	return -1;
-    }
-    return 0;
+static void
+ConnectionFree(
+	       CONNECTION      *c
+	       )
+{
+    uint32_t             i;
+
+    if(c->s >= 0)
+	close(c->s);
+    for(i = 0; i < c->passCount; i++)
+	close(c->passFd[i]);
+    if(c->ring != NULL)
+	munmap(c->ring, c->ringLength);
+    if(c->type == CONNECTION_RING && c->ringDoorbell >= 0)
+	close(c->ringDoorbell);
+    free(c->in);
+    free(c->out);
+    free(c);
 }
 
-// D.3.3.5.	RegularCommandService()
-// This funciton services regular commands.
+// This function makes room for at least size bytes in a connection buffer.
 
-int
-RegularCommandService(
-		      int              *PortNumber
-		      )
+static bool
+BufferReserve(
+	      char            **buffer,
+	      uint32_t         *bufferSize,
+	      uint32_t          size
+	      )
 {
-    SOCKET               listenSocket[2], maxListenSocket;
-    SOCKET               serverSocket;
-    struct               sockaddr_storage HerAddress;
-    fd_set               sockSet;
-    int                  res, i;
-    int                  nSock = 0;
-    socklen_t            length[2];
-    BOOL 		 continueServing = true;	/* kgold - initialized */
-
-    if (CreateSocket(*PortNumber, &listenSocket[nSock], &length[nSock],
-		     AF_INET) == 0) {
-        nSock++;
-
-    }
-    if (CreateSocket(*PortNumber, &listenSocket[nSock], &length[nSock],
-		     AF_INET6) == 0) {
-        nSock++;
-    }
-    if (nSock == 0) {
-        printf("Create TPM command service socket fail\n");
-        return -1;
-    }
-    maxListenSocket = listenSocket[0];
-    if (nSock == 2 && listenSocket[1] > maxListenSocket) {
-        maxListenSocket = listenSocket[1];
-    }
-    
-    // Loop accepting connections one-by-one until we are killed or asked to stop
-    // Note the TPM command service is single-threaded so we don't listen for
-    // a new connection until the prior connection drops.
-    do
-	{
-	    printf("TPM command server listening on port %d\n", *PortNumber);
-
-	    // Select both IPv4 and IPv6 sockets or whatever is available
-	    FD_ZERO(&sockSet);
-	    FD_SET(listenSocket[0], &sockSet);
-	    if (nSock == 2)
-		FD_SET(listenSocket[1], &sockSet);
-	    do {
-	        res = select(maxListenSocket + 1, &sockSet, NULL, NULL, NULL);
-	    } while ((res == -1) && (errno == EINTR));
-	    if (res == -1) {
-	        printf("TPM command server select error.  Error is %d %s\n", errno,
-		       strerror(errno));
-	        return -1;
-	    }
-
-	    for (i = 0; i < nSock; i++) {
-	        int ipver = IPVER(length[i]);
-
-	        if (!FD_ISSET(listenSocket[i], &sockSet))
-	            continue;
-	        // blocking accept
-		serverSocket = accept(listenSocket[i],
-				      (struct sockaddr*) &HerAddress,
-				      &length[i]);
-		if(serverSocket < 0)
-		    {
-			printf("TPM server IPv%d Accept error.  Error is %d %s\n",
-			       ipver, errno, strerror(errno));
-			return -1;
-		    };
-	        printf("Command IPv%d client accepted\n", ipver);
-
-	        // normal behavior on client disconnection is to wait for a new
-	        // client to connect
-	        continueServing = TpmServer(serverSocket);
-	        close(serverSocket);
-	        serverSocket = -1;
-	    }
+    char                *newBuffer;
+    uint32_t             newSize = *bufferSize;
+
+    if(size <= *bufferSize)
+	return true;
+    if(newSize == 0)
+	newSize = CONNECTION_BUFFER_SIZE;
+    while(newSize < size)
+	newSize *= 2;
+    newBuffer = realloc(*buffer, newSize);
+    if(newBuffer == NULL)
+	{
+	    printf("Connection buffer allocation of %u bytes failed\n", newSize);
+	    return false;
 	}
-    while(continueServing);
-    return 0;
+    *buffer = newBuffer;
+    *bufferSize = newSize;
+    return true;
 }
 
-#if RH_ACT_0
+// Append bytes to the connection output buffer.  If the buffer cannot grow, the connection is
+// closed once the rest of the output has been sent.
 
-/* D.3.2.5.	SimulatorTimeServiceRoutine() */
-/* This function is called to service the time ticks. */
-static int
-SimulatorTimeServiceRoutine(
-			    void
-			    )
+static void
+OutputBytes(
+	    CONNECTION      *c,
+	    const void      *buffer,
+	    uint32_t         length
+	    )
 {
-    // All time is in ms
-    const int64_t tick = 1000;
-    uint64_t prevTime = _plat__RealTime();
-    int64_t timeout = tick;
-
-    while (true)
+    if(c->closing)
+	return;
+    if(!BufferReserve(&c->out, &c->outSize, c->outUsed + length))
 	{
-	    uint64_t curTime;
-
-	    struct timespec req = {timeout / 1000, (timeout % 1000) * 1000};
-	    struct timespec rem;
-	    nanosleep(&req, &rem);
-
-	    curTime = _plat__RealTime();
-
-	    // May need to issue several ticks if the Sleep() took longer than asked,
-	    // or no ticks at all, it Sleep() was interrupted prematurely.
-	    while (prevTime < curTime - tick / 2)
-	        {
-	            //printf("%05lld | %05lld\n",
-	            //      prevTime % 100000, (curTime - tick / 2) % 100000);
-	            _plat__ACT_Tick();
-	            prevTime += (uint64_t)tick;
-	        }
-	    // Adjust the next timeout to keep the average interval of one second
-	    timeout = tick + (prevTime - curTime);
-	    //prevTime = curTime;
-	    //printf("%04lld | c:%05lld | p:%05llu\n",
-	    //          timeout, curTime % 100000, prevTime);
+	    c->closing = true;
+	    return;
 	}
-    return 0;
+    memcpy(c->out + c->outUsed, buffer, length);
+    c->outUsed += length;
 }
 
-/* D.3.2.6.	ActTimeService() */
-/* This function starts a new thread waiting to wait for time ticks. */
-/* Return Value	Meaning */
-/* ==0	success */
-/*     !=0	failure */
-static int
-ActTimeService(
-	       void
-	       )
+static void
+OutputUINT32(
+	     CONNECTION      *c,
+	     uint32_t         val
+	     )
 {
-    static bool          running = false;
-    int                  ret = 0;
-
-    if(!running)
-	{
-	    pthread_t            thread_id;
+    uint32_t netVal = htonl(val);
+    OutputBytes(c, &netVal, sizeof(netVal));
+}
 
-	    /* kgold - hoisted out of WIndows only version */
-	    printf("Starting ACT thread...\n");
-	    //  Don't allow ticks to be processed before TPM is manufactured.
-	    _plat__ACT_EnableTicks(false);
+// Send a uint32_t-length-prepended binary array.  Note that the 4-byte length is in network byte
+// order (big-endian).
 
-	    //
-	    ret = pthread_create(&thread_id, NULL, (void*)SimulatorTimeServiceRoutine,
-				 NULL);
+static void
+OutputVarBytes(
+	       CONNECTION      *c,
+	       const void      *buffer,
+	       uint32_t         length
+	       )
+{
+    OutputUINT32(c, length);
+    OutputBytes(c, buffer, length);
+}
 
-	    if(ret != 0)
-		printf("ACT thread Creation failed\n");
-	    else
-		running = TRUE;
-	}
-    return ret;
+static uint32_t
+GetUINT32(
+	  const char      *buffer
+	  )
+{
+    uint32_t netVal;
+    memcpy(&netVal, buffer, sizeof(netVal));
+    return ntohl(netVal);
 }
-#endif // RH_ACT_0
 
+// D.3.3.3.	RequestSize()
 
-// D.3.3.6.	StartTcpServer()
+// This function frames the first unprocessed request in the connection input buffer.  It sets size to the
+// number of bytes in the request.  When only part of the request header has been received, size is
+// the number of bytes needed to learn the full size.
 
-// Main entry-point to the TCP server.  The server listens on port specified. Note that there is no
-// way to specify the network interface in this implementation.
+// Return Value	Meaning
+// 1		the request is complete
+// 0		more input is needed
+// -1		the request can not be handled and the connection should be closed
 
-int
-StartTcpServer(
-	       int              *PortNumber,
-	       int              *PortNumberPlatform
-	       )
+static int
+RequestSize(
+	    CONNECTION      *c,
+	    uint32_t        *size
+	    )
 {
-    int                  res;
-
-#if RH_ACT_0 || 1
-    // Start the Time Service routine
-    res = ActTimeService();
-    if(res != 0)
-	{
-	    printf("TimeService failed\n");
-	    return res;
-	}
-#endif
-    // Start Platform Signal Processing Service
-    res = PlatformSignalService(PortNumberPlatform);
-    if (res != 0)
+    uint32_t             command;
+    uint32_t             lengthOffset;
+    uint32_t             length;
+    uint32_t             count;
+    const char          *in = c->in + c->inStart;
+    uint32_t             inUsed = c->inUsed - c->inStart;
+
+    if(c->type == CONNECTION_RING)
 	{
-	    printf("PlatformSignalService failed\n");
-	    return res;
+	    // the requests stay in the ring.  A client can not have more than a ring of them.
+	    *size = 0;
+	    count = __atomic_load_n(&c->ring->requestHead, __ATOMIC_ACQUIRE) - c->ringNext;
+	    if(count > TPM_SHM_SLOT_COUNT)
+		{
+		    printf("Ring request head is out of range\n");
+		    return -1;
+		}
+	    return (count != 0) ? 1 : 0;
 	}
-
-    // Start Regular/DRTM TPM command service
-    res = RegularCommandService(PortNumber);
-    if (res != 0)
+    *size = sizeof(uint32_t);
+    if(inUsed < *size)
+	return 0;
+    command = GetUINT32(in);
+    lengthOffset = 0;
+    if(c->type == CONNECTION_PLATFORM)
 	{
-	    printf("RegularCommandService failed\n");
-	    return res;
+	    if(command == TPM_ACT_GET_SIGNALED)
+		*size += sizeof(uint32_t);		// ACT handle
+	    else if(command == TPM_GET_COMMAND_STATS)
+		*size += sizeof(uint32_t);		// reset
+	    else if(command == TPM_SNAPSHOT_SAVE || command == TPM_SNAPSHOT_RESTORE)
+		lengthOffset = sizeof(uint32_t);	// file name
 	}
-    return 0;
-}
-
-// D.3.3.7.	ReadBytes()
-// This function reads the indicated number of bytes (NumBytes) into buffer from the indicated
-// socket.
-
-bool
-ReadBytes(
-	  SOCKET           s,
-	  char            *buffer,
-	  int              NumBytes
-	  )
-{
-    int                  res;
-    int                  numGot = 0;
-
-    while(numGot<NumBytes)
+    else
 	{
-	    res = read(s, buffer+numGot, NumBytes-numGot);
-	    if(res < 0)
-		{
-		    printf("read() error.  Error is %d %s\n", errno, strerror(errno));
-		    return false;
-		}
-	    if(res==0)
+	    switch(command)
 		{
-		    return false;
+		  case TPM_SIGNAL_HASH_DATA:
+		    lengthOffset = sizeof(uint32_t);
+		    break;
+		  case TPM_SEND_COMMAND:
+		    lengthOffset = sizeof(uint32_t) + 1;	// locality
+		    break;
+		  case TPM_REMOTE_HANDSHAKE:
+		  case TPM_SET_ALTERNATIVE_RESULT:
+		    *size += sizeof(uint32_t);
+		    break;
+		  case TPM_SEND_COMMAND_BATCH:
+		    if(!c->batch)
+			break;
+		    // {uint32_t Count, Count * {uint8_t Locality, uint32_t length, uint8_t[length]}}
+		    *size += sizeof(uint32_t);
+		    if(inUsed < *size)
+			return 0;
+		    count = GetUINT32(in + sizeof(uint32_t));
+		    if(count > TPM_BATCH_MAX_COMMANDS)
+			{
+			    printf("Batch too big.  Client says %u commands\n", count);
+			    return -1;
+			}
+		    while(count-- > 0)
+			{
+			    *size += 1 + sizeof(uint32_t);
+			    if(inUsed < *size)
+				return 0;
+			    length = GetUINT32(in + *size - sizeof(uint32_t));
+			    if(length > MAX_BUFFER || *size + length > MAX_BUFFER)
+				{
+				    printf("Batch too big.  Client says %u\n", length);
+				    return -1;
+				}
+			    *size += length;
+			}
+		    break;
+		  default:
+		    break;
 		}
-	    numGot+=res;
 	}
-    return true;
-}
-
-// D.3.3.8.	WriteBytes()
-// This function will send the indicated number of bytes (NumBytes) to the indicated socket
-
-bool
-WriteBytes(
-	   SOCKET           s,
-	   char            *buffer,
-	   int              NumBytes
-	   )
-{
-    int                  res;
-    int                  numSent = 0;
-    while(numSent<NumBytes)
+    if(lengthOffset != 0)
 	{
-	    res = write(s, buffer+numSent, NumBytes-numSent);
-	    if(res == 0)
+	    // variable length request, {uint32_t length, uint8_t[length]}
+	    *size = lengthOffset + sizeof(uint32_t);
+	    if(inUsed < *size)
+		return 0;
+	    length = GetUINT32(in + lengthOffset);
+	    if(length > MAX_BUFFER)
 		{
-		    printf("write() error. Error is %d %s\n",  errno, strerror(errno));
-		    return false;
+		    printf("Buffer too big.  Client says %u\n", length);
+		    return -1;
 		}
-	    numSent+=res;
+	    *size += length;
 	}
-    return true;
+    return (inUsed >= *size) ? 1 : 0;
 }
 
-// D.3.3.9.	WriteUINT32()
-// Send 4 byte integer
-
-bool
-WriteUINT32(
-	    SOCKET           s,
-	    uint32_t 	     val
-	    )
-{
-    uint32_t netVal = htonl(val);
-    return WriteBytes(s, (char*) &netVal, 4);
-}
+// Build the path of the snapshot file named by a platform request.  The name comes from the
+// network, so it must be a plain file name in SnapshotDirectory.
 
-/* D.3.2.11.	ReadUINT32() */
-/* Function to read 4 byte integer from socket. */
+// Return Value	Meaning
+// true		the path is in path
+// false	no snapshot directory, or the name is not a plain file name
 
-bool
-ReadUINT32(
-	   SOCKET           s,
-	   uint32_t 	    *val
-	   )
+static bool
+SnapshotPath(
+	     char            *path,
+	     size_t           pathSize,
+	     const char      *name,
+	     uint32_t         length
+	     )
 {
-    uint32_t netVal;
-    //
-    if (!ReadBytes(s, (char*)&netVal, 4))
+    int                  res;
+
+    if(SnapshotDirectory == NULL || length == 0
+       || memchr(name, '/', length) != NULL || memchr(name, '\0', length) != NULL
+       || (length == 1 && name[0] == '.')
+       || (length == 2 && name[0] == '.' && name[1] == '.'))
 	return false;
-    *val = ntohl(netVal);
-    return true;
+    res = snprintf(path, pathSize, "%s/%.*s", SnapshotDirectory, (int)length, name);
+    return res > 0 && (size_t)res < pathSize;
 }
 
-// D.3.3.10.	ReadVarBytes()
-// Get a uint32_t-length-prepended binary array.  Note that the 4-byte length is in network byte
-// order (big-endian).
+// D.3.3.4.	PlatformRequest()
 
-bool
-ReadVarBytes(
-	     SOCKET           s,
-	     char            *buffer,
-	     uint32_t	     *BytesReceived,
-	     int              MaxLen
-	     )
+// This function processes one platform request from the connection input buffer.  The response
+// is placed in the connection output buffer.
+
+// Return Value	Meaning
+// true		continue serving
+// false	stop the platform service
+
+static bool
+PlatformRequest(
+		CONNECTION      *c
+		)
 {
-    int                  length;
-    bool                 res;
+    const char          *in = c->in + c->inStart;
+    uint32_t             Command = GetUINT32(in);
+    uint32_t             length;
+    char                 fileName[FILENAME_MAX];
 
-    res = ReadBytes(s, (char*) &length, 4);
-    if(!res) return res;
-    length = ntohl(length);
-    *BytesReceived = length;
-    if(length>MaxLen)
+    switch(Command)
 	{
-	    printf("Buffer too big.  Client says %d\n", length);
+	  case TPM_SIGNAL_POWER_ON:
+	    _rpc__Signal_PowerOn(false);
+	    break;
+	  case TPM_SIGNAL_POWER_OFF:
+	    _rpc__Signal_PowerOff();
+	    break;
+	  case TPM_SIGNAL_RESET:
+	    _rpc__Signal_PowerOn(true);
+	    break;
+	  case TPM_SIGNAL_PHYS_PRES_ON:
+	    _rpc__Signal_PhysicalPresenceOn();
+	    break;
+	  case TPM_SIGNAL_PHYS_PRES_OFF:
+	    _rpc__Signal_PhysicalPresenceOff();
+	    break;
+	  case TPM_SIGNAL_CANCEL_ON:
+	    _rpc__Signal_CancelOn();
+	    break;
+	  case TPM_SIGNAL_CANCEL_OFF:
+	    _rpc__Signal_CancelOff();
+	    break;
+	  case TPM_SIGNAL_NV_ON:
+	    _rpc__Signal_NvOn();
+	    break;
+	  case TPM_SIGNAL_NV_OFF:
+	    _rpc__Signal_NvOff();
+	    break;
+	  case TPM_SESSION_END:
+	    // Client signaled end-of-session
+	    TpmEndSimulation();
+	    c->closing = true;
+	    return true;
+	  case TPM_STOP:
+	    // Client requested the platform service to exit
+	    c->closing = true;
 	    return false;
+	  case TPM_TEST_FAILURE_MODE:
+	    _rpc__ForceFailureMode();
+	    break;
+	  case TPM_GET_COMMAND_RESPONSE_SIZES:
+	    OutputVarBytes(c, &CommandResponseSizes, sizeof(CommandResponseSizes));
+	    memset(&CommandResponseSizes, 0, sizeof(CommandResponseSizes));
+	    break;
+	  case TPM_ACT_GET_SIGNALED:
+	    OutputUINT32(c, _rpc__ACT_GetSignaled(GetUINT32(in + sizeof(uint32_t))));
+	    break;
+	  case TPM_GET_COMMAND_STATS:
+	    // the statistics are copied straight into the output buffer
+	    length = _plat__StatsGet(NULL, 0, 0);
+	    if(c->closing
+	       || !BufferReserve(&c->out, &c->outSize, c->outUsed + sizeof(uint32_t) + length))
+		{
+		    c->closing = true;
+		    return true;
+		}
+	    length = _plat__StatsGet(c->out + c->outUsed + sizeof(uint32_t), length,
+				     GetUINT32(in + sizeof(uint32_t)));
+	    OutputUINT32(c, length);
+	    c->outUsed += length;
+	    break;
+	  case TPM_SNAPSHOT_SAVE:
+	  case TPM_SNAPSHOT_RESTORE:
+	    length = GetUINT32(in + sizeof(uint32_t));
+	    if(!SnapshotPath(fileName, sizeof(fileName), in + 2 * sizeof(uint32_t), length))
+		{
+		    OutputUINT32(c, 1);
+		    break;
+		}
+	    OutputUINT32(c, (Command == TPM_SNAPSHOT_SAVE) ? _rpc__Signal_Snapshot(fileName)
+			 : _rpc__Signal_Restore(fileName));
+	    break;
+	  default:
+	    printf("Unrecognized platform interface command %08x\n", Command);
+	    OutputUINT32(c, 1);
+	    c->closing = true;
+	    return true;
 	}
-    if(length==0) return true;
-    res = ReadBytes(s, buffer, length);
-    if(!res) return res;
+    OutputUINT32(c, 0);
     return true;
 }
 
-// D.3.3.11.	WriteVarBytes()
-// Send a uint32_t--length-prepended binary array.  Note that the 4-byte length is in network byte
-// order (big-endian).
+// D.3.3.5.	SendCommand()
 
-bool
-WriteVarBytes(
-	      SOCKET           s,
-	      char            *buffer,
-	      int              BytesToSend
-	      )
+// This function executes one TPM command and appends the uint32_t-length-prepended response to the
+// connection output buffer.  The command is executed where it was received and the TPM builds the
+// response directly in the output buffer.
+
+static void
+SendCommand(
+	    CONNECTION      *c,
+	    uint8_t          locality,
+	    char            *command,
+	    uint32_t         length
+	    )
 {
-    uint32_t 		netLength = htonl(BytesToSend);
-    bool res;
+    _IN_BUFFER           InBuffer;
+    _OUT_BUFFER          OutBuffer;
+    unsigned char       *response;
+    uint32_t             netVal;
+    uint64_t             wait;
+    NV_FLUSH_STATUS     *status;
+
+    // room for the size, the largest response and the acknowledgment
+    if(c->closing
+       || !BufferReserve(&c->out, &c->outSize,
+			 c->outUsed + 2 * sizeof(uint32_t) + MAX_RESPONSE_SIZE))
+	{
+	    c->closing = true;
+	    return;
+	}
+    response = (unsigned char *)c->out + c->outUsed + sizeof(uint32_t);
+    InBuffer.Buffer = (uint8_t *) command;
+    InBuffer.BufferSize = length;
+    OutBuffer.BufferSize = MAX_RESPONSE_SIZE;
+    OutBuffer.Buffer = response;
+    // record the number of bytes in the command if it is the largest
+    // we have seen so far.
+    if(InBuffer.BufferSize > CommandResponseSizes.largestCommandSize)
+	{
+	    CommandResponseSizes.largestCommandSize = InBuffer.BufferSize;
+	    if(length >= 10)
+		memcpy(&CommandResponseSizes.largestCommand,
+		       &command[6], sizeof(uint32_t));
+	}
+    _rpc__Send_Command(locality, InBuffer, &OutBuffer);
+    // failure mode responses come from a buffer of their own
+    if(OutBuffer.Buffer != response)
+	{
+	    if(OutBuffer.BufferSize > MAX_RESPONSE_SIZE)
+		OutBuffer.BufferSize = 0;
+	    memcpy(response, OutBuffer.Buffer, OutBuffer.BufferSize);
+	}
+    // record the number of bytes in the response if it is the largest
+    // we have seen so far.
+    if(OutBuffer.BufferSize > CommandResponseSizes.largestResponseSize)
+	{
+	    CommandResponseSizes.largestResponseSize
+		= OutBuffer.BufferSize;
+	    memcpy(&CommandResponseSizes.largestResponse,
+		   &response[6], sizeof(uint32_t));
+	}
+    netVal = htonl(OutBuffer.BufferSize);
+    memcpy(c->out + c->outUsed, &netVal, sizeof(netVal));
+    c->outUsed += sizeof(uint32_t) + OutBuffer.BufferSize;
+    // In the group NV durability mode, the output is held until the NV commit is written
+    wait = _plat__NvFlushPending(&status);
+    if(wait != 0)
+	{
+	    c->nvWait = wait;
+	    c->nvStatus = status;
+	}
+}
 
-    res = WriteBytes(s, (char*) &netLength, 4);
-    if(!res) return res;
-    res = WriteBytes(s, buffer, BytesToSend);
-    if(!res) return res;
-    return true;
+// D.3.3.6.	Shared memory ring
+
+// This function creates a shared memory command ring for a client on an AF_UNIX command
+// connection.  The ring is served like another connection and lives as long as the connection
+// that attached it.  The ring memory and the doorbells are passed to the client with the response.
+
+static void
+RingAttach(
+	   SERVER          *server,
+	   CONNECTION      *c
+	   )
+{
+    static uint32_t      ringNumber = 0;
+    char                 name[64];
+    struct epoll_event   event;
+    CONNECTION          *r;
+    int                  fd;
+
+    if(c->ipver != IPVER_UNIX || c->attached != NULL)
+	{
+	    printf("Shared memory ring requires one attach on a Unix socket connection\n");
+	    c->closing = true;
+	    return;
+	}
+    r = calloc(1, sizeof(CONNECTION));
+    if(r == NULL)
+	{
+	    c->closing = true;
+	    return;
+	}
+    r->type = CONNECTION_RING;
+    r->ipver = IPVER_UNIX;
+    r->instance = c->instance;
+    r->ringLength = TPM_SHM_SLOT_OFFSET + TPM_SHM_SLOT_COUNT * TPM_SHM_SLOT_SIZE;
+    r->s = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    // the client may block reading the response doorbell
+    r->ringDoorbell = eventfd(0, EFD_CLOEXEC);
+    // the name is only used until the memory is mapped
+    snprintf(name, sizeof(name), "/tpm_server.%d.%u", (int)getpid(), ringNumber++);
+    fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if(fd >= 0)
+	{
+	    shm_unlink(name);
+	    if(ftruncate(fd, r->ringLength) == 0)
+		r->ring = mmap(NULL, r->ringLength, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+    if(r->ring == MAP_FAILED)
+	r->ring = NULL;
+    if(r->s < 0 || r->ringDoorbell < 0 || fd < 0 || r->ring == NULL)
+	{
+	    printf("Shared memory ring creation failed.  Error is %d %s\n", errno, strerror(errno));
+	    if(fd >= 0)
+		close(fd);
+	    ConnectionFree(r);
+	    c->closing = true;
+	    return;
+	}
+    r->ring->slotCount = TPM_SHM_SLOT_COUNT;
+    r->ring->slotSize = TPM_SHM_SLOT_SIZE;
+    memset(&event, 0, sizeof(event));
+    event.events = r->events = EPOLLIN;
+    event.data.ptr = r;
+    if(epoll_ctl(server->epollFd, EPOLL_CTL_ADD, r->s, &event) != 0)
+	{
+	    printf("epoll_ctl error. Error is %d %s\n", errno, strerror(errno));
+	    close(fd);
+	    ConnectionFree(r);
+	    c->closing = true;
+	    return;
+	}
+    r->attached = c;
+    c->attached = r;
+    c->passFd[0] = fd;
+    c->passFd[1] = dup(r->s);
+    c->passFd[2] = dup(r->ringDoorbell);
+    c->passCount = 3;
+    c->passOffset = c->outUsed;
+    OutputUINT32(c, TPM_SHM_SLOT_COUNT);
+    OutputUINT32(c, TPM_SHM_SLOT_SIZE);
 }
 
-// D.3.3.12.	TpmServer()
-// Processing incoming TPM command requests using the protocol / interface defined above.
+// This function executes the TPM command in the next ring slot.  The command is executed where
+// the client put it and the response is built over it.
 
-bool
-TpmServer(
-	  SOCKET           s
-	  )
+static void
+RingRequest(
+	    CONNECTION      *c
+	    )
 {
-    uint32_t 		 length;
-    uint32_t             Command;
-    uint8_t 		 locality;
-    bool                 ok;
-    int                  result;
-    int                  clientVersion;
+    unsigned char       *slot = (unsigned char *)c->ring + TPM_SHM_SLOT_OFFSET
+			   + (c->ringNext % TPM_SHM_SLOT_COUNT) * TPM_SHM_SLOT_SIZE;
+    uint32_t             Command = GetUINT32((char *)slot + TPM_SHM_SLOT_REQUEST);
+    uint8_t              locality = slot[TPM_SHM_SLOT_REQUEST + 4];
+    uint32_t             length = GetUINT32((char *)slot + TPM_SHM_SLOT_REQUEST + 5);
+    uint32_t             maxLength = TPM_SHM_SLOT_SIZE - TPM_SHM_SLOT_DATA - sizeof(uint32_t);
+    uint32_t             ack = 0;
+    uint32_t             netVal;
+    uint64_t             wait;
+    NV_FLUSH_STATUS     *status;
     _IN_BUFFER           InBuffer;
     _OUT_BUFFER          OutBuffer;
 
-    for(;;)
+    OutBuffer.BufferSize = 0;
+    if(Command != TPM_SEND_COMMAND || length > maxLength)
+	{
+	    printf("Unrecognized ring request %08x size %u\n", Command, length);
+	    ack = 1;
+	}
+    else
+	{
+	    InBuffer.Buffer = slot + TPM_SHM_SLOT_DATA;
+	    InBuffer.BufferSize = length;
+	    OutBuffer.Buffer = slot + TPM_SHM_SLOT_DATA;
+	    OutBuffer.BufferSize = maxLength;
+	    _rpc__Send_Command(locality, InBuffer, &OutBuffer);
+	    wait = _plat__NvFlushPending(&status);
+	    if(wait != 0)
+		{
+		    c->nvWait = wait;
+		    c->nvStatus = status;
+		}
+	    // failure mode responses come from a buffer of their own
+	    if(OutBuffer.Buffer != slot + TPM_SHM_SLOT_DATA)
+		{
+		    if(OutBuffer.BufferSize > maxLength)
+			OutBuffer.BufferSize = 0;
+		    memcpy(slot + TPM_SHM_SLOT_DATA, OutBuffer.Buffer, OutBuffer.BufferSize);
+		}
+	}
+    netVal = htonl(OutBuffer.BufferSize);
+    memcpy(slot + TPM_SHM_SLOT_RESPONSE, &netVal, sizeof(netVal));
+    netVal = htonl(ack);
+    memcpy(slot + TPM_SHM_SLOT_DATA + OutBuffer.BufferSize, &netVal, sizeof(netVal));
+    c->ringNext++;
+    // The client sees a slot as soon as it is completed, so the completed slots are held, like the
+    // output of a connection, until the NV commit is written
+    if(c->nvWait == 0)
+	{
+	    __atomic_store_n(&c->ring->responseHead, c->ringNext, __ATOMIC_RELEASE);
+	    c->ringNotify = true;
+	}
+}
+
+// D.3.3.7.	CommandRequest()
+
+// This function processes one request on the TPM command port from the connection input buffer.
+// The response is placed in the connection output buffer.
+
+// Return Value	Meaning
+// true		continue serving
+// false	the client requested the simulator to exit
+
+static bool
+CommandRequest(
+	       SERVER          *server,
+	       CONNECTION      *c
+	       )
+{
+    char                *in = c->in + c->inStart;
+    uint32_t 		 length;
+    uint32_t             Command = GetUINT32(in);
+    uint32_t             count;
+    uint32_t             offset;
+    _IN_BUFFER           InBuffer;
+
+    switch(Command)
+	{
+	  case TPM_SIGNAL_HASH_START:
+	    _rpc__Signal_Hash_Start();
+	    break;
+	  case TPM_SIGNAL_HASH_END:
+	    _rpc__Signal_HashEnd();
+	    break;
+	  case TPM_SIGNAL_HASH_DATA:
+	    InBuffer.Buffer = (uint8_t *) in + 8;
+	    InBuffer.BufferSize = GetUINT32(in + 4);
+	    _rpc__Signal_Hash_Data(InBuffer);
+	    break;
+	  case TPM_SEND_COMMAND:
+	    SendCommand(c, (uint8_t)in[4], in + 9, GetUINT32(in + 5));
+	    break;
+	  case TPM_SEND_COMMAND_BATCH:
+	    if(!c->batch)
+		{
+		    printf("TPM_SEND_COMMAND_BATCH was not negotiated\n");
+		    c->closing = true;
+		    return true;
+		}
+	    // RequestSize() has checked that all of the commands are in the input buffer
+	    count = GetUINT32(in + 4);
+	    offset = 8;
+	    while(count-- > 0 && !c->closing)
+		{
+		    length = GetUINT32(in + offset + 1);
+		    SendCommand(c, (uint8_t)in[offset], in + offset + 5, length);
+		    offset += 5 + length;
+		}
+	    break;
+	  case TPM_REMOTE_HANDSHAKE:
+	    if(GetUINT32(in + 4) == 0)
+		{
+		    printf("Unsupported client version (0).\n");
+		    c->closing = true;
+		    return true;
+		}
+	    // A client that knows about batches gets them.  Older clients see the original reply.
+	    if(GetUINT32(in + 4) >= SERVER_VERSION_BATCH)
+		{
+		    c->batch = true;
+		    OutputUINT32(c, SERVER_VERSION_BATCH);
+		    OutputUINT32(c, tpmInRawMode | tpmPlatformAvailable | tpmSupportsPP |
+				 tpmSupportsBatch);
+		}
+	    else
+		{
+		    OutputUINT32(c, ServerVersion);
+		    OutputUINT32(c, tpmInRawMode | tpmPlatformAvailable | tpmSupportsPP);
+		}
+	    break;
+	  case TPM_SHARED_MEMORY_ATTACH:
+	    RingAttach(server, c);
+	    break;
+	  case TPM_SET_ALTERNATIVE_RESULT:
+	    // Alternative result is not applicable to the simulator.
+	    break;
+	  case TPM_SESSION_END:
+	    // Client signaled end-of-session
+	    c->closing = true;
+	    return true;
+	  case TPM_STOP:
+	    // Client requested the simulator to exit
+	    c->closing = true;
+	    return false;
+	  default:
+	    printf("Unrecognized TPM interface command %08x\n", Command);
+	    c->closing = true;
+	    return true;
+	}
+    OutputUINT32(c, 0);
+    return true;
+}
+
+// D.3.3.8.	Event loop helpers
+
+// Select the TPM instance of a connection before it is used.  The selection only costs a copy of
+// the TPM state when it changes to another instance.
+
+static bool
+ConnectionSelect(
+		 CONNECTION      *c
+		 )
+{
+    if(_plat__InstanceSelect(c->instance) != 0)
+	{
+	    printf("TPM instance selection failed\n");
+	    return false;
+	}
+    return true;
+}
+
+// Remember that the selected instance, that of c, has work for the idle time.  Each instance is
+// on the list once.
+
+static void
+ServerIdleAdd(
+	      SERVER          *server,
+	      CONNECTION      *c
+	      )
+{
+    int                  i;
+
+    if(!_rpc__IdlePending())
+	return;
+    for(i = 0; i < server->idleCount; i++)
+	if(server->idle[i] == c->instance)
+	    return;
+    server->idle[server->idleCount++] = c->instance;
+}
+
+// Let the instances on the idle list do their idle time work, such as refilling the DRBG pool.
+// The selected instance goes first, as it needs no copy of the TPM state.  The other instances are
+// selected one after the other, and only those that have work are on the list.
+
+static void
+ServerIdle(
+	   SERVER          *server
+	   )
+{
+    TPM_INSTANCE        *current = _plat__InstanceCurrent();
+    int                  i;
+
+    for(i = 0; i < server->idleCount; i++)
+	if(server->idle[i] == current)
+	    {
+		_rpc__Idle();
+		server->idle[i] = server->idle[--server->idleCount];
+		break;
+	    }
+    for(i = 0; i < server->idleCount; i++)
+	if(_plat__InstanceSelect(server->idle[i]) == 0)
+	    _rpc__Idle();
+    server->idleCount = 0;
+}
+
+// Register the events of interest for a connection.  A connection is read while there is room in
+// its input buffer and written while it has unsent output.  The output of a queued connection is
+// held back until its last ready request has been processed, and the output of a connection that
+// waits for an NV commit until the commit is written.
+
+static void
+ConnectionUpdateEvents(
+		       SERVER          *server,
+		       CONNECTION      *c
+		       )
+{
+    struct epoll_event   event;
+    uint32_t             events = 0;
+
+    // held output is sent when the NV flush event says that the commit is written
+    if(c->nvWait != 0 && !c->nvWaiting)
+	{
+	    c->nvNext = server->nvWaiting;
+	    server->nvWaiting = c;
+	    c->nvWaiting = true;
+	}
+    // a ring is only ever waiting for its request doorbell
+    if(c->type == CONNECTION_RING)
+	return;
+    if(!c->closing && (c->inUsed < c->inSize || c->inStart > 0))
+	events |= EPOLLIN;
+    if(c->outSent < c->outUsed && !c->queued && c->nvWait == 0)
+	events |= EPOLLOUT;
+    if(events == c->events)
+	return;
+    memset(&event, 0, sizeof(event));
+    event.events = events;
+    event.data.ptr = c;
+    if(epoll_ctl(server->epollFd, EPOLL_CTL_MOD, c->s, &event) != 0)
+	printf("epoll_ctl error. Error is %d %s\n", errno, strerror(errno));
+    c->events = events;
+}
+
+// Put a connection on the tail of the ready queue if it has a complete request and is not
+// waiting for the client to read its responses.
+
+static void
+ConnectionQueue(
+		SERVER          *server,
+		CONNECTION      *c
+		)
+{
+    uint32_t             size;
+
+    if(c->queued || c->closing
+       || (c->outUsed - c->outSent) > CONNECTION_MAX_PENDING
+       || RequestSize(c, &size) != 1)
+	return;
+    c->next = NULL;
+    if(server->readyTail == NULL)
+	server->readyHead = c;
+    else
+	server->readyTail->next = c;
+    server->readyTail = c;
+    c->queued = true;
+}
+
+static void
+ConnectionClose(
+		SERVER          *server,
+		CONNECTION      *c
+		)
+{
+    CONNECTION          *prev = NULL;
+    CONNECTION          *q;
+
+    if(c->closed)
+	return;
+    c->closed = true;
+    // a ring and the connection that attached it go away together
+    if(c->attached != NULL)
+	{
+	    c->attached->attached = NULL;
+	    ConnectionClose(server, c->attached);
+	}
+    if(c->nvWaiting)
 	{
-	    ok = ReadBytes(s, (char*) &Command, 4);
-	    // client disconnected (or other error).  We stop processing this client
-	    // and return to our caller who can stop the server or listen for another
-	    // connection.
-	    if(!ok)
-		return true;
-	    Command = ntohl(Command);
-	    switch(Command)
-		{
-		  case TPM_SIGNAL_HASH_START:
-		    _rpc__Signal_Hash_Start();
+	    for(q = server->nvWaiting; q != NULL; prev = q, q = q->nvNext)
+		{
+		    if(q != c)
+			continue;
+		    if(prev == NULL)
+			server->nvWaiting = c->nvNext;
+		    else
+			prev->nvNext = c->nvNext;
 		    break;
-		  case TPM_SIGNAL_HASH_END:
-		    _rpc__Signal_HashEnd();
+		}
+	    prev = NULL;
+	}
+    if(c->queued)
+	{
+	    for(q = server->readyHead; q != NULL; prev = q, q = q->next)
+		{
+		    if(q != c)
+			continue;
+		    if(prev == NULL)
+			server->readyHead = c->next;
+		    else
+			prev->next = c->next;
+		    if(server->readyTail == c)
+			server->readyTail = prev;
 		    break;
-		  case TPM_SIGNAL_HASH_DATA:
-		    ok = ReadVarBytes(s, InputBuffer, &length, MAX_BUFFER);
-		    if(!ok) return true;
-		    InBuffer.Buffer = (uint8_t *) InputBuffer;
-		    InBuffer.BufferSize = length;
-		    _rpc__Signal_Hash_Data(InBuffer);
+		}
+	}
+    epoll_ctl(server->epollFd, EPOLL_CTL_DEL, c->s, NULL);
+    // later events of this event loop pass may still point to the connection
+    c->next = server->closed;
+    server->closed = c;
+}
+
+// This function sends the output from passOffset on together with the descriptors that are waiting
+// to be passed to the client.
+
+static ssize_t
+ConnectionSendDescriptors(
+			  CONNECTION      *c
+			  )
+{
+    struct msghdr        msg;
+    struct iovec         iov;
+    struct cmsghdr      *cmsg;
+    union {
+	char             buf[CMSG_SPACE(sizeof(c->passFd))];
+	struct cmsghdr   align;
+    } control;
+    ssize_t              res;
+    uint32_t             i;
+
+    memset(&msg, 0, sizeof(msg));
+    memset(&control, 0, sizeof(control));
+    iov.iov_base = c->out + c->outSent;
+    iov.iov_len = c->outUsed - c->outSent;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = CMSG_SPACE(c->passCount * sizeof(int));
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(c->passCount * sizeof(int));
+    memcpy(CMSG_DATA(cmsg), c->passFd, c->passCount * sizeof(int));
+    res = sendmsg(c->s, &msg, MSG_NOSIGNAL);
+    if(res > 0)
+	{
+	    // the client has its own copies now
+	    for(i = 0; i < c->passCount; i++)
+		close(c->passFd[i]);
+	    c->passCount = 0;
+	}
+    return res;
+}
+
+// Send as much of the pending output as the socket accepts without blocking.  A ring instead rings
+// the response doorbell if slots were completed.  Output that waits for an NV commit is held until
+// the commit is written.  If the commit could not be written, the responses are not sent at all
+// and the connection is closed.
+
+static bool
+ConnectionFlush(
+		CONNECTION      *c
+		)
+{
+    ssize_t              res;
+    uint64_t             one = 1;
+
+    if(c->nvWait != 0)
+	{
+	    switch(_plat__NvFlushDone(c->nvStatus, c->nvWait))
+		{
+		  case 0:
+		    return true;
+		  case 1:
 		    break;
-		  case TPM_SEND_COMMAND:
-		    ok = ReadBytes(s, (char*) &locality, 1);
-		    if(!ok)
+		  default:
+		    printf("NV commit was not written, closing the connection\n");
+		    return false;
+		}
+	    c->nvWait = 0;
+	    if(c->type == CONNECTION_RING)
+		{
+		    __atomic_store_n(&c->ring->responseHead, c->ringNext, __ATOMIC_RELEASE);
+		    c->ringNotify = true;
+		}
+	}
+    if(c->type == CONNECTION_RING)
+	{
+	    if(c->ringNotify && write(c->ringDoorbell, &one, sizeof(one)) != sizeof(one))
+		{
+		    printf("Ring doorbell error. Error is %d %s\n", errno, strerror(errno));
+		    return false;
+		}
+	    c->ringNotify = false;
+	    return true;
+	}
+    while(c->outSent < c->outUsed)
+	{
+	    if(c->passCount != 0 && c->outSent == c->passOffset)
+		res = ConnectionSendDescriptors(c);
+	    else
+		res = write(c->s, c->out + c->outSent,
+			    ((c->passCount != 0) ? c->passOffset : c->outUsed) - c->outSent);
+	    if(res < 0)
+		{
+		    if(errno == EINTR)
+			continue;
+		    if(errno == EAGAIN || errno == EWOULDBLOCK)
 			return true;
-		    ok = ReadVarBytes(s, InputBuffer, &length, MAX_BUFFER);
-		    if(!ok)
+		    printf("write() error. Error is %d %s\n", errno, strerror(errno));
+		    return false;
+		}
+	    c->outSent += res;
+	}
+    c->outUsed = c->outSent = 0;
+    return true;
+}
+
+// Read whatever the client has sent.  The input buffer grows to hold the current request.  The
+// processed requests are only moved out of the way when the buffer is full.
+
+static bool
+ConnectionRead(
+	       CONNECTION      *c
+	       )
+{
+    ssize_t              res;
+    uint32_t             size;
+    uint64_t             count;
+
+    // the requests of a ring are in the ring.  Only reset the doorbell.
+    if(c->type == CONNECTION_RING)
+	{
+	    res = read(c->s, &count, sizeof(count));
+	    return (res == sizeof(count) || errno == EAGAIN || errno == EINTR);
+	}
+    for(;;)
+	{
+	    if(c->inUsed == c->inSize && c->inStart > 0)
+		{
+		    c->inUsed -= c->inStart;
+		    memmove(c->in, c->in + c->inStart, c->inUsed);
+		    c->inStart = 0;
+		}
+	    if(c->inUsed == c->inSize)
+		{
+		    if(RequestSize(c, &size) != 0)
+			return true;	// a complete request (or an error) is waiting
+		    if(!BufferReserve(&c->in, &c->inSize, size))
+			return false;
+		}
+	    res = read(c->s, c->in + c->inUsed, c->inSize - c->inUsed);
+	    if(res < 0)
+		{
+		    if(errno == EINTR)
+			continue;
+		    if(errno == EAGAIN || errno == EWOULDBLOCK)
 			return true;
-		    InBuffer.Buffer = (uint8_t *) InputBuffer;
-		    InBuffer.BufferSize = length;
-		    OutBuffer.BufferSize = MAX_BUFFER;
-		    OutBuffer.Buffer = (_OUTPUT_BUFFER) OutputBuffer;
-		    // record the number of bytes in the command if it is the largest
-		    // we have seen so far.
-		    if(InBuffer.BufferSize > CommandResponseSizes.largestCommandSize)
+		    printf("read() error.  Error is %d %s\n", errno, strerror(errno));
+		    return false;
+		}
+	    // client disconnected
+	    if(res == 0)
+		return false;
+	    c->inUsed += res;
+	}
+}
+
+static void
+ConnectionAccept(
+		 SERVER          *server,
+		 CONNECTION      *listener
+		 )
+{
+    struct               sockaddr_storage HerAddress;
+    socklen_t            length;
+    struct epoll_event   event;
+    SOCKET               s;
+    CONNECTION          *c;
+    int                  opt = 1;
+
+    for(;;)
+	{
+	    length = sizeof(HerAddress);
+	    s = accept(listener->s, (struct sockaddr*) &HerAddress, &length);
+	    if(s < 0)
+		{
+		    if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+			printf("%s server IPv%d Accept error.  Error is %d %s\n",
+			       (listener->type == LISTEN_PLATFORM) ? "Platform" : "TPM",
+			       listener->ipver, errno, strerror(errno));
+		    return;
+		}
+	    c = calloc(1, sizeof(CONNECTION));
+	    if(c == NULL
+	       || !BufferReserve(&c->in, &c->inSize, CONNECTION_BUFFER_SIZE))
+		{
+		    printf("Connection allocation failed\n");
+		    if(c != NULL)
+			free(c);
+		    close(s);
+		    continue;
+		}
+	    c->s = s;
+	    c->ipver = listener->ipver;
+	    c->instance = listener->instance;
+	    c->type = (listener->type == LISTEN_PLATFORM) ?
+		      CONNECTION_PLATFORM : CONNECTION_COMMAND;
+	    fcntl(s, F_SETFL, fcntl(s, F_GETFL, 0) | O_NONBLOCK);
+	    // responses are small and the client waits for them
+	    if(c->ipver != IPVER_UNIX)
+		setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+	    memset(&event, 0, sizeof(event));
+	    event.events = c->events = EPOLLIN;
+	    event.data.ptr = c;
+	    if(epoll_ctl(server->epollFd, EPOLL_CTL_ADD, s, &event) != 0)
+		{
+		    printf("epoll_ctl error. Error is %d %s\n", errno, strerror(errno));
+		    ConnectionFree(c);
+		    continue;
+		}
+	    if(c->ipver == IPVER_UNIX)
+		printf("%s Unix client accepted\n",
+		       (c->type == CONNECTION_PLATFORM) ? "Platform" : "Command");
+	    else
+		printf("%s IPv%d client accepted\n",
+		       (c->type == CONNECTION_PLATFORM) ? "Platform" : "Command", c->ipver);
+	}
+}
+
+// Add a listening socket, or the NV flush eventfd, to the event loop.  The listener owns the
+// socket.  The connections accepted on a listener talk to its TPM instance.
+
+static int
+ServerAddListener(
+		  SERVER          *server,
+		  SOCKET           s,
+		  CONNECTION_TYPE  type,
+		  int              ipver,
+		  TPM_INSTANCE    *instance
+		  )
+{
+    struct epoll_event   event;
+    CONNECTION          *listener;
+
+    listener = calloc(1, sizeof(CONNECTION));
+    if(listener == NULL)
+	{
+	    close(s);
+	    return -1;
+	}
+    listener->s = s;
+    listener->type = type;
+    listener->ipver = ipver;
+    listener->instance = instance;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.ptr = listener;
+    if(epoll_ctl(server->epollFd, EPOLL_CTL_ADD, listener->s, &event) != 0)
+	{
+	    printf("epoll_ctl error. Error is %d %s\n", errno, strerror(errno));
+	    ConnectionFree(listener);
+	    return -1;
+	}
+    listener->next = server->listeners;
+    server->listeners = listener;
+    return 0;
+}
+
+// Add a listening socket for the port to the event loop, one for each of IPv4 and IPv6 that is
+// available.
+
+static int
+ServerListen(
+	     SERVER          *server,
+	     int              PortNumber,
+	     CONNECTION_TYPE  type,
+	     TPM_INSTANCE    *instance
+	     )
+{
+    static const int     domains[] = {AF_INET, AF_INET6};
+    SOCKET               s;
+    socklen_t            length;
+    size_t               i;
+    int                  nSock = 0;
+
+    for(i = 0; i < sizeof(domains) / sizeof(domains[0]); i++)
+	{
+	    if(CreateSocket(PortNumber, &s, &length, domains[i]) == 0
+	       && ServerAddListener(server, s, type, IPVER(length), instance) == 0)
+		nSock++;
+	}
+    if(nSock == 0)
+	return -1;
+    printf("%s server listening on port %d\n",
+	   (type == LISTEN_PLATFORM) ? "Platform" : "TPM command", PortNumber);
+    return 0;
+}
+
+// Add a listening AF_UNIX socket at path to the event loop.
+
+static int
+ServerListenUnix(
+		 SERVER          *server,
+		 const char      *path,
+		 CONNECTION_TYPE  type,
+		 TPM_INSTANCE    *instance
+		 )
+{
+    SOCKET               s;
+
+    if(CreateUnixSocket(path, &s) != 0
+       || ServerAddListener(server, s, type, IPVER_UNIX, instance) != 0)
+	return -1;
+    printf("%s server listening on %s\n",
+	   (type == LISTEN_PLATFORM) ? "Platform" : "TPM command", path);
+    return 0;
+}
+
+// The AF_UNIX sockets of instance i are UnixPath.i and UnixPath.i.platform, and those of instance 0
+// are UnixPath and UnixPath.platform.
+
+static void
+ServerUnixPaths(
+		char            *commandPath,
+		char            *platformPath,
+		size_t           pathSize,
+		const char      *UnixPath,
+		int              instance
+		)
+{
+    if(instance == 0)
+	snprintf(commandPath, pathSize, "%s", UnixPath);
+    else
+	snprintf(commandPath, pathSize, "%s.%d", UnixPath, instance);
+    snprintf(platformPath, pathSize, "%s.platform", commandPath);
+}
+
+// This function removes the AF_UNIX sockets of the first InstanceCount instances.
+
+static void
+ServerUnlinkUnix(
+		 const char      *UnixPath,
+		 int              InstanceCount
+		 )
+{
+    char                 commandPath[sizeof(((struct sockaddr_un *)0)->sun_path) + 32];
+    char                 platformPath[sizeof(commandPath)];
+    int                  i;
+
+    for(i = 0; i < InstanceCount; i++)
+	{
+	    ServerUnixPaths(commandPath, platformPath, sizeof(commandPath), UnixPath, i);
+	    unlink(commandPath);
+	    unlink(platformPath);
+	}
+}
+
+// The platform service stops at the request of a client.  The TPM command service continues.
+
+static void
+ServerStopPlatform(
+		   SERVER          *server
+		   )
+{
+    CONNECTION          **link = &server->listeners;
+    CONNECTION          *listener;
+
+    while(*link != NULL)
+	{
+	    listener = *link;
+	    if(listener->type == LISTEN_PLATFORM)
+		{
+		    *link = listener->next;
+		    epoll_ctl(server->epollFd, EPOLL_CTL_DEL, listener->s, NULL);
+		    ConnectionFree(listener);
+		}
+	    else
+		link = &listener->next;
+	}
+}
+
+// An NV flush finished.  Send the output that was held for the NV commits that are written now.
+// The output of a queued connection is sent once its requests have been processed.
+
+static void
+ServerNvFlushed(
+		SERVER          *server,
+		CONNECTION      *flush
+		)
+{
+    CONNECTION          *c;
+    CONNECTION          *next;
+    uint64_t             count;
+
+    if(read(flush->s, &count, sizeof(count)) < 0 && errno != EAGAIN && errno != EINTR)
+	printf("NV flush event error. Error is %d %s\n", errno, strerror(errno));
+    c = server->nvWaiting;
+    server->nvWaiting = NULL;
+    for( ; c != NULL; c = next)
+	{
+	    next = c->nvNext;
+	    c->nvWaiting = false;
+	    if(c->queued)
+		continue;
+	    if(!ConnectionFlush(c) || (c->closing && c->outSent == c->outUsed))
+		{
+		    ConnectionClose(server, c);
+		    continue;
+		}
+	    ConnectionQueue(server, c);
+	    ConnectionUpdateEvents(server, c);
+	}
+}
+
+// D.3.3.9.	ServerServiceReady()
+
+// Process one request from each connection that is on the ready queue when the function is called.
+// A connection that has another complete request goes back on the tail of the queue, so that a
+// client with many requests pending cannot starve the others.  The responses to a client's
+// pipelined requests are collected in its output buffer and sent with one write once it has no
+// complete request left (or has too much unsent output).
+
+static bool
+ServerServiceReady(
+		   SERVER          *server
+		   )
+{
+    CONNECTION          *c;
+    uint32_t             size;
+    uint32_t             pending = 0;
+    bool                 continueServing = true;
+
+    for(c = server->readyHead; c != NULL; c = c->next)
+	pending++;
+    for( ; pending > 0 && server->readyHead != NULL; pending--)
+	{
+	    c = server->readyHead;
+	    server->readyHead = c->next;
+	    if(server->readyHead == NULL)
+		server->readyTail = NULL;
+	    c->queued = false;
+
+	    if(!ConnectionSelect(c))
+		{
+		    ConnectionClose(server, c);
+		    continue;
+		}
+	    RequestSize(c, &size);
+	    if(c->type == CONNECTION_RING)
+		RingRequest(c);
+	    else if(c->type == CONNECTION_PLATFORM)
+		{
+		    if(!PlatformRequest(c))
+			ServerStopPlatform(server);
+		}
+	    else
+		continueServing = CommandRequest(server, c);
+	    ServerIdleAdd(server, c);
+	    // done with the request
+	    c->inStart += size;
+	    if(c->inStart == c->inUsed)
+		c->inStart = c->inUsed = 0;
+	    ConnectionQueue(server, c);
+	    if(!c->queued
+	       && (!ConnectionFlush(c) || (c->closing && c->outSent == c->outUsed)))
+		{
+		    ConnectionClose(server, c);
+		    continue;
+		}
+	    ConnectionUpdateEvents(server, c);
+	    if(!continueServing)
+		break;
+	}
+    return continueServing;
+}
+
+// D.3.3.10.	ServerEventLoop()
+
+// This function services the TPM command port and the platform port, and their AF_UNIX sockets
+// if UnixPath is not NULL.  All of the client connections are nonblocking and are multiplexed with
+// epoll, so any number of clients can be connected at once.  The requests are framed per
+// connection and executed one at a time, in the order of the ready queue.
+
+// Each of the InstanceCount TPM instances has its own ports.  Instance i listens on PortNumber + 2 * i
+// and PortNumberPlatform + 2 * i, and on UnixPath.i and UnixPath.i.platform.  Instance 0 is the
+// default instance and uses the ports and the Unix socket paths as they are.
+
+static int
+ServerEventLoop(
+		int              PortNumber,
+		int              PortNumberPlatform,
+		const char      *UnixPath,
+		TPM_INSTANCE    **Instances,
+		int              InstanceCount
+		)
+{
+    SERVER               server;
+    struct epoll_event   events[SERVER_MAX_EVENTS];
+    CONNECTION          *c;
+    char                 commandPath[sizeof(((struct sockaddr_un *)0)->sun_path) + 32];
+    char                 platformPath[sizeof(commandPath)];
+    uint32_t             size;
+    bool                 continueServing = true;
+    int                  n, i;
+    int                  fd;
+
+    memset(&server, 0, sizeof(server));
+    server.idle = calloc(InstanceCount, sizeof(TPM_INSTANCE *));
+    server.epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if(server.idle == NULL || server.epollFd < 0)
+	{
+	    printf("epoll_create1 error. Error is %d %s\n", errno, strerror(errno));
+	    return -1;
+	}
+    // the NV flusher tells when the output held for an NV commit can be sent
+    fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(fd < 0 || ServerAddListener(&server, fd, CONNECTION_NV_FLUSH, 0, NULL) != 0)
+	{
+	    printf("Create NV flush event fail\n");
+	    return -1;
+	}
+    _plat__NvFlushNotify(fd);
+    for(i = 0; i < InstanceCount; i++)
+	{
+	    if(ServerListen(&server, PortNumberPlatform + 2 * i, LISTEN_PLATFORM,
+			    Instances[i]) != 0)
+		{
+		    printf("Create platform service socket fail\n");
+		    exit(5);
+		}
+	    if(ServerListen(&server, PortNumber + 2 * i, LISTEN_COMMAND, Instances[i]) != 0)
+		{
+		    printf("Create TPM command service socket fail\n");
+		    return -1;
+		}
+	    if(UnixPath == NULL)
+		continue;
+	    ServerUnixPaths(commandPath, platformPath, sizeof(commandPath), UnixPath, i);
+	    if(ServerListenUnix(&server, platformPath, LISTEN_PLATFORM, Instances[i]) != 0
+	       || ServerListenUnix(&server, commandPath, LISTEN_COMMAND, Instances[i]) != 0)
+		{
+		    printf("Create Unix socket service fail\n");
+		    ServerUnlinkUnix(UnixPath, i + 1);
+		    return -1;
+		}
+	}
+    while(continueServing)
+	{
+	    // Don't wait for new events while there are requests to process. Before
+	    // waiting, let the TPM instances use the idle time.
+	    if(server.readyHead == NULL)
+		ServerIdle(&server);
+	    n = epoll_wait(server.epollFd, events, SERVER_MAX_EVENTS,
+			   (server.readyHead != NULL) ? 0 : -1);
+	    if(n < 0)
+		{
+		    if(errno == EINTR)
+			continue;
+		    printf("epoll_wait error.  Error is %d %s\n", errno, strerror(errno));
+		    if(UnixPath != NULL)
+			ServerUnlinkUnix(UnixPath, InstanceCount);
+		    return -1;
+		}
+	    for(i = 0; i < n; i++)
+		{
+		    c = events[i].data.ptr;
+		    if(c->closed)
+			continue;
+		    if(c->type == LISTEN_COMMAND || c->type == LISTEN_PLATFORM)
 			{
-			    CommandResponseSizes.largestCommandSize = InBuffer.BufferSize;
-			    memcpy(&CommandResponseSizes.largestCommand,
-				   &InputBuffer[6], sizeof(uint32_t));
+			    ConnectionAccept(&server, c);
+			    continue;
 			}
-			if (verbose) {
-				printf("\n\t InputBuffer.BufferSize=%ld\n", InBuffer.BufferSize);
-				for (uint32_t i = 0; i < InBuffer.BufferSize; ++i) {
-					unsigned char c = (unsigned char)InBuffer.Buffer[i];
-					printf("\t InputBuffer[%02d]=%02x\n",i, c);
-				}
-				printf("\n");
+		    if(c->type == CONNECTION_NV_FLUSH)
+			{
+			    ServerNvFlushed(&server, c);
+			    continue;
 			}
-			_rpc__Send_Command(locality, InBuffer, &OutBuffer);
-
-			if (verbose) {
-				printf("\n\t OutBuffer.BufferSize=%d\n", OutBuffer.BufferSize);
-				for (uint32_t i = 0; i < OutBuffer.BufferSize; ++i) {
-					printf("\t OutBuffer[%02d]=%02x\n", i, (unsigned char)OutBuffer.Buffer[i]);
-				}
+		    if((events[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP))
+		       && !ConnectionFlush(c))
+			{
+			    ConnectionClose(&server, c);
+			    continue;
 			}
-		    // record the number of bytes in the response if it is the largest
-		    // we have seen so far.
-		    if(OutBuffer.BufferSize > CommandResponseSizes.largestResponseSize)
+		    if(c->closing && c->outSent == c->outUsed)
 			{
-			    CommandResponseSizes.largestResponseSize
-				= OutBuffer.BufferSize;
-			    memcpy(&CommandResponseSizes.largestResponse,
-				   &OutputBuffer[6], sizeof(uint32_t));
+			    ConnectionClose(&server, c);
+			    continue;
 			}
-		    ok = WriteVarBytes(s,
-				       (char*) OutBuffer.Buffer,
-				       OutBuffer.BufferSize);
-		    if(!ok)
-			return true;
-		    break;
-		  case TPM_REMOTE_HANDSHAKE:
-		    ok = ReadBytes(s, (char*)&clientVersion, 4);
-		    if(!ok)
-			return true;
-		    if( clientVersion == 0 )
+		    // client disconnected (or other error).  We stop processing this client.
+		    if((events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+		       && (!ConnectionRead(c) || RequestSize(c, &size) < 0))
 			{
-			    printf("Unsupported client version (0).\n");
-			    return true;
+			    ConnectionClose(&server, c);
+			    continue;
 			}
-		    ok &= WriteUINT32(s, ServerVersion);
-		    ok &= WriteUINT32(s,
-				      tpmInRawMode | tpmPlatformAvailable | tpmSupportsPP);
-		    break;
-		  case TPM_SET_ALTERNATIVE_RESULT:
-		    ok = ReadBytes(s, (char*)&result, 4);
-		    if(!ok)
-			return true;
-		    // Alternative result is not applicable to the simulator.
-		    break;
-		  case TPM_SESSION_END:
-		    // Client signaled end-of-session
-		    return true;
-		  case TPM_STOP:
-		    // Client requested the simulator to exit
-		    return false;
-		  default:
-		    printf("Unrecognized TPM interface command %08x\n", Command);
-		    return true;
+		    ConnectionQueue(&server, c);
+		    ConnectionUpdateEvents(&server, c);
+		}
+	    continueServing = ServerServiceReady(&server);
+	    while(server.closed != NULL)
+		{
+		    c = server.closed;
+		    server.closed = c->next;
+		    ConnectionFree(c);
 		}
-	    ok = WriteUINT32(s,0);
-	    if(!ok)
-		return true;
 	}
+    _plat__NvFlushNotify(-1);
+    if(UnixPath != NULL)
+	ServerUnlinkUnix(UnixPath, InstanceCount);
+    free(server.idle);
+    return 0;
+}
+
+#if RH_ACT_0
+
+/* D.3.2.5.	SimulatorTimeServiceRoutine() */
+/* This function is called to service the time ticks. */
+static int
+SimulatorTimeServiceRoutine(
+			    void
+			    )
+{
+    // All time is in ms
+    const int64_t tick = 1000;
+    uint64_t prevTime = _plat__RealTime();
+    int64_t timeout = tick;
+
+    while (true)
+	{
+	    uint64_t curTime;
+
+	    struct timespec req = {timeout / 1000, (timeout % 1000) * 1000};
+	    struct timespec rem;
+	    nanosleep(&req, &rem);
+
+	    curTime = _plat__RealTime();
+
+	    // May need to issue several ticks if the Sleep() took longer than asked,
+	    // or no ticks at all, it Sleep() was interrupted prematurely.
+	    while (prevTime < curTime - tick / 2)
+	        {
+	            //printf("%05lld | %05lld\n",
+	            //      prevTime % 100000, (curTime - tick / 2) % 100000);
+	            _plat__ACT_Tick();
+	            prevTime += (uint64_t)tick;
+	        }
+	    // Adjust the next timeout to keep the average interval of one second
+	    timeout = tick + (prevTime - curTime);
+	    //prevTime = curTime;
+	    //printf("%04lld | c:%05lld | p:%05llu\n",
+	    //          timeout, curTime % 100000, prevTime);
+	}
+    return 0;
+}
+
+/* D.3.2.6.	ActTimeService() */
+/* This function starts a new thread waiting to wait for time ticks. */
+/* Return Value	Meaning */
+/* ==0	success */
+/*     !=0	failure */
+static int
+ActTimeService(
+	       void
+	       )
+{
+    static bool          running = false;
+    int                  ret = 0;
+
+    if(!running)
+	{
+	    pthread_t            thread_id;
+
+	    /* kgold - hoisted out of WIndows only version */
+	    printf("Starting ACT thread...\n");
+	    //  Don't allow ticks to be processed before TPM is manufactured.
+	    _plat__ACT_EnableTicks(false);
+
+	    //
+	    ret = pthread_create(&thread_id, NULL, (void*)SimulatorTimeServiceRoutine,
+				 NULL);
+
+	    if(ret != 0)
+		printf("ACT thread Creation failed\n");
+	    else
+		running = TRUE;
+	}
+    return ret;
+}
+#endif // RH_ACT_0
+
+
+// D.3.3.11.	StartTcpServer()
+
+// Main entry-point to the TCP server.  The server listens on port specified. Note that there is no
+// way to specify the network interface in this implementation.  If UnixPath is not NULL, the
+// server also listens on the AF_UNIX sockets UnixPath (TPM commands) and UnixPath.platform.
+// SnapshotDir, if not NULL, is the directory of the snapshots saved and restored through the
+// platform port.  Instances holds the InstanceCount TPM instances to serve, the first being NULL for the default
+// instance (see ServerEventLoop()).  The ACT ticks go to every instance, whether it is selected
+// or not (see _plat__ACT_Tick()).
+
+int
+StartTcpServer(
+	       int              *PortNumber,
+	       int              *PortNumberPlatform,
+	       const char       *UnixPath,
+	       const char       *SnapshotDir,
+	       TPM_INSTANCE    **Instances,
+	       int              InstanceCount
+	       )
+{
+    int                  res;
+
+    SnapshotDirectory = SnapshotDir;
+
+#if RH_ACT_0 || 1
+    // Start the Time Service routine
+    res = ActTimeService();
+    if(res != 0)
+	{
+	    printf("TimeService failed\n");
+	    return res;
+	}
+#endif
+    // Start the TPM command and platform services
+    res = ServerEventLoop(*PortNumber, *PortNumberPlatform, UnixPath,
+			  Instances, InstanceCount);
+    if (res != 0)
+	{
+	    printf("ServerEventLoop failed\n");
+	    return res;
+	}
+    return 0;
 }
@@ -70,62 +70,16 @@
 
 #include "CompilerDependencies.h"
 #include "BaseTypes.h"
+#include "Platform_fp.h"
 
-bool
-PlatformServer(
-	       SOCKET           s
-	       );
-int
-PlatformSvcRoutine(
-		   void *port
-		   );
-int
-PlatformSignalService(
-		      int              *PortNumberPlatform
-		      );
-int
-RegularCommandService(
-		      int              *PortNumber
-		      );
 int
 StartTcpServer(
 	       int              *PortNumber,
-	       int              *PortNumberPlatform
+	       int              *PortNumberPlatform,
+	       const char       *UnixPath,
+	       const char       *SnapshotDir,
+	       TPM_INSTANCE    **Instances,
+	       int              InstanceCount
 	       );
-bool
-ReadBytes(
-	  SOCKET           s,
-	  char            *buffer,
-	  int              NumBytes
-	  );
-bool
-WriteBytes(
-	   SOCKET           s,
-	   char            *buffer,
-	   int              NumBytes
-	   );
-bool
-WriteUINT32(
-	    SOCKET           s,
-	    UINT32           val
-	    );
-bool
-ReadVarBytes(
-	     SOCKET           s,
-	     char            *buffer,
-	     UINT32          *BytesReceived,
-	     int              MaxLen
-	     );
-bool
-WriteVarBytes(
-	      SOCKET           s,
-	      char            *buffer,
-	      int              BytesToSend
-	      );
-bool
-TpmServer(
-	  SOCKET           s
-	  );
-
 
 #endif
@@ -365,6 +365,8 @@
 				      + CC_NTC2_PreConfig	\
 				      + CC_NTC2_LockPreConfig	\
 				      + CC_NTC2_GetConfig	\
+				      + CC_NTC2_EncryptDecryptStart	\
+				      + CC_NTC2_EncryptDecryptUpdate	\
 				      )
 #endif
 
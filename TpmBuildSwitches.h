@@ -356,6 +356,31 @@
 #   define  TABLE_DRIVEN_MARSHAL NO    // Default: Either YES or NO
 #endif
 
+/* This switch collects all of the TPM and platform state variables into one linker section so that
+   the complete state of a simulated TPM can be saved and restored as a unit. This allows a single
+   process to host several independent TPM instances (see InstancePlat.c). It needs a compiler and
+   linker that provide the __start_/__stop_ symbols for a named section (gcc or clang with an ELF
+   target) so it defaults to NO everywhere else. */
+/* The state that belongs to the process rather than to the simulated TPM, such as the open NV file,
+   goes in INSTANCE_LOCAL instead. It is switched with the instance but it is not part of a snapshot
+   (see _plat__InstanceSnapshot()). */
+#if !(defined INSTANCE_CONTEXT)						\
+    || ((INSTANCE_CONTEXT != NO) && (INSTANCE_CONTEXT != YES))
+#   undef   INSTANCE_CONTEXT
+#   if defined __GNUC__ && defined __ELF__
+#       define  INSTANCE_CONTEXT    YES     // Default: Either YES or NO
+#   else
+#       define  INSTANCE_CONTEXT    NO
+#   endif
+#endif
+#if INSTANCE_CONTEXT
+#   define INSTANCE_STATE   __attribute__((section("tpm_instance_state")))
+#   define INSTANCE_LOCAL   __attribute__((section("tpm_instance_local")))
+#else
+#   define INSTANCE_STATE
+#   define INSTANCE_LOCAL
+#endif
+
 /* Change these definitions to turn all algorithms or commands ON or OFF. That is, to turn all
    algorithms on, set ALG_NO to YES. This is mostly useful as a debug feature. */
 #define      ALG_YES      YES
@@ -0,0 +1,191 @@
+/********************************************************************************/
+/*										*/
+/*			In-process TPM library interface			*/
+/*            $Id: TpmLib.c $							*/
+/*										*/
+/*  Licenses and Notices							*/
+/*										*/
+/*  1. Copyright Licenses:							*/
+/*										*/
+/*  - Trusted Computing Group (TCG) grants to the user of the source code in	*/
+/*    this specification (the "Source Code") a worldwide, irrevocable, 		*/
+/*    nonexclusive, royalty free, copyright license to reproduce, create 	*/
+/*    derivative works, distribute, display and perform the Source Code and	*/
+/*    derivative works thereof, and to grant others the rights granted herein.	*/
+/*										*/
+/*  - The TCG grants to the user of the other parts of the specification 	*/
+/*    (other than the Source Code) the rights to reproduce, distribute, 	*/
+/*    display, and perform the specification solely for the purpose of 		*/
+/*    developing products based on such documents.				*/
+/*										*/
+/*  2. Source Code Distribution Conditions:					*/
+/*										*/
+/*  - Redistributions of Source Code must retain the above copyright licenses, 	*/
+/*    this list of conditions and the following disclaimers.			*/
+/*										*/
+/*  - Redistributions in binary form must reproduce the above copyright 	*/
+/*    licenses, this list of conditions	and the following disclaimers in the 	*/
+/*    documentation and/or other materials provided with the distribution.	*/
+/*										*/
+/*  3. Disclaimers:								*/
+/*										*/
+/*  - THE COPYRIGHT LICENSES SET FORTH ABOVE DO NOT REPRESENT ANY FORM OF	*/
+/*  LICENSE OR WAIVER, EXPRESS OR IMPLIED, BY ESTOPPEL OR OTHERWISE, WITH	*/
+/*  RESPECT TO PATENT RIGHTS HELD BY TCG MEMBERS (OR OTHER THIRD PARTIES)	*/
+/*  THAT MAY BE NECESSARY TO IMPLEMENT THIS SPECIFICATION OR OTHERWISE.		*/
+/*  Contact TCG Administration (admin@trustedcomputinggroup.org) for 		*/
+/*  information on specification licensing rights available through TCG 	*/
+/*  membership agreements.							*/
+/*										*/
+/*  - THIS SPECIFICATION IS PROVIDED "AS IS" WITH NO EXPRESS OR IMPLIED 	*/
+/*    WARRANTIES WHATSOEVER, INCLUDING ANY WARRANTY OF MERCHANTABILITY OR 	*/
+/*    FITNESS FOR A PARTICULAR PURPOSE, ACCURACY, COMPLETENESS, OR 		*/
+/*    NONINFRINGEMENT OF INTELLECTUAL PROPERTY RIGHTS, OR ANY WARRANTY 		*/
+/*    OTHERWISE ARISING OUT OF ANY PROPOSAL, SPECIFICATION OR SAMPLE.		*/
+/*										*/
+/*  - Without limitation, TCG and its members and licensors disclaim all 	*/
+/*    liability, including liability for infringement of any proprietary 	*/
+/*    rights, relating to use of information in this specification and to the	*/
+/*    implementation of this specification, and TCG disclaims all liability for	*/
+/*    cost of procurement of substitute goods or services, lost profits, loss 	*/
+/*    of use, loss of data or any incidental, consequential, direct, indirect, 	*/
+/*    or special damages, whether under contract, tort, warranty or otherwise, 	*/
+/*    arising in any way out of use or reliance upon this specification or any 	*/
+/*    information herein.							*/
+/*										*/
+/*  (c) Copyright IBM Corp. and others, 2016 - 2026				*/
+/*										*/
+/********************************************************************************/
+
+/* D.6 TpmLib.c */
+/* D.6.1. Description */
+/* This file contains a small interface for running the TPM inside the process of its caller, for
+   example a test suite linked with libtpm.a or libtpm.so.  The TPM commands are executed directly
+   from the caller's request buffer into the caller's response buffer, without the TCP server. */
+/* The functions operate on the current TPM instance (see InstancePlat.c). */
+/* D.6.2. Includes */
+#include <stdbool.h>
+#include <string.h>
+#include "TpmBuildSwitches.h"
+#include "TpmTcpProtocol.h"
+#include "Platform_fp.h"
+#include "Manufacture_fp.h"
+#include "Simulator_fp.h"
+#include "TpmProfile.h"
+#include "TpmLib_fp.h"
+/* D.6.3. Functions */
+/* D.6.3.1. TpmLib_Init() */
+/* This function prepares the TPM the way the simulator does at start up. It enables the NV memory,
+   manufactures the TPM if the NV memory is new or manufacture is nonzero, and powers the TPM on
+   with the NV memory available. platParameter is passed to _plat__NVEnable(). */
+/* Return Values Meaning */
+/* 0 success */
+/* != 0 failure */
+LIB_EXPORT int
+TpmLib_Init(
+	    void            *platParameter,    // IN: platform specific parameters
+	    int              manufacture       // IN: manufacture even if the NV memory exists
+	    )
+{
+    if(_plat__NVEnable(platParameter) < 0)
+	return -1;
+    if(manufacture || _plat__NVNeedsManufacture())
+	{
+	    if(TPM_Manufacture(1) != 0)
+		{
+		    // do not leave a partly manufactured NV memory behind
+		    _plat__NVDisable(1);
+		    return -1;
+		}
+	}
+    _plat__NVDisable(0);
+    TpmLib_PowerOn();
+    return 0;
+}
+/* D.6.3.2. TpmLib_Manufacture() */
+/* This function manufactures the TPM. See TPM_Manufacture() for the values of firstTime and the
+   return value. */
+LIB_EXPORT int
+TpmLib_Manufacture(
+		   int              firstTime
+		   )
+{
+    return TPM_Manufacture(firstTime);
+}
+/* D.6.3.3. TpmLib_PowerOn() */
+/* This function powers the TPM on and makes the NV memory available. The next command must be
+   TPM2_Startup(). */
+LIB_EXPORT void
+TpmLib_PowerOn(
+	       void
+	       )
+{
+    _rpc__Signal_PowerOn(false);
+    _rpc__Signal_NvOn();
+}
+/* D.6.3.4. TpmLib_PowerOff() */
+LIB_EXPORT void
+TpmLib_PowerOff(
+		void
+		)
+{
+    _rpc__Signal_PowerOff();
+}
+/* D.6.3.5. TpmLib_Execute() */
+/* This function executes one TPM command. The response is placed in the caller's response buffer,
+   which must hold at least MAX_RESPONSE_SIZE bytes. The TPM may modify the request buffer, for
+   example when it decrypts a command parameter. */
+/* Return Values Meaning */
+/* 0 success, responseSize is the size of the TPM response */
+/* != 0 the TPM is powered off or the response buffer is too small */
+LIB_EXPORT int
+TpmLib_Execute(
+	       unsigned char    locality,      // IN: command locality
+	       unsigned char   *request,       // IN: command buffer
+	       uint32_t         requestSize,   // IN: command buffer size
+	       unsigned char   *response,      // OUT: response buffer
+	       uint32_t        *responseSize   // IN/OUT: response buffer size
+	       )
+{
+    _IN_BUFFER           in;
+    _OUT_BUFFER          out;
+
+    if(*responseSize < MAX_RESPONSE_SIZE)
+	return -1;
+    in.Buffer = request;
+    in.BufferSize = requestSize;
+    out.Buffer = response;
+    out.BufferSize = *responseSize;
+    _rpc__Send_Command(locality, in, &out);
+    // failure mode responses come from a buffer of their own
+    if(out.Buffer != response && out.BufferSize <= *responseSize)
+	memcpy(response, out.Buffer, out.BufferSize);
+    *responseSize = out.BufferSize;
+    return (out.BufferSize == 0) ? -1 : 0;
+}
+/* D.6.3.6. TpmLib_Snapshot() */
+/* This function writes the complete state of the powered on TPM, including its NV memory, to
+   fileName. */
+/* Return Values Meaning */
+/* 0 success */
+/* != 0 failure */
+LIB_EXPORT int
+TpmLib_Snapshot(
+		const char      *fileName      // IN: snapshot file
+		)
+{
+    return _rpc__Signal_Snapshot(fileName);
+}
+/* D.6.3.7. TpmLib_Restore() */
+/* This function can replace TpmLib_Init(). It brings the TPM to the point where the snapshot in
+   fileName was taken. If NV is not enabled, the default NV file is used. */
+/* Return Values Meaning */
+/* 0 success */
+/* != 0 failure */
+LIB_EXPORT int
+TpmLib_Restore(
+	       const char      *fileName      // IN: snapshot file
+	       )
+{
+    return _rpc__Signal_Restore(fileName);
+}
@@ -223,6 +223,22 @@
 #ifndef NV_MEMORY_SIZE
 #define NV_MEMORY_SIZE                  32768
 #endif
+/* the NV size can be raised at run time up to NV_MEMORY_SIZE_MAX */
+#ifndef NV_MEMORY_SIZE_MAX
+#define NV_MEMORY_SIZE_MAX              0x40000000
+#endif
+/* the largest number of NV indexes and persistent objects together */
+#ifndef NV_ENTITIES_MAX
+#define NV_ENTITIES_MAX                 4096
+#endif
+/* the number of non-orderly NV counters whose value is kept in RAM, 0 to keep none */
+#ifndef NV_COUNTER_CACHE_SIZE
+#define NV_COUNTER_CACHE_SIZE           32
+#endif
+/* how far the NV copy of a counter kept in RAM is advanced ahead of its value */
+#ifndef NV_COUNTER_RESERVE
+#define NV_COUNTER_RESERVE              1024
+#endif
 #ifndef MIN_COUNTER_INDICES
 #define MIN_COUNTER_INDICES             8
 #endif
@@ -821,5 +837,7 @@
 #define  CC_NTC2_PreConfig                CC_YES
 #define  CC_NTC2_LockPreConfig            CC_YES
 #define  CC_NTC2_GetConfig                CC_YES
+#define  CC_NTC2_EncryptDecryptStart      CC_YES
+#define  CC_NTC2_EncryptDecryptUpdate     CC_YES
 #endif
 #endif // _TPM_PROFIL
@@ -101,6 +101,26 @@
 #define TPM_GET_COMMAND_RESPONSE_SIZES  25
 #define TPM_ACT_GET_SIGNALED        26
 #define TPM_TEST_FAILURE_MODE       30
+#define TPM_SEND_COMMAND_BATCH      40
+// Only after TPM_REMOTE_HANDSHAKE negotiated tpmSupportsBatch.  The commands are executed in order
+// and the response is acknowledged once, after the last OutBuffer.
+// {uint32_t Count, Count * {uint8_t Locality, uint32_t InBufferSize, uint8_t[InBufferSize] InBuffer}} ->
+//     {Count * {uint32_t OutBufferSize, uint8_t[OutBufferSize] OutBuffer}}
+#define TPM_BATCH_MAX_COMMANDS      256
+#define TPM_SHARED_MEMORY_ATTACH    41
+// Only on an AF_UNIX command connection.  The ring memory, the request doorbell and the response
+// doorbell file descriptors are passed with the response as SCM_RIGHTS ancillary data.
+// {} -> {uint32_t SlotCount, uint32_t SlotSize}
+#define TPM_GET_COMMAND_STATS       42
+// Platform port.  The command latency statistics described in StatsPlat.h, in host byte order.
+// A Reset that is not 0 clears them.
+// {uint32_t Reset} -> {uint32_t StatsSize, uint8_t[StatsSize] Stats}
+#define TPM_SNAPSHOT_SAVE           43
+#define TPM_SNAPSHOT_RESTORE        44
+// Platform port.  Write the complete TPM state to, or restore it from, the snapshot file FileName
+// in the -snapshotdir directory of the simulator.  FileName is a plain file name, without a '/'.
+// Result is 0 on success, and not 0 when the simulator was started without -snapshotdir.
+// {uint32_t NameSize, char[NameSize] FileName} -> {uint32_t Result}
 
 // D.3.4.	Enumerations and Structures
 
@@ -109,9 +129,38 @@ enum TpmEndPointInfo
 	tpmPlatformAvailable = 0x01,
 	tpmUsesTbs = 0x02,
 	tpmInRawMode = 0x04,
-	tpmSupportsPP = 0x08
+	tpmSupportsPP = 0x08,
+	tpmSupportsBatch = 0x10		// TPM_SEND_COMMAND_BATCH, client version 2 or later
     };
 
+// D.3.5.	Shared memory command ring
+
+// A co-located client can exchange TPM commands with the simulator through a ring of slots in
+// shared memory instead of the socket.  The client fills slot (n % slotCount) with a
+// TPM_SEND_COMMAND request in the usual framing, sets requestHead to n + 1 and writes 1 to the
+// request eventfd.  The simulator executes the command in place, replaces the request with the
+// usual {uint32_t OutBufferSize, uint8_t[OutBufferSize] OutBuffer, uint32_t 0} response, sets
+// responseHead to n + 1 and writes 1 to the response eventfd.  The frames are placed so that both
+// the TPM command and the TPM response start at TPM_SHM_SLOT_DATA in the slot.  The client may
+// have up to slotCount commands outstanding.
+
+typedef struct
+{
+    uint32_t         slotCount;
+    uint32_t         slotSize;
+    uint32_t         requestHead;       // slots submitted by the client
+    uint32_t         reserved1[13];     // keep the two heads in different cache lines
+    uint32_t         responseHead;      // slots completed by the simulator
+    uint32_t         reserved2[15];
+} TPM_SHM_RING;
+
+#define TPM_SHM_SLOT_OFFSET         4096                    // from the start of the ring memory
+#define TPM_SHM_SLOT_SIZE           8192
+#define TPM_SHM_SLOT_COUNT          16
+#define TPM_SHM_SLOT_DATA           16
+#define TPM_SHM_SLOT_REQUEST        (TPM_SHM_SLOT_DATA - 9)  // {uint32_t, uint8_t, uint32_t}
+#define TPM_SHM_SLOT_RESPONSE       (TPM_SHM_SLOT_DATA - 4)  // {uint32_t}
+
 #ifdef _MSC_VER
 #   pragma warning(push, 3)
 #endif
@@ -72,6 +72,7 @@
 #include <mbedtls/sha1.h>
 #include <mbedtls/sha256.h>
 #include <mbedtls/sha512.h>
+#include "TpmToOsslHashSupport_fp.h"
 
 #if ALG_SM3_256
 // #   if defined(OPENSSL_NO_SM3) || OPENSSL_VERSION_NUMBER < 0x10101010L
@@ -190,15 +191,15 @@ typedef const BYTE    *PCBYTE;
    need to be translated to the function names of the library. */
 // #define tpmHashInit_SHA1            mbedtls_sha1_init //SHA1_Init   // external name of the initialization method
 #define tpmHashStart_SHA1           mbedtls_sha1_starts //SHA1_Init   // external name of the initialization method
-#define tpmHashData_SHA1            mbedtls_sha1_update // SHA1_Update
-#define tpmHashEnd_SHA1             mbedtls_sha1_finish //SHA1_Final
+#define tpmHashData_SHA1            HashAccelSha1Update // SHA1_Update
+#define tpmHashEnd_SHA1             HashAccelSha1Finish //SHA1_Final
 #define tpmHashStateCopy_SHA1       memcpy
 #define tpmHashStateExport_SHA1     memcpy
 #define tpmHashStateImport_SHA1     memcpy
 // #define tpmHashInit_SHA256          mbedtls_sha256_init // SHA256_Init
 #define tpmHashStart_SHA256         mbedtls_sha256_starts // SHA256_Init
-#define tpmHashData_SHA256          mbedtls_sha256_update // SHA256_Update
-#define tpmHashEnd_SHA256           mbedtls_sha256_finish // SHA256_Final
+#define tpmHashData_SHA256          HashAccelSha256Update // SHA256_Update
+#define tpmHashEnd_SHA256           HashAccelSha256Finish // SHA256_Final
 #define tpmHashStateCopy_SHA256     memcpy
 #define tpmHashStateExport_SHA256   memcpy
 #define tpmHashStateImport_SHA256   memcpy
@@ -224,7 +225,7 @@ typedef const BYTE    *PCBYTE;
 #define tpmHashStateImport_SM3_256  memcpy
 
 #endif // _CRYPT_HASH_C_
-#define LibHashInit()
+#define LibHashInit()   HashAccelInit()
 /* This definition would change if there were something to report */
 #define HashLibSimulationEnd()
 #endif // // HASH_LIB_DEFINED
@@ -0,0 +1,604 @@
+/********************************************************************************/
+/*										*/
+/*			Hash Library Acceleration				*/
+/*            $Id: TpmToOsslHashSupport.c $					*/
+/*										*/
+/*  Licenses and Notices							*/
+/*										*/
+/*  1. Copyright Licenses:							*/
+/*										*/
+/*  - Trusted Computing Group (TCG) grants to the user of the source code in	*/
+/*    this specification (the "Source Code") a worldwide, irrevocable, 		*/
+/*    nonexclusive, royalty free, copyright license to reproduce, create 	*/
+/*    derivative works, distribute, display and perform the Source Code and	*/
+/*    derivative works thereof, and to grant others the rights granted herein.	*/
+/*										*/
+/*  - The TCG grants to the user of the other parts of the specification 	*/
+/*    (other than the Source Code) the rights to reproduce, distribute, 	*/
+/*    display, and perform the specification solely for the purpose of 		*/
+/*    developing products based on such documents.				*/
+/*										*/
+/*  2. Source Code Distribution Conditions:					*/
+/*										*/
+/*  - Redistributions of Source Code must retain the above copyright licenses, 	*/
+/*    this list of conditions and the following disclaimers.			*/
+/*										*/
+/*  - Redistributions in binary form must reproduce the above copyright 	*/
+/*    licenses, this list of conditions	and the following disclaimers in the 	*/
+/*    documentation and/or other materials provided with the distribution.	*/
+/*										*/
+/*  3. Disclaimers:								*/
+/*										*/
+/*  - THE COPYRIGHT LICENSES SET FORTH ABOVE DO NOT REPRESENT ANY FORM OF	*/
+/*  LICENSE OR WAIVER, EXPRESS OR IMPLIED, BY ESTOPPEL OR OTHERWISE, WITH	*/
+/*  RESPECT TO PATENT RIGHTS HELD BY TCG MEMBERS (OR OTHER THIRD PARTIES)	*/
+/*  THAT MAY BE NECESSARY TO IMPLEMENT THIS SPECIFICATION OR OTHERWISE.		*/
+/*  Contact TCG Administration (admin@trustedcomputinggroup.org) for 		*/
+/*  information on specification licensing rights available through TCG 	*/
+/*  membership agreements.							*/
+/*										*/
+/*  - THIS SPECIFICATION IS PROVIDED "AS IS" WITH NO EXPRESS OR IMPLIED 	*/
+/*    WARRANTIES WHATSOEVER, INCLUDING ANY WARRANTY OF MERCHANTABILITY OR 	*/
+/*    FITNESS FOR A PARTICULAR PURPOSE, ACCURACY, COMPLETENESS, OR 		*/
+/*    NONINFRINGEMENT OF INTELLECTUAL PROPERTY RIGHTS, OR ANY WARRANTY 		*/
+/*    OTHERWISE ARISING OUT OF ANY PROPOSAL, SPECIFICATION OR SAMPLE.		*/
+/*										*/
+/*  - Without limitation, TCG and its members and licensors disclaim all 	*/
+/*    liability, including liability for infringement of any proprietary 	*/
+/*    rights, relating to use of information in this specification and to the	*/
+/*    implementation of this specification, and TCG disclaims all liability for	*/
+/*    cost of procurement of substitute goods or services, lost profits, loss 	*/
+/*    of use, loss of data or any incidental, consequential, direct, indirect, 	*/
+/*    or special damages, whether under contract, tort, warranty or otherwise, 	*/
+/*    arising in any way out of use or reliance upon this specification or any 	*/
+/*    information herein.							*/
+/*										*/
+/*  (c) Copyright IBM Corp. and others, 2016 - 2026				*/
+/*										*/
+/********************************************************************************/
+
+/* B.2.3.4. TpmToOsslHashSupport.c */
+/* B.2.3.4.1. Introduction */
+/* The functions in this file sit between CryptHash.c and the hash library. HashAccelInit() is
+   called from CryptHashInit() (through LibHashInit()) and checks the processor for the SHA
+   extensions. When they are present, the SHA-1 and SHA-256 update and finish methods run the
+   compression function with the SHA-NI instructions on the library context. Otherwise, and on
+   processors or compilers where the extensions cannot be used, the methods call straight through to
+   the library code. Either way, the known-answer HMAC in TestHash() exercises the code that is
+   selected, because the test data covers whole blocks and the finish padding. */
+/* The state layout is that of the library context, so context save, export and import are not
+   affected by which code was used. */
+/* B.2.3.4.2. Defines and Includes */
+#include "Tpm.h"
+
+#if defined(HASH_LIB_OSSL)
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#   define HASH_ACCEL_X86   YES
+#   include <cpuid.h>
+#   include <immintrin.h>
+#   define SHA_NI_TARGET    __attribute__((target("sha,sse4.1,ssse3")))
+#else
+#   define HASH_ACCEL_X86   NO
+#endif
+
+/* mbedtls 3 names the context members through MBEDTLS_PRIVATE() */
+#ifndef MBEDTLS_PRIVATE
+#   define MBEDTLS_PRIVATE(member)  member
+#endif
+
+/* A compression function over a number of whole 64-byte blocks. The state is in the word order of
+   the library context. */
+typedef void (HASH_BLOCKS_FUNC)(uint32_t *state, const BYTE *data, size_t blocks);
+
+static HASH_BLOCKS_FUNC     *s_sha1Blocks = NULL;
+static HASH_BLOCKS_FUNC     *s_sha256Blocks = NULL;
+
+/* B.2.3.4.3. Functions */
+#if HASH_ACCEL_X86
+#if ALG_SHA1
+/* B.2.3.4.3.1. Sha1BlocksShaNi() */
+/* SHA-1 compression using the SHA extensions. Each group of four rounds is one sha1rnds4; the
+   message schedule for the following groups is built with sha1msg1/sha1msg2 while the rounds
+   run. */
+static SHA_NI_TARGET void
+Sha1BlocksShaNi(
+		uint32_t        *state,
+		const BYTE      *data,
+		size_t           blocks
+		)
+{
+    const __m128i    mask = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+    __m128i          abcd, abcdSave, E0, E0Save, E1;
+    __m128i          MSG0, MSG1, MSG2, MSG3;
+    //
+    abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)state), 0x1B);
+    E0 = _mm_set_epi32((int)state[4], 0, 0, 0);
+    for(; blocks > 0; blocks--, data += 64)
+	{
+	    abcdSave = abcd;
+	    E0Save = E0;
+	    // Rounds 0-3
+	    MSG0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)&data[0]), mask);
+	    E0 = _mm_add_epi32(E0, MSG0);
+	    E1 = abcd;
+	    abcd = _mm_sha1rnds4_epu32(abcd, E0, 0);
+	    // Rounds 4-7
+	    MSG1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)&data[16]), mask);
+	    E1 = _mm_sha1nexte_epu32(E1, MSG1);
+	    E0 = abcd;
+	    abcd = _mm_sha1rnds4_epu32(abcd, E1, 0);
+	    MSG0 = _mm_sha1msg1_epu32(MSG0, MSG1);
+	    // Rounds 8-11
+	    MSG2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)&data[32]), mask);
+	    E0 = _mm_sha1nexte_epu32(E0, MSG2);
+	    E1 = abcd;
+	    abcd = _mm_sha1rnds4_epu32(abcd, E0, 0);
+	    MSG1 = _mm_sha1msg1_epu32(MSG1, MSG2);
+	    MSG0 = _mm_xor_si128(MSG0, MSG2);
+	    // Rounds 12-15
+	    MSG3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)&data[48]), mask);
+	    E1 = _mm_sha1nexte_epu32(E1, MSG3);
+	    E0 = abcd;
+	    MSG0 = _mm_sha1msg2_epu32(MSG0, MSG3);
+	    abcd = _mm_sha1rnds4_epu32(abcd, E1, 0);
+	    MSG2 = _mm_sha1msg1_epu32(MSG2, MSG3);
+	    MSG1 = _mm_xor_si128(MSG1, MSG3);
+	    // Rounds 16-19
+	    E0 = _mm_sha1nexte_epu32(E0, MSG0);
+	    E1 = abcd;
+	    MSG1 = _mm_sha1msg2_epu32(MSG1, MSG0);
+	    abcd = _mm_sha1rnds4_epu32(abcd, E0, 0);
+	    MSG3 = _mm_sha1msg1_epu32(MSG3, MSG0);
+	    MSG2 = _mm_xor_si128(MSG2, MSG0);
+	    // Rounds 20-23
+	    E1 = _mm_sha1nexte_epu32(E1, MSG1);
+	    E0 = abcd;
+	    MSG2 = _mm_sha1msg2_epu32(MSG2, MSG1);
+	    abcd = _mm_sha1rnds4_epu32(abcd, E1, 1);
+	    MSG0 = _mm_sha1msg1_epu32(MSG0, MSG1);
+	    MSG3 = _mm_xor_si128(MSG3, MSG1);
+	    // Rounds 24-27
+	    E0 = _mm_sha1nexte_epu32(E0, MSG2);
+	    E1 = abcd;
+	    MSG3 = _mm_sha1msg2_epu32(MSG3, MSG2);
+	    abcd = _mm_sha1rnds4_epu32(abcd, E0, 1);
+	    MSG1 = _mm_sha1msg1_epu32(MSG1, MSG2);
+	    MSG0 = _mm_xor_si128(MSG0, MSG2);
+	    // Rounds 28-31
+	    E1 = _mm_sha1nexte_epu32(E1, MSG3);
+	    E0 = abcd;
+	    MSG0 = _mm_sha1msg2_epu32(MSG0, MSG3);
+	    abcd = _mm_sha1rnds4_epu32(abcd, E1, 1);
+	    MSG2 = _mm_sha1msg1_epu32(MSG2, MSG3);
+	    MSG1 = _mm_xor_si128(MSG1, MSG3);
+	    // Rounds 32-35
+	    E0 = _mm_sha1nexte_epu32(E0, MSG0);
+	    E1 = abcd;
+	    MSG1 = _mm_sha1msg2_epu32(MSG1, MSG0);
+	    abcd = _mm_sha1rnds4_epu32(abcd, E0, 1);
+	    MSG3 = _mm_sha1msg1_epu32(MSG3, MSG0);
+	    MSG2 = _mm_xor_si128(MSG2, MSG0);
+	    // Rounds 36-39
+	    E1 = _mm_sha1nexte_epu32(E1, MSG1);
+	    E0 = abcd;
+	    MSG2 = _mm_sha1msg2_epu32(MSG2, MSG1);
+	    abcd = _mm_sha1rnds4_epu32(abcd, E1, 1);
+	    MSG0 = _mm_sha1msg1_epu32(MSG0, MSG1);
+	    MSG3 = _mm_xor_si128(MSG3, MSG1);
+	    // Rounds 40-43
+	    E0 = _mm_sha1nexte_epu32(E0, MSG2);
+	    E1 = abcd;
+	    MSG3 = _mm_sha1msg2_epu32(MSG3, MSG2);
+	    abcd = _mm_sha1rnds4_epu32(abcd, E0, 2);
+	    MSG1 = _mm_sha1msg1_epu32(MSG1, MSG2);
+	    MSG0 = _mm_xor_si128(MSG0, MSG2);
+	    // Rounds 44-47
+	    E1 = _mm_sha1nexte_epu32(E1, MSG3);
+	    E0 = abcd;
+	    MSG0 = _mm_sha1msg2_epu32(MSG0, MSG3);
+	    abcd = _mm_sha1rnds4_epu32(abcd, E1, 2);
+	    MSG2 = _mm_sha1msg1_epu32(MSG2, MSG3);
+	    MSG1 = _mm_xor_si128(MSG1, MSG3);
+	    // Rounds 48-51
+	    E0 = _mm_sha1nexte_epu32(E0, MSG0);
+	    E1 = abcd;
+	    MSG1 = _mm_sha1msg2_epu32(MSG1, MSG0);
+	    abcd = _mm_sha1rnds4_epu32(abcd, E0, 2);
+	    MSG3 = _mm_sha1msg1_epu32(MSG3, MSG0);
+	    MSG2 = _mm_xor_si128(MSG2, MSG0);
+	    // Rounds 52-55
+	    E1 = _mm_sha1nexte_epu32(E1, MSG1);
+	    E0 = abcd;
+	    MSG2 = _mm_sha1msg2_epu32(MSG2, MSG1);
+	    abcd = _mm_sha1rnds4_epu32(abcd, E1, 2);
+	    MSG0 = _mm_sha1msg1_epu32(MSG0, MSG1);
+	    MSG3 = _mm_xor_si128(MSG3, MSG1);
+	    // Rounds 56-59
+	    E0 = _mm_sha1nexte_epu32(E0, MSG2);
+	    E1 = abcd;
+	    MSG3 = _mm_sha1msg2_epu32(MSG3, MSG2);
+	    abcd = _mm_sha1rnds4_epu32(abcd, E0, 2);
+	    MSG1 = _mm_sha1msg1_epu32(MSG1, MSG2);
+	    MSG0 = _mm_xor_si128(MSG0, MSG2);
+	    // Rounds 60-63
+	    E1 = _mm_sha1nexte_epu32(E1, MSG3);
+	    E0 = abcd;
+	    MSG0 = _mm_sha1msg2_epu32(MSG0, MSG3);
+	    abcd = _mm_sha1rnds4_epu32(abcd, E1, 3);
+	    MSG2 = _mm_sha1msg1_epu32(MSG2, MSG3);
+	    MSG1 = _mm_xor_si128(MSG1, MSG3);
+	    // Rounds 64-67
+	    E0 = _mm_sha1nexte_epu32(E0, MSG0);
+	    E1 = abcd;
+	    MSG1 = _mm_sha1msg2_epu32(MSG1, MSG0);
+	    abcd = _mm_sha1rnds4_epu32(abcd, E0, 3);
+	    MSG3 = _mm_sha1msg1_epu32(MSG3, MSG0);
+	    MSG2 = _mm_xor_si128(MSG2, MSG0);
+	    // Rounds 68-71
+	    E1 = _mm_sha1nexte_epu32(E1, MSG1);
+	    E0 = abcd;
+	    MSG2 = _mm_sha1msg2_epu32(MSG2, MSG1);
+	    abcd = _mm_sha1rnds4_epu32(abcd, E1, 3);
+	    MSG3 = _mm_xor_si128(MSG3, MSG1);
+	    // Rounds 72-75
+	    E0 = _mm_sha1nexte_epu32(E0, MSG2);
+	    E1 = abcd;
+	    MSG3 = _mm_sha1msg2_epu32(MSG3, MSG2);
+	    abcd = _mm_sha1rnds4_epu32(abcd, E0, 3);
+	    // Rounds 76-79
+	    E1 = _mm_sha1nexte_epu32(E1, MSG3);
+	    E0 = abcd;
+	    abcd = _mm_sha1rnds4_epu32(abcd, E1, 3);
+	    // Add this block to the chaining value
+	    E0 = _mm_sha1nexte_epu32(E0, E0Save);
+	    abcd = _mm_add_epi32(abcd, abcdSave);
+	}
+    _mm_storeu_si128((__m128i *)state, _mm_shuffle_epi32(abcd, 0x1B));
+    state[4] = (uint32_t)_mm_extract_epi32(E0, 3);
+}
+#endif // ALG_SHA1
+#if ALG_SHA256
+static const uint32_t c_sha256K[64] = {
+    0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+    0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+    0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+    0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+    0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+    0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+    0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+    0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2
+};
+/* B.2.3.4.3.2. Sha256BlocksShaNi() */
+/* SHA-256 compression using the SHA extensions. sha256rnds2 works on the state split as ABEF and
+   CDGH, so the state is rearranged on entry and put back in A..H order on exit. */
+static SHA_NI_TARGET void
+Sha256BlocksShaNi(
+		  uint32_t        *state,
+		  const BYTE      *data,
+		  size_t           blocks
+		  )
+{
+    const __m128i    mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i          state0, state1, abefSave, cdghSave, msg, tmp;
+    __m128i          MSG0, MSG1, MSG2, MSG3;
+    //
+    tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[0]), 0xB1);    // CDAB
+    state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[4]), 0x1B); // EFGH
+    state0 = _mm_alignr_epi8(tmp, state1, 8);                                      // ABEF
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);                                   // CDGH
+    for(; blocks > 0; blocks--, data += 64)
+	{
+	    abefSave = state0;
+	    cdghSave = state1;
+	    // Rounds 0-3
+	    MSG0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)&data[0]), mask);
+	    msg = _mm_add_epi32(MSG0, _mm_loadu_si128((const __m128i *)&c_sha256K[0]));
+	    state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+	    msg = _mm_shuffle_epi32(msg, 0x0E);
+	    state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+	    // Rounds 4-7
+	    MSG1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)&data[16]), mask);
+	    msg = _mm_add_epi32(MSG1, _mm_loadu_si128((const __m128i *)&c_sha256K[4]));
+	    state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+	    msg = _mm_shuffle_epi32(msg, 0x0E);
+	    state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+	    MSG0 = _mm_sha256msg1_epu32(MSG0, MSG1);
+	    // Rounds 8-11
+	    MSG2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)&data[32]), mask);
+	    msg = _mm_add_epi32(MSG2, _mm_loadu_si128((const __m128i *)&c_sha256K[8]));
+	    state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+	    msg = _mm_shuffle_epi32(msg, 0x0E);
+	    state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+	    MSG1 = _mm_sha256msg1_epu32(MSG1, MSG2);
+	    // Rounds 12-15
+	    MSG3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)&data[48]), mask);
+	    msg = _mm_add_epi32(MSG3, _mm_loadu_si128((const __m128i *)&c_sha256K[12]));
+	    state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+	    MSG0 = _mm_add_epi32(MSG0, _mm_alignr_epi8(MSG3, MSG2, 4));
+	    MSG0 = _mm_sha256msg2_epu32(MSG0, MSG3);
+	    msg = _mm_shuffle_epi32(msg, 0x0E);
+	    state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+	    MSG2 = _mm_sha256msg1_epu32(MSG2, MSG3);
+	    // Rounds 16-19
+	    msg = _mm_add_epi32(MSG0, _mm_loadu_si128((const __m128i *)&c_sha256K[16]));
+	    state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+	    MSG1 = _mm_add_epi32(MSG1, _mm_alignr_epi8(MSG0, MSG3, 4));
+	    MSG1 = _mm_sha256msg2_epu32(MSG1, MSG0);
+	    msg = _mm_shuffle_epi32(msg, 0x0E);
+	    state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+	    MSG3 = _mm_sha256msg1_epu32(MSG3, MSG0);
+	    // Rounds 20-23
+	    msg = _mm_add_epi32(MSG1, _mm_loadu_si128((const __m128i *)&c_sha256K[20]));
+	    state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+	    MSG2 = _mm_add_epi32(MSG2, _mm_alignr_epi8(MSG1, MSG0, 4));
+	    MSG2 = _mm_sha256msg2_epu32(MSG2, MSG1);
+	    msg = _mm_shuffle_epi32(msg, 0x0E);
+	    state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+	    MSG0 = _mm_sha256msg1_epu32(MSG0, MSG1);
+	    // Rounds 24-27
+	    msg = _mm_add_epi32(MSG2, _mm_loadu_si128((const __m128i *)&c_sha256K[24]));
+	    state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+	    MSG3 = _mm_add_epi32(MSG3, _mm_alignr_epi8(MSG2, MSG1, 4));
+	    MSG3 = _mm_sha256msg2_epu32(MSG3, MSG2);
+	    msg = _mm_shuffle_epi32(msg, 0x0E);
+	    state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+	    MSG1 = _mm_sha256msg1_epu32(MSG1, MSG2);
+	    // Rounds 28-31
+	    msg = _mm_add_epi32(MSG3, _mm_loadu_si128((const __m128i *)&c_sha256K[28]));
+	    state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+	    MSG0 = _mm_add_epi32(MSG0, _mm_alignr_epi8(MSG3, MSG2, 4));
+	    MSG0 = _mm_sha256msg2_epu32(MSG0, MSG3);
+	    msg = _mm_shuffle_epi32(msg, 0x0E);
+	    state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+	    MSG2 = _mm_sha256msg1_epu32(MSG2, MSG3);
+	    // Rounds 32-35
+	    msg = _mm_add_epi32(MSG0, _mm_loadu_si128((const __m128i *)&c_sha256K[32]));
+	    state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+	    MSG1 = _mm_add_epi32(MSG1, _mm_alignr_epi8(MSG0, MSG3, 4));
+	    MSG1 = _mm_sha256msg2_epu32(MSG1, MSG0);
+	    msg = _mm_shuffle_epi32(msg, 0x0E);
+	    state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+	    MSG3 = _mm_sha256msg1_epu32(MSG3, MSG0);
+	    // Rounds 36-39
+	    msg = _mm_add_epi32(MSG1, _mm_loadu_si128((const __m128i *)&c_sha256K[36]));
+	    state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+	    MSG2 = _mm_add_epi32(MSG2, _mm_alignr_epi8(MSG1, MSG0, 4));
+	    MSG2 = _mm_sha256msg2_epu32(MSG2, MSG1);
+	    msg = _mm_shuffle_epi32(msg, 0x0E);
+	    state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+	    MSG0 = _mm_sha256msg1_epu32(MSG0, MSG1);
+	    // Rounds 40-43
+	    msg = _mm_add_epi32(MSG2, _mm_loadu_si128((const __m128i *)&c_sha256K[40]));
+	    state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+	    MSG3 = _mm_add_epi32(MSG3, _mm_alignr_epi8(MSG2, MSG1, 4));
+	    MSG3 = _mm_sha256msg2_epu32(MSG3, MSG2);
+	    msg = _mm_shuffle_epi32(msg, 0x0E);
+	    state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+	    MSG1 = _mm_sha256msg1_epu32(MSG1, MSG2);
+	    // Rounds 44-47
+	    msg = _mm_add_epi32(MSG3, _mm_loadu_si128((const __m128i *)&c_sha256K[44]));
+	    state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+	    MSG0 = _mm_add_epi32(MSG0, _mm_alignr_epi8(MSG3, MSG2, 4));
+	    MSG0 = _mm_sha256msg2_epu32(MSG0, MSG3);
+	    msg = _mm_shuffle_epi32(msg, 0x0E);
+	    state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+	    MSG2 = _mm_sha256msg1_epu32(MSG2, MSG3);
+	    // Rounds 48-51
+	    msg = _mm_add_epi32(MSG0, _mm_loadu_si128((const __m128i *)&c_sha256K[48]));
+	    state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+	    MSG1 = _mm_add_epi32(MSG1, _mm_alignr_epi8(MSG0, MSG3, 4));
+	    MSG1 = _mm_sha256msg2_epu32(MSG1, MSG0);
+	    msg = _mm_shuffle_epi32(msg, 0x0E);
+	    state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+	    MSG3 = _mm_sha256msg1_epu32(MSG3, MSG0);
+	    // Rounds 52-55
+	    msg = _mm_add_epi32(MSG1, _mm_loadu_si128((const __m128i *)&c_sha256K[52]));
+	    state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+	    MSG2 = _mm_add_epi32(MSG2, _mm_alignr_epi8(MSG1, MSG0, 4));
+	    MSG2 = _mm_sha256msg2_epu32(MSG2, MSG1);
+	    msg = _mm_shuffle_epi32(msg, 0x0E);
+	    state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+	    // Rounds 56-59
+	    msg = _mm_add_epi32(MSG2, _mm_loadu_si128((const __m128i *)&c_sha256K[56]));
+	    state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+	    MSG3 = _mm_add_epi32(MSG3, _mm_alignr_epi8(MSG2, MSG1, 4));
+	    MSG3 = _mm_sha256msg2_epu32(MSG3, MSG2);
+	    msg = _mm_shuffle_epi32(msg, 0x0E);
+	    state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+	    // Rounds 60-63
+	    msg = _mm_add_epi32(MSG3, _mm_loadu_si128((const __m128i *)&c_sha256K[60]));
+	    state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+	    msg = _mm_shuffle_epi32(msg, 0x0E);
+	    state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+	    // Add this block to the chaining value
+	    state0 = _mm_add_epi32(state0, abefSave);
+	    state1 = _mm_add_epi32(state1, cdghSave);
+	}
+    tmp = _mm_shuffle_epi32(state0, 0x1B);                                         // FEBA
+    state1 = _mm_shuffle_epi32(state1, 0xB1);                                      // DCHG
+    _mm_storeu_si128((__m128i *)&state[0], _mm_blend_epi16(tmp, state1, 0xF0));    // DCBA
+    _mm_storeu_si128((__m128i *)&state[4], _mm_alignr_epi8(state1, tmp, 8));       // HGFE
+}
+#endif // ALG_SHA256
+#endif // HASH_ACCEL_X86
+/* B.2.3.4.3.3. HashAccelInit() */
+/* This function selects the compression functions for the processor that the TPM is running on.
+   It is called from CryptHashInit() and may be called more than once. */
+LIB_EXPORT void
+HashAccelInit(
+	      void
+	      )
+{
+#if HASH_ACCEL_X86
+    unsigned int         eax, ebx, ecx, edx;
+    BOOL                 shaNi = FALSE;
+    //
+    // SHA-NI needs SSSE3 and SSE4.1 for the byte swap and the state shuffles
+    if(__get_cpuid(1, &eax, &ebx, &ecx, &edx)
+       && (ecx & bit_SSSE3) && (ecx & bit_SSE4_1)
+       && __get_cpuid_max(0, NULL) >= 7)
+	{
+	    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+	    shaNi = (ebx & (1u << 29)) != 0;
+	}
+#   if ALG_SHA1
+    s_sha1Blocks = shaNi ? Sha1BlocksShaNi : NULL;
+#   endif
+#   if ALG_SHA256
+    s_sha256Blocks = shaNi ? Sha256BlocksShaNi : NULL;
+#   endif
+#endif // HASH_ACCEL_X86
+    return;
+}
+/* B.2.3.4.3.4. HashAccelBlocks() */
+/* Common update for the 64-byte block hashes, called once any partially filled block in the
+   context has been completed by the library. All of the whole blocks in the input go to the
+   selected compression function and the byte count in total is advanced the way the library keeps
+   it. The return value is the number of bytes consumed; the caller gives the rest to the library
+   to buffer. */
+static size_t
+HashAccelBlocks(
+		HASH_BLOCKS_FUNC    *blocksFunc,
+		uint32_t            *state,
+		uint32_t            *total,
+		const BYTE          *in,
+		size_t               size
+		)
+{
+    size_t           blocks = size / 64;
+    UINT64           count;
+    //
+    if(blocks > 0)
+	{
+	    blocksFunc(state, in, blocks);
+	    count = ((UINT64)total[1] << 32) + total[0] + (UINT64)blocks * 64;
+	    total[0] = (uint32_t)count;
+	    total[1] = (uint32_t)(count >> 32);
+	}
+    return blocks * 64;
+}
+/* B.2.3.4.3.5. HashAccelFinish() */
+/* Common Merkle-Damgard padding for the 64-byte block hashes. The padding is built in the context
+   buffer and run through the selected compression function, then outWords of the big-endian state
+   are returned. */
+static void
+HashAccelFinish(
+		HASH_BLOCKS_FUNC    *blocksFunc,
+		uint32_t            *state,
+		const uint32_t      *total,
+		BYTE                *buffer,
+		BYTE                *out,
+		int                  outWords
+		)
+{
+    UINT32           used = total[0] & 0x3F;
+    UINT32           high = (total[0] >> 29) | (total[1] << 3);
+    UINT32           low = total[0] << 3;
+    int              i;
+    //
+    buffer[used++] = 0x80;
+    if(used > 56)
+	{
+	    MemorySet(&buffer[used], 0, 64 - used);
+	    blocksFunc(state, buffer, 1);
+	    used = 0;
+	}
+    MemorySet(&buffer[used], 0, 56 - used);
+    UINT32_TO_BYTE_ARRAY(high, &buffer[56]);
+    UINT32_TO_BYTE_ARRAY(low, &buffer[60]);
+    blocksFunc(state, buffer, 1);
+    for(i = 0; i < outWords; i++)
+	UINT32_TO_BYTE_ARRAY(state[i], &out[4 * i]);
+}
+#if ALG_SHA1
+/* B.2.3.4.3.6. HashAccelSha1Update() */
+LIB_EXPORT void
+HashAccelSha1Update(
+		    mbedtls_sha1_context    *ctx,
+		    const BYTE              *in,
+		    size_t                   size
+		    )
+{
+    size_t           used;
+    size_t           done;
+    //
+    if(s_sha1Blocks == NULL || size < 64)
+	{
+	    mbedtls_sha1_update(ctx, in, size);
+	    return;
+	}
+    // Let the library complete a buffered partial block
+    used = ctx->MBEDTLS_PRIVATE(total)[0] & 0x3F;
+    if(used != 0)
+	{
+	    mbedtls_sha1_update(ctx, in, 64 - used);
+	    in += 64 - used;
+	    size -= 64 - used;
+	}
+    done = HashAccelBlocks(s_sha1Blocks, ctx->MBEDTLS_PRIVATE(state),
+			   ctx->MBEDTLS_PRIVATE(total), in, size);
+    if(done < size)
+	mbedtls_sha1_update(ctx, &in[done], size - done);
+}
+/* B.2.3.4.3.7. HashAccelSha1Finish() */
+LIB_EXPORT void
+HashAccelSha1Finish(
+		    mbedtls_sha1_context    *ctx,
+		    BYTE                    *out
+		    )
+{
+    if(s_sha1Blocks == NULL)
+	mbedtls_sha1_finish(ctx, out);
+    else
+	HashAccelFinish(s_sha1Blocks, ctx->MBEDTLS_PRIVATE(state),
+			ctx->MBEDTLS_PRIVATE(total), ctx->MBEDTLS_PRIVATE(buffer),
+			out, 5);
+}
+#endif // ALG_SHA1
+#if ALG_SHA256
+/* B.2.3.4.3.8. HashAccelSha256Update() */
+LIB_EXPORT void
+HashAccelSha256Update(
+		      mbedtls_sha256_context  *ctx,
+		      const BYTE              *in,
+		      size_t                   size
+		      )
+{
+    size_t           used;
+    size_t           done;
+    //
+    if(s_sha256Blocks == NULL || size < 64)
+	{
+	    mbedtls_sha256_update(ctx, in, size);
+	    return;
+	}
+    // Let the library complete a buffered partial block
+    used = ctx->MBEDTLS_PRIVATE(total)[0] & 0x3F;
+    if(used != 0)
+	{
+	    mbedtls_sha256_update(ctx, in, 64 - used);
+	    in += 64 - used;
+	    size -= 64 - used;
+	}
+    done = HashAccelBlocks(s_sha256Blocks, ctx->MBEDTLS_PRIVATE(state),
+			   ctx->MBEDTLS_PRIVATE(total), in, size);
+    if(done < size)
+	mbedtls_sha256_update(ctx, &in[done], size - done);
+}
+/* B.2.3.4.3.9. HashAccelSha256Finish() */
+LIB_EXPORT void
+HashAccelSha256Finish(
+		      mbedtls_sha256_context  *ctx,
+		      BYTE                    *out
+		      )
+{
+    if(s_sha256Blocks == NULL)
+	mbedtls_sha256_finish(ctx, out);
+    else
+	HashAccelFinish(s_sha256Blocks, ctx->MBEDTLS_PRIVATE(state),
+			ctx->MBEDTLS_PRIVATE(total), ctx->MBEDTLS_PRIVATE(buffer),
+			out, ctx->MBEDTLS_PRIVATE(is224) ? 7 : 8);
+}
+#endif // ALG_SHA256
+#endif // HASH_LIB_OSSL
@@ -133,6 +133,37 @@ typedef void(*TpmCryptSetSymKeyCall_t)(
 				       BYTE        *out
 				       );
 
+/* The multi-block methods used by CryptSym.c for the modes that can work on several blocks at
+   once. A blocks call processes size bytes of whole blocks in ECB fashion. A CTR call applies the
+   key stream from a big-endian counter block to size bytes, advancing the counter by one for each
+   block including a partial last block. An algorithm that does not have one of these sets it to
+   NULL and CryptSym.c uses the single block call instead. */
+
+#define SWIZZLE_BLOCKS_ENC(keySchedule, size, in, out)			\
+    (void *)(keySchedule), _MBEDTLS_ENCRYPT_CODE, (int)(size), (const BYTE *)(in), (BYTE *)(out)
+
+#define SWIZZLE_BLOCKS_DEC(keySchedule, size, in, out)			\
+    (void *)(keySchedule), _MBEDTLS_DECRYPT_CODE, (int)(size), (const BYTE *)(in), (BYTE *)(out)
+
+#define SWIZZLE_CTR(keySchedule, size, counter, in, out)			\
+    (void *)(keySchedule), (size_t)(size), (BYTE *)(counter), (const BYTE *)(in), (BYTE *)(out)
+
+typedef void(*TpmCryptBlocksCall_t)(
+				    void        *keySchedule,
+				    int          mode,
+				    int          size,
+				    const BYTE  *in,
+				    BYTE        *out
+				    );
+
+typedef void(*TpmCryptCtrCall_t)(
+				 void        *keySchedule,
+				 size_t       size,
+				 BYTE        *counter,
+				 const BYTE  *in,
+				 BYTE        *out
+				 );
+
 #define SYM_ALIGNMENT   RADIX_BYTES
 
 /* B.2.2.3.3.	Links to the OpenSSL AES code */
@@ -152,6 +183,12 @@ typedef void(*TpmCryptSetSymKeyCall_t)(
 #define TpmCryptDecryptAES          mbedtls_aes_crypt_ecb // AES_decrypt
 #define tpmKeyScheduleAES           mbedtls_aes_context //AES_KEY
 
+#include "TpmToOsslSymSupport_fp.h"
+
+#define TpmCryptEncryptBlocksAES    AES_crypt_blocks
+#define TpmCryptDecryptBlocksAES    AES_crypt_blocks
+#define TpmCryptCtrAES              NULL
+
 /* B.2.2.3.4.	Links to the OpenSSL DES code */
 
 #if ALG_TDES
@@ -170,6 +207,10 @@ typedef void(*TpmCryptSetSymKeyCall_t)(
 #define TpmCryptDecryptTDES         mbedtls_des3_crypt_ecb // TDES_decrypt
 #define tpmKeyScheduleTDES          mbedtls_des3_context   //DES_key_schedule
 
+#define TpmCryptEncryptBlocksTDES   NULL
+#define TpmCryptDecryptBlocksTDES   NULL
+#define TpmCryptCtrTDES             NULL
+
 /* B.2.2.3.5.	Links to the OpenSSL SM4 code */
 /* Macros to set up the encryption/decryption key schedules */
 
@@ -178,11 +219,17 @@ typedef void(*TpmCryptSetSymKeyCall_t)(
 #define TpmCryptSetDecryptKeySM4(key, keySizeInBits, schedule)	\
     sm4_setkey_dec( (tpmKeyScheduleSM4 *)(schedule), (key))
 /* Macros to alias encryption calls to specific algorithms. This should be used sparingly. */
+/* sm4_crypt_block() takes its parameters in the SWIZZLE_ENC() order. SM4_encrypt() does not, and
+   must not be called through TpmCryptSetSymKeyCall_t. */
 
-#define TpmCryptEncryptSM4          SM4_encrypt
-#define TpmCryptDecryptSM4          SM4_decrypt
+#define TpmCryptEncryptSM4          sm4_crypt_block // SM4_encrypt
+#define TpmCryptDecryptSM4          sm4_crypt_block // SM4_decrypt
 #define tpmKeyScheduleSM4           sm4_context
 
+#define TpmCryptEncryptBlocksSM4    sm4_crypt_ecb
+#define TpmCryptDecryptBlocksSM4    sm4_crypt_ecb
+#define TpmCryptCtrSM4              sm4_crypt_ctr
+
 /* B.2.2.3.6.	Links to the OpenSSL CAMELLIA code */
 /* Macros to set up the encryption/decryption key schedules */
 
@@ -197,6 +244,10 @@ typedef void(*TpmCryptSetSymKeyCall_t)(
 #define TpmCryptDecryptCAMELLIA          mbedtls_camellia_crypt_ecb //Camellia_decrypt
 #define tpmKeyScheduleCAMELLIA           mbedtls_camellia_context //CAMELLIA_KEY
 
+#define TpmCryptEncryptBlocksCAMELLIA    NULL
+#define TpmCryptDecryptBlocksCAMELLIA    NULL
+#define TpmCryptCtrCAMELLIA              NULL
+
 /* Forward reference */
 
 // kgold typedef union tpmCryptKeySchedule_t tpmCryptKeySchedule_t;
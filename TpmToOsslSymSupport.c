@@ -0,0 +1,194 @@
+/********************************************************************************/
+/*										*/
+/*			Symmetric Library Bulk Support				*/
+/*            $Id: TpmToOsslSymSupport.c $					*/
+/*										*/
+/*  Licenses and Notices							*/
+/*										*/
+/*  1. Copyright Licenses:							*/
+/*										*/
+/*  - Trusted Computing Group (TCG) grants to the user of the source code in	*/
+/*    this specification (the "Source Code") a worldwide, irrevocable, 		*/
+/*    nonexclusive, royalty free, copyright license to reproduce, create 	*/
+/*    derivative works, distribute, display and perform the Source Code and	*/
+/*    derivative works thereof, and to grant others the rights granted herein.	*/
+/*										*/
+/*  - The TCG grants to the user of the other parts of the specification 	*/
+/*    (other than the Source Code) the rights to reproduce, distribute, 	*/
+/*    display, and perform the specification solely for the purpose of 		*/
+/*    developing products based on such documents.				*/
+/*										*/
+/*  2. Source Code Distribution Conditions:					*/
+/*										*/
+/*  - Redistributions of Source Code must retain the above copyright licenses, 	*/
+/*    this list of conditions and the following disclaimers.			*/
+/*										*/
+/*  - Redistributions in binary form must reproduce the above copyright 	*/
+/*    licenses, this list of conditions	and the following disclaimers in the 	*/
+/*    documentation and/or other materials provided with the distribution.	*/
+/*										*/
+/*  3. Disclaimers:								*/
+/*										*/
+/*  - THE COPYRIGHT LICENSES SET FORTH ABOVE DO NOT REPRESENT ANY FORM OF	*/
+/*  LICENSE OR WAIVER, EXPRESS OR IMPLIED, BY ESTOPPEL OR OTHERWISE, WITH	*/
+/*  RESPECT TO PATENT RIGHTS HELD BY TCG MEMBERS (OR OTHER THIRD PARTIES)	*/
+/*  THAT MAY BE NECESSARY TO IMPLEMENT THIS SPECIFICATION OR OTHERWISE.		*/
+/*  Contact TCG Administration (admin@trustedcomputinggroup.org) for 		*/
+/*  information on specification licensing rights available through TCG 	*/
+/*  membership agreements.							*/
+/*										*/
+/*  - THIS SPECIFICATION IS PROVIDED "AS IS" WITH NO EXPRESS OR IMPLIED 	*/
+/*    WARRANTIES WHATSOEVER, INCLUDING ANY WARRANTY OF MERCHANTABILITY OR 	*/
+/*    FITNESS FOR A PARTICULAR PURPOSE, ACCURACY, COMPLETENESS, OR 		*/
+/*    NONINFRINGEMENT OF INTELLECTUAL PROPERTY RIGHTS, OR ANY WARRANTY 		*/
+/*    OTHERWISE ARISING OUT OF ANY PROPOSAL, SPECIFICATION OR SAMPLE.		*/
+/*										*/
+/*  - Without limitation, TCG and its members and licensors disclaim all 	*/
+/*    liability, including liability for infringement of any proprietary 	*/
+/*    rights, relating to use of information in this specification and to the	*/
+/*    implementation of this specification, and TCG disclaims all liability for	*/
+/*    cost of procurement of substitute goods or services, lost profits, loss 	*/
+/*    of use, loss of data or any incidental, consequential, direct, indirect, 	*/
+/*    or special damages, whether under contract, tort, warranty or otherwise, 	*/
+/*    arising in any way out of use or reliance upon this specification or any 	*/
+/*    information herein.							*/
+/*										*/
+/*  (c) Copyright IBM Corp. and others, 2016 - 2026				*/
+/*										*/
+/********************************************************************************/
+
+/* B.2.3.5. TpmToOsslSymSupport.c */
+/* B.2.3.5.1. Introduction */
+/* The functions in this file are the multi-block methods that CryptSym.c uses for the modes that can
+   process several blocks at once. The library only provides single block AES, so when the processor
+   has the AES instructions, the blocks are run eight at a time with AES-NI on the round keys of the
+   library context. The schedules built by mbedtls_aes_setkey_enc() and mbedtls_aes_setkey_dec() are
+   the standard and the equivalent inverse cipher round keys whether or not the library was built
+   with its own AES-NI code, so the same context works either way. Otherwise the blocks go to the
+   library one at a time. */
+/* B.2.3.5.2. Defines and Includes */
+#include "Tpm.h"
+
+#if defined(SYM_LIB_OSSL) && ALG_AES
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#   define SYM_ACCEL_X86    YES
+#   include <immintrin.h>
+#   define AES_NI_TARGET    __attribute__((target("aes,sse2")))
+#else
+#   define SYM_ACCEL_X86    NO
+#endif
+
+/* mbedtls 3 names the context members through MBEDTLS_PRIVATE() and keeps an offset to the round
+   keys rather than a pointer */
+#if defined(MBEDTLS_PRIVATE)
+#   define AES_ROUND_KEYS(ctx)						\
+    ((const BYTE *)((ctx)->MBEDTLS_PRIVATE(buf) + (ctx)->MBEDTLS_PRIVATE(rk_offset)))
+#   define AES_ROUNDS(ctx)          ((ctx)->MBEDTLS_PRIVATE(nr))
+#else
+#   define AES_ROUND_KEYS(ctx)      ((const BYTE *)(ctx)->rk)
+#   define AES_ROUNDS(ctx)          ((ctx)->nr)
+#endif
+
+/* B.2.3.5.3. Functions */
+#if SYM_ACCEL_X86
+/* B.2.3.5.3.1. AesBlocksAesNi() */
+/* Runs blocks through AES with the given schedule, eight at a time so that the aesenc or aesdec
+   latency of one block is covered by the others. For decryption, rk is the equivalent inverse
+   cipher schedule, which starts with the last encryption round key. */
+#define AES_NI_BATCH    8
+
+/* Applies one AES round instruction to all eight blocks of a batch */
+#define AES_NI_ROUND8(op, key)						\
+    {									\
+	b0 = op(b0, key); b1 = op(b1, key); b2 = op(b2, key); b3 = op(b3, key); \
+	b4 = op(b4, key); b5 = op(b5, key); b6 = op(b6, key); b7 = op(b7, key); \
+    }
+#define AES_NI_LOAD(i)							\
+    _mm_xor_si128(_mm_loadu_si128((const __m128i *)&in[16 * (i)]), k[0])
+#define AES_NI_STORE(i, b)						\
+    _mm_storeu_si128((__m128i *)&out[16 * (i)], (b))
+
+static AES_NI_TARGET void
+AesBlocksAesNi(
+	       const BYTE      *rk,            // IN: round keys
+	       int              nr,            // IN: number of rounds
+	       int              encrypt,       // IN: TRUE to encrypt
+	       size_t           blocks,        // IN: number of 16-byte blocks
+	       const BYTE      *in,            // IN: input blocks
+	       BYTE            *out            // OUT: output blocks (may be in)
+	       )
+{
+    __m128i          k[15];
+    __m128i          b0, b1, b2, b3, b4, b5, b6, b7;
+    int              r;
+    //
+    for(r = 0; r <= nr; r++)
+	k[r] = _mm_loadu_si128((const __m128i *)&rk[16 * r]);
+    for(; blocks >= AES_NI_BATCH; blocks -= AES_NI_BATCH)
+	{
+	    b0 = AES_NI_LOAD(0); b1 = AES_NI_LOAD(1); b2 = AES_NI_LOAD(2); b3 = AES_NI_LOAD(3);
+	    b4 = AES_NI_LOAD(4); b5 = AES_NI_LOAD(5); b6 = AES_NI_LOAD(6); b7 = AES_NI_LOAD(7);
+	    if(encrypt)
+		{
+		    for(r = 1; r < nr; r++)
+			AES_NI_ROUND8(_mm_aesenc_si128, k[r]);
+		    AES_NI_ROUND8(_mm_aesenclast_si128, k[nr]);
+		}
+	    else
+		{
+		    for(r = 1; r < nr; r++)
+			AES_NI_ROUND8(_mm_aesdec_si128, k[r]);
+		    AES_NI_ROUND8(_mm_aesdeclast_si128, k[nr]);
+		}
+	    AES_NI_STORE(0, b0); AES_NI_STORE(1, b1); AES_NI_STORE(2, b2); AES_NI_STORE(3, b3);
+	    AES_NI_STORE(4, b4); AES_NI_STORE(5, b5); AES_NI_STORE(6, b6); AES_NI_STORE(7, b7);
+	    in += 16 * AES_NI_BATCH;
+	    out += 16 * AES_NI_BATCH;
+	}
+    for(; blocks > 0; blocks--, in += 16, out += 16)
+	{
+	    b0 = AES_NI_LOAD(0);
+	    if(encrypt)
+		{
+		    for(r = 1; r < nr; r++)
+			b0 = _mm_aesenc_si128(b0, k[r]);
+		    b0 = _mm_aesenclast_si128(b0, k[nr]);
+		}
+	    else
+		{
+		    for(r = 1; r < nr; r++)
+			b0 = _mm_aesdec_si128(b0, k[r]);
+		    b0 = _mm_aesdeclast_si128(b0, k[nr]);
+		}
+	    AES_NI_STORE(0, b0);
+	}
+}
+#endif // SYM_ACCEL_X86
+
+/* B.2.3.5.3.2. AES_crypt_blocks() */
+/* This function encrypts or decrypts length bytes of whole blocks in ECB fashion. The mode and key
+   schedule are as for mbedtls_aes_crypt_ecb(). dIn and dOut may be the same buffer. */
+LIB_EXPORT void
+AES_crypt_blocks(
+		 tpmKeyScheduleAES      *ks,            // IN: key schedule
+		 int                     mode,          // IN: _MBEDTLS_ENCRYPT_CODE or
+		 //     _MBEDTLS_DECRYPT_CODE
+		 int                     length,        // IN: a multiple of 16
+		 const BYTE             *dIn,           // IN: input blocks
+		 BYTE                   *dOut           // OUT: output blocks
+		 )
+{
+#if SYM_ACCEL_X86
+    if(__builtin_cpu_supports("aes") && AES_ROUNDS(ks) <= 14)
+	{
+	    AesBlocksAesNi(AES_ROUND_KEYS(ks), AES_ROUNDS(ks), mode == _MBEDTLS_ENCRYPT_CODE,
+			   (size_t)length / 16, dIn, dOut);
+	    return;
+	}
+#endif
+    for(; length >= 16; length -= 16, dIn += 16, dOut += 16)
+	mbedtls_aes_crypt_ecb(ks, mode, dIn, dOut);
+}
+
+#endif // SYM_LIB_OSSL && ALG_AES
@@ -300,6 +300,8 @@ typedef UINT32                              TPM_CC;
 #define NTC2_CC_PreConfig		    (TPM_CC)(0x20000211)
 #define NTC2_CC_LockPreConfig               (TPM_CC)(0x20000212)
 #define NTC2_CC_GetConfig                   (TPM_CC)(0x20000213)
+#define NTC2_CC_EncryptDecryptStart         (TPM_CC)(0x20000214)
+#define NTC2_CC_EncryptDecryptUpdate        (TPM_CC)(0x20000215)
 
 /* Table 2:5 - Definition of Types for Documentation Clarity */
 typedef UINT32              TPM_ALGORITHM_ID;
@@ -0,0 +1,203 @@
+/********************************************************************************/
+/*										*/
+/*			Decode the Binary Command Trace				*/
+/*            $Id: TraceDecode.c $						*/
+/*										*/
+/*  Licenses and Notices							*/
+/*										*/
+/*  1. Copyright Licenses:							*/
+/*										*/
+/*  - Trusted Computing Group (TCG) grants to the user of the source code in	*/
+/*    this specification (the "Source Code") a worldwide, irrevocable, 		*/
+/*    nonexclusive, royalty free, copyright license to reproduce, create 	*/
+/*    derivative works, distribute, display and perform the Source Code and	*/
+/*    derivative works thereof, and to grant others the rights granted herein.	*/
+/*										*/
+/*  - The TCG grants to the user of the other parts of the specification 	*/
+/*    (other than the Source Code) the rights to reproduce, distribute, 	*/
+/*    display, and perform the specification solely for the purpose of 		*/
+/*    developing products based on such documents.				*/
+/*										*/
+/*  2. Source Code Distribution Conditions:					*/
+/*										*/
+/*  - Redistributions of Source Code must retain the above copyright licenses, 	*/
+/*    this list of conditions and the following disclaimers.			*/
+/*										*/
+/*  - Redistributions in binary form must reproduce the above copyright 	*/
+/*    licenses, this list of conditions	and the following disclaimers in the 	*/
+/*    documentation and/or other materials provided with the distribution.	*/
+/*										*/
+/*  3. Disclaimers:								*/
+/*										*/
+/*  - THE COPYRIGHT LICENSES SET FORTH ABOVE DO NOT REPRESENT ANY FORM OF	*/
+/*  LICENSE OR WAIVER, EXPRESS OR IMPLIED, BY ESTOPPEL OR OTHERWISE, WITH	*/
+/*  RESPECT TO PATENT RIGHTS HELD BY TCG MEMBERS (OR OTHER THIRD PARTIES)	*/
+/*  THAT MAY BE NECESSARY TO IMPLEMENT THIS SPECIFICATION OR OTHERWISE.		*/
+/*  Contact TCG Administration (admin@trustedcomputinggroup.org) for 		*/
+/*  information on specification licensing rights available through TCG 	*/
+/*  membership agreements.							*/
+/*										*/
+/*  - THIS SPECIFICATION IS PROVIDED "AS IS" WITH NO EXPRESS OR IMPLIED 	*/
+/*    WARRANTIES WHATSOEVER, INCLUDING ANY WARRANTY OF MERCHANTABILITY OR 	*/
+/*    FITNESS FOR A PARTICULAR PURPOSE, ACCURACY, COMPLETENESS, OR 		*/
+/*    NONINFRINGEMENT OF INTELLECTUAL PROPERTY RIGHTS, OR ANY WARRANTY 		*/
+/*    OTHERWISE ARISING OUT OF ANY PROPOSAL, SPECIFICATION OR SAMPLE.		*/
+/*										*/
+/*  - Without limitation, TCG and its members and licensors disclaim all 	*/
+/*    liability, including liability for infringement of any proprietary 	*/
+/*    rights, relating to use of information in this specification and to the	*/
+/*    implementation of this specification, and TCG disclaims all liability for	*/
+/*    cost of procurement of substitute goods or services, lost profits, loss 	*/
+/*    of use, loss of data or any incidental, consequential, direct, indirect, 	*/
+/*    or special damages, whether under contract, tort, warranty or otherwise, 	*/
+/*    arising in any way out of use or reliance upon this specification or any 	*/
+/*    information herein.							*/
+/*										*/
+/*  (c) Copyright IBM Corp. and others, 2016 - 2026				*/
+/*										*/
+/********************************************************************************/
+
+/* D.7 TraceDecode.c */
+/* D.7.1. Description */
+/* This is a standalone program that prints a trace file written by TracePlat.c as text, oldest
+   command first. */
+/* Usage: tracedecode [File] where File defaults to TRACE_DEFAULT_FILE */
+/* D.7.2. Includes and Data Definitions */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "TracePlat.h"
+#include "CommandNames_fp.h"
+
+/* D.7.3. Functions */
+/* D.7.3.1. CompareRecords() */
+/* qsort() comparison that orders records by sequence number. */
+static int
+CompareRecords(
+	       const void      *a,
+	       const void      *b
+	       )
+{
+    uint64_t         sa = (*(const TRACE_RECORD * const *)a)->sequence;
+    uint64_t         sb = (*(const TRACE_RECORD * const *)b)->sequence;
+    return (sa > sb) - (sa < sb);
+}
+/* D.7.3.2. PrintBytes() */
+static void
+PrintBytes(
+	   const char              *label,
+	   const unsigned char     *bytes,
+	   uint32_t                 captured,
+	   uint32_t                 size
+	   )
+{
+    uint32_t         i;
+    printf("%s %u bytes%s\n", label, size, captured < size ? ", truncated" : "");
+    for(i = 0; i < captured; i++)
+	printf("%s%02x%s", (i % 16) == 0 ? "\t" : " ", bytes[i],
+	       ((i % 16) == 15 || i == captured - 1) ? "\n" : "");
+}
+/* D.7.3.3. main() */
+int
+main(
+     int              argc,
+     char            *argv[]
+     )
+{
+    const char          *fileName = (argc > 1) ? argv[1] : TRACE_DEFAULT_FILE;
+    FILE                *f;
+    TRACE_FILE_HEADER    header;
+    TRACE_RECORD        *records;
+    TRACE_RECORD       **ordered;
+    unsigned char       *payload = NULL;
+    size_t               payloadBytes;
+    uint32_t             count = 0;
+    uint32_t             i;
+    uint32_t             j;
+
+    if(argc > 2 || (argc > 1 && strcmp(argv[1], "-h") == 0))
+	{
+	    fprintf(stderr, "Usage: %s [File]  - print the simulator command trace, default %s\n",
+		    argv[0], TRACE_DEFAULT_FILE);
+	    return 1;
+	}
+    f = fopen(fileName, "rb");
+    if(f == NULL)
+	{
+	    fprintf(stderr, "Cannot open %s\n", fileName);
+	    return 1;
+	}
+    if(fread(&header, sizeof(header), 1, f) != 1
+       || header.magic != TRACE_FILE_MAGIC
+       || header.version != TRACE_FILE_VERSION
+       || header.recordSize != sizeof(TRACE_RECORD)
+       || header.recordCount == 0)
+	{
+	    fprintf(stderr, "%s is not a trace file of this version\n", fileName);
+	    fclose(f);
+	    return 1;
+	}
+    payloadBytes = (size_t)header.recordCount * 2 * header.payloadSize;
+    records = calloc(header.recordCount, sizeof(TRACE_RECORD));
+    ordered = calloc(header.recordCount, sizeof(TRACE_RECORD *));
+    if(payloadBytes != 0)
+	payload = malloc(payloadBytes);
+    if(records == NULL || ordered == NULL || (payloadBytes != 0 && payload == NULL))
+	{
+	    fprintf(stderr, "Cannot allocate %u trace records\n", header.recordCount);
+	    fclose(f);
+	    return 1;
+	}
+    if(fread(records, sizeof(TRACE_RECORD), header.recordCount, f) != header.recordCount
+       || (payloadBytes != 0 && fread(payload, payloadBytes, 1, f) != 1))
+	{
+	    fprintf(stderr, "%s is truncated\n", fileName);
+	    fclose(f);
+	    return 1;
+	}
+    fclose(f);
+    // records that were being written when the trace was dumped have sequence 0
+    for(i = 0; i < header.recordCount; i++)
+	if(records[i].sequence != 0)
+	    ordered[count++] = &records[i];
+    qsort(ordered, count, sizeof(TRACE_RECORD *), CompareRecords);
+    printf("%u commands traced, %u kept\n", (unsigned)header.next, count);
+    for(i = 0; i < count; i++)
+	{
+	    const TRACE_RECORD  *r = ordered[i];
+	    const char          *name = CommandName(r->commandCode);
+	    char                 unknown[16];
+	    if(name == NULL)
+		{
+		    sprintf(unknown, "CC_%08x", r->commandCode);
+		    name = unknown;
+		}
+	    printf("\n\t\tCommand Code %08x\n", r->commandCode);
+	    printf("%s: sequence %llu locality %u start %llu.%09llu duration %u ns\n",
+		   name, (unsigned long long)r->sequence, r->locality,
+		   (unsigned long long)(r->startTime / 1000000000),
+		   (unsigned long long)(r->startTime % 1000000000), r->duration);
+	    for(j = 0; j < r->handleNum && j < TRACE_MAX_HANDLES; j++)
+		printf("%s: handle %08x\n", name, r->handles[j]);
+	    for(j = 0; j < r->sessionNum && j < TRACE_MAX_SESSIONS; j++)
+		printf("Session %u handle %08x\n", j, r->sessions[j]);
+	    if(r->responseHandle != 0)
+		printf("%s: response handle %08x\n", name, r->responseHandle);
+	    printf("%s: response code %08x\n", name, r->responseCode);
+	    if(payload != NULL)
+		{
+		    size_t index = (size_t)(r - records);
+		    PrintBytes("Command", &payload[index * 2 * header.payloadSize],
+			       r->commandCaptured, r->commandSize);
+		    PrintBytes("Response", &payload[(index * 2 + 1) * header.payloadSize],
+			       r->responseCaptured, r->responseSize);
+		}
+	    else
+		printf("Command %u bytes, response %u bytes\n", r->commandSize, r->responseSize);
+	}
+    free(payload);
+    free(ordered);
+    free(records);
+    return 0;
+}
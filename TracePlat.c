@@ -0,0 +1,303 @@
+/********************************************************************************/
+/*										*/
+/*			Binary Command Trace					*/
+/*            $Id: TracePlat.c $						*/
+/*										*/
+/*  Licenses and Notices							*/
+/*										*/
+/*  1. Copyright Licenses:							*/
+/*										*/
+/*  - Trusted Computing Group (TCG) grants to the user of the source code in	*/
+/*    this specification (the "Source Code") a worldwide, irrevocable, 		*/
+/*    nonexclusive, royalty free, copyright license to reproduce, create 	*/
+/*    derivative works, distribute, display and perform the Source Code and	*/
+/*    derivative works thereof, and to grant others the rights granted herein.	*/
+/*										*/
+/*  - The TCG grants to the user of the other parts of the specification 	*/
+/*    (other than the Source Code) the rights to reproduce, distribute, 	*/
+/*    display, and perform the specification solely for the purpose of 		*/
+/*    developing products based on such documents.				*/
+/*										*/
+/*  2. Source Code Distribution Conditions:					*/
+/*										*/
+/*  - Redistributions of Source Code must retain the above copyright licenses, 	*/
+/*    this list of conditions and the following disclaimers.			*/
+/*										*/
+/*  - Redistributions in binary form must reproduce the above copyright 	*/
+/*    licenses, this list of conditions	and the following disclaimers in the 	*/
+/*    documentation and/or other materials provided with the distribution.	*/
+/*										*/
+/*  3. Disclaimers:								*/
+/*										*/
+/*  - THE COPYRIGHT LICENSES SET FORTH ABOVE DO NOT REPRESENT ANY FORM OF	*/
+/*  LICENSE OR WAIVER, EXPRESS OR IMPLIED, BY ESTOPPEL OR OTHERWISE, WITH	*/
+/*  RESPECT TO PATENT RIGHTS HELD BY TCG MEMBERS (OR OTHER THIRD PARTIES)	*/
+/*  THAT MAY BE NECESSARY TO IMPLEMENT THIS SPECIFICATION OR OTHERWISE.		*/
+/*  Contact TCG Administration (admin@trustedcomputinggroup.org) for 		*/
+/*  information on specification licensing rights available through TCG 	*/
+/*  membership agreements.							*/
+/*										*/
+/*  - THIS SPECIFICATION IS PROVIDED "AS IS" WITH NO EXPRESS OR IMPLIED 	*/
+/*    WARRANTIES WHATSOEVER, INCLUDING ANY WARRANTY OF MERCHANTABILITY OR 	*/
+/*    FITNESS FOR A PARTICULAR PURPOSE, ACCURACY, COMPLETENESS, OR 		*/
+/*    NONINFRINGEMENT OF INTELLECTUAL PROPERTY RIGHTS, OR ANY WARRANTY 		*/
+/*    OTHERWISE ARISING OUT OF ANY PROPOSAL, SPECIFICATION OR SAMPLE.		*/
+/*										*/
+/*  - Without limitation, TCG and its members and licensors disclaim all 	*/
+/*    liability, including liability for infringement of any proprietary 	*/
+/*    rights, relating to use of information in this specification and to the	*/
+/*    implementation of this specification, and TCG disclaims all liability for	*/
+/*    cost of procurement of substitute goods or services, lost profits, loss 	*/
+/*    of use, loss of data or any incidental, consequential, direct, indirect, 	*/
+/*    or special damages, whether under contract, tort, warranty or otherwise, 	*/
+/*    arising in any way out of use or reliance upon this specification or any 	*/
+/*    information herein.							*/
+/*										*/
+/*  (c) Copyright IBM Corp. and others, 2016 - 2026				*/
+/*										*/
+/********************************************************************************/
+
+/* C.17 TracePlat.c */
+/* C.17.2. Description */
+/* This file keeps a binary trace of the commands executed by the TPM in a ring in memory. For each
+   command it records the command code, the handles and sessions, the locality, the response code,
+   the sizes, and the start time and duration. Optionally the first TRACE_PAYLOAD_SIZE bytes of the
+   command and of the response are kept as well. Recording is a few stores and two clock reads, so
+   the trace can be left on under load. */
+/* The ring is written to a file when the process exits and, on POSIX, when the process receives
+   SIGUSR1. TraceDecode turns the file into text. */
+/* The TPM is single threaded, so there is one writer. A record is marked invalid while it is being
+   written, so a dump that interrupts the writer skips that record. */
+/* C.17.3. Includes and locals */
+#include <stdlib.h>
+#include <string.h>
+#ifdef TPM_POSIX
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#else
+#include <stdio.h>
+#endif
+#include "Platform.h"
+#include "TracePlat.h"
+
+#ifdef __GNUC__
+// keep the stores to a record on the right side of its sequence number as seen by a signal handler
+#define TRACE_BARRIER()     __atomic_signal_fence(__ATOMIC_SEQ_CST)
+#else
+#define TRACE_BARRIER()
+#endif
+
+static struct
+{
+    TRACE_RECORD        *records;
+    unsigned char       *payload;       // recordCount * 2 * payloadSize bytes
+    uint32_t             recordCount;
+    uint32_t             payloadSize;
+    volatile uint64_t    next;
+    const char          *fileName;
+} s_trace;
+
+/* C.17.4. Functions */
+/* C.17.4.1. TraceWrite() */
+/* This function writes the trace file. On POSIX it only uses calls that are safe in a signal
+   handler. */
+static int
+TraceWrite(
+	   void
+	   )
+{
+    TRACE_FILE_HEADER    header;
+    size_t               recordBytes = (size_t)s_trace.recordCount * sizeof(TRACE_RECORD);
+    size_t               payloadBytes = (size_t)s_trace.recordCount * 2 * s_trace.payloadSize;
+    int                  ok;
+
+    memset(&header, 0, sizeof(header));
+    header.magic = TRACE_FILE_MAGIC;
+    header.version = TRACE_FILE_VERSION;
+    header.recordCount = s_trace.recordCount;
+    header.payloadSize = s_trace.payloadSize;
+    header.recordSize = sizeof(TRACE_RECORD);
+    header.next = s_trace.next;
+#ifdef TPM_POSIX
+    {
+	int fd = open(s_trace.fileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(fd < 0)
+	    return -1;
+	ok = write(fd, &header, sizeof(header)) == (ssize_t)sizeof(header)
+	     && write(fd, s_trace.records, recordBytes) == (ssize_t)recordBytes
+	     && (payloadBytes == 0
+		 || write(fd, s_trace.payload, payloadBytes) == (ssize_t)payloadBytes);
+	close(fd);
+    }
+#else
+    {
+	FILE *f = fopen(s_trace.fileName, "wb");
+	if(f == NULL)
+	    return -1;
+	ok = fwrite(&header, sizeof(header), 1, f) == 1
+	     && fwrite(s_trace.records, recordBytes, 1, f) == 1
+	     && (payloadBytes == 0 || fwrite(s_trace.payload, payloadBytes, 1, f) == 1);
+	fclose(f);
+    }
+#endif
+    return ok ? 0 : -1;
+}
+/* C.17.4.2. TraceAtExit() */
+static void
+TraceAtExit(
+	    void
+	    )
+{
+    TraceWrite();
+}
+#ifdef TPM_POSIX
+/* C.17.4.3. TraceSignal() */
+static void
+TraceSignal(
+	    int              sig
+	    )
+{
+    int                  savedErrno = errno;
+    NOT_REFERENCED(sig);
+    TraceWrite();
+    errno = savedErrno;
+}
+#endif
+/* C.17.4.4. _plat__TraceEnable() */
+/* This function starts recording commands in a ring of recordCount records (TRACE_DEFAULT_RECORDS
+   if 0). If payload is not 0, the start of each command and response is kept too. The ring is
+   written to fileName at exit and, on POSIX, on SIGUSR1. Tracing can only be enabled once. */
+/* Return Values Meaning */
+/* 0 success */
+/* != 0 already enabled or allocation failure */
+LIB_EXPORT int
+_plat__TraceEnable(
+		   const char      *fileName,
+		   uint32_t         recordCount,
+		   int              payload
+		   )
+{
+    if(s_trace.records != NULL)
+	return -1;
+    if(recordCount == 0)
+	recordCount = TRACE_DEFAULT_RECORDS;
+    s_trace.payloadSize = payload ? TRACE_PAYLOAD_SIZE : 0;
+    s_trace.records = calloc(recordCount, sizeof(TRACE_RECORD));
+    if(s_trace.payloadSize != 0)
+	s_trace.payload = calloc(recordCount, 2 * s_trace.payloadSize);
+    if(s_trace.records == NULL || (s_trace.payloadSize != 0 && s_trace.payload == NULL))
+	{
+	    free(s_trace.records);
+	    free(s_trace.payload);
+	    memset(&s_trace, 0, sizeof(s_trace));
+	    return -1;
+	}
+    s_trace.recordCount = recordCount;
+    s_trace.fileName = fileName;
+    atexit(TraceAtExit);
+#ifdef TPM_POSIX
+    {
+	struct sigaction     sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = TraceSignal;
+	sa.sa_flags = SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGUSR1, &sa, NULL);
+    }
+#endif
+    return 0;
+}
+/* C.17.4.5. _plat__TraceDump() */
+/* This function writes the trace file now. */
+/* Return Values Meaning */
+/* 0 success */
+/* != 0 tracing is not enabled or the file could not be written */
+LIB_EXPORT int
+_plat__TraceDump(
+		 void
+		 )
+{
+    if(s_trace.records == NULL)
+	return -1;
+    return TraceWrite();
+}
+/* C.17.4.6. _plat__TraceCommandStart() */
+/* This function is called when a command arrives. It returns the start time that is passed to
+   _plat__TraceCommandEnd(), or 0 when tracing is off. The command bytes are kept now, because the
+   TPM may decrypt the command in place and the response may be built over it. */
+LIB_EXPORT uint64_t
+_plat__TraceCommandStart(
+			 uint32_t              requestSize,
+			 const unsigned char  *request
+			 )
+{
+    TRACE_RECORD        *record;
+    uint32_t             index;
+
+    if(s_trace.records == NULL)
+	return 0;
+    index = (uint32_t)(s_trace.next % s_trace.recordCount);
+    record = &s_trace.records[index];
+    record->sequence = 0;
+    TRACE_BARRIER();
+    record->commandCaptured = 0;
+    if(s_trace.payloadSize != 0)
+	{
+	    record->commandCaptured = (uint16_t)MIN(requestSize, s_trace.payloadSize);
+	    memcpy(&s_trace.payload[(size_t)index * 2 * s_trace.payloadSize], request,
+		   record->commandCaptured);
+	}
+    return _plat__StatsTime();
+}
+/* C.17.4.7. _plat__TraceCommandEnd() */
+/* This function completes the record of a command when its response is ready. */
+LIB_EXPORT void
+_plat__TraceCommandEnd(
+		       uint64_t              startTime,
+		       uint32_t              commandCode,
+		       uint32_t              responseCode,
+		       uint32_t              handleNum,
+		       const uint32_t       *handles,
+		       uint32_t              sessionNum,
+		       const uint32_t       *sessions,
+		       uint32_t              requestSize,
+		       uint32_t              responseSize,
+		       const unsigned char  *response,
+		       uint32_t              responseHandle
+		       )
+{
+    TRACE_RECORD        *record;
+    uint32_t             index;
+    uint32_t             i;
+
+    if(s_trace.records == NULL || startTime == 0)
+	return;
+    index = (uint32_t)(s_trace.next % s_trace.recordCount);
+    record = &s_trace.records[index];
+    record->startTime = startTime;
+    record->duration = (uint32_t)MIN(_plat__StatsTime() - startTime, 0xffffffff);
+    record->commandCode = commandCode;
+    record->responseCode = responseCode;
+    record->commandSize = requestSize;
+    record->responseSize = responseSize;
+    record->responseHandle = responseHandle;
+    record->locality = _plat__LocalityGet();
+    record->handleNum = (uint8_t)MIN(handleNum, TRACE_MAX_HANDLES);
+    for(i = 0; i < record->handleNum; i++)
+	record->handles[i] = handles[i];
+    record->sessionNum = (uint8_t)MIN(sessionNum, TRACE_MAX_SESSIONS);
+    for(i = 0; i < record->sessionNum; i++)
+	record->sessions[i] = sessions[i];
+    record->responseCaptured = 0;
+    if(s_trace.payloadSize != 0)
+	{
+	    record->responseCaptured = (uint16_t)MIN(responseSize, s_trace.payloadSize);
+	    memcpy(&s_trace.payload[((size_t)index * 2 + 1) * s_trace.payloadSize], response,
+		   record->responseCaptured);
+	}
+    TRACE_BARRIER();
+    record->sequence = s_trace.next + 1;
+    s_trace.next++;
+}
@@ -0,0 +1,114 @@
+/********************************************************************************/
+/*										*/
+/*			Command trace record format				*/
+/*            $Id: TracePlat.h $						*/
+/*										*/
+/*  Licenses and Notices							*/
+/*										*/
+/*  1. Copyright Licenses:							*/
+/*										*/
+/*  - Trusted Computing Group (TCG) grants to the user of the source code in	*/
+/*    this specification (the "Source Code") a worldwide, irrevocable, 		*/
+/*    nonexclusive, royalty free, copyright license to reproduce, create 	*/
+/*    derivative works, distribute, display and perform the Source Code and	*/
+/*    derivative works thereof, and to grant others the rights granted herein.	*/
+/*										*/
+/*  - The TCG grants to the user of the other parts of the specification 	*/
+/*    (other than the Source Code) the rights to reproduce, distribute, 	*/
+/*    display, and perform the specification solely for the purpose of 		*/
+/*    developing products based on such documents.				*/
+/*										*/
+/*  2. Source Code Distribution Conditions:					*/
+/*										*/
+/*  - Redistributions of Source Code must retain the above copyright licenses, 	*/
+/*    this list of conditions and the following disclaimers.			*/
+/*										*/
+/*  - Redistributions in binary form must reproduce the above copyright 	*/
+/*    licenses, this list of conditions	and the following disclaimers in the 	*/
+/*    documentation and/or other materials provided with the distribution.	*/
+/*										*/
+/*  3. Disclaimers:								*/
+/*										*/
+/*  - THE COPYRIGHT LICENSES SET FORTH ABOVE DO NOT REPRESENT ANY FORM OF	*/
+/*  LICENSE OR WAIVER, EXPRESS OR IMPLIED, BY ESTOPPEL OR OTHERWISE, WITH	*/
+/*  RESPECT TO PATENT RIGHTS HELD BY TCG MEMBERS (OR OTHER THIRD PARTIES)	*/
+/*  THAT MAY BE NECESSARY TO IMPLEMENT THIS SPECIFICATION OR OTHERWISE.		*/
+/*  Contact TCG Administration (admin@trustedcomputinggroup.org) for 		*/
+/*  information on specification licensing rights available through TCG 	*/
+/*  membership agreements.							*/
+/*										*/
+/*  - THIS SPECIFICATION IS PROVIDED "AS IS" WITH NO EXPRESS OR IMPLIED 	*/
+/*    WARRANTIES WHATSOEVER, INCLUDING ANY WARRANTY OF MERCHANTABILITY OR 	*/
+/*    FITNESS FOR A PARTICULAR PURPOSE, ACCURACY, COMPLETENESS, OR 		*/
+/*    NONINFRINGEMENT OF INTELLECTUAL PROPERTY RIGHTS, OR ANY WARRANTY 		*/
+/*    OTHERWISE ARISING OUT OF ANY PROPOSAL, SPECIFICATION OR SAMPLE.		*/
+/*										*/
+/*  - Without limitation, TCG and its members and licensors disclaim all 	*/
+/*    liability, including liability for infringement of any proprietary 	*/
+/*    rights, relating to use of information in this specification and to the	*/
+/*    implementation of this specification, and TCG disclaims all liability for	*/
+/*    cost of procurement of substitute goods or services, lost profits, loss 	*/
+/*    of use, loss of data or any incidental, consequential, direct, indirect, 	*/
+/*    or special damages, whether under contract, tort, warranty or otherwise, 	*/
+/*    arising in any way out of use or reliance upon this specification or any 	*/
+/*    information herein.							*/
+/*										*/
+/*  (c) Copyright IBM Corp. and others, 2016 - 2026				*/
+/*										*/
+/********************************************************************************/
+
+/* C.17.1 TracePlat.h */
+/* This file describes the binary command trace kept by TracePlat.c and the file that it is dumped
+   to. The trace is decoded offline by TraceDecode. */
+
+#ifndef TRACEPLAT_H
+#define TRACEPLAT_H
+
+#include <stdint.h>
+
+#define TRACE_FILE_MAGIC        0x54504d54      // "TPMT"
+#define TRACE_FILE_VERSION      1
+#define TRACE_MAX_HANDLES       3
+#define TRACE_MAX_SESSIONS      3
+// Trace file written by the simulator -v option
+#define TRACE_DEFAULT_FILE      "trace.bin"
+// Default number of commands kept in the ring
+#define TRACE_DEFAULT_RECORDS   16384
+// Number of command and of response bytes kept per record when payload capture is on
+#define TRACE_PAYLOAD_SIZE      256
+
+typedef struct
+{
+    uint64_t         sequence;          // 1 for the first command traced, 0 while being written
+    uint64_t         startTime;         // ns, monotonic
+    uint32_t         duration;          // ns
+    uint32_t         commandCode;
+    uint32_t         responseCode;
+    uint32_t         commandSize;
+    uint32_t         responseSize;
+    uint32_t         responseHandle;    // 0 if the response has no handle
+    uint32_t         handles[TRACE_MAX_HANDLES];
+    uint32_t         sessions[TRACE_MAX_SESSIONS];
+    uint8_t          locality;
+    uint8_t          handleNum;
+    uint8_t          sessionNum;
+    uint8_t          reserved;
+    uint16_t         commandCaptured;   // payload bytes kept
+    uint16_t         responseCaptured;
+} TRACE_RECORD;
+
+/* The dump file is the header, then recordCount TRACE_RECORDs, then, if payloadSize is not 0,
+   recordCount payload areas of payloadSize command bytes followed by payloadSize response
+   bytes. Record i holds sequence numbers that are i modulo recordCount. */
+typedef struct
+{
+    uint32_t         magic;
+    uint32_t         version;
+    uint32_t         recordCount;
+    uint32_t         payloadSize;
+    uint32_t         recordSize;
+    uint32_t         reserved;
+    uint64_t         next;              // sequence number of the next command
+} TRACE_FILE_HEADER;
+
+#endif  // TRACEPLAT_H
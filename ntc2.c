@@ -44,7 +44,7 @@
 
 /* config state has some required or default values */
 
-static NTC2_CFG_STRUCT ntc2state = {
+static NTC2_CFG_STRUCT ntc2state INSTANCE_STATE = {
     .i2cLoc1_2  =	0xff,
     .i2cLoc3_4  =	0xff,
     .AltCfg 	= 	0x13,
@@ -90,3 +90,112 @@ NTC2_GetConfig(NTC2_GetConfig_Out *out)
     out->preConfig = ntc2state;
     return TPM_RC_SUCCESS;
 }
+
+/* The stream commands are an emulator extension rather than Nuvoton commands.  They run a
+   TPM2_EncryptDecrypt2 style operation over a data stream without the per command
+   TPM2B_MAX_BUFFER limit.
+
+   NTC2_EncryptDecryptStart() checks the key as TPM2_EncryptDecrypt2 does and copies it, the
+   direction, the mode, and the IV into a sequence object with its own authValue, as
+   TPM2_HMAC_Start() does.  NTC2_EncryptDecryptUpdate() then encrypts or decrypts the next part of
+   the stream and returns the chained IV.  The sequence is ended with TPM2_FlushContext().
+
+   The IV only chains across whole blocks.  An update that is not a multiple of the block size
+   must be the last one.
+*/
+
+TPM_RC
+NTC2_EncryptDecryptStart(NTC2_EncryptDecryptStart_In *in,
+			 NTC2_EncryptDecryptStart_Out *out)
+{
+    OBJECT		*symKey;
+    TPMT_SYM_DEF_OBJECT	*sym;
+    TPM_ALG_ID		mode;
+    UINT16		blockSize;
+    BOOL		OK;
+
+    // Input Validation
+    symKey = HandleToObject(in->keyHandle);
+    sym = &symKey->publicArea.parameters.symDetail.sym;
+    mode = sym->mode.sym;
+    /* the key must be a symmetric key */
+    if (symKey->publicArea.type != TPM_ALG_SYMCIPHER) {
+	return TPM_RCS_KEY + RC_NTC2_EncryptDecryptStart_keyHandle;
+    }
+    /* the key must be unrestricted and allow the selected operation */
+    OK = !IS_ATTRIBUTE(symKey->publicArea.objectAttributes, TPMA_OBJECT, restricted);
+    if (in->decrypt == YES) {
+	OK = OK && IS_ATTRIBUTE(symKey->publicArea.objectAttributes, TPMA_OBJECT, decrypt);
+    }
+    else {
+	OK = OK && IS_ATTRIBUTE(symKey->publicArea.objectAttributes, TPMA_OBJECT, sign);
+    }
+    if (!OK) {
+	return TPM_RCS_ATTRIBUTES + RC_NTC2_EncryptDecryptStart_keyHandle;
+    }
+    /* the key must be an encrypt/decrypt key and not SMAC */
+    if (!CryptSymModeIsValid(mode, TRUE)) {
+	return TPM_RCS_MODE + RC_NTC2_EncryptDecryptStart_keyHandle;
+    }
+    /* a key mode other than TPM_ALG_NULL must match the input mode, and a TPM_ALG_NULL key mode
+       needs an input mode */
+    if (mode != TPM_ALG_NULL) {
+	if ((in->mode != TPM_ALG_NULL) && (in->mode != mode)) {
+	    return TPM_RCS_MODE + RC_NTC2_EncryptDecryptStart_mode;
+	}
+    }
+    else {
+	if (in->mode == TPM_ALG_NULL) {
+	    return TPM_RCS_MODE + RC_NTC2_EncryptDecryptStart_mode;
+	}
+	mode = in->mode;
+    }
+    /* ECB takes an Empty Buffer IV, the other modes an IV of the block size */
+    blockSize = CryptGetSymmetricBlockSize(sym->algorithm, sym->keyBits.sym);
+    if (blockSize == 0) {
+	return TPM_RCS_KEY + RC_NTC2_EncryptDecryptStart_keyHandle;
+    }
+    if (((mode == TPM_ALG_ECB) && (in->ivIn.t.size != 0)) ||
+	((mode != TPM_ALG_ECB) && (in->ivIn.t.size != blockSize))) {
+	return TPM_RCS_SIZE + RC_NTC2_EncryptDecryptStart_ivIn;
+    }
+    // Internal Data Update
+    return ObjectCreateSymSequence(symKey, in->decrypt, mode, &in->ivIn, &in->auth,
+				   &out->sequenceHandle);
+}
+
+TPM_RC
+NTC2_EncryptDecryptUpdate(NTC2_EncryptDecryptUpdate_In *in,
+			  NTC2_EncryptDecryptUpdate_Out *out)
+{
+    TPM_RC		rc = TPM_RC_SUCCESS;
+    HASH_OBJECT		*sequence;
+    SYM_SEQUENCE_STATE	*state;
+    UINT16		blockSize;
+    BOOL		partial;
+
+    // Input Validation
+    sequence = (HASH_OBJECT *)HandleToObject(in->sequenceHandle);
+    if (sequence->attributes.symSeq == CLEAR) {
+	return TPM_RCS_MODE + RC_NTC2_EncryptDecryptUpdate_sequenceHandle;
+    }
+    state = &sequence->state.symState;
+    blockSize = CryptGetSymmetricBlockSize(state->sym.algorithm, state->sym.keyBits.sym);
+    partial = (in->inData.t.size % blockSize) != 0;
+    /* after a partial block the IV no longer lines up with the stream, and CBC and ECB only
+       take whole blocks */
+    if (state->closed ||
+	(partial &&
+	 ((state->sym.mode.sym == TPM_ALG_CBC) || (state->sym.mode.sym == TPM_ALG_ECB)))) {
+	return TPM_RCS_SIZE + RC_NTC2_EncryptDecryptUpdate_inData;
+    }
+    // Command Output
+    out->outData.t.size = in->inData.t.size;
+    rc = CryptSymmetricSequenceUpdate(out->outData.t.buffer, sequence,
+				      in->inData.t.size, in->inData.t.buffer);
+    if (rc == TPM_RC_SUCCESS) {
+	state->closed = partial;
+	out->ivOut = state->iv;
+    }
+    return rc;
+}
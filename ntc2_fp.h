@@ -48,6 +48,12 @@ TPM_RC
 NTC2_LockPreConfig(void);
 TPM_RC
 NTC2_GetConfig(NTC2_GetConfig_Out *out);
+TPM_RC
+NTC2_EncryptDecryptStart(NTC2_EncryptDecryptStart_In *in,
+			 NTC2_EncryptDecryptStart_Out *out);
+TPM_RC
+NTC2_EncryptDecryptUpdate(NTC2_EncryptDecryptUpdate_In *in,
+			  NTC2_EncryptDecryptUpdate_Out *out);
 
 
 #endif
@@ -70,3 +70,21 @@ NTC2_CFG_STRUCT_Marshal(NTC2_CFG_STRUCT *source, BYTE **buffer, INT32 *size)
     return written;
 }
 
+TPM_RC
+NTC2_STREAM_BUFFER_Unmarshal(NTC2_STREAM_BUFFER *target, BYTE **buffer, INT32 *size)
+{
+    TPM_RC rc = TPM_RC_SUCCESS;
+
+    if (rc == TPM_RC_SUCCESS) {
+	rc = TPM2B_Unmarshal(&target->b, NTC2_MAX_STREAM_BUFFER, buffer, size);
+    }
+    return rc;
+}
+
+UINT16
+NTC2_STREAM_BUFFER_Marshal(NTC2_STREAM_BUFFER *source, BYTE **buffer, INT32 *size)
+{
+    UINT16 written = 0;
+    written += TPM2B_Marshal(&source->b, buffer, size);
+    return written;
+}
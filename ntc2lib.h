@@ -75,11 +75,60 @@ typedef struct {
     NTC2_CFG_STRUCT preConfig;
 } NTC2_GetConfig_Out;     
 
+/* The stream commands carry up to NTC2_MAX_STREAM_BUFFER bytes of data in each direction. This
+   leaves 1024 bytes of MAX_COMMAND_SIZE and MAX_RESPONSE_SIZE for the header, handle, IV, and up
+   to three sessions. */
+
+#define NTC2_MAX_STREAM_BUFFER	(MAX_COMMAND_SIZE - 1024)
+
+typedef union {
+    struct {
+	UINT16			size;
+	BYTE			buffer[NTC2_MAX_STREAM_BUFFER];
+    }            t;
+    TPM2B        b;
+} NTC2_STREAM_BUFFER;
+
+typedef struct {
+    TPMI_DH_OBJECT		keyHandle;
+    TPM2B_AUTH			auth;
+    TPMI_YES_NO			decrypt;
+    TPMI_ALG_CIPHER_MODE	mode;
+    TPM2B_IV			ivIn;
+} NTC2_EncryptDecryptStart_In;
+
+#define RC_NTC2_EncryptDecryptStart_keyHandle	(TPM_RC_H + TPM_RC_1)
+#define RC_NTC2_EncryptDecryptStart_auth	(TPM_RC_P + TPM_RC_1)
+#define RC_NTC2_EncryptDecryptStart_decrypt	(TPM_RC_P + TPM_RC_2)
+#define RC_NTC2_EncryptDecryptStart_mode	(TPM_RC_P + TPM_RC_3)
+#define RC_NTC2_EncryptDecryptStart_ivIn	(TPM_RC_P + TPM_RC_4)
+
+typedef struct {
+    TPMI_DH_OBJECT		sequenceHandle;
+} NTC2_EncryptDecryptStart_Out;
+
+typedef struct {
+    TPMI_DH_OBJECT		sequenceHandle;
+    NTC2_STREAM_BUFFER		inData;
+} NTC2_EncryptDecryptUpdate_In;
+
+#define RC_NTC2_EncryptDecryptUpdate_sequenceHandle	(TPM_RC_H + TPM_RC_1)
+#define RC_NTC2_EncryptDecryptUpdate_inData		(TPM_RC_P + TPM_RC_1)
+
+typedef struct {
+    NTC2_STREAM_BUFFER		outData;
+    TPM2B_IV			ivOut;
+} NTC2_EncryptDecryptUpdate_Out;
+
 
 TPM_RC
 NTC2_CFG_STRUCT_Unmarshal(NTC2_CFG_STRUCT *target, BYTE **buffer, INT32 *size);
 UINT16
 NTC2_CFG_STRUCT_Marshal(NTC2_CFG_STRUCT *source, BYTE **buffer, INT32 *size);
+TPM_RC
+NTC2_STREAM_BUFFER_Unmarshal(NTC2_STREAM_BUFFER *target, BYTE **buffer, INT32 *size);
+UINT16
+NTC2_STREAM_BUFFER_Marshal(NTC2_STREAM_BUFFER *source, BYTE **buffer, INT32 *size);
 
 
 #endif
@@ -14,18 +14,18 @@
 /*
  * 32-bit integer manipulation macros (big endian)
  */
-#ifndef GET_ULONG_BE
-#define GET_ULONG_BE(n,b,i)                             \
+#ifndef GET_UINT32_BE
+#define GET_UINT32_BE(n,b,i)                            \
 {                                                       \
-    (n) = ( (unsigned long) (b)[(i)    ] << 24 )        \
-        | ( (unsigned long) (b)[(i) + 1] << 16 )        \
-        | ( (unsigned long) (b)[(i) + 2] <<  8 )        \
-        | ( (unsigned long) (b)[(i) + 3]       );       \
+    (n) = ( (uint32_t) (b)[(i)    ] << 24 )             \
+        | ( (uint32_t) (b)[(i) + 1] << 16 )             \
+        | ( (uint32_t) (b)[(i) + 2] <<  8 )             \
+        | ( (uint32_t) (b)[(i) + 3]       );            \
 }
 #endif
 
-#ifndef PUT_ULONG_BE
-#define PUT_ULONG_BE(n,b,i)                             \
+#ifndef PUT_UINT32_BE
+#define PUT_UINT32_BE(n,b,i)                            \
 {                                                       \
     (b)[(i)    ] = (unsigned char) ( (n) >> 24 );       \
     (b)[(i) + 1] = (unsigned char) ( (n) >> 16 );       \
@@ -53,64 +53,94 @@ void sm3_starts( sm3_context *ctx )
 
 }
 
-static void sm3_process( sm3_context *ctx, unsigned char data[64] )
+/*
+ * Round constants T(j) already rotated left by (j mod 32), so the
+ * compression function needs no per-round rotation of the constant
+ */
+static const uint32_t SM3_T[64] =
 {
-    unsigned long SS1, SS2, TT1, TT2, W[68],W1[64];
-    unsigned long A, B, C, D, E, F, G, H;
-	unsigned long T[64];
-	unsigned long Temp1,Temp2,Temp3,Temp4,Temp5;
-	int j;
-
-	for(j = 0; j < 16; j++)
-		T[j] = 0x79CC4519;
-	for(j =16; j < 64; j++)
-		T[j] = 0x7A879D8A;
-
-    GET_ULONG_BE( W[ 0], data,  0 );
-    GET_ULONG_BE( W[ 1], data,  4 );
-    GET_ULONG_BE( W[ 2], data,  8 );
-    GET_ULONG_BE( W[ 3], data, 12 );
-    GET_ULONG_BE( W[ 4], data, 16 );
-    GET_ULONG_BE( W[ 5], data, 20 );
-    GET_ULONG_BE( W[ 6], data, 24 );
-    GET_ULONG_BE( W[ 7], data, 28 );
-    GET_ULONG_BE( W[ 8], data, 32 );
-    GET_ULONG_BE( W[ 9], data, 36 );
-    GET_ULONG_BE( W[10], data, 40 );
-    GET_ULONG_BE( W[11], data, 44 );
-    GET_ULONG_BE( W[12], data, 48 );
-    GET_ULONG_BE( W[13], data, 52 );
-    GET_ULONG_BE( W[14], data, 56 );
-    GET_ULONG_BE( W[15], data, 60 );
-
-#define FF0(x,y,z) ( (x) ^ (y) ^ (z))
-#define FF1(x,y,z) (((x) & (y)) | ( (x) & (z)) | ( (y) & (z)))
-
-#define GG0(x,y,z) ( (x) ^ (y) ^ (z))
-#define GG1(x,y,z) (((x) & (y)) | ( (~(x)) & (z)) )
-
-
-#define  SHL(x,n) (((x) & 0xFFFFFFFF) << n)
-#define ROTL(x,n) (SHL((x),n) | ((x) >> (32 - n)))
-
-#define P0(x) ((x) ^  ROTL((x),9) ^ ROTL((x),17))
-#define P1(x) ((x) ^  ROTL((x),15) ^ ROTL((x),23))
-
-	for(j = 16; j < 68; j++ )
-	{
-		Temp1 = W[j-16] ^ W[j-9];
-		Temp2 = ROTL(W[j-3],15);
-		Temp3 = Temp1 ^ Temp2;
-		Temp4 = P1(Temp3);
-		Temp5 =  ROTL(W[j - 13],7 ) ^ W[j-6];
-		W[j] = Temp4 ^ Temp5;
-	}
-
-	for(j =  0; j < 64; j++)
-	{
-        W1[j] = W[j] ^ W[j+4];
-	}
+    0x79CC4519, 0xF3988A32, 0xE7311465, 0xCE6228CB,
+    0x9CC45197, 0x3988A32F, 0x7311465E, 0xE6228CBC,
+    0xCC451979, 0x988A32F3, 0x311465E7, 0x6228CBCE,
+    0xC451979C, 0x88A32F39, 0x11465E73, 0x228CBCE6,
+    0x9D8A7A87, 0x3B14F50F, 0x7629EA1E, 0xEC53D43C,
+    0xD8A7A879, 0xB14F50F3, 0x629EA1E7, 0xC53D43CE,
+    0x8A7A879D, 0x14F50F3B, 0x29EA1E76, 0x53D43CEC,
+    0xA7A879D8, 0x4F50F3B1, 0x9EA1E762, 0x3D43CEC5,
+    0x7A879D8A, 0xF50F3B14, 0xEA1E7629, 0xD43CEC53,
+    0xA879D8A7, 0x50F3B14F, 0xA1E7629E, 0x43CEC53D,
+    0x879D8A7A, 0x0F3B14F5, 0x1E7629EA, 0x3CEC53D4,
+    0x79D8A7A8, 0xF3B14F50, 0xE7629EA1, 0xCEC53D43,
+    0x9D8A7A87, 0x3B14F50F, 0x7629EA1E, 0xEC53D43C,
+    0xD8A7A879, 0xB14F50F3, 0x629EA1E7, 0xC53D43CE,
+    0x8A7A879D, 0x14F50F3B, 0x29EA1E76, 0x53D43CEC,
+    0xA7A879D8, 0x4F50F3B1, 0x9EA1E762, 0x3D43CEC5
+};
+
+#define FF0(x,y,z) ( (x) ^ (y) ^ (z) )
+#define FF1(x,y,z) ( ( (x) & (y) ) | ( ( (x) | (y) ) & (z) ) )
+
+#define GG0(x,y,z) ( (x) ^ (y) ^ (z) )
+#define GG1(x,y,z) ( ( ( (y) ^ (z) ) & (x) ) ^ (z) )
+
+#define ROTL(x,n) ( ( (x) << (n) ) | ( (x) >> (32 - (n)) ) )
+
+#define P0(x) ( (x) ^ ROTL((x),  9) ^ ROTL((x), 17) )
+#define P1(x) ( (x) ^ ROTL((x), 15) ^ ROTL((x), 23) )
+
+/*
+ * W[j+16] from the 16 word window, computed in place of W[j]
+ */
+#define EXPAND(W0,W7,W13,W3,W10)                                \
+    ( P1( (W0) ^ (W7) ^ ROTL((W13), 15) ) ^ ROTL((W3), 7) ^ (W10) )
+
+/*
+ * One round.  Instead of shifting the eight working words, the callers
+ * rotate the argument order by one position per round, so only the
+ * words that actually change are written: B and F are rotated in place,
+ * D receives the new A and H receives the new E.  W1[j] = W[j] ^ W[j+4]
+ * is formed from the two window words.
+ */
+#define ROUND(FF,GG,A,B,C,D,E,F,G,H,Tj,Wj,Wj4)                   \
+{                                                               \
+    uint32_t A12 = ROTL((A), 12);                               \
+    uint32_t SS1 = ROTL(A12 + (E) + (Tj), 7);                   \
+    uint32_t TT1 = FF((A),(B),(C)) + (D) + (SS1 ^ A12)          \
+                 + ((Wj) ^ (Wj4));                              \
+    uint32_t TT2 = GG((E),(F),(G)) + (H) + SS1 + (Wj);          \
+    (B) = ROTL((B), 9);                                         \
+    (D) = TT1;                                                  \
+    (F) = ROTL((F), 19);                                        \
+    (H) = P0(TT2);                                              \
+}
 
+#define R1(A,B,C,D,E,F,G,H,Tj,Wj,Wj4)                           \
+    ROUND(FF0,GG0,A,B,C,D,E,F,G,H,Tj,Wj,Wj4)
+#define R2(A,B,C,D,E,F,G,H,Tj,Wj,Wj4)                           \
+    ROUND(FF1,GG1,A,B,C,D,E,F,G,H,Tj,Wj,Wj4)
+
+static void sm3_process( sm3_context *ctx, const unsigned char data[64] )
+{
+    uint32_t A, B, C, D, E, F, G, H;
+    uint32_t W00, W01, W02, W03, W04, W05, W06, W07;
+    uint32_t W08, W09, W10, W11, W12, W13, W14, W15;
+
+    GET_UINT32_BE( W00, data,  0 );
+    GET_UINT32_BE( W01, data,  4 );
+    GET_UINT32_BE( W02, data,  8 );
+    GET_UINT32_BE( W03, data, 12 );
+    GET_UINT32_BE( W04, data, 16 );
+    GET_UINT32_BE( W05, data, 20 );
+    GET_UINT32_BE( W06, data, 24 );
+    GET_UINT32_BE( W07, data, 28 );
+    GET_UINT32_BE( W08, data, 32 );
+    GET_UINT32_BE( W09, data, 36 );
+    GET_UINT32_BE( W10, data, 40 );
+    GET_UINT32_BE( W11, data, 44 );
+    GET_UINT32_BE( W12, data, 48 );
+    GET_UINT32_BE( W13, data, 52 );
+    GET_UINT32_BE( W14, data, 56 );
+    GET_UINT32_BE( W15, data, 60 );
 
     A = ctx->state[0];
     B = ctx->state[1];
@@ -121,37 +151,126 @@ static void sm3_process( sm3_context *ctx, unsigned char data[64] )
     G = ctx->state[6];
     H = ctx->state[7];
 
-	for(j =0; j < 16; j++)
-	{
-		SS1 = ROTL((ROTL(A,12) + E + ROTL(T[j],j)), 7);
-		SS2 = SS1 ^ ROTL(A,12);
-		TT1 = FF0(A,B,C) + D + SS2 + W1[j];
-		TT2 = GG0(E,F,G) + H + SS1 + W[j];
-		D = C;
-		C = ROTL(B,9);
-		B = A;
-		A = TT1;
-		H = G;
-		G = ROTL(F,19);
-		F = E;
-		E = P0(TT2);
-	}
-
-	for(j =16; j < 64; j++)
-	{
-		SS1 = ROTL((ROTL(A,12) + E + ROTL(T[j],j)), 7);
-		SS2 = SS1 ^ ROTL(A,12);
-		TT1 = FF1(A,B,C) + D + SS2 + W1[j];
-		TT2 = GG1(E,F,G) + H + SS1 + W[j];
-		D = C;
-		C = ROTL(B,9);
-		B = A;
-		A = TT1;
-		H = G;
-		G = ROTL(F,19);
-		F = E;
-		E = P0(TT2);
-	}
+    /*
+     * Rounds 0..51 each expand one new message word into the slot just
+     * consumed; rounds 52..63 only read W[52]..W[67]
+     */
+    R1( A, B, C, D, E, F, G, H, SM3_T[ 0], W00, W04 );
+    W00 = EXPAND( W00, W07, W13, W03, W10 );
+    R1( D, A, B, C, H, E, F, G, SM3_T[ 1], W01, W05 );
+    W01 = EXPAND( W01, W08, W14, W04, W11 );
+    R1( C, D, A, B, G, H, E, F, SM3_T[ 2], W02, W06 );
+    W02 = EXPAND( W02, W09, W15, W05, W12 );
+    R1( B, C, D, A, F, G, H, E, SM3_T[ 3], W03, W07 );
+    W03 = EXPAND( W03, W10, W00, W06, W13 );
+    R1( A, B, C, D, E, F, G, H, SM3_T[ 4], W04, W08 );
+    W04 = EXPAND( W04, W11, W01, W07, W14 );
+    R1( D, A, B, C, H, E, F, G, SM3_T[ 5], W05, W09 );
+    W05 = EXPAND( W05, W12, W02, W08, W15 );
+    R1( C, D, A, B, G, H, E, F, SM3_T[ 6], W06, W10 );
+    W06 = EXPAND( W06, W13, W03, W09, W00 );
+    R1( B, C, D, A, F, G, H, E, SM3_T[ 7], W07, W11 );
+    W07 = EXPAND( W07, W14, W04, W10, W01 );
+    R1( A, B, C, D, E, F, G, H, SM3_T[ 8], W08, W12 );
+    W08 = EXPAND( W08, W15, W05, W11, W02 );
+    R1( D, A, B, C, H, E, F, G, SM3_T[ 9], W09, W13 );
+    W09 = EXPAND( W09, W00, W06, W12, W03 );
+    R1( C, D, A, B, G, H, E, F, SM3_T[10], W10, W14 );
+    W10 = EXPAND( W10, W01, W07, W13, W04 );
+    R1( B, C, D, A, F, G, H, E, SM3_T[11], W11, W15 );
+    W11 = EXPAND( W11, W02, W08, W14, W05 );
+    R1( A, B, C, D, E, F, G, H, SM3_T[12], W12, W00 );
+    W12 = EXPAND( W12, W03, W09, W15, W06 );
+    R1( D, A, B, C, H, E, F, G, SM3_T[13], W13, W01 );
+    W13 = EXPAND( W13, W04, W10, W00, W07 );
+    R1( C, D, A, B, G, H, E, F, SM3_T[14], W14, W02 );
+    W14 = EXPAND( W14, W05, W11, W01, W08 );
+    R1( B, C, D, A, F, G, H, E, SM3_T[15], W15, W03 );
+    W15 = EXPAND( W15, W06, W12, W02, W09 );
+    R2( A, B, C, D, E, F, G, H, SM3_T[16], W00, W04 );
+    W00 = EXPAND( W00, W07, W13, W03, W10 );
+    R2( D, A, B, C, H, E, F, G, SM3_T[17], W01, W05 );
+    W01 = EXPAND( W01, W08, W14, W04, W11 );
+    R2( C, D, A, B, G, H, E, F, SM3_T[18], W02, W06 );
+    W02 = EXPAND( W02, W09, W15, W05, W12 );
+    R2( B, C, D, A, F, G, H, E, SM3_T[19], W03, W07 );
+    W03 = EXPAND( W03, W10, W00, W06, W13 );
+    R2( A, B, C, D, E, F, G, H, SM3_T[20], W04, W08 );
+    W04 = EXPAND( W04, W11, W01, W07, W14 );
+    R2( D, A, B, C, H, E, F, G, SM3_T[21], W05, W09 );
+    W05 = EXPAND( W05, W12, W02, W08, W15 );
+    R2( C, D, A, B, G, H, E, F, SM3_T[22], W06, W10 );
+    W06 = EXPAND( W06, W13, W03, W09, W00 );
+    R2( B, C, D, A, F, G, H, E, SM3_T[23], W07, W11 );
+    W07 = EXPAND( W07, W14, W04, W10, W01 );
+    R2( A, B, C, D, E, F, G, H, SM3_T[24], W08, W12 );
+    W08 = EXPAND( W08, W15, W05, W11, W02 );
+    R2( D, A, B, C, H, E, F, G, SM3_T[25], W09, W13 );
+    W09 = EXPAND( W09, W00, W06, W12, W03 );
+    R2( C, D, A, B, G, H, E, F, SM3_T[26], W10, W14 );
+    W10 = EXPAND( W10, W01, W07, W13, W04 );
+    R2( B, C, D, A, F, G, H, E, SM3_T[27], W11, W15 );
+    W11 = EXPAND( W11, W02, W08, W14, W05 );
+    R2( A, B, C, D, E, F, G, H, SM3_T[28], W12, W00 );
+    W12 = EXPAND( W12, W03, W09, W15, W06 );
+    R2( D, A, B, C, H, E, F, G, SM3_T[29], W13, W01 );
+    W13 = EXPAND( W13, W04, W10, W00, W07 );
+    R2( C, D, A, B, G, H, E, F, SM3_T[30], W14, W02 );
+    W14 = EXPAND( W14, W05, W11, W01, W08 );
+    R2( B, C, D, A, F, G, H, E, SM3_T[31], W15, W03 );
+    W15 = EXPAND( W15, W06, W12, W02, W09 );
+    R2( A, B, C, D, E, F, G, H, SM3_T[32], W00, W04 );
+    W00 = EXPAND( W00, W07, W13, W03, W10 );
+    R2( D, A, B, C, H, E, F, G, SM3_T[33], W01, W05 );
+    W01 = EXPAND( W01, W08, W14, W04, W11 );
+    R2( C, D, A, B, G, H, E, F, SM3_T[34], W02, W06 );
+    W02 = EXPAND( W02, W09, W15, W05, W12 );
+    R2( B, C, D, A, F, G, H, E, SM3_T[35], W03, W07 );
+    W03 = EXPAND( W03, W10, W00, W06, W13 );
+    R2( A, B, C, D, E, F, G, H, SM3_T[36], W04, W08 );
+    W04 = EXPAND( W04, W11, W01, W07, W14 );
+    R2( D, A, B, C, H, E, F, G, SM3_T[37], W05, W09 );
+    W05 = EXPAND( W05, W12, W02, W08, W15 );
+    R2( C, D, A, B, G, H, E, F, SM3_T[38], W06, W10 );
+    W06 = EXPAND( W06, W13, W03, W09, W00 );
+    R2( B, C, D, A, F, G, H, E, SM3_T[39], W07, W11 );
+    W07 = EXPAND( W07, W14, W04, W10, W01 );
+    R2( A, B, C, D, E, F, G, H, SM3_T[40], W08, W12 );
+    W08 = EXPAND( W08, W15, W05, W11, W02 );
+    R2( D, A, B, C, H, E, F, G, SM3_T[41], W09, W13 );
+    W09 = EXPAND( W09, W00, W06, W12, W03 );
+    R2( C, D, A, B, G, H, E, F, SM3_T[42], W10, W14 );
+    W10 = EXPAND( W10, W01, W07, W13, W04 );
+    R2( B, C, D, A, F, G, H, E, SM3_T[43], W11, W15 );
+    W11 = EXPAND( W11, W02, W08, W14, W05 );
+    R2( A, B, C, D, E, F, G, H, SM3_T[44], W12, W00 );
+    W12 = EXPAND( W12, W03, W09, W15, W06 );
+    R2( D, A, B, C, H, E, F, G, SM3_T[45], W13, W01 );
+    W13 = EXPAND( W13, W04, W10, W00, W07 );
+    R2( C, D, A, B, G, H, E, F, SM3_T[46], W14, W02 );
+    W14 = EXPAND( W14, W05, W11, W01, W08 );
+    R2( B, C, D, A, F, G, H, E, SM3_T[47], W15, W03 );
+    W15 = EXPAND( W15, W06, W12, W02, W09 );
+    R2( A, B, C, D, E, F, G, H, SM3_T[48], W00, W04 );
+    W00 = EXPAND( W00, W07, W13, W03, W10 );
+    R2( D, A, B, C, H, E, F, G, SM3_T[49], W01, W05 );
+    W01 = EXPAND( W01, W08, W14, W04, W11 );
+    R2( C, D, A, B, G, H, E, F, SM3_T[50], W02, W06 );
+    W02 = EXPAND( W02, W09, W15, W05, W12 );
+    R2( B, C, D, A, F, G, H, E, SM3_T[51], W03, W07 );
+    W03 = EXPAND( W03, W10, W00, W06, W13 );
+    R2( A, B, C, D, E, F, G, H, SM3_T[52], W04, W08 );
+    R2( D, A, B, C, H, E, F, G, SM3_T[53], W05, W09 );
+    R2( C, D, A, B, G, H, E, F, SM3_T[54], W06, W10 );
+    R2( B, C, D, A, F, G, H, E, SM3_T[55], W07, W11 );
+    R2( A, B, C, D, E, F, G, H, SM3_T[56], W08, W12 );
+    R2( D, A, B, C, H, E, F, G, SM3_T[57], W09, W13 );
+    R2( C, D, A, B, G, H, E, F, SM3_T[58], W10, W14 );
+    R2( B, C, D, A, F, G, H, E, SM3_T[59], W11, W15 );
+    R2( A, B, C, D, E, F, G, H, SM3_T[60], W12, W00 );
+    R2( D, A, B, C, H, E, F, G, SM3_T[61], W13, W01 );
+    R2( C, D, A, B, G, H, E, F, SM3_T[62], W14, W02 );
+    R2( B, C, D, A, F, G, H, E, SM3_T[63], W15, W03 );
 
     ctx->state[0] ^= A;
     ctx->state[1] ^= B;
@@ -169,7 +288,7 @@ static void sm3_process( sm3_context *ctx, unsigned char data[64] )
 void sm3_update( sm3_context *ctx, unsigned char *input, int ilen )
 {
     int fill;
-    unsigned long left;
+    uint32_t left;
 
     if( ilen <= 0 )
         return;
@@ -177,10 +296,9 @@ void sm3_update( sm3_context *ctx, unsigned char *input, int ilen )
     left = ctx->total[0] & 0x3F;
     fill = 64 - left;
 
-    ctx->total[0] += ilen;
-    ctx->total[0] &= 0xFFFFFFFF;
+    ctx->total[0] += (uint32_t) ilen;
 
-    if( ctx->total[0] < (unsigned long) ilen )
+    if( ctx->total[0] < (uint32_t) ilen )
         ctx->total[1]++;
 
     if( left && ilen >= fill )
@@ -220,16 +338,16 @@ static const unsigned char sm3_padding[64] =
  */
 void sm3_finish(  sm3_context *ctx ,unsigned char* output )
 {
-    unsigned long last, padn;
-    unsigned long high, low;
+    uint32_t last, padn;
+    uint32_t high, low;
     unsigned char msglen[8];
 
     high = ( ctx->total[0] >> 29 )
          | ( ctx->total[1] <<  3 );
     low  = ( ctx->total[0] <<  3 );
 
-    PUT_ULONG_BE( high, msglen, 0 );
-    PUT_ULONG_BE( low,  msglen, 4 );
+    PUT_UINT32_BE( high, msglen, 0 );
+    PUT_UINT32_BE( low,  msglen, 4 );
 
     last = ctx->total[0] & 0x3F;
     padn = ( last < 56 ) ? ( 56 - last ) : ( 120 - last );
@@ -237,14 +355,14 @@ void sm3_finish(  sm3_context *ctx ,unsigned char* output )
     sm3_update( ctx, (unsigned char *) sm3_padding, padn );
     sm3_update( ctx, msglen, 8 );
 
-    PUT_ULONG_BE( ctx->state[0], output,  0 );
-    PUT_ULONG_BE( ctx->state[1], output,  4 );
-    PUT_ULONG_BE( ctx->state[2], output,  8 );
-    PUT_ULONG_BE( ctx->state[3], output, 12 );
-    PUT_ULONG_BE( ctx->state[4], output, 16 );
-    PUT_ULONG_BE( ctx->state[5], output, 20 );
-    PUT_ULONG_BE( ctx->state[6], output, 24 );
-    PUT_ULONG_BE( ctx->state[7], output, 28 );
+    PUT_UINT32_BE( ctx->state[0], output,  0 );
+    PUT_UINT32_BE( ctx->state[1], output,  4 );
+    PUT_UINT32_BE( ctx->state[2], output,  8 );
+    PUT_UINT32_BE( ctx->state[3], output, 12 );
+    PUT_UINT32_BE( ctx->state[4], output, 16 );
+    PUT_UINT32_BE( ctx->state[5], output, 20 );
+    PUT_UINT32_BE( ctx->state[6], output, 24 );
+    PUT_UINT32_BE( ctx->state[7], output, 28 );
 }
 
 /*
@@ -1,13 +1,15 @@
 #ifndef SM3_H
 #define SM3_H
 
+#include <stdint.h>
+
 /**
  * \brief          SM3 context structure
  */
 typedef struct
 {
-    unsigned long total[2];     /*!< number of bytes processed  */
-    unsigned long state[8];     /*!< intermediate digest state  */
+    uint32_t total[2];          /*!< number of bytes processed  */
+    uint32_t state[8];          /*!< intermediate digest state  */
     unsigned char buffer[64];   /*!< data block being processed */
 }
 sm3_context;
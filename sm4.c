@@ -44,23 +44,27 @@
 
 #include "sm4.h"
 #include <string.h>
-#include <stdio.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SM4_AESNI
+#include <immintrin.h>
+#endif
 
 /*
  * 32-bit integer manipulation macros (big endian)
  */
-#ifndef GET_ULONG_BE
-#define GET_ULONG_BE(n,b,i)                             \
+#ifndef GET_UINT32_BE
+#define GET_UINT32_BE(n,b,i)                            \
 {                                                       \
-    (n) = ( (unsigned long) (b)[(i)    ] << 24 )        \
-        | ( (unsigned long) (b)[(i) + 1] << 16 )        \
-        | ( (unsigned long) (b)[(i) + 2] <<  8 )        \
-        | ( (unsigned long) (b)[(i) + 3]       );       \
+    (n) = ( (uint32_t) (b)[(i)    ] << 24 )             \
+        | ( (uint32_t) (b)[(i) + 1] << 16 )             \
+        | ( (uint32_t) (b)[(i) + 2] <<  8 )             \
+        | ( (uint32_t) (b)[(i) + 3]       );            \
 }
 #endif
 
-#ifndef PUT_ULONG_BE
-#define PUT_ULONG_BE(n,b,i)                             \
+#ifndef PUT_UINT32_BE
+#define PUT_UINT32_BE(n,b,i)                            \
 {                                                       \
     (b)[(i)    ] = (unsigned char) ( (n) >> 24 );       \
     (b)[(i) + 1] = (unsigned char) ( (n) >> 16 );       \
@@ -73,10 +77,10 @@
  *rotate shift left marco definition
  *
  */
-#define  SHL(x,n) (((x) & 0xFFFFFFFF) << n)
-#define ROTL(x,n) (SHL((x),n) | ((x) >> (32 - n)))
+#define ROTL(x,n) ( ( (x) << (n) ) | ( (x) >> (32 - (n)) ) )
+#define ROTR(x,n) ( ( (x) >> (n) ) | ( (x) << (32 - (n)) ) )
 
-#define SWAP(a,b) { unsigned long t = a; a = b; b = t; t = 0; }
+#define SWAP(a,b) { uint32_t t = a; a = b; b = t; t = 0; }
 
 /*
  * Expanded SM4 S-boxes
@@ -104,10 +108,10 @@ static const unsigned char SboxTable[16][16] =
 };
 
 /* System parameter */
-static const unsigned long FK[4] = {0xa3b1bac6,0x56aa3350,0x677d9197,0xb27022dc};
+static const uint32_t FK[4] = {0xa3b1bac6,0x56aa3350,0x677d9197,0xb27022dc};
 
 /* fixed parameter */
-static const unsigned long CK[32] =
+static const uint32_t CK[32] =
 {
 0x00070e15,0x1c232a31,0x383f464d,0x545b6269,
 0x70777e85,0x8c939aa1,0xa8afb6bd,0xc4cbd2d9,
@@ -119,128 +123,366 @@ static const unsigned long CK[32] =
 0x10171e25,0x2c333a41,0x484f565d,0x646b7279
 };
 
-
 /*
- * private function:
- * look up in SboxTable and get the related value.
- * args:    [in] inch: 0x00~0xFF (8 bits unsigned value).
+ * Round T table: SM4_T0[x] = L( Sbox[x] << 24 ).
+ * L is linear and commutes with rotation, so the lookups for the
+ * other three bytes of the word are the same table rotated right by
+ * 8, 16 and 24 bits.
  */
-static unsigned char sm4Sbox(unsigned char inch)
+static const uint32_t SM4_T0[256] =
 {
-    unsigned char *pTable = (unsigned char *)SboxTable;
-    unsigned char retVal = (unsigned char)(pTable[inch]);
-    return retVal;
-}
+    0x8ed55b5b, 0xd0924242, 0x4deaa7a7, 0x06fdfbfb, 0xfccf3333, 0x65e28787,
+    0xc93df4f4, 0x6bb5dede, 0x4e165858, 0x6eb4dada, 0x44145050, 0xcac10b0b,
+    0x8828a0a0, 0x17f8efef, 0x9c2cb0b0, 0x11051414, 0x872bacac, 0xfb669d9d,
+    0xf2986a6a, 0xae77d9d9, 0x822aa8a8, 0x46bcfafa, 0x14041010, 0xcfc00f0f,
+    0x02a8aaaa, 0x54451111, 0x5f134c4c, 0xbe269898, 0x6d482525, 0x9e841a1a,
+    0x1e061818, 0xfd9b6666, 0xec9e7272, 0x4a430909, 0x10514141, 0x24f7d3d3,
+    0xd5934646, 0x53ecbfbf, 0xf89a6262, 0x927be9e9, 0xff33cccc, 0x04555151,
+    0x270b2c2c, 0x4f420d0d, 0x59eeb7b7, 0xf3cc3f3f, 0x1caeb2b2, 0xea638989,
+    0x74e79393, 0x7fb1cece, 0x6c1c7070, 0x0daba6a6, 0xedca2727, 0x28082020,
+    0x48eba3a3, 0xc1975656, 0x80820202, 0xa3dc7f7f, 0xc4965252, 0x12f9ebeb,
+    0xa174d5d5, 0xb38d3e3e, 0xc33ffcfc, 0x3ea49a9a, 0x5b461d1d, 0x1b071c1c,
+    0x3ba59e9e, 0x0cfff3f3, 0x3ff0cfcf, 0xbf72cdcd, 0x4b175c5c, 0x52b8eaea,
+    0x8f810e0e, 0x3d586565, 0xcc3cf0f0, 0x7d196464, 0x7ee59b9b, 0x91871616,
+    0x734e3d3d, 0x08aaa2a2, 0xc869a1a1, 0xc76aadad, 0x85830606, 0x7ab0caca,
+    0xb570c5c5, 0xf4659191, 0xb2d96b6b, 0xa7892e2e, 0x18fbe3e3, 0x47e8afaf,
+    0x330f3c3c, 0x674a2d2d, 0xb071c1c1, 0x0e575959, 0xe99f7676, 0xe135d4d4,
+    0x661e7878, 0xb4249090, 0x360e3838, 0x265f7979, 0xef628d8d, 0x38596161,
+    0x95d24747, 0x2aa08a8a, 0xb1259494, 0xaa228888, 0x8c7df1f1, 0xd73becec,
+    0x05010404, 0xa5218484, 0x9879e1e1, 0x9b851e1e, 0x84d75353, 0x00000000,
+    0x5e471919, 0x0b565d5d, 0xe39d7e7e, 0x9fd04f4f, 0xbb279c9c, 0x1a534949,
+    0x7c4d3131, 0xee36d8d8, 0x0a020808, 0x7be49f9f, 0x20a28282, 0xd4c71313,
+    0xe8cb2323, 0xe69c7a7a, 0x42e9abab, 0x43bdfefe, 0xa2882a2a, 0x9ad14b4b,
+    0x40410101, 0xdbc41f1f, 0xd838e0e0, 0x61b7d6d6, 0x2fa18e8e, 0x2bf4dfdf,
+    0x3af1cbcb, 0xf6cd3b3b, 0x1dfae7e7, 0xe5608585, 0x41155454, 0x25a38686,
+    0x60e38383, 0x16acbaba, 0x295c7575, 0x34a69292, 0xf7996e6e, 0xe434d0d0,
+    0x721a6868, 0x01545555, 0x19afb6b6, 0xdf914e4e, 0xfa32c8c8, 0xf030c0c0,
+    0x21f6d7d7, 0xbc8e3232, 0x75b3c6c6, 0x6fe08f8f, 0x691d7474, 0x2ef5dbdb,
+    0x6ae18b8b, 0x962eb8b8, 0x8a800a0a, 0xfe679999, 0xe2c92b2b, 0xe0618181,
+    0xc0c30303, 0x8d29a4a4, 0xaf238c8c, 0x07a9aeae, 0x390d3434, 0x1f524d4d,
+    0x764f3939, 0xd36ebdbd, 0x81d65757, 0xb7d86f6f, 0xeb37dcdc, 0x51441515,
+    0xa6dd7b7b, 0x09fef7f7, 0xb68c3a3a, 0x932fbcbc, 0x0f030c0c, 0x03fcffff,
+    0xc26ba9a9, 0xba73c9c9, 0xd96cb5b5, 0xdc6db1b1, 0x375a6d6d, 0x15504545,
+    0xb98f3636, 0x771b6c6c, 0x13adbebe, 0xda904a4a, 0x57b9eeee, 0xa9de7777,
+    0x4cbef2f2, 0x837efdfd, 0x55114444, 0xbdda6767, 0x2c5d7171, 0x45400505,
+    0x631f7c7c, 0x50104040, 0x325b6969, 0xb8db6363, 0x220a2828, 0xc5c20707,
+    0xf531c4c4, 0xa88a2222, 0x31a79696, 0xf9ce3737, 0x977aeded, 0x49bff6f6,
+    0x992db4b4, 0xa475d1d1, 0x90d34343, 0x5a124848, 0x58bae2e2, 0x71e69797,
+    0x64b6d2d2, 0x70b2c2c2, 0xad8b2626, 0xcd68a5a5, 0xcb955e5e, 0x624b2929,
+    0x3c0c3030, 0xce945a5a, 0xab76dddd, 0x867ff9f9, 0xf1649595, 0x5dbbe6e6,
+    0x35f2c7c7, 0x2d092424, 0xd1c61717, 0xd66fb9b9, 0xdec51b1b, 0x94861212,
+    0x78186060, 0x30f3c3c3, 0x897cf5f5, 0x5cefb3b3, 0xd23ae8e8, 0xacdf7373,
+    0x794c3535, 0xa0208080, 0x9d78e5e5, 0x56edbbbb, 0x235e7d7d, 0xc63ef8f8,
+    0x8bd45f5f, 0xe7c82f2f, 0xdd39e4e4, 0x68492121
+};
 
 /*
- * private F(Lt) function:
- * "T algorithm" == "L algorithm" + "t algorithm".
- * args:    [in] a: a is a 32 bits unsigned value;
- * return: c: c is calculated with line algorithm "L" and nonline algorithm "t"
+ * T(x) = L( tau(x) ), one table lookup per byte
  */
-static unsigned long sm4Lt(unsigned long ka)
-{
-    unsigned long bb = 0;
-    unsigned long c = 0;
-    unsigned char a[4];
-	unsigned char b[4];
-    PUT_ULONG_BE(ka,a,0)
-    b[0] = sm4Sbox(a[0]);
-    b[1] = sm4Sbox(a[1]);
-    b[2] = sm4Sbox(a[2]);
-    b[3] = sm4Sbox(a[3]);
-	GET_ULONG_BE(bb,b,0)
-    c =bb^(ROTL(bb, 2))^(ROTL(bb, 10))^(ROTL(bb, 18))^(ROTL(bb, 24));
-    return c;
-}
+#define SM4_T(x)                                        \
+    ( SM4_T0[ (x) >> 24 ]                               \
+    ^ ROTR( SM4_T0[ ( (x) >> 16 ) & 0xFF ],  8 )        \
+    ^ ROTR( SM4_T0[ ( (x) >>  8 ) & 0xFF ], 16 )        \
+    ^ ROTR( SM4_T0[ (x) & 0xFF ], 24 ) )
 
 /*
- * private F function:
- * Calculating and getting encryption/decryption contents.
- * args:    [in] x0: original contents;
- * args:    [in] x1: original contents;
- * args:    [in] x2: original contents;
- * args:    [in] x3: original contents;
- * args:    [in] rk: encryption/decryption key;
- * return the contents of encryption/decryption contents.
+ * private function:
+ * look up in SboxTable and get the related value.
+ * args:    [in] inch: 0x00~0xFF (8 bits unsigned value).
  */
-static unsigned long sm4F(unsigned long x0, unsigned long x1, unsigned long x2, unsigned long x3, unsigned long rk)
+static unsigned char sm4Sbox(unsigned char inch)
 {
-    return (x0^sm4Lt(x1^x2^x3^rk));
+    const unsigned char *pTable = (const unsigned char *)SboxTable;
+    return pTable[inch];
 }
 
-
 /* private function:
  * Calculating round encryption key.
  * args:    [in] a: a is a 32 bits unsigned value;
  * return: sk[i]: i{0,1,2,3,...31}.
  */
-static unsigned long sm4CalciRK(unsigned long ka)
+static uint32_t sm4CalciRK(uint32_t ka)
 {
-    unsigned long bb = 0;
-    unsigned long rk = 0;
+    uint32_t bb = 0;
     unsigned char a[4];
     unsigned char b[4];
-    PUT_ULONG_BE(ka,a,0)
+    PUT_UINT32_BE(ka,a,0)
     b[0] = sm4Sbox(a[0]);
     b[1] = sm4Sbox(a[1]);
     b[2] = sm4Sbox(a[2]);
     b[3] = sm4Sbox(a[3]);
-	GET_ULONG_BE(bb,b,0)
-    rk = bb^(ROTL(bb, 13))^(ROTL(bb, 23));
-    return rk;
+    GET_UINT32_BE(bb,b,0)
+    return bb^(ROTL(bb, 13))^(ROTL(bb, 23));
 }
 
-static void sm4_setkey( unsigned long SK[32], const unsigned char key[16] )
+static void sm4_setkey( uint32_t SK[32], const unsigned char key[16] )
 {
-    unsigned long MK[4];
-    unsigned long k[36];
-    unsigned long i = 0;
-
-    GET_ULONG_BE( MK[0], key, 0 );
-    GET_ULONG_BE( MK[1], key, 4 );
-    GET_ULONG_BE( MK[2], key, 8 );
-    GET_ULONG_BE( MK[3], key, 12 );
+    uint32_t MK[4];
+    uint32_t k[36];
+    int i;
+
+    GET_UINT32_BE( MK[0], key, 0 );
+    GET_UINT32_BE( MK[1], key, 4 );
+    GET_UINT32_BE( MK[2], key, 8 );
+    GET_UINT32_BE( MK[3], key, 12 );
     k[0] = MK[0]^FK[0];
     k[1] = MK[1]^FK[1];
     k[2] = MK[2]^FK[2];
     k[3] = MK[3]^FK[3];
-    for(; i<32; i++)
+    for( i = 0; i < 32; i++ )
     {
         k[i+4] = k[i] ^ (sm4CalciRK(k[i+1]^k[i+2]^k[i+3]^CK[i]));
         SK[i] = k[i+4];
-	}
-
+    }
+    memset( k, 0, sizeof( k ) );
+    memset( MK, 0, sizeof( MK ) );
 }
 
 /*
- * SM4 standard one round processing
+ * SM4 standard 32 round processing of one block
  *
+ * The four state words are used in rotation rather than kept in a
+ * 36 word buffer, four rounds per loop.
  */
-static void sm4_one_round( unsigned long sk[32],
-                    unsigned char input[16],
+static void sm4_one_round( const uint32_t sk[32],
+                    const unsigned char input[16],
                     unsigned char output[16] )
 {
-    unsigned long i = 0;
-    unsigned long ulbuf[36];
-
-    memset(ulbuf, 0, sizeof(ulbuf));
-    GET_ULONG_BE( ulbuf[0], input, 0 )
-    GET_ULONG_BE( ulbuf[1], input, 4 )
-    GET_ULONG_BE( ulbuf[2], input, 8 )
-    GET_ULONG_BE( ulbuf[3], input, 12 )
-    while(i<32)
+    uint32_t X0, X1, X2, X3;
+    int i;
+
+    GET_UINT32_BE( X0, input, 0 )
+    GET_UINT32_BE( X1, input, 4 )
+    GET_UINT32_BE( X2, input, 8 )
+    GET_UINT32_BE( X3, input, 12 )
+    for( i = 0; i < 32; i += 4 )
     {
-        ulbuf[i+4] = sm4F(ulbuf[i], ulbuf[i+1], ulbuf[i+2], ulbuf[i+3], sk[i]);
-// #ifdef _DEBUG
-//        	printf("rk(%02d) = 0x%08x,  X(%02d) = 0x%08x \n",i,sk[i], i, ulbuf[i+4] );
-// #endif
-	    i++;
+        X0 ^= SM4_T( X1 ^ X2 ^ X3 ^ sk[i    ] );
+        X1 ^= SM4_T( X2 ^ X3 ^ X0 ^ sk[i + 1] );
+        X2 ^= SM4_T( X3 ^ X0 ^ X1 ^ sk[i + 2] );
+        X3 ^= SM4_T( X0 ^ X1 ^ X2 ^ sk[i + 3] );
+    }
+    PUT_UINT32_BE(X3,output,0);
+    PUT_UINT32_BE(X2,output,4);
+    PUT_UINT32_BE(X1,output,8);
+    PUT_UINT32_BE(X0,output,12);
+}
+
+#ifdef SM4_AESNI
+/*
+ * Four blocks at a time with AES-NI.
+ *
+ * The SM4 and AES S-boxes are both an inversion in GF(2^8) between two
+ * affine maps, over different field polynomials.  With the field
+ * isomorphism folded into the affine maps,
+ *     Sbox(x) = post( AES_SubBytes( pre(x) ) )
+ * pre() and post() are applied a nibble at a time with pshufb, and
+ * AESENCLAST with a zero round key supplies SubBytes; its ShiftRows is
+ * undone by permuting the bytes beforehand.  The state is transposed
+ * so that each register holds the same word of the four blocks, which
+ * lets the linear transform L work on all of them at once.
+ */
+#define SM4_AESNI_TARGET __attribute__((target("aes,ssse3")))
+
+static SM4_AESNI_TARGET __m128i sm4_aesni_affine( __m128i x, __m128i lo,
+                                                  __m128i hi )
+{
+    const __m128i nibble = _mm_set1_epi8( 0x0F );
+
+    return _mm_xor_si128(
+        _mm_shuffle_epi8( lo, _mm_and_si128( x, nibble ) ),
+        _mm_shuffle_epi8( hi, _mm_and_si128( _mm_srli_epi32( x, 4 ), nibble ) ) );
+}
+
+static SM4_AESNI_TARGET __m128i sm4_aesni_t( __m128i x )
+{
+    const __m128i pre_lo  = _mm_setr_epi8(
+        0x3E, 0xB2, 0x0E, 0x82, 0xBB, 0x37, 0x8B, 0x07,
+        0xA1, 0x2D, 0x91, 0x1D, 0x24, 0xA8, 0x14, 0x98 );
+    const __m128i pre_hi  = _mm_setr_epi8(
+        0x00, 0xDC, 0x2E, 0xF2, 0xC5, 0x19, 0xEB, 0x37,
+        0x08, 0xD4, 0x26, 0xFA, 0xCD, 0x11, 0xE3, 0x3F );
+    const __m128i post_lo = _mm_setr_epi8(
+        0x6C, 0xD4, 0xA6, 0x1E, 0x52, 0xEA, 0x98, 0x20,
+        0x0B, 0xB3, 0xC1, 0x79, 0x35, 0x8D, 0xFF, 0x47 );
+    const __m128i post_hi = _mm_setr_epi8(
+        0x00, 0xE0, 0x50, 0xB0, 0x9D, 0x7D, 0xCD, 0x2D,
+        0xC0, 0x20, 0x90, 0x70, 0x5D, 0xBD, 0x0D, 0xED );
+    const __m128i inv_shift_row = _mm_setr_epi8(
+        0, 13, 10, 7, 4, 1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3 );
+    const __m128i rol8  = _mm_setr_epi8(
+        3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14 );
+    const __m128i rol16 = _mm_setr_epi8(
+        2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13 );
+    const __m128i rol24 = _mm_setr_epi8(
+        1, 2, 3, 0, 5, 6, 7, 4, 9, 10, 11, 8, 13, 14, 15, 12 );
+    __m128i r;
+
+    /* tau: the S-box on every byte */
+    x = sm4_aesni_affine( x, pre_lo, pre_hi );
+    x = _mm_shuffle_epi8( x, inv_shift_row );
+    x = _mm_aesenclast_si128( x, _mm_setzero_si128() );
+    x = sm4_aesni_affine( x, post_lo, post_hi );
+
+    /* L(x) = x ^ (x <<< 24) ^ ((x ^ (x <<< 8) ^ (x <<< 16)) <<< 2) */
+    r = _mm_xor_si128( x, _mm_xor_si128( _mm_shuffle_epi8( x, rol8 ),
+                                         _mm_shuffle_epi8( x, rol16 ) ) );
+    r = _mm_xor_si128( _mm_slli_epi32( r, 2 ), _mm_srli_epi32( r, 30 ) );
+    return _mm_xor_si128( _mm_xor_si128( x, _mm_shuffle_epi8( x, rol24 ) ), r );
+}
+
+/*
+ * Load four blocks and transpose them so that X[j] holds word j of
+ * each block
+ */
+static SM4_AESNI_TARGET void sm4_aesni_load( const unsigned char *input,
+                                             __m128i X[4] )
+{
+    const __m128i bswap = _mm_setr_epi8(
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12 );
+    __m128i b0, b1, b2, b3, t0, t1, t2, t3;
+
+    b0 = _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i *) ( input      ) ), bswap );
+    b1 = _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i *) ( input + 16 ) ), bswap );
+    b2 = _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i *) ( input + 32 ) ), bswap );
+    b3 = _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i *) ( input + 48 ) ), bswap );
+    t0 = _mm_unpacklo_epi32( b0, b1 );
+    t1 = _mm_unpacklo_epi32( b2, b3 );
+    t2 = _mm_unpackhi_epi32( b0, b1 );
+    t3 = _mm_unpackhi_epi32( b2, b3 );
+    X[0] = _mm_unpacklo_epi64( t0, t1 );
+    X[1] = _mm_unpackhi_epi64( t0, t1 );
+    X[2] = _mm_unpacklo_epi64( t2, t3 );
+    X[3] = _mm_unpackhi_epi64( t2, t3 );
+}
+
+/*
+ * Inverse of sm4_aesni_load(), with the words written in the reversed
+ * order X[3], X[2], X[1], X[0] that ends the cipher
+ */
+static SM4_AESNI_TARGET void sm4_aesni_store( const __m128i X[4],
+                                              unsigned char *output )
+{
+    const __m128i bswap = _mm_setr_epi8(
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12 );
+    __m128i t0, t1, t2, t3;
+
+    t0 = _mm_unpacklo_epi32( X[3], X[2] );
+    t1 = _mm_unpacklo_epi32( X[1], X[0] );
+    t2 = _mm_unpackhi_epi32( X[3], X[2] );
+    t3 = _mm_unpackhi_epi32( X[1], X[0] );
+    _mm_storeu_si128( (__m128i *) ( output      ),
+                      _mm_shuffle_epi8( _mm_unpacklo_epi64( t0, t1 ), bswap ) );
+    _mm_storeu_si128( (__m128i *) ( output + 16 ),
+                      _mm_shuffle_epi8( _mm_unpackhi_epi64( t0, t1 ), bswap ) );
+    _mm_storeu_si128( (__m128i *) ( output + 32 ),
+                      _mm_shuffle_epi8( _mm_unpacklo_epi64( t2, t3 ), bswap ) );
+    _mm_storeu_si128( (__m128i *) ( output + 48 ),
+                      _mm_shuffle_epi8( _mm_unpackhi_epi64( t2, t3 ), bswap ) );
+}
+
+/*
+ * One round on a group of four blocks: X[a] ^= T( X[b] ^ X[c] ^ X[d] ^ rk )
+ */
+#define SM4_AESNI_ROUND(X, a, b, c, d, rk)                              \
+    (X)[a] = _mm_xor_si128( (X)[a], sm4_aesni_t(                        \
+        _mm_xor_si128( _mm_xor_si128( (X)[b], (X)[c] ),                 \
+                       _mm_xor_si128( (X)[d], (rk) ) ) ) )
+
+static SM4_AESNI_TARGET void sm4_crypt_4blocks_aesni( const uint32_t sk[32],
+                                                      const unsigned char *input,
+                                                      unsigned char *output )
+{
+    __m128i X[4], rk;
+    int i;
+
+    sm4_aesni_load( input, X );
+    for( i = 0; i < 32; i += 4 )
+    {
+        rk = _mm_set1_epi32( (int) sk[i    ] );
+        SM4_AESNI_ROUND( X, 0, 1, 2, 3, rk );
+        rk = _mm_set1_epi32( (int) sk[i + 1] );
+        SM4_AESNI_ROUND( X, 1, 2, 3, 0, rk );
+        rk = _mm_set1_epi32( (int) sk[i + 2] );
+        SM4_AESNI_ROUND( X, 2, 3, 0, 1, rk );
+        rk = _mm_set1_epi32( (int) sk[i + 3] );
+        SM4_AESNI_ROUND( X, 3, 0, 1, 2, rk );
+    }
+    sm4_aesni_store( X, output );
+}
+
+/*
+ * Eight blocks as two independent groups of four, so that the AESENCLAST
+ * and shuffle latencies of one group overlap with the other
+ */
+static SM4_AESNI_TARGET void sm4_crypt_8blocks_aesni( const uint32_t sk[32],
+                                                      const unsigned char *input,
+                                                      unsigned char *output )
+{
+    __m128i X[4], Y[4], rk;
+    int i;
+
+    sm4_aesni_load( input, X );
+    sm4_aesni_load( input + 64, Y );
+    for( i = 0; i < 32; i += 4 )
+    {
+        rk = _mm_set1_epi32( (int) sk[i    ] );
+        SM4_AESNI_ROUND( X, 0, 1, 2, 3, rk );
+        SM4_AESNI_ROUND( Y, 0, 1, 2, 3, rk );
+        rk = _mm_set1_epi32( (int) sk[i + 1] );
+        SM4_AESNI_ROUND( X, 1, 2, 3, 0, rk );
+        SM4_AESNI_ROUND( Y, 1, 2, 3, 0, rk );
+        rk = _mm_set1_epi32( (int) sk[i + 2] );
+        SM4_AESNI_ROUND( X, 2, 3, 0, 1, rk );
+        SM4_AESNI_ROUND( Y, 2, 3, 0, 1, rk );
+        rk = _mm_set1_epi32( (int) sk[i + 3] );
+        SM4_AESNI_ROUND( X, 3, 0, 1, 2, rk );
+        SM4_AESNI_ROUND( Y, 3, 0, 1, 2, rk );
+    }
+    sm4_aesni_store( X, output );
+    sm4_aesni_store( Y, output + 64 );
+}
+
+static int sm4_has_aesni( void )
+{
+    return __builtin_cpu_supports( "aes" ) && __builtin_cpu_supports( "ssse3" );
+}
+#endif /* SM4_AESNI */
+
+/*
+ * Process a run of whole blocks, eight or four at a time when the
+ * processor allows it and one at a time for the rest
+ */
+static void sm4_crypt_blocks( const uint32_t sk[32],
+                              size_t blocks,
+                              const unsigned char *input,
+                              unsigned char *output )
+{
+#ifdef SM4_AESNI
+    if( blocks >= 4 && sm4_has_aesni() )
+    {
+        for( ; blocks >= 8; blocks -= 8 )
+        {
+            sm4_crypt_8blocks_aesni( sk, input, output );
+            input  += 128;
+            output += 128;
+        }
+        if( blocks >= 4 )
+        {
+            sm4_crypt_4blocks_aesni( sk, input, output );
+            input  += 64;
+            output += 64;
+            blocks -= 4;
+        }
+    }
+#endif
+    while( blocks > 0 )
+    {
+        sm4_one_round( sk, input, output );
+        input  += 16;
+        output += 16;
+        blocks--;
     }
-	PUT_ULONG_BE(ulbuf[35],output,0);
-	PUT_ULONG_BE(ulbuf[34],output,4);
-	PUT_ULONG_BE(ulbuf[33],output,8);
-	PUT_ULONG_BE(ulbuf[32],output,12);
 }
 
 /*
@@ -249,7 +491,7 @@ static void sm4_one_round( unsigned long sk[32],
 void sm4_setkey_enc( sm4_context *ctx, const unsigned char *key )
 {
     ctx->mode = SM4_ENCRYPT;
-	sm4_setkey( ctx->sk, key );
+    sm4_setkey( ctx->sk, key );
 }
 
 /*
@@ -258,7 +500,7 @@ void sm4_setkey_enc( sm4_context *ctx, const unsigned char *key )
 void sm4_setkey_dec( sm4_context *ctx, const unsigned char *key )
 {
     int i;
-	ctx->mode = SM4_ENCRYPT;
+    ctx->mode = SM4_ENCRYPT;
     sm4_setkey( ctx->sk, key );
     for( i = 0; i < 16; i ++ )
     {
@@ -272,19 +514,65 @@ void sm4_setkey_dec( sm4_context *ctx, const unsigned char *key )
  */
 
 void sm4_crypt_ecb( sm4_context *ctx,
-				   int mode,
-				   int length,
-				   unsigned char *input,
+                   int mode,
+                   int length,
+                   unsigned char *input,
                    unsigned char *output)
 {
+    (void) mode;
+    if( length > 0 )
+        sm4_crypt_blocks( ctx->sk, (size_t) length / 16, input, output );
+}
+
+/*
+ * SM4-CTR buffer encryption/decryption
+ */
+#define SM4_CTR_BATCH   8
+
+void sm4_crypt_ctr( sm4_context *ctx,
+                    size_t length,
+                    unsigned char counter[16],
+                    const unsigned char *input,
+                    unsigned char *output )
+{
+    unsigned char stream[SM4_CTR_BATCH * 16];
+    size_t blocks, bytes, i;
+    int j;
+
     while( length > 0 )
     {
-        sm4_one_round( ctx->sk, input, output );
-        input  += 16;
-        output += 16;
-        length -= 16;
+        blocks = ( length + 15 ) / 16;
+        if( blocks > SM4_CTR_BATCH )
+            blocks = SM4_CTR_BATCH;
+        for( i = 0; i < blocks; i++ )
+        {
+            memcpy( &stream[i * 16], counter, 16 );
+            for( j = 15; j >= 0; j-- )
+                if( ++counter[j] != 0 )
+                    break;
+        }
+        sm4_crypt_blocks( ctx->sk, blocks, stream, stream );
+        bytes = ( length < blocks * 16 ) ? length : blocks * 16;
+        for( i = 0; i < bytes; i++ )
+            output[i] = (unsigned char) ( input[i] ^ stream[i] );
+        input  += bytes;
+        output += bytes;
+        length -= bytes;
     }
+    memset( stream, 0, sizeof( stream ) );
+}
 
+/*
+ * Single block in the (schedule, mode, input, output) order used by
+ * the TPM block cipher calls
+ */
+void sm4_crypt_block( sm4_context *ctx,
+                      int mode,
+                      const unsigned char input[16],
+                      unsigned char output[16] )
+{
+    (void) mode;
+    sm4_one_round( ctx->sk, input, output );
 }
 
 
@@ -295,4 +583,3 @@ void SM4_encrypt(unsigned char *in, unsigned char *out, sm4_context *ks){
 void SM4_decrypt(unsigned char *in, unsigned char *out, sm4_context *ks){
     sm4_one_round(ks->sk, in, out);
 }
-
@@ -2,6 +2,9 @@
 #ifndef SM4_H
 #define SM4_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 #define SM4_ENCRYPT     1
 #define SM4_DECRYPT     0
 
@@ -11,7 +14,7 @@
 typedef struct
 {
     int mode;                   /*!<  encrypt/decrypt   */
-    unsigned long sk[32];       /*!<  SM4 subkeys       */
+    uint32_t sk[32];            /*!<  SM4 subkeys       */
 }
 sm4_context;
 
@@ -40,7 +43,7 @@ void sm4_setkey_dec( sm4_context *ctx, const unsigned char *key );
  * \brief          SM4-ECB block encryption/decryption
  * \param ctx      SM4 context
  * \param mode     SM4_ENCRYPT or SM4_DECRYPT
- * \param length   length of the input data
+ * \param length   length of the input data, a multiple of 16
  * \param input    input block
  * \param output   output block
  */
@@ -50,6 +53,38 @@ void sm4_crypt_ecb( sm4_context *ctx,
                      unsigned char *input,
                      unsigned char *output);
 
+/**
+ * \brief          SM4-CTR buffer encryption/decryption
+ *
+ *                 The counter is a 128-bit big-endian value that is
+ *                 incremented once per block, including a partial
+ *                 final block, and is left at the next unused value.
+ *
+ * \param ctx      SM4 context set up with sm4_setkey_enc()
+ * \param length   length of the input data in bytes
+ * \param counter  16-byte initial counter block (updated)
+ * \param input    input data
+ * \param output   output data
+ */
+void sm4_crypt_ctr( sm4_context *ctx,
+                    size_t length,
+                    unsigned char counter[16],
+                    const unsigned char *input,
+                    unsigned char *output );
+
+/**
+ * \brief          SM4 single block encryption/decryption
+ * \param ctx      SM4 context
+ * \param mode     SM4_ENCRYPT or SM4_DECRYPT (the direction is set by
+ *                 the key schedule)
+ * \param input    16-byte input block
+ * \param output   16-byte output block
+ */
+void sm4_crypt_block( sm4_context *ctx,
+                      int mode,
+                      const unsigned char input[16],
+                      unsigned char output[16] );
+
 void SM4_encrypt(unsigned char *in, unsigned char *out, sm4_context *ks);
 
 void SM4_decrypt(unsigned char *in, unsigned char *out, sm4_context *ks);